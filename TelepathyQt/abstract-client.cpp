@@ -122,12 +122,14 @@ struct TP_QT_NO_EXPORT AbstractClientObserver::Private
 {
     Private(const ChannelClassList &channelFilter, bool shouldRecover)
         : channelFilter(channelFilter),
-          shouldRecover(shouldRecover)
+          shouldRecover(shouldRecover),
+          shouldReplyEarly(false)
     {
     }
 
     ChannelClassList channelFilter;
     bool shouldRecover;
+    bool shouldReplyEarly;
 };
 
 /**
@@ -343,6 +345,41 @@ bool AbstractClientObserver::shouldRecover() const
     return mPriv->shouldRecover;
 }
 
+/**
+ * Return whether the channel dispatcher is answered as soon as channels are announced to this
+ * observer, rather than once observeChannels() has finished.
+ *
+ * This is only honoured if shouldRecover() is \c false.
+ *
+ * \return \c true if this observer replies early, \c false otherwise.
+ * \sa setShouldReplyEarly()
+ */
+bool AbstractClientObserver::shouldReplyEarly() const
+{
+    return mPriv->shouldReplyEarly;
+}
+
+/**
+ * Set whether the channel dispatcher is answered as soon as channels are announced to this
+ * observer.
+ *
+ * By default the channel dispatcher waits for each observer to finish the context given to
+ * observeChannels() before approving or handling the channels, so the proxies of every observer
+ * have to be made ready first. Observers which only watch the channels, and don't need to act on
+ * them before anyone else, can set this to let the dispatch go ahead immediately.
+ *
+ * observeChannels() is still called once the proxies are ready, with a context which is already
+ * finished; if the proxies can't be made ready it is not called at all. This is ignored for
+ * observers with shouldRecover() set.
+ *
+ * \param shouldReplyEarly Whether to reply early.
+ * \sa shouldReplyEarly()
+ */
+void AbstractClientObserver::setShouldReplyEarly(bool shouldReplyEarly)
+{
+    mPriv->shouldReplyEarly = shouldReplyEarly;
+}
+
 /**
  * \fn void AbstractClientObserver::observeChannels(
  *                  const MethodInvocationContextPtr<> &context,
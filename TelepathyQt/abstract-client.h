@@ -91,6 +91,7 @@ public:
     ChannelClassSpecList observerFilter() const;
 
     bool shouldRecover() const;
+    bool shouldReplyEarly() const;
 
     virtual void observeChannels(const MethodInvocationContextPtr<> &context,
             const AccountPtr &account,
@@ -103,6 +104,8 @@ public:
 protected:
     AbstractClientObserver(const ChannelClassSpecList &channelFilter, bool shouldRecover = false);
 
+    void setShouldReplyEarly(bool shouldReplyEarly);
+
 private:
     struct Private;
     friend struct Private;
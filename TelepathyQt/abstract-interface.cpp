@@ -34,7 +34,9 @@
 #include <TelepathyQt/Types>
 
 #include <QDBusPendingCall>
+#include <QHash>
 #include <QDBusVariant>
+#include <QSet>
 
 namespace Tp
 {
@@ -45,13 +47,44 @@ struct TP_QT_NO_EXPORT AbstractInterface::Private
     QString mError;
     QString mMessage;
     bool monitorProperties;
+
+    bool updateProperty(const QString &name, const QVariant &value);
+
+    // property cache, only maintained while monitoring properties
+    QVariantMap properties;
+    // whether properties holds all the properties of the interface
+    bool propertiesComplete;
+    quint64 generation;
+    // property name -> generation it last changed in
+    QHash<QString, quint64> propertyGenerations;
+
+    // GetAll calls in flight while monitoring, and the properties PropertiesChanged reported
+    // meanwhile, whose values in the GetAll replies may be older than the cached ones
+    int pendingGetAlls;
+    QSet<QString> changedDuringGetAll;
+    QSet<QString> invalidatedDuringGetAll;
 };
 
 AbstractInterface::Private::Private()
-    : monitorProperties(false)
+    : monitorProperties(false),
+      propertiesComplete(false),
+      generation(0),
+      pendingGetAlls(0)
 {
 }
 
+bool AbstractInterface::Private::updateProperty(const QString &name, const QVariant &value)
+{
+    QVariantMap::iterator i = properties.find(name);
+    if (i != properties.end() && i.value() == value) {
+        return false;
+    }
+
+    properties.insert(name, value);
+    propertyGenerations.insert(name, generation + 1);
+    return true;
+}
+
 /**
  * \class AbstractInterface
  * \ingroup clientsideproxies
@@ -111,6 +144,11 @@ void AbstractInterface::invalidate(DBusProxy *proxy,
 
 PendingVariant *AbstractInterface::internalRequestProperty(const QString &name) const
 {
+    if (mPriv->monitorProperties && mPriv->properties.contains(name)) {
+        DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
+        return new PendingVariant(mPriv->properties.value(name), DBusProxyPtr(proxy));
+    }
+
     QDBusMessage msg = QDBusMessage::createMethodCall(service(), path(),
             TP_QT_IFACE_PROPERTIES, QLatin1String("Get"));
     msg << interface() << name;
@@ -132,12 +170,28 @@ PendingOperation *AbstractInterface::internalSetProperty(const QString &name,
 
 PendingVariantMap *AbstractInterface::internalRequestAllProperties() const
 {
+    DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
+    if (mPriv->monitorProperties && mPriv->propertiesComplete) {
+        return new PendingVariantMap(mPriv->properties, DBusProxyPtr(proxy));
+    }
+
     QDBusMessage msg = QDBusMessage::createMethodCall(service(), path(),
             TP_QT_IFACE_PROPERTIES, QLatin1String("GetAll"));
     msg << interface();
     QDBusPendingCall pendingCall = connection().asyncCall(msg);
-    DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
-    return new PendingVariantMap(pendingCall, DBusProxyPtr(proxy));
+    PendingVariantMap *pvm = new PendingVariantMap(pendingCall, DBusProxyPtr(proxy));
+    if (mPriv->monitorProperties) {
+        if (mPriv->pendingGetAlls++ == 0) {
+            mPriv->changedDuringGetAll.clear();
+            mPriv->invalidatedDuringGetAll.clear();
+        }
+
+        // Connected before the caller gets the operation, so the cache is filled by the time
+        // the caller is told about the result
+        connect(pvm, SIGNAL(finished(Tp::PendingOperation*)),
+                this, SLOT(onGotAllProperties(Tp::PendingOperation*)));
+    }
+    return pvm;
 }
 
 /**
@@ -148,6 +202,12 @@ PendingVariantMap *AbstractInterface::internalRequestAllProperties() const
  * By default, AbstractInterface does not monitor properties: you need to call this method
  * for this to happen.
  *
+ * While monitoring, the properties returned by the D-Bus Properties.GetAll method are cached
+ * and kept up to date from the PropertiesChanged signal, see cachedProperties(). Once the
+ * cache is filled, requests for properties are answered from it without any D-Bus call.
+ * Only enable monitoring on interfaces which announce all their property changes through
+ * PropertiesChanged.
+ *
  * \param monitorProperties Whether this interface should monitor property changes or not.
  * \sa isMonitoringProperties
  *     propertiesChanged()
@@ -178,6 +238,13 @@ void AbstractInterface::setMonitorProperties(bool monitorProperties)
     if (!success) {
         warning() << "Connection or disconnection to " << TP_QT_IFACE_PROPERTIES <<
                 ".PropertiesChanged failed.";
+        return;
+    }
+
+    mPriv->monitorProperties = monitorProperties;
+    if (!monitorProperties) {
+        // changes are not tracked anymore, the cache has to be refilled by GetAll
+        mPriv->propertiesComplete = false;
     }
 }
 
@@ -198,13 +265,142 @@ bool AbstractInterface::isMonitoringProperties() const
     return mPriv->monitorProperties;
 }
 
+/**
+ * Return whether the property cache holds all the properties of this interface.
+ *
+ * The cache is filled by the first requestAllProperties() call made while monitoring
+ * properties, and stops being complete when a property is invalidated or monitoring is
+ * disabled.
+ *
+ * \return \c true if the cache is complete, \c false otherwise.
+ * \sa cachedProperties(), setMonitorProperties()
+ */
+bool AbstractInterface::hasCachedProperties() const
+{
+    return mPriv->propertiesComplete;
+}
+
+/**
+ * Return the cached value of the property \a name, without any D-Bus call.
+ *
+ * \param name The property name.
+ * \return The value, or an invalid QVariant if the property is not in the cache.
+ * \sa cachedProperties()
+ */
+QVariant AbstractInterface::cachedProperty(const QString &name) const
+{
+    return mPriv->properties.value(name);
+}
+
+/**
+ * Return the cached properties of this interface, without any D-Bus call.
+ *
+ * \return The property values keyed by property name.
+ * \sa hasCachedProperties(), cachedProperty(), propertiesGeneration()
+ */
+QVariantMap AbstractInterface::cachedProperties() const
+{
+    return mPriv->properties;
+}
+
+/**
+ * Return the generation of the property cache.
+ *
+ * The generation is incremented every time cached properties change, so high-level proxies
+ * can store it and later call propertiesChangedSince() to only parse what changed.
+ *
+ * \return The current generation.
+ * \sa propertiesChangedSince()
+ */
+quint64 AbstractInterface::propertiesGeneration() const
+{
+    return mPriv->generation;
+}
+
+/**
+ * Return the names of the cached properties which changed after \a generation.
+ *
+ * \param generation A value previously returned by propertiesGeneration().
+ * \return The names of the changed properties, empty if nothing changed.
+ * \sa propertiesGeneration()
+ */
+QStringList AbstractInterface::propertiesChangedSince(quint64 generation) const
+{
+    QStringList ret;
+    if (generation >= mPriv->generation) {
+        return ret;
+    }
+
+    QHash<QString, quint64>::const_iterator i = mPriv->propertyGenerations.constBegin();
+    for (; i != mPriv->propertyGenerations.constEnd(); ++i) {
+        if (i.value() > generation) {
+            ret << i.key();
+        }
+    }
+    return ret;
+}
+
 void AbstractInterface::onPropertiesChanged(const QString &interface,
             const QVariantMap &changedProperties,
             const QStringList &invalidatedProperties)
 {
+    bool changed = false;
+    QVariantMap::const_iterator i = changedProperties.constBegin();
+    for (; i != changedProperties.constEnd(); ++i) {
+        changed |= mPriv->updateProperty(i.key(), i.value());
+        if (mPriv->pendingGetAlls > 0) {
+            mPriv->changedDuringGetAll.insert(i.key());
+            mPriv->invalidatedDuringGetAll.remove(i.key());
+        }
+    }
+    foreach (const QString &name, invalidatedProperties) {
+        if (mPriv->pendingGetAlls > 0) {
+            mPriv->invalidatedDuringGetAll.insert(name);
+            mPriv->changedDuringGetAll.remove(name);
+        }
+
+        mPriv->properties.remove(name);
+        mPriv->propertyGenerations.insert(name, mPriv->generation + 1);
+        mPriv->propertiesComplete = false;
+        changed = true;
+    }
+    if (changed) {
+        ++mPriv->generation;
+    }
+
     emit propertiesChanged(changedProperties, invalidatedProperties);
 }
 
+void AbstractInterface::onGotAllProperties(PendingOperation *op)
+{
+    Q_ASSERT(mPriv->pendingGetAlls > 0);
+    --mPriv->pendingGetAlls;
+
+    if (op->isError() || !mPriv->monitorProperties) {
+        return;
+    }
+
+    PendingVariantMap *pvm = qobject_cast<PendingVariantMap*>(op);
+    QVariantMap properties = pvm->result();
+
+    // PropertiesChanged may have been processed while the call was in flight, in which case the
+    // cache already has newer values than the reply
+    bool changed = false;
+    QVariantMap::const_iterator i = properties.constBegin();
+    for (; i != properties.constEnd(); ++i) {
+        if (mPriv->changedDuringGetAll.contains(i.key()) ||
+            mPriv->invalidatedDuringGetAll.contains(i.key())) {
+            continue;
+        }
+        changed |= mPriv->updateProperty(i.key(), i.value());
+    }
+    if (changed) {
+        ++mPriv->generation;
+    }
+    // Invalidated properties have to be fetched again to know their current value
+    mPriv->propertiesComplete = mPriv->invalidatedDuringGetAll.isEmpty();
+}
+
 /**
  * \fn void AbstractInterface::propertiesChanged(const QVariantMap &changedProperties,
  *             const QStringList &invalidatedProperties)
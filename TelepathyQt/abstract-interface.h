@@ -30,6 +30,8 @@
 #include <TelepathyQt/Global>
 
 #include <QDBusAbstractInterface>
+#include <QStringList>
+#include <QVariantMap>
 
 namespace Tp
 {
@@ -54,6 +56,12 @@ public:
     void setMonitorProperties(bool monitorProperties);
     bool isMonitoringProperties() const;
 
+    bool hasCachedProperties() const;
+    QVariant cachedProperty(const QString &name) const;
+    QVariantMap cachedProperties() const;
+    quint64 propertiesGeneration() const;
+    QStringList propertiesChangedSince(quint64 generation) const;
+
 Q_SIGNALS:
     void propertiesChanged(const QVariantMap &changedProperties,
             const QStringList &invalidatedProperties);
@@ -76,6 +84,7 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void onPropertiesChanged(const QString &interface,
             const QVariantMap &changedProperties,
             const QStringList &invalidatedProperties);
+    TP_QT_NO_EXPORT void onGotAllProperties(Tp::PendingOperation *);
 
 private:
     struct Private;
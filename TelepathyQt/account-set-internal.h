@@ -22,6 +22,11 @@
 
 #include <TelepathyQt/AccountPropertyFilter>
 
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
 namespace Tp
 {
 
@@ -29,54 +34,76 @@ class ConnectionCapabilities;
 
 struct TP_QT_NO_EXPORT AccountSet::Private
 {
-    class AccountWrapper;
+    class Tracker;
 
     Private(AccountSet *parent, const AccountManagerPtr &accountManager,
             const AccountFilterConstPtr &filter);
     Private(AccountSet *parent, const AccountManagerPtr &accountManager,
             const QVariantMap &filter);
+    ~Private();
 
     void init();
-    void connectSignals();
-    void insertAccounts();
-    void insertAccount(const AccountPtr &account);
+    void setAccountMatching(const AccountPtr &account, bool matching);
     void removeAccount(const AccountPtr &account);
-    void wrapAccount(const AccountPtr &account);
-    void filterAccount(const AccountPtr &account);
-    bool accountMatchFilter(AccountWrapper *account);
 
     AccountSet *parent;
     AccountManagerPtr accountManager;
     AccountFilterConstPtr filter;
-    QHash<QString, AccountWrapper *> wrappers;
+    Tracker *tracker;
     QHash<QString, AccountPtr> accounts;
     bool ready;
 };
 
-class TP_QT_NO_EXPORT AccountSet::Private::AccountWrapper : public QObject
+// Tracks the accounts of an AccountManager on behalf of all its AccountSets, so each account
+// is connected to once and a change only re-evaluates the filters depending on it. Sets with
+// equivalent filters share the evaluation.
+class TP_QT_NO_EXPORT AccountSet::Private::Tracker : public QObject
 {
     Q_OBJECT
 
 public:
-    AccountWrapper(const AccountPtr &account, QObject *parent = 0);
-    ~AccountWrapper();
-
-    AccountPtr account() const { return mAccount; }
+    static Tracker *forAccountManager(const AccountManagerPtr &accountManager);
 
-Q_SIGNALS:
-    void accountRemoved(const Tp::AccountPtr &account);
-    void accountPropertyChanged(const Tp::AccountPtr &account,
-            const QString &propertyName);
-    void accountCapabilitiesChanged(const Tp::AccountPtr &account,
-            const Tp::ConnectionCapabilities &capabilities);
+    void addSet(AccountSet::Private *set);
+    void removeSet(AccountSet::Private *set);
 
 private Q_SLOTS:
-    TP_QT_NO_EXPORT void onAccountRemoved();
-    TP_QT_NO_EXPORT void onAccountPropertyChanged(const QString &propertyName);
-    TP_QT_NO_EXPORT void onAccountCapalitiesChanged(const Tp::ConnectionCapabilities &capabilities);
+    void onNewAccount(const Tp::AccountPtr &account);
+    void onAccountRemoved();
+    void onAccountPropertyChanged(const QString &propertyName);
+    void onAccountCapabilitiesChanged(const Tp::ConnectionCapabilities &capabilities);
 
 private:
-    AccountPtr mAccount;
+    struct FilterGroup
+    {
+        FilterGroup() : dependsOnAll(false), dependsOnCapabilities(false) {}
+
+        AccountFilterConstPtr filter;
+        bool dependsOnAll;
+        bool dependsOnCapabilities;
+        QSet<QString> properties;
+        QSet<QString> matching;
+        QList<AccountSet::Private *> sets;
+    };
+
+    Tracker(AccountManager *accountManager);
+    ~Tracker();
+
+    void trackAccount(const AccountPtr &account);
+    AccountPtr accountForSender() const;
+    FilterGroup *groupForFilter(const AccountFilterConstPtr &filter);
+    void filterAccount(FilterGroup *group, const AccountPtr &account);
+
+    static void collectDependencies(const AccountFilterConstPtr &filter, FilterGroup *group);
+    static bool equivalentFilters(const AccountFilterConstPtr &a, const AccountFilterConstPtr &b);
+
+    AccountManager *mAccountManager;
+    QHash<QString, AccountPtr> mAccounts;
+    QList<FilterGroup *> mGroups;
+    // property name -> groups whose filter depends on it
+    QHash<QString, QList<FilterGroup *> > mGroupsByProperty;
+    QList<FilterGroup *> mCapabilitiesGroups;
+    QList<FilterGroup *> mWildcardGroups;
 };
 
 } // Tp
@@ -29,10 +29,14 @@
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Account>
+#include <TelepathyQt/AccountCapabilityFilter>
 #include <TelepathyQt/AccountFilter>
 #include <TelepathyQt/AccountManager>
+#include <TelepathyQt/AndFilter>
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/ConnectionManager>
+#include <TelepathyQt/NotFilter>
+#include <TelepathyQt/OrFilter>
 
 namespace Tp
 {
@@ -43,6 +47,7 @@ AccountSet::Private::Private(AccountSet *parent,
     : parent(parent),
       accountManager(accountManager),
       filter(filter),
+      tracker(0),
       ready(false)
 {
     init();
@@ -53,6 +58,7 @@ AccountSet::Private::Private(AccountSet *parent,
         const QVariantMap &filterMap)
     : parent(parent),
       accountManager(accountManager),
+      tracker(0),
       ready(false)
 {
     AccountPropertyFilterPtr propertyFilter = AccountPropertyFilter::create();
@@ -64,103 +70,186 @@ AccountSet::Private::Private(AccountSet *parent,
     init();
 }
 
+AccountSet::Private::~Private()
+{
+    if (tracker) {
+        tracker->removeSet(this);
+    }
+}
+
 void AccountSet::Private::init()
 {
     if (filter->isValid()) {
-        connectSignals();
-        insertAccounts();
+        tracker = Tracker::forAccountManager(accountManager);
+        tracker->addSet(this);
         ready = true;
     }
 }
 
-void AccountSet::Private::connectSignals()
+void AccountSet::Private::setAccountMatching(const AccountPtr &account, bool matching)
 {
-    parent->connect(accountManager.data(),
-            SIGNAL(newAccount(Tp::AccountPtr)),
-            SLOT(onNewAccount(Tp::AccountPtr)));
+    QString accountPath = account->objectPath();
+
+    if (matching) {
+        if (!accounts.contains(accountPath)) {
+            accounts.insert(accountPath, account);
+            if (ready) {
+                emit parent->accountAdded(account);
+            }
+        }
+    } else {
+        if (accounts.contains(accountPath)) {
+            accounts.remove(accountPath);
+            if (ready) {
+                emit parent->accountRemoved(account);
+            }
+        }
+    }
+}
+
+void AccountSet::Private::removeAccount(const AccountPtr &account)
+{
+    accounts.remove(account->objectPath());
+
+    emit parent->accountRemoved(account);
 }
 
-void AccountSet::Private::insertAccounts()
+AccountSet::Private::Tracker *AccountSet::Private::Tracker::forAccountManager(
+        const AccountManagerPtr &accountManager)
 {
-    foreach (const Tp::AccountPtr &account, accountManager->allAccounts()) {
-        insertAccount(account);
+    Tracker *tracker = accountManager->findChild<Tracker *>();
+    if (!tracker) {
+        tracker = new Tracker(accountManager.data());
     }
+    return tracker;
 }
 
-void AccountSet::Private::insertAccount(const Tp::AccountPtr &account)
+AccountSet::Private::Tracker::Tracker(AccountManager *accountManager)
+    : QObject(accountManager),
+      mAccountManager(accountManager)
 {
-    QString accountPath = account->objectPath();
-    Q_ASSERT(!wrappers.contains(accountPath));
-    wrapAccount(account);
-    filterAccount(account);
+    connect(accountManager,
+            SIGNAL(newAccount(Tp::AccountPtr)),
+            SLOT(onNewAccount(Tp::AccountPtr)));
+
+    foreach (const AccountPtr &account, accountManager->allAccounts()) {
+        trackAccount(account);
+    }
 }
 
-void AccountSet::Private::removeAccount(const Tp::AccountPtr &account)
+AccountSet::Private::Tracker::~Tracker()
 {
-    QString accountPath = account->objectPath();
-    Q_ASSERT(wrappers.contains(accountPath));
-    accounts.remove(accountPath);
+    qDeleteAll(mGroups);
+}
 
-    AccountWrapper *wrapper = wrappers.take(accountPath);
-    Q_ASSERT(wrapper->disconnect(parent));
-    wrapper->deleteLater();
+void AccountSet::Private::Tracker::addSet(AccountSet::Private *set)
+{
+    FilterGroup *group = groupForFilter(set->filter);
+    group->sets.append(set);
 
-    emit parent->accountRemoved(account);
+    foreach (const QString &accountPath, group->matching) {
+        set->setAccountMatching(mAccounts.value(accountPath), true);
+    }
 }
 
-void AccountSet::Private::wrapAccount(const AccountPtr &account)
+void AccountSet::Private::Tracker::removeSet(AccountSet::Private *set)
 {
-    AccountWrapper *wrapper = new AccountWrapper(account, parent);
-    parent->connect(wrapper,
-            SIGNAL(accountRemoved(Tp::AccountPtr)),
-            SLOT(onAccountRemoved(Tp::AccountPtr)));
-    parent->connect(wrapper,
-            SIGNAL(accountPropertyChanged(Tp::AccountPtr,QString)),
-            SLOT(onAccountChanged(Tp::AccountPtr)));
-    parent->connect(wrapper,
-            SIGNAL(accountCapabilitiesChanged(Tp::AccountPtr,Tp::ConnectionCapabilities)),
-            SLOT(onAccountChanged(Tp::AccountPtr)));
-    wrappers.insert(account->objectPath(), wrapper);
+    foreach (FilterGroup *group, mGroups) {
+        if (!group->sets.removeOne(set)) {
+            continue;
+        }
+
+        if (group->sets.isEmpty()) {
+            mGroups.removeOne(group);
+            foreach (const QString &propertyName, group->properties) {
+                QList<FilterGroup *> &groups = mGroupsByProperty[propertyName];
+                groups.removeOne(group);
+                if (groups.isEmpty()) {
+                    mGroupsByProperty.remove(propertyName);
+                }
+            }
+            mCapabilitiesGroups.removeOne(group);
+            mWildcardGroups.removeOne(group);
+            delete group;
+        }
+        return;
+    }
 }
 
-void AccountSet::Private::filterAccount(const AccountPtr &account)
+void AccountSet::Private::Tracker::onNewAccount(const AccountPtr &account)
 {
+    trackAccount(account);
+
+    foreach (FilterGroup *group, mGroups) {
+        filterAccount(group, account);
+    }
+}
+
+void AccountSet::Private::Tracker::onAccountRemoved()
+{
+    AccountPtr account = accountForSender();
+    if (!account) {
+        return;
+    }
+
     QString accountPath = account->objectPath();
-    Q_ASSERT(wrappers.contains(accountPath));
-    AccountWrapper *wrapper = wrappers[accountPath];
+    mAccounts.remove(accountPath);
+    account->disconnect(this);
+
+    // Copied as removing an account from a set may result in the set being destroyed
+    QList<FilterGroup *> groups = mGroups;
+    foreach (FilterGroup *group, groups) {
+        if (!mGroups.contains(group)) {
+            continue;
+        }
 
-    /* account changed, let's check if it matches filter */
-    if (accountMatchFilter(wrapper)) {
-        if (!accounts.contains(account->objectPath())) {
-            accounts.insert(account->objectPath(), account);
-            if (ready) {
-                emit parent->accountAdded(account);
+        group->matching.remove(accountPath);
+        QList<AccountSet::Private *> sets = group->sets;
+        foreach (AccountSet::Private *set, sets) {
+            if (group->sets.contains(set)) {
+                set->removeAccount(account);
             }
         }
-    } else {
-        if (accounts.contains(account->objectPath())) {
-            accounts.remove(account->objectPath());
-            if (ready) {
-                emit parent->accountRemoved(account);
-            }
+    }
+}
+
+void AccountSet::Private::Tracker::onAccountPropertyChanged(const QString &propertyName)
+{
+    AccountPtr account = accountForSender();
+    if (!account) {
+        return;
+    }
+
+    QList<FilterGroup *> groups = mGroupsByProperty.value(propertyName) + mWildcardGroups;
+    foreach (FilterGroup *group, groups) {
+        if (mGroups.contains(group)) {
+            filterAccount(group, account);
         }
     }
 }
 
-bool AccountSet::Private::accountMatchFilter(AccountWrapper *wrapper)
+void AccountSet::Private::Tracker::onAccountCapabilitiesChanged(
+        const ConnectionCapabilities &capabilities)
 {
-    if (!filter) {
-        return true;
+    Q_UNUSED(capabilities);
+
+    AccountPtr account = accountForSender();
+    if (!account) {
+        return;
     }
 
-    return filter->matches(wrapper->account());
+    QList<FilterGroup *> groups = mCapabilitiesGroups + mWildcardGroups;
+    foreach (FilterGroup *group, groups) {
+        if (mGroups.contains(group)) {
+            filterAccount(group, account);
+        }
+    }
 }
 
-AccountSet::Private::AccountWrapper::AccountWrapper(
-        const AccountPtr &account, QObject *parent)
-    : QObject(parent),
-      mAccount(account)
+void AccountSet::Private::Tracker::trackAccount(const AccountPtr &account)
 {
+    mAccounts.insert(account->objectPath(), account);
+
     connect(account.data(),
             SIGNAL(removed()),
             SLOT(onAccountRemoved()));
@@ -169,28 +258,141 @@ AccountSet::Private::AccountWrapper::AccountWrapper(
             SLOT(onAccountPropertyChanged(QString)));
     connect(account.data(),
             SIGNAL(capabilitiesChanged(Tp::ConnectionCapabilities)),
-            SLOT(onAccountCapalitiesChanged(Tp::ConnectionCapabilities)));
+            SLOT(onAccountCapabilitiesChanged(Tp::ConnectionCapabilities)));
 }
 
-AccountSet::Private::AccountWrapper::~AccountWrapper()
+AccountPtr AccountSet::Private::Tracker::accountForSender() const
 {
+    Account *account = qobject_cast<Account *>(sender());
+    if (!account) {
+        return AccountPtr();
+    }
+    return mAccounts.value(account->objectPath());
 }
 
-void AccountSet::Private::AccountWrapper::onAccountRemoved()
+AccountSet::Private::Tracker::FilterGroup *AccountSet::Private::Tracker::groupForFilter(
+        const AccountFilterConstPtr &filter)
 {
-    emit accountRemoved(mAccount);
+    foreach (FilterGroup *group, mGroups) {
+        if (equivalentFilters(group->filter, filter)) {
+            return group;
+        }
+    }
+
+    FilterGroup *group = new FilterGroup;
+    group->filter = filter;
+    collectDependencies(filter, group);
+    mGroups.append(group);
+
+    if (group->dependsOnAll) {
+        mWildcardGroups.append(group);
+    } else {
+        foreach (const QString &propertyName, group->properties) {
+            mGroupsByProperty[propertyName].append(group);
+        }
+        if (group->dependsOnCapabilities) {
+            mCapabilitiesGroups.append(group);
+        }
+    }
+
+    foreach (const AccountPtr &account, mAccounts) {
+        if (!filter || filter->matches(account)) {
+            group->matching.insert(account->objectPath());
+        }
+    }
+
+    return group;
+}
+
+void AccountSet::Private::Tracker::filterAccount(FilterGroup *group, const AccountPtr &account)
+{
+    QString accountPath = account->objectPath();
+    bool matching = !group->filter || group->filter->matches(account);
+    if (matching == group->matching.contains(accountPath)) {
+        return;
+    }
+
+    if (matching) {
+        group->matching.insert(accountPath);
+    } else {
+        group->matching.remove(accountPath);
+    }
+
+    QList<AccountSet::Private *> sets = group->sets;
+    foreach (AccountSet::Private *set, sets) {
+        if (group->sets.contains(set)) {
+            set->setAccountMatching(account, matching);
+        }
+    }
 }
 
-void AccountSet::Private::AccountWrapper::onAccountPropertyChanged(
-        const QString &propertyName)
+void AccountSet::Private::Tracker::collectDependencies(const AccountFilterConstPtr &filter,
+        FilterGroup *group)
 {
-    emit accountPropertyChanged(mAccount, propertyName);
+    if (!filter) {
+        return;
+    }
+
+    // Filter types we can't look into (including custom filters) are re-evaluated on every
+    // change, as AccountSet always did
+    if (const AccountPropertyFilter *propertyFilter =
+            dynamic_cast<const AccountPropertyFilter *>(filter.data())) {
+        foreach (const QString &propertyName, propertyFilter->filter().keys()) {
+            if (propertyName == QLatin1String("capabilities")) {
+                group->dependsOnCapabilities = true;
+            } else {
+                group->properties.insert(propertyName);
+            }
+        }
+    } else if (dynamic_cast<const AccountCapabilityFilter *>(filter.data())) {
+        group->dependsOnCapabilities = true;
+    } else if (const AndFilter<Account> *andFilter =
+            dynamic_cast<const AndFilter<Account> *>(filter.data())) {
+        foreach (const AccountFilterConstPtr &child, andFilter->filters()) {
+            collectDependencies(child, group);
+        }
+    } else if (const OrFilter<Account> *orFilter =
+            dynamic_cast<const OrFilter<Account> *>(filter.data())) {
+        foreach (const AccountFilterConstPtr &child, orFilter->filters()) {
+            collectDependencies(child, group);
+        }
+    } else if (const NotFilter<Account> *notFilter =
+            dynamic_cast<const NotFilter<Account> *>(filter.data())) {
+        collectDependencies(notFilter->filter(), group);
+    } else {
+        group->dependsOnAll = true;
+    }
 }
 
-void AccountSet::Private::AccountWrapper::onAccountCapalitiesChanged(
-        const ConnectionCapabilities &caps)
+bool AccountSet::Private::Tracker::equivalentFilters(const AccountFilterConstPtr &a,
+        const AccountFilterConstPtr &b)
 {
-    emit accountCapabilitiesChanged(mAccount, caps);
+    if (a == b) {
+        return true;
+    }
+
+    if (!a || !b) {
+        return false;
+    }
+
+    // AccountManager creates a new filter for each validAccounts(), onlineAccounts(), ... call
+    const AccountPropertyFilter *propertyFilterA =
+        dynamic_cast<const AccountPropertyFilter *>(a.data());
+    const AccountPropertyFilter *propertyFilterB =
+        dynamic_cast<const AccountPropertyFilter *>(b.data());
+    if (propertyFilterA && propertyFilterB) {
+        return propertyFilterA->filter() == propertyFilterB->filter();
+    }
+
+    const AccountCapabilityFilter *capabilityFilterA =
+        dynamic_cast<const AccountCapabilityFilter *>(a.data());
+    const AccountCapabilityFilter *capabilityFilterB =
+        dynamic_cast<const AccountCapabilityFilter *>(b.data());
+    if (capabilityFilterA && capabilityFilterB) {
+        return capabilityFilterA->filter() == capabilityFilterB->filter();
+    }
+
+    return false;
 }
 
 /**
@@ -400,19 +602,4 @@ QList<AccountPtr> AccountSet::accounts() const
  * \sa accounts()
  */
 
-void AccountSet::onNewAccount(const AccountPtr &account)
-{
-    mPriv->insertAccount(account);
-}
-
-void AccountSet::onAccountRemoved(const AccountPtr &account)
-{
-    mPriv->removeAccount(account);
-}
-
-void AccountSet::onAccountChanged(const AccountPtr &account)
-{
-    mPriv->filterAccount(account);
-}
-
 } // Tp
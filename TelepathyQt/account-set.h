@@ -63,11 +63,6 @@ Q_SIGNALS:
     void accountAdded(const Tp::AccountPtr &account);
     void accountRemoved(const Tp::AccountPtr &account);
 
-private Q_SLOTS:
-    TP_QT_NO_EXPORT void onNewAccount(const Tp::AccountPtr &account);
-    TP_QT_NO_EXPORT void onAccountRemoved(const Tp::AccountPtr &account);
-    TP_QT_NO_EXPORT void onAccountChanged(const Tp::AccountPtr &account);
-
 private:
     struct Private;
     friend struct Private;
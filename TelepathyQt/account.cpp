@@ -29,6 +29,7 @@
 #include "TelepathyQt/debug-internal.h"
 
 #include "TelepathyQt/connection-internal.h"
+#include "TelepathyQt/name-owner-cache-internal.h"
 
 #include <TelepathyQt/AccountManager>
 #include <TelepathyQt/Channel>
@@ -627,6 +628,7 @@ struct TP_QT_NO_EXPORT Account::Private
     QString nickname;
     QString iconName;
     QQueue<QString> connObjPathQueue;
+    QString resolvedConnBusName;
     ConnectionPtr connection;
     bool mayFinishCore, coreFinished;
     QString normalizedName;
@@ -4601,6 +4603,8 @@ bool Account::Private::processConnQueue()
     while (!connObjPathQueue.isEmpty()) {
         QString path = connObjPathQueue.head();
         if (path.isEmpty()) {
+            resolvedConnBusName.clear();
+
             if (!connection.isNull()) {
                 debug() << "Dropping connection for account" << parent->objectPath();
 
@@ -4621,6 +4625,25 @@ bool Account::Private::processConnQueue()
             }
 
             QString busName = path.mid(1).replace(QLatin1String("/"), QLatin1String("."));
+
+            // Find out the unique name asynchronously, so constructing the connection doesn't
+            // block on the bus daemon
+            QString uniqueName;
+            if (busName != resolvedConnBusName &&
+                !NameOwnerCache::forBus(connFactory->dbusConnection())->lookup(busName,
+                    uniqueName)) {
+                resolvedConnBusName = busName;
+                parent->connect(NameOwnerCache::forBus(connFactory->dbusConnection())->resolve(
+                            QStringList() << busName, AccountPtr(parent)),
+                        SIGNAL(finished(Tp::PendingOperation*)),
+                        SLOT(onConnectionNameResolved()));
+                return false;
+            }
+
+            // The name has been resolved for this build only. A later connection, even on the
+            // same path, must go through the cache again, as the name may have changed owners.
+            resolvedConnBusName.clear();
+
             parent->connect(connFactory->proxy(busName, path, chanFactory, contactFactory),
                     SIGNAL(finished(Tp::PendingOperation*)),
                     SLOT(onConnectionBuilt(Tp::PendingOperation*)));
@@ -4785,6 +4808,15 @@ void Account::onRemoved()
     emit removed();
 }
 
+void Account::onConnectionNameResolved()
+{
+    if (mPriv->processConnQueue() && !mPriv->coreFinished && mPriv->mayFinishCore) {
+        debug() << "Account" << objectPath() << "basic functionality is ready (connections built)";
+        mPriv->coreFinished = true;
+        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+    }
+}
+
 void Account::onConnectionBuilt(PendingOperation *op)
 {
     PendingReady *readyOp = qobject_cast<PendingReady *>(op);
@@ -0,0 +1,127 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+#define _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+#include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/SharedPtr>
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+class TP_QT_NO_EXPORT AvatarCache
+{
+    Q_DISABLE_COPY(AvatarCache)
+
+public:
+    class PendingOp;
+
+    static AvatarCache *instance();
+
+    QString avatarDirectory(const QString &cmName, const QString &protocolName) const;
+
+    bool lookup(const QString &avatarFileName, QString &mimeType);
+    PendingOp *load(const QStringList &avatarFileNames, const SharedPtr<RefCounted> &object);
+    PendingOp *store(const QString &avatarFileName, const QByteArray &data,
+            const QString &mimeType, const SharedPtr<RefCounted> &object);
+
+    int maxEntries() const;
+    void setMaxEntries(int maxEntries);
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    class LoadJob;
+    class StoreJob;
+    class CheckJob;
+    friend class LoadJob;
+    friend class StoreJob;
+    friend class CheckJob;
+
+    AvatarCache();
+    ~AvatarCache();
+
+    static void cleanup();
+
+    void runLoad(PendingOp *op, const QStringList &avatarFileNames);
+    void runStore(PendingOp *op, const QString &avatarFileName, const QByteArray &data,
+            const QString &mimeType);
+    void runCheck();
+    void insert(const QString &avatarFileName, const QString &mimeType);
+    bool ensureDirectory(const QString &path);
+
+    static AvatarCache *mInstance;
+    static QMutex mInstanceMutex;
+
+    mutable QMutex mMutex;
+    QCache<QString, QString> mEntries;
+    QSet<QString> mCreatedDirectories;
+    QSet<QString> mToCheck;
+    quint64 mHits;
+    quint64 mMisses;
+    QString mBaseDirectory;
+    QThreadPool mPool;
+};
+
+class TP_QT_NO_EXPORT AvatarCache::PendingOp : public PendingOperation
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(PendingOp)
+
+public:
+    PendingOp(const SharedPtr<RefCounted> &object);
+    ~PendingOp();
+
+    // fileName -> mimeType for every avatar found in (or written to) the disk cache
+    QHash<QString, QString> avatars() const { return mAvatars; }
+    // file names which could not be found in (or written to) the disk cache
+    QStringList missing() const { return mMissing; }
+
+private Q_SLOTS:
+    void onJobFinished();
+
+private:
+    friend class AvatarCache;
+
+    QHash<QString, QString> mAvatars;
+    QStringList mMissing;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
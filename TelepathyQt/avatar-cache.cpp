@@ -0,0 +1,372 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/avatar-cache-internal.h"
+
+#include "TelepathyQt/_gen/avatar-cache-internal.moc.hpp"
+
+#include "TelepathyQt/cache-file-internal.h"
+#include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/test-backdoors.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+
+namespace Tp
+{
+
+// Default number of avatars (file name + mime type) kept in memory, shared by all the
+// ContactManagers of the process
+static const int AVATAR_CACHE_DEFAULT_MAX_ENTRIES = 8192;
+
+class TP_QT_NO_EXPORT AvatarCache::LoadJob : public QRunnable
+{
+public:
+    LoadJob(AvatarCache *cache, PendingOp *op, const QStringList &avatarFileNames)
+        : cache(cache), op(op), avatarFileNames(avatarFileNames)
+    {
+    }
+
+    void run()
+    {
+        cache->runLoad(op, avatarFileNames);
+    }
+
+private:
+    AvatarCache *cache;
+    PendingOp *op;
+    QStringList avatarFileNames;
+};
+
+class TP_QT_NO_EXPORT AvatarCache::StoreJob : public QRunnable
+{
+public:
+    StoreJob(AvatarCache *cache, PendingOp *op, const QString &avatarFileName,
+            const QByteArray &data, const QString &mimeType)
+        : cache(cache), op(op), avatarFileName(avatarFileName), data(data), mimeType(mimeType)
+    {
+    }
+
+    void run()
+    {
+        cache->runStore(op, avatarFileName, data, mimeType);
+    }
+
+private:
+    AvatarCache *cache;
+    PendingOp *op;
+    QString avatarFileName;
+    QByteArray data;
+    QString mimeType;
+};
+
+class TP_QT_NO_EXPORT AvatarCache::CheckJob : public QRunnable
+{
+public:
+    CheckJob(AvatarCache *cache)
+        : cache(cache)
+    {
+    }
+
+    void run()
+    {
+        cache->runCheck();
+    }
+
+private:
+    AvatarCache *cache;
+};
+
+AvatarCache::PendingOp::PendingOp(const SharedPtr<RefCounted> &object)
+    : PendingOperation(object)
+{
+}
+
+AvatarCache::PendingOp::~PendingOp()
+{
+}
+
+void AvatarCache::PendingOp::onJobFinished()
+{
+    setFinished();
+}
+
+AvatarCache *AvatarCache::mInstance = 0;
+QMutex AvatarCache::mInstanceMutex;
+
+AvatarCache *AvatarCache::instance()
+{
+    QMutexLocker locker(&mInstanceMutex);
+    if (!mInstance) {
+        mInstance = new AvatarCache();
+        qAddPostRoutine(cleanup);
+    }
+    return mInstance;
+}
+
+void AvatarCache::cleanup()
+{
+    // Lets the queued disk operations finish before the application goes away
+    QMutexLocker locker(&mInstanceMutex);
+    delete mInstance;
+}
+
+AvatarCache::AvatarCache()
+    : mEntries(AVATAR_CACHE_DEFAULT_MAX_ENTRIES),
+      mHits(0),
+      mMisses(0)
+{
+    mBaseDirectory = QString(QLatin1String("%1/avatars")).arg(cacheDirectory());
+
+    // A single worker thread keeps disk operations ordered, so a load queued after a store
+    // for the same token always sees the written file
+    mPool.setMaxThreadCount(1);
+}
+
+AvatarCache::~AvatarCache()
+{
+    mPool.waitForDone();
+    mInstance = 0;
+}
+
+QString AvatarCache::avatarDirectory(const QString &cmName, const QString &protocolName) const
+{
+    return QString(QLatin1String("%1/%2/%3")).arg(mBaseDirectory).arg(cmName).arg(protocolName);
+}
+
+/**
+ * Look up \a avatarFileName in the in-memory cache, without touching the disk.
+ *
+ * The file may have been removed behind our back since it was cached, e.g. by the user cleaning
+ * up their cache. Hits are checked against the disk on the worker thread afterwards, and dropped
+ * from the in-memory cache if the file is gone, so the next lookup misses and goes to disk.
+ *
+ * \return \c true and set \a mimeType if the avatar is known to be in the disk cache.
+ */
+bool AvatarCache::lookup(const QString &avatarFileName, QString &mimeType)
+{
+    QMutexLocker locker(&mMutex);
+    QString *entry = mEntries.object(avatarFileName);
+    if (!entry) {
+        ++mMisses;
+        return false;
+    }
+
+    ++mHits;
+    mimeType = *entry;
+
+    // A single job checks all the hits made while it was queued
+    if (mToCheck.isEmpty()) {
+        mPool.start(new CheckJob(this));
+    }
+    mToCheck.insert(avatarFileName);
+    return true;
+}
+
+/**
+ * Check whether each of \a avatarFileNames is in the disk cache, reading the mime type sidecar
+ * files on the worker thread. Found avatars are added to the in-memory cache.
+ */
+AvatarCache::PendingOp *AvatarCache::load(const QStringList &avatarFileNames,
+        const SharedPtr<RefCounted> &object)
+{
+    PendingOp *op = new PendingOp(object);
+    mPool.start(new LoadJob(this, op, avatarFileNames));
+    return op;
+}
+
+/**
+ * Write \a data and \a mimeType for \a avatarFileName to the disk cache on the worker thread.
+ * The returned operation finishes once the files are on disk.
+ */
+AvatarCache::PendingOp *AvatarCache::store(const QString &avatarFileName, const QByteArray &data,
+        const QString &mimeType, const SharedPtr<RefCounted> &object)
+{
+    PendingOp *op = new PendingOp(object);
+    mPool.start(new StoreJob(this, op, avatarFileName, data, mimeType));
+    return op;
+}
+
+int AvatarCache::maxEntries() const
+{
+    QMutexLocker locker(&mMutex);
+    return mEntries.maxCost();
+}
+
+void AvatarCache::setMaxEntries(int maxEntries)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.setMaxCost(qMax(maxEntries, 0));
+}
+
+quint64 AvatarCache::hits() const
+{
+    QMutexLocker locker(&mMutex);
+    return mHits;
+}
+
+quint64 AvatarCache::misses() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMisses;
+}
+
+void AvatarCache::runLoad(PendingOp *op, const QStringList &avatarFileNames)
+{
+    foreach (const QString &avatarFileName, avatarFileNames) {
+        mMutex.lock();
+        QString *entry = mEntries.object(avatarFileName);
+        bool cached = (entry != 0);
+        QString mimeType = cached ? *entry : QString();
+        mMutex.unlock();
+
+        if (!QFile::exists(avatarFileName)) {
+            if (cached) {
+                QMutexLocker locker(&mMutex);
+                mEntries.remove(avatarFileName);
+            }
+            op->mMissing.append(avatarFileName);
+            continue;
+        }
+
+        if (cached) {
+            op->mAvatars.insert(avatarFileName, mimeType);
+            continue;
+        }
+
+        QFile mimeTypeFile(QString(QLatin1String("%1.mime")).arg(avatarFileName));
+        if (mimeTypeFile.open(QIODevice::ReadOnly)) {
+            mimeType = QString(QLatin1String(mimeTypeFile.readAll()));
+            mimeTypeFile.close();
+        }
+
+        insert(avatarFileName, mimeType);
+        op->mAvatars.insert(avatarFileName, mimeType);
+    }
+
+    QMetaObject::invokeMethod(op, "onJobFinished", Qt::QueuedConnection);
+}
+
+void AvatarCache::runStore(PendingOp *op, const QString &avatarFileName,
+        const QByteArray &data, const QString &mimeType)
+{
+    QString mimeTypeFileName = QString(QLatin1String("%1.mime")).arg(avatarFileName);
+
+    if (!ensureDirectory(QFileInfo(avatarFileName).absolutePath())) {
+        warning() << "Unable to create avatar cache directory for" << avatarFileName;
+        op->mMissing.append(avatarFileName);
+        QMetaObject::invokeMethod(op, "onJobFinished", Qt::QueuedConnection);
+        return;
+    }
+
+    // The mime type goes first, so an avatar file is never found without it. Existing files are
+    // left alone, as their contents only depend on the token.
+    if ((!QFile::exists(mimeTypeFileName) &&
+         !writeCacheFile(mimeTypeFileName, mimeType.toLatin1())) ||
+        (!QFile::exists(avatarFileName) && !writeCacheFile(avatarFileName, data))) {
+        op->mMissing.append(avatarFileName);
+        QMetaObject::invokeMethod(op, "onJobFinished", Qt::QueuedConnection);
+        return;
+    }
+
+    insert(avatarFileName, mimeType);
+    op->mAvatars.insert(avatarFileName, mimeType);
+
+    QMetaObject::invokeMethod(op, "onJobFinished", Qt::QueuedConnection);
+}
+
+void AvatarCache::runCheck()
+{
+    mMutex.lock();
+    QSet<QString> avatarFileNames = mToCheck;
+    mToCheck.clear();
+    mMutex.unlock();
+
+    foreach (const QString &avatarFileName, avatarFileNames) {
+        if (!QFile::exists(avatarFileName)) {
+            debug() << "Avatar" << avatarFileName << "was removed from the disk cache";
+            QMutexLocker locker(&mMutex);
+            mEntries.remove(avatarFileName);
+        }
+    }
+}
+
+void AvatarCache::insert(const QString &avatarFileName, const QString &mimeType)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.insert(avatarFileName, new QString(mimeType));
+}
+
+bool AvatarCache::ensureDirectory(const QString &path)
+{
+    // Only called from the worker thread, the mutex protects against concurrent lookups only
+    mMutex.lock();
+    bool created = mCreatedDirectories.contains(path);
+    mMutex.unlock();
+
+    if (created) {
+        return true;
+    }
+
+    if (!QDir().mkpath(path)) {
+        return false;
+    }
+
+    QMutexLocker locker(&mMutex);
+    mCreatedDirectories.insert(path);
+    return true;
+}
+
+PendingOperation *TestBackdoors::storeAvatar(const QString &avatarFileName,
+        const QByteArray &data, const QString &mimeType)
+{
+    return AvatarCache::instance()->store(avatarFileName, data, mimeType,
+            SharedPtr<RefCounted>());
+}
+
+PendingOperation *TestBackdoors::loadAvatars(const QStringList &avatarFileNames)
+{
+    return AvatarCache::instance()->load(avatarFileNames, SharedPtr<RefCounted>());
+}
+
+QHash<QString, QString> TestBackdoors::avatarsFound(PendingOperation *op)
+{
+    AvatarCache::PendingOp *cacheOp = qobject_cast<AvatarCache::PendingOp *>(op);
+    return cacheOp ? cacheOp->avatars() : QHash<QString, QString>();
+}
+
+QStringList TestBackdoors::avatarsMissing(PendingOperation *op)
+{
+    AvatarCache::PendingOp *cacheOp = qobject_cast<AvatarCache::PendingOp *>(op);
+    return cacheOp ? cacheOp->missing() : QStringList();
+}
+
+bool TestBackdoors::lookupAvatar(const QString &avatarFileName, QString &mimeType)
+{
+    return AvatarCache::instance()->lookup(avatarFileName, mimeType);
+}
+
+} // Tp
@@ -32,6 +32,8 @@
 #include <TelepathyQt/DBusObject>
 #include <TelepathyQt/Utils>
 #include <TelepathyQt/AbstractProtocolInterface>
+#include <QHash>
+#include <QPair>
 #include <QString>
 #include <QVariantMap>
 
@@ -56,16 +58,64 @@ struct TP_QT_NO_EXPORT BaseConnection::Private {
     QString protocolName;
     QVariantMap parameters;
     uint status;
+    typedef QPair<QString, QPair<uint, uint> > ChannelKey;
+
+    static ChannelKey channelKey(const QString &channelType, uint targetHandleType,
+            uint targetHandle)
+    {
+        return ChannelKey(channelType, qMakePair(targetHandleType, targetHandle));
+    }
+
+    void insertChannel(const BaseChannelPtr &channel);
+    void removeChannel(const BaseChannelPtr &channel);
+    Tp::ChannelDetails channelDetails(const BaseChannelPtr &channel);
+
     QHash<QString, AbstractConnectionInterfacePtr> interfaces;
-    QSet<BaseChannelPtr> channels;
+    // channel -> details, which only contain immutable properties and are thus cached once the
+    // channel is registered (the details are left empty until then)
+    QHash<BaseChannelPtr, Tp::ChannelDetails> channels;
+    // (channel type, target handle type, target handle) -> channels, used by ensureChannel()
+    QMultiHash<ChannelKey, BaseChannelPtr> channelsByKey;
     CreateChannelCallback createChannelCB;
     RequestHandlesCallback requestHandlesCB;
+    RequestHandlesAsyncCallback requestHandlesAsyncCB;
     ConnectCallback connectCB;
     InspectHandlesCallback inspectHandlesCB;
     uint selfHandle;
     BaseConnection::Adaptee *adaptee;
 };
 
+void BaseConnection::Private::insertChannel(const BaseChannelPtr &channel)
+{
+    channels.insert(channel, Tp::ChannelDetails());
+    channelsByKey.insert(channelKey(channel->channelType(), channel->targetHandleType(),
+                channel->targetHandle()), channel);
+}
+
+void BaseConnection::Private::removeChannel(const BaseChannelPtr &channel)
+{
+    channels.remove(channel);
+    channelsByKey.remove(channelKey(channel->channelType(), channel->targetHandleType(),
+                channel->targetHandle()), channel);
+}
+
+Tp::ChannelDetails BaseConnection::Private::channelDetails(const BaseChannelPtr &channel)
+{
+    QHash<BaseChannelPtr, Tp::ChannelDetails>::iterator i = channels.find(channel);
+    if (i == channels.end()) {
+        return channel->details();
+    }
+
+    // Interfaces can be plugged into a channel, changing its details, until it is registered
+    if (i.value().channel.path().isEmpty()) {
+        if (!channel->isRegistered()) {
+            return channel->details();
+        }
+        i.value() = channel->details();
+    }
+    return i.value();
+}
+
 BaseConnection::Adaptee::Adaptee(const QDBusConnection &dbusConnection,
                                  BaseConnection *connection)
     : QObject(connection),
@@ -166,6 +216,11 @@ void BaseConnection::Adaptee::requestChannel(const QString &type, uint handleTyp
 void BaseConnection::Adaptee::requestHandles(uint handleType, const QStringList &identifiers,
         const Tp::Service::ConnectionAdaptor::RequestHandlesContextPtr &context)
 {
+    if (mConnection->mPriv->requestHandlesAsyncCB.isValid()) {
+        mConnection->mPriv->requestHandlesAsyncCB(handleType, identifiers, context);
+        return;
+    }
+
     DBusError error;
     Tp::UIntList handles = mConnection->requestHandles(handleType, identifiers, &error);
     if (error.isValid()) {
@@ -204,7 +259,7 @@ BaseConnection::BaseConnection(const QDBusConnection &dbusConnection,
  */
 BaseConnection::~BaseConnection()
 {
-    foreach (BaseChannelPtr channel, mPriv->channels) {
+    foreach (BaseChannelPtr channel, mPriv->channels.keys()) {
         channel->close();
     }
 
@@ -337,7 +392,7 @@ Tp::BaseChannelPtr BaseConnection::createChannel(const QString &channelType,
     if (error->isValid())
         return BaseChannelPtr();
 
-    mPriv->channels.insert(channel);
+    mPriv->insertChannel(channel);
 
     BaseConnectionRequestsInterfacePtr reqIface =
         BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
@@ -346,7 +401,7 @@ Tp::BaseChannelPtr BaseConnection::createChannel(const QString &channelType,
         //emit after return
         QMetaObject::invokeMethod(reqIface.data(), "newChannels",
                                   Qt::QueuedConnection,
-                                  Q_ARG(Tp::ChannelDetailsList, ChannelDetailsList() << channel->details()));
+                                  Q_ARG(Tp::ChannelDetailsList, ChannelDetailsList() << mPriv->channelDetails(channel)));
 
 
     //emit after return
@@ -370,6 +425,21 @@ void BaseConnection::setRequestHandlesCallback(const RequestHandlesCallback &cb)
     mPriv->requestHandlesCB = cb;
 }
 
+/**
+ * Set a callback that answers the RequestHandles D-Bus method asynchronously.
+ *
+ * The callback is given the method invocation context and may finish it later, for example
+ * once a network lookup completes, without blocking other D-Bus clients. It takes precedence
+ * over the callback set with setRequestHandlesCallback() for D-Bus calls, while requestHandles()
+ * keeps using the synchronous one.
+ *
+ * \param cb The callback.
+ */
+void BaseConnection::setRequestHandlesAsyncCallback(const RequestHandlesAsyncCallback &cb)
+{
+    mPriv->requestHandlesAsyncCB = cb;
+}
+
 UIntList BaseConnection::requestHandles(uint handleType, const QStringList &identifiers, DBusError* error)
 {
     if (!mPriv->requestHandlesCB.isValid()) {
@@ -383,7 +453,7 @@ Tp::ChannelInfoList BaseConnection::channelsInfo()
 {
     qDebug() << "BaseConnection::channelsInfo:";
     Tp::ChannelInfoList list;
-    foreach(const BaseChannelPtr & c, mPriv->channels) {
+    foreach(const BaseChannelPtr & c, mPriv->channels.keys()) {
         Tp::ChannelInfo info;
         info.channel = QDBusObjectPath(c->objectPath());
         info.channelType = c->channelType();
@@ -398,8 +468,10 @@ Tp::ChannelInfoList BaseConnection::channelsInfo()
 Tp::ChannelDetailsList BaseConnection::channelsDetails()
 {
     Tp::ChannelDetailsList list;
-    foreach(const BaseChannelPtr & c, mPriv->channels)
-    list << c->details();
+    QHash<BaseChannelPtr, Tp::ChannelDetails>::const_iterator i = mPriv->channels.constBegin();
+    for (; i != mPriv->channels.constEnd(); ++i) {
+        list << mPriv->channelDetails(i.key());
+    }
     return list;
 }
 
@@ -409,13 +481,11 @@ BaseChannelPtr BaseConnection::ensureChannel(const QString &channelType, uint ta
         const QVariantMap &request,
         DBusError* error)
 {
-    foreach(BaseChannelPtr channel, mPriv->channels) {
-        if (channel->channelType() == channelType
-                && channel->targetHandleType() == targetHandleType
-                && channel->targetHandle() == targetHandle) {
-            yours = false;
-            return channel;
-        }
+    BaseChannelPtr channel = mPriv->channelsByKey.value(
+            Private::channelKey(channelType, targetHandleType, targetHandle));
+    if (channel) {
+        yours = false;
+        return channel;
     }
     yours = true;
     return createChannel(channelType, targetHandleType, targetHandle, initiatorHandle, suppressHandler, request, error);
@@ -428,7 +498,7 @@ void BaseConnection::addChannel(BaseChannelPtr channel)
         return;
     }
 
-    mPriv->channels.insert(channel);
+    mPriv->insertChannel(channel);
 
     BaseConnectionRequestsInterfacePtr reqIface =
         BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
@@ -437,7 +507,7 @@ void BaseConnection::addChannel(BaseChannelPtr channel)
         //emit after return
         QMetaObject::invokeMethod(reqIface.data(), "newChannels",
                                   Qt::QueuedConnection,
-                                  Q_ARG(Tp::ChannelDetailsList, ChannelDetailsList() << channel->details()));
+                                  Q_ARG(Tp::ChannelDetailsList, ChannelDetailsList() << mPriv->channelDetails(channel)));
     }
 
     //emit after return
@@ -468,7 +538,7 @@ void BaseConnection::removeChannel()
         reqIface->channelClosed(QDBusObjectPath(channel->objectPath()));
     }
 
-    mPriv->channels.remove(channel);
+    mPriv->removeChannel(channel);
 }
 
 /**
@@ -840,6 +910,11 @@ void BaseConnectionContactsInterface::Adaptee::getContactAttributes(const Tp::UI
         const QStringList &interfaces, bool /*hold*/,
         const Tp::Service::ConnectionInterfaceContactsAdaptor::GetContactAttributesContextPtr &context)
 {
+    if (mInterface->mPriv->getContactAttributesAsyncCallback.isValid()) {
+        mInterface->mPriv->getContactAttributesAsyncCallback(handles, interfaces, context);
+        return;
+    }
+
     DBusError error;
     ContactAttributesMap contactAttributes = mInterface->getContactAttributes(handles, interfaces, &error);
     if (error.isValid()) {
@@ -855,6 +930,7 @@ struct TP_QT_NO_EXPORT BaseConnectionContactsInterface::Private {
     }
     QStringList contactAttributeInterfaces;
     GetContactAttributesCallback getContactAttributesCallback;
+    GetContactAttributesAsyncCallback getContactAttributesAsyncCallback;
     BaseConnectionContactsInterface::Adaptee *adaptee;
 };
 
@@ -920,6 +996,23 @@ void BaseConnectionContactsInterface::setGetContactAttributesCallback(const GetC
     mPriv->getContactAttributesCallback = cb;
 }
 
+/**
+ * Set a callback that answers the GetContactAttributes D-Bus method asynchronously.
+ *
+ * The callback is given the method invocation context and may finish it later with the
+ * attributes, so slow lookups do not block other D-Bus clients and several requests can be in
+ * flight at once. It takes precedence over the callback set with
+ * setGetContactAttributesCallback() for D-Bus calls, while getContactAttributes() keeps using
+ * the synchronous one.
+ *
+ * \param cb The callback.
+ */
+void BaseConnectionContactsInterface::setGetContactAttributesAsyncCallback(
+        const GetContactAttributesAsyncCallback &cb)
+{
+    mPriv->getContactAttributesAsyncCallback = cb;
+}
+
 ContactAttributesMap BaseConnectionContactsInterface::getContactAttributes(const Tp::UIntList &handles,
         const QStringList &interfaces,
         DBusError *error)
@@ -1989,6 +2082,7 @@ struct TP_QT_NO_EXPORT BaseConnectionAvatarsInterface::Private {
     AvatarSpec avatarDetails;
     GetKnownAvatarTokensCallback getKnownAvatarTokensCB;
     RequestAvatarsCallback requestAvatarsCB;
+    RequestAvatarsAsyncCallback requestAvatarsAsyncCB;
     SetAvatarCallback setAvatarCB;
     ClearAvatarCallback clearAvatarCB;
     BaseConnectionAvatarsInterface::Adaptee *adaptee;
@@ -2063,6 +2157,11 @@ void BaseConnectionAvatarsInterface::Adaptee::requestAvatars(const Tp::UIntList
         const Tp::Service::ConnectionInterfaceAvatarsAdaptor::RequestAvatarsContextPtr &context)
 {
     qDebug() << "BaseConnectionAvatarsInterface::Adaptee::requestAvatars";
+    if (mInterface->mPriv->requestAvatarsAsyncCB.isValid()) {
+        mInterface->mPriv->requestAvatarsAsyncCB(contacts, context);
+        return;
+    }
+
     DBusError error;
     mInterface->requestAvatars(contacts, &error);
     if (error.isValid()) {
@@ -2172,6 +2271,22 @@ void BaseConnectionAvatarsInterface::setRequestAvatarsCallback(const BaseConnect
     mPriv->requestAvatarsCB = cb;
 }
 
+/**
+ * Set a callback that answers the RequestAvatars D-Bus method asynchronously.
+ *
+ * The callback is given the method invocation context and may finish it later, once the
+ * avatar requests have been sent, without blocking other D-Bus clients. It takes precedence
+ * over the callback set with setRequestAvatarsCallback() for D-Bus calls, while
+ * requestAvatars() keeps using the synchronous one.
+ *
+ * \param cb The callback.
+ */
+void BaseConnectionAvatarsInterface::setRequestAvatarsAsyncCallback(
+        const BaseConnectionAvatarsInterface::RequestAvatarsAsyncCallback &cb)
+{
+    mPriv->requestAvatarsAsyncCB = cb;
+}
+
 void BaseConnectionAvatarsInterface::requestAvatars(const Tp::UIntList &contacts, DBusError *error)
 {
     if (!mPriv->requestAvatarsCB.isValid()) {
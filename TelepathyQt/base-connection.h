@@ -33,6 +33,7 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/Callbacks>
 #include <TelepathyQt/Constants>
+#include <TelepathyQt/MethodInvocationContext>
 
 #include <QDBusConnection>
 
@@ -90,6 +91,10 @@ public:
     void setRequestHandlesCallback(const RequestHandlesCallback &cb);
     UIntList requestHandles(uint handleType, const QStringList &identifiers, DBusError* error);
 
+    typedef MethodInvocationContextPtr<Tp::UIntList> RequestHandlesContextPtr;
+    typedef Callback3<void, uint, const QStringList&, const RequestHandlesContextPtr&> RequestHandlesAsyncCallback;
+    void setRequestHandlesAsyncCallback(const RequestHandlesAsyncCallback &cb);
+
     //typedef Callback3<uint, const QString&, const QString&, DBusError*> SetPresenceCallback;
     //void setSetPresenceCallback(const SetPresenceCallback &cb);
 
@@ -223,6 +228,11 @@ public:
     ContactAttributesMap getContactAttributes(const Tp::UIntList &handles,
             const QStringList &interfaces,
             DBusError *error);
+
+    typedef MethodInvocationContextPtr<Tp::ContactAttributesMap> GetContactAttributesContextPtr;
+    typedef Callback3<void, const Tp::UIntList&, const QStringList&, const GetContactAttributesContextPtr&> GetContactAttributesAsyncCallback;
+    void setGetContactAttributesAsyncCallback(const GetContactAttributesAsyncCallback &cb);
+
     void setContactAttributeInterfaces(const QStringList &contactAttributeInterfaces);
 protected:
     BaseConnectionContactsInterface();
@@ -543,6 +553,10 @@ public:
     void setRequestAvatarsCallback(const RequestAvatarsCallback &cb);
     void requestAvatars(const Tp::UIntList &contacts, DBusError *error);
 
+    typedef MethodInvocationContextPtr<> RequestAvatarsContextPtr;
+    typedef Callback2<void, const Tp::UIntList &, const RequestAvatarsContextPtr&> RequestAvatarsAsyncCallback;
+    void setRequestAvatarsAsyncCallback(const RequestAvatarsAsyncCallback &cb);
+
     typedef Callback3<QString, const QByteArray &, const QString &, DBusError*> SetAvatarCallback;
     void setSetAvatarCallback(const SetAvatarCallback &cb);
     QString setAvatar(const QByteArray &avatar, const QString &mimeType, DBusError *error);
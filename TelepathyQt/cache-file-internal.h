@@ -0,0 +1,48 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _TelepathyQt_cache_file_internal_h_HEADER_GUARD_
+#define _TelepathyQt_cache_file_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+
+#include <QByteArray>
+#include <QString>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// The directory the on-disk caches live in, $XDG_CACHE_HOME/telepathy
+TP_QT_NO_EXPORT QString cacheDirectory();
+
+// Replace the contents of fileName with data, such that other processes reading the file see
+// either the old or the new contents, never a partially written file. The directory the file is
+// in must exist.
+TP_QT_NO_EXPORT bool writeCacheFile(const QString &fileName, const QByteArray &data);
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
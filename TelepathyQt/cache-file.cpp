@@ -0,0 +1,86 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "TelepathyQt/cache-file-internal.h"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <QFile>
+#if QT_VERSION >= 0x050000
+#include <QSaveFile>
+#else
+#include <QTemporaryFile>
+
+#include <cstdio>
+#endif
+
+namespace Tp
+{
+
+QString cacheDirectory()
+{
+    QString cacheDir = QFile::decodeName(qgetenv("XDG_CACHE_HOME"));
+    if (cacheDir.isEmpty()) {
+        cacheDir = QString(QLatin1String("%1/.cache")).arg(QFile::decodeName(qgetenv("HOME")));
+    }
+    return QString(QLatin1String("%1/telepathy")).arg(cacheDir);
+}
+
+bool writeCacheFile(const QString &fileName, const QByteArray &data)
+{
+#if QT_VERSION >= 0x050000
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        warning() << "Unable to open" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+
+    if (file.write(data) != data.size() || !file.commit()) {
+        warning() << "Unable to write" << fileName << "-" << file.errorString();
+        return false;
+    }
+#else
+    QTemporaryFile file(fileName);
+    if (!file.open()) {
+        warning() << "Unable to create temporary file for" << fileName << "-" <<
+            file.errorString();
+        return false;
+    }
+
+    if (file.write(data) != data.size() || !file.flush()) {
+        warning() << "Unable to write" << fileName << "-" << file.errorString();
+        return false;
+    }
+
+    // Unlike QFile::rename(), rename() atomically replaces an existing file
+    if (::rename(QFile::encodeName(file.fileName()).constData(),
+                QFile::encodeName(fileName).constData()) != 0) {
+        warning() << "Unable to rename temporary file to" << fileName;
+        return false;
+    }
+    file.setAutoRemove(false);
+#endif
+
+    return true;
+}
+
+} // Tp
@@ -48,23 +48,212 @@
 #include <TelepathyQt/StreamedMediaChannel>
 #include <TelepathyQt/TextChannel>
 
+#include <QHash>
+#include <QPair>
+#include <QSet>
+
 namespace Tp
 {
 
 struct TP_QT_NO_EXPORT ChannelFactory::Private
 {
+    // Index over the configured channel classes, keyed by (ChannelType, TargetHandleType), so
+    // looking up the classes a channel belongs to doesn't need to compare it against every class
+    struct DispatchIndex
+    {
+        DispatchIndex() : valid(false) {}
+
+        void compile(const QList<ChannelClassSpec> &specs);
+        const QList<int> &candidates(const QVariantMap &props, bool *keyed) const;
+        bool matches(int index, const QVariantMap &props, bool keyed) const;
+
+        struct Entry
+        {
+            bool hasChannelType;
+            QString channelType;
+            bool hasTargetHandleType;
+            uint targetHandleType;
+            QVariantMap props;
+            QVariantMap otherProps;
+        };
+
+        typedef QPair<QString, uint> Key;
+
+        bool valid;
+        QList<Entry> entries;
+        QHash<Key, QList<int> > buckets;
+        // classes not specifying both ChannelType and TargetHandleType, in lookup order
+        QList<int> wildcards;
+    };
+
     Private();
 
+    static QVariantMap classProperties(const QVariantMap &immutableProperties);
+
+    Features featuresFor(const QVariantMap &props);
+    ConstructorConstPtr constructorFor(const QVariantMap &props);
+
     QList<ChannelClassFeatures> features;
+    DispatchIndex featuresIndex;
 
     typedef QPair<ChannelClassSpec, ConstructorConstPtr> CtorPair;
     QList<CtorPair> ctors;
+    DispatchIndex ctorsIndex;
 };
 
+void ChannelFactory::Private::DispatchIndex::compile(const QList<ChannelClassSpec> &specs)
+{
+    static const QString channelTypeProp = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleTypeProp =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    entries.clear();
+    buckets.clear();
+    wildcards.clear();
+
+    QSet<Key> keys;
+    foreach (const ChannelClassSpec &spec, specs) {
+        Entry entry;
+        entry.props = spec.allProperties();
+        entry.hasChannelType = entry.props.contains(channelTypeProp);
+        entry.channelType = qdbus_cast<QString>(entry.props.value(channelTypeProp));
+        entry.hasTargetHandleType = entry.props.contains(targetHandleTypeProp);
+        entry.targetHandleType = qdbus_cast<uint>(entry.props.value(targetHandleTypeProp));
+        entry.otherProps = entry.props;
+        entry.otherProps.remove(channelTypeProp);
+        entry.otherProps.remove(targetHandleTypeProp);
+
+        if (entry.hasChannelType && entry.hasTargetHandleType) {
+            keys.insert(Key(entry.channelType, entry.targetHandleType));
+        } else {
+            wildcards.append(entries.size());
+        }
+
+        entries.append(entry);
+    }
+
+    foreach (const Key &key, keys) {
+        QList<int> &bucket = buckets[key];
+        for (int i = 0; i < entries.size(); ++i) {
+            const Entry &entry = entries[i];
+            if ((!entry.hasChannelType || entry.channelType == key.first) &&
+                    (!entry.hasTargetHandleType || entry.targetHandleType == key.second)) {
+                bucket.append(i);
+            }
+        }
+    }
+
+    valid = true;
+}
+
+const QList<int> &ChannelFactory::Private::DispatchIndex::candidates(const QVariantMap &props,
+        bool *keyed) const
+{
+    static const QString channelTypeProp = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleTypeProp =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    QVariantMap::const_iterator channelType = props.constFind(channelTypeProp);
+    QVariantMap::const_iterator targetHandleType = props.constFind(targetHandleTypeProp);
+    if (channelType != props.constEnd() && targetHandleType != props.constEnd()) {
+        QHash<Key, QList<int> >::const_iterator bucket = buckets.constFind(
+                Key(qdbus_cast<QString>(channelType.value()),
+                    qdbus_cast<uint>(targetHandleType.value())));
+        if (bucket != buckets.constEnd()) {
+            *keyed = true;
+            return bucket.value();
+        }
+    }
+
+    // Only the classes leaving ChannelType or TargetHandleType unspecified can match
+    *keyed = false;
+    return wildcards;
+}
+
+bool ChannelFactory::Private::DispatchIndex::matches(int index, const QVariantMap &props,
+        bool keyed) const
+{
+    // Keyed candidates are already known to match on ChannelType and TargetHandleType
+    const QVariantMap &required = keyed ? entries[index].otherProps : entries[index].props;
+
+    QVariantMap::const_iterator i;
+    for (i = required.constBegin(); i != required.constEnd(); ++i) {
+        QVariantMap::const_iterator prop = props.constFind(i.key());
+        if (prop == props.constEnd() || prop.value() != i.value()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 ChannelFactory::Private::Private()
 {
 }
 
+QVariantMap ChannelFactory::Private::classProperties(const QVariantMap &immutableProperties)
+{
+    // Same as ChannelClassSpec(immutableProperties).allProperties(), which defaults the
+    // ChannelType and TargetHandleType, without building the temporary spec
+    static const QString channelTypeProp = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleTypeProp =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    QVariantMap props = immutableProperties;
+    if (!props.contains(channelTypeProp)) {
+        props.insert(channelTypeProp, QString());
+    }
+    if (!props.contains(targetHandleTypeProp)) {
+        props.insert(targetHandleTypeProp, (uint) HandleTypeNone);
+    }
+    return props;
+}
+
+Features ChannelFactory::Private::featuresFor(const QVariantMap &props)
+{
+    if (!featuresIndex.valid) {
+        QList<ChannelClassSpec> specs;
+        foreach (const ChannelClassFeatures &pair, features) {
+            specs.append(pair.first);
+        }
+        featuresIndex.compile(specs);
+    }
+
+    Features ret;
+
+    bool keyed;
+    const QList<int> &candidates = featuresIndex.candidates(props, &keyed);
+    foreach (int index, candidates) {
+        if (featuresIndex.matches(index, props, keyed)) {
+            ret.unite(features[index].second);
+        }
+    }
+
+    return ret;
+}
+
+ChannelFactory::ConstructorConstPtr ChannelFactory::Private::constructorFor(
+        const QVariantMap &props)
+{
+    if (!ctorsIndex.valid) {
+        QList<ChannelClassSpec> specs;
+        foreach (const CtorPair &pair, ctors) {
+            specs.append(pair.first);
+        }
+        ctorsIndex.compile(specs);
+    }
+
+    bool keyed;
+    const QList<int> &candidates = ctorsIndex.candidates(props, &keyed);
+    foreach (int index, candidates) {
+        if (ctorsIndex.matches(index, props, keyed)) {
+            return ctors[index].second;
+        }
+    }
+
+    return ConstructorConstPtr();
+}
+
 /**
  * \class ChannelFactory
  * \ingroup utils
@@ -546,15 +735,7 @@ void ChannelFactory::setFallbackConstructor(const ConstructorConstPtr &ctor)
 
 Features ChannelFactory::featuresFor(const ChannelClassSpec &channelClass) const
 {
-    Features features;
-
-    foreach (const ChannelClassFeatures &pair, mPriv->features) {
-        if (pair.first.isSubsetOf(channelClass)) {
-            features.unite(pair.second);
-        }
-    }
-
-    return features;
+    return mPriv->featuresFor(channelClass.allProperties());
 }
 
 void ChannelFactory::addFeaturesFor(const ChannelClassSpec &channelClass, const Features &features)
@@ -574,20 +755,16 @@ void ChannelFactory::addFeaturesFor(const ChannelClassSpec &channelClass, const
     // We ran out of feature specifications (for the given size/specificity of a channel class)
     // before finding a matching one, so let's create a new entry
     mPriv->features.insert(i, qMakePair(channelClass, features));
+    mPriv->featuresIndex.valid = false;
 }
 
 ChannelFactory::ConstructorConstPtr ChannelFactory::constructorFor(const ChannelClassSpec &cc) const
 {
-    QList<Private::CtorPair>::iterator i;
-    for (i = mPriv->ctors.begin(); i != mPriv->ctors.end(); ++i) {
-        if (i->first.isSubsetOf(cc)) {
-            return i->second;
-        }
-    }
+    ConstructorConstPtr ctor = mPriv->constructorFor(cc.allProperties());
 
-    // If this is reached, we didn't have a proper fallback constructor
-    Q_ASSERT(false);
-    return ConstructorConstPtr();
+    // If this is hit, we didn't have a proper fallback constructor
+    Q_ASSERT(!ctor.isNull());
+    return ctor;
 }
 
 void ChannelFactory::setConstructorFor(const ChannelClassSpec &channelClass,
@@ -615,6 +792,7 @@ void ChannelFactory::setConstructorFor(const ChannelClassSpec &channelClass,
     // We ran out of constructors (for the given size/specificity of a channel class)
     // before finding a matching one, so let's create a new entry
     mPriv->ctors.insert(i, qMakePair(channelClass, ctor));
+    mPriv->ctorsIndex.valid = false;
 }
 
 /**
@@ -637,8 +815,10 @@ PendingReady *ChannelFactory::proxy(const ConnectionPtr &connection, const QStri
 {
     DBusProxyPtr proxy = cachedProxy(connection->busName(), channelPath);
     if (proxy.isNull()) {
-        proxy = constructorFor(ChannelClassSpec(immutableProperties))->construct(connection,
-                channelPath, immutableProperties);
+        ConstructorConstPtr ctor = mPriv->constructorFor(
+                Private::classProperties(immutableProperties));
+        Q_ASSERT(!ctor.isNull());
+        proxy = ctor->construct(connection, channelPath, immutableProperties);
     }
 
     return nowHaveProxy(proxy);
@@ -667,7 +847,7 @@ Features ChannelFactory::featuresFor(const DBusProxyPtr &proxy) const
     ChannelPtr chan = ChannelPtr::qObjectCast(proxy);
     Q_ASSERT(!chan.isNull());
 
-    return featuresFor(ChannelClassSpec(chan->immutableProperties()));
+    return mPriv->featuresFor(Private::classProperties(chan->immutableProperties()));
 }
 
 } // Tp
@@ -91,8 +91,10 @@ struct TP_QT_NO_EXPORT Channel::Private
     void doMembersChangedDetailed(const UIntList &, const UIntList &, const UIntList &,
             const UIntList &, const QVariantMap &);
     void processMembersChanged();
+    void prepareMembersChanged();
     void updateContacts(const QList<ContactPtr> &contacts =
             QList<ContactPtr>());
+    void applyMembersChanged(const QList<ContactPtr> &contacts);
     bool fakeGroupInterfaceIfNeeded();
     void setReady();
 
@@ -162,6 +164,8 @@ struct TP_QT_NO_EXPORT Channel::Private
 
     // Queue of received MCD signals to process
     QQueue<GroupMembersChangedInfo *> groupMembersChangedQueue;
+    // MCD signals whose contacts are being built, applied in order once they are
+    QList<GroupMembersChangedInfo *> groupMembersChangedBatch;
     GroupMembersChangedInfo *currentGroupMembersChangedInfo;
 
     // Pending from the MCD signal currently processed, but contacts not yet built
@@ -332,6 +336,9 @@ Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
 Channel::Private::~Private()
 {
     delete currentGroupMembersChangedInfo;
+    foreach (GroupMembersChangedInfo *info, groupMembersChangedBatch) {
+        delete info;
+    }
     foreach (GroupMembersChangedInfo *info, groupMembersChangedQueue) {
         delete info;
     }
@@ -833,14 +840,42 @@ void Channel::Private::buildContacts()
     buildingContacts = true;
 
     ContactManagerPtr manager = connection->contactManager();
-    UIntList toBuild = QSet<uint>(pendingGroupMembers +
-            pendingGroupLocalPendingMembers +
-            pendingGroupRemotePendingMembers).toList();
 
-    if (currentGroupMembersChangedInfo &&
-            currentGroupMembersChangedInfo->actor != 0) {
-        toBuild.append(currentGroupMembersChangedInfo->actor);
+    // Build the contacts for all the MCD signals in the batch with a single request. Handles
+    // already in the list they're added to are skipped, unless one of the signals removes them
+    // (and another may add them back).
+    QSet<uint> removedHandles;
+    foreach (GroupMembersChangedInfo *info, groupMembersChangedBatch) {
+        foreach (uint handle, info->removed) {
+            removedHandles.insert(handle);
+        }
+    }
+
+    QSet<uint> handles;
+    foreach (GroupMembersChangedInfo *info, groupMembersChangedBatch) {
+        foreach (uint handle, info->added) {
+            if (!groupContacts.contains(handle) || removedHandles.contains(handle)) {
+                handles.insert(handle);
+            }
+        }
+
+        foreach (uint handle, info->localPending) {
+            if (!groupLocalPendingContacts.contains(handle) || removedHandles.contains(handle)) {
+                handles.insert(handle);
+            }
+        }
+
+        foreach (uint handle, info->remotePending) {
+            if (!groupRemotePendingContacts.contains(handle) || removedHandles.contains(handle)) {
+                handles.insert(handle);
+            }
+        }
+
+        if (info->actor != 0) {
+            handles.insert(info->actor);
+        }
     }
+    UIntList toBuild = handles.toList();
 
     if (!initiatorContact && initiatorHandle) {
         // No initiator contact, but Yes initiator handle - might do something about it with just
@@ -869,6 +904,11 @@ void Channel::Private::buildContacts()
         }
 
         buildingContacts = false;
+
+        if (!groupMembersChangedBatch.isEmpty()) {
+            // Nothing to build, but the batch still has to be applied (e.g. removals only)
+            updateContacts();
+        }
         return;
     }
 
@@ -919,16 +959,29 @@ void Channel::Private::processMembersChanged()
         return;
     }
 
-    Q_ASSERT(pendingGroupMembers.isEmpty());
-    Q_ASSERT(pendingGroupLocalPendingMembers.isEmpty());
-    Q_ASSERT(pendingGroupRemotePendingMembers.isEmpty());
+    Q_ASSERT(groupMembersChangedBatch.isEmpty());
 
     // always set this to false here, as buildContacts will always try to
     // retrieve the selfContact and updateContacts will check if the built
     // contact is the same as the current contact.
     pendingRetrieveGroupSelfContact = false;
 
-    currentGroupMembersChangedInfo = groupMembersChangedQueue.dequeue();
+    // Drain the whole queue, so bursts of MCD signals (e.g. when joining a big room) cost a
+    // single contact building round trip instead of one per signal
+    while (!groupMembersChangedQueue.isEmpty()) {
+        groupMembersChangedBatch.append(groupMembersChangedQueue.dequeue());
+    }
+
+    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
+    buildContacts();
+}
+
+void Channel::Private::prepareMembersChanged()
+{
+    Q_ASSERT(currentGroupMembersChangedInfo);
+    Q_ASSERT(pendingGroupMembers.isEmpty());
+    Q_ASSERT(pendingGroupLocalPendingMembers.isEmpty());
+    Q_ASSERT(pendingGroupRemotePendingMembers.isEmpty());
 
     foreach (uint handle, currentGroupMembersChangedInfo->added) {
         if (!groupContacts.contains(handle)) {
@@ -959,12 +1012,52 @@ void Channel::Private::processMembersChanged()
     foreach (uint handle, currentGroupMembersChangedInfo->removed) {
         groupMembersToRemove.append(handle);
     }
-
-    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
-    buildContacts();
 }
 
 void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
+{
+    debug() << "Entering Chan::Priv::updateContacts() with" << contacts.size() << "contacts" <<
+        "for" << groupMembersChangedBatch.size() << "MCD signals";
+
+    if (groupMembersChangedBatch.isEmpty()) {
+        applyMembersChanged(contacts);
+        processMembersChanged();
+        return;
+    }
+
+    QHash<uint, ContactPtr> contactsByHandle;
+    foreach (const ContactPtr &contact, contacts) {
+        contactsByHandle.insert(contact->handle()[0], contact);
+    }
+
+    // Apply the changes one by one, in the order they were received, each with its own details
+    while (!groupMembersChangedBatch.isEmpty()) {
+        currentGroupMembersChangedInfo = groupMembersChangedBatch.takeFirst();
+        prepareMembersChanged();
+
+        QSet<uint> handles = pendingGroupMembers + pendingGroupLocalPendingMembers +
+            pendingGroupRemotePendingMembers;
+        handles.insert(currentGroupMembersChangedInfo->actor);
+        if (groupMembersChangedBatch.isEmpty()) {
+            // Only needs to be checked once
+            handles << groupSelfHandle << initiatorHandle << targetHandle;
+        }
+
+        QList<ContactPtr> changeContacts;
+        foreach (uint handle, handles) {
+            ContactPtr contact = contactsByHandle.value(handle);
+            if (contact) {
+                changeContacts.append(contact);
+            }
+        }
+
+        applyMembersChanged(changeContacts);
+    }
+
+    processMembersChanged();
+}
+
+void Channel::Private::applyMembersChanged(const QList<ContactPtr> &contacts)
 {
     Contacts groupContactsAdded;
     Contacts groupLocalPendingContactsAdded;
@@ -972,8 +1065,6 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
     ContactPtr actorContact;
     bool selfContactUpdated = false;
 
-    debug() << "Entering Chan::Priv::updateContacts() with" << contacts.size() << "contacts";
-
     // FIXME: simplify. Some duplication of logic present.
     foreach (ContactPtr contact, contacts) {
         uint handle = contact->handle()[0];
@@ -1105,8 +1196,6 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
     if (selfContactUpdated && parent->isReady(Channel::FeatureCore)) {
         emit parent->groupSelfContactChanged();
     }
-
-    processMembersChanged();
 }
 
 bool Channel::Private::fakeGroupInterfaceIfNeeded()
@@ -23,12 +23,18 @@
 #ifndef _TelepathyQt_client_registrar_internal_h_HEADER_GUARD_
 #define _TelepathyQt_client_registrar_internal_h_HEADER_GUARD_
 
+#include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
 #include <QtDBus/QtDBus>
 
 #include <TelepathyQt/AbstractClientHandler>
+#include <TelepathyQt/AccountFactory>
 #include <TelepathyQt/Channel>
 #include <TelepathyQt/ChannelClassSpecList>
+#include <TelepathyQt/ChannelFactory>
+#include <TelepathyQt/ConnectionFactory>
+#include <TelepathyQt/ContactFactory>
 #include <TelepathyQt/Types>
 
 #include "TelepathyQt/fake-handler-manager-internal.h"
@@ -37,6 +43,71 @@ namespace Tp
 {
 
 class PendingOperation;
+class PendingReady;
+
+/*
+ * Proxies being made ready for the Observer, Approver and Handler adaptors of a registrar, by
+ * object path.
+ *
+ * The channel dispatcher usually sends the same channels to several clients of a process at about
+ * the same time. All the adaptors of a registrar use the same factories, so they would ask for the
+ * same proxies with the same features; while a proxy is being prepared, later requests get the
+ * in-flight PendingReady instead of a new one.
+ *
+ * It also keeps track of how long each dispatch stage takes, which ClientRegistrar exposes.
+ */
+class TP_QT_NO_EXPORT ProxyReadinessTable : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ProxyReadinessTable)
+
+public:
+    ProxyReadinessTable(const AccountFactoryConstPtr &accFactory,
+            const ConnectionFactoryConstPtr &connFactory,
+            const ChannelFactoryConstPtr &chanFactory,
+            const ContactFactoryConstPtr &contactFactory);
+    ~ProxyReadinessTable();
+
+    PendingReady *accountReady(const QString &objectPath);
+    PendingReady *connectionReady(const QString &objectPath);
+    PendingReady *channelReady(const ConnectionPtr &connection, const QString &objectPath,
+            const QVariantMap &immutableProperties);
+
+    void recordDispatch(const char *method, int preparationTime, int queueTime);
+
+    quint64 requests() const { return mRequests; }
+    quint64 sharedRequests() const { return mSharedRequests; }
+    quint64 dispatches() const { return mDispatches; }
+    int averagePreparationTime() const
+    {
+        return mDispatches ? int(mPreparationTime / mDispatches) : 0;
+    }
+    int averageQueueTime() const
+    {
+        return mDispatches ? int(mQueueTime / mDispatches) : 0;
+    }
+
+private Q_SLOTS:
+    void onProxyReady(Tp::PendingOperation *op);
+
+private:
+    PendingReady *inFlight(const QString &objectPath);
+    PendingReady *track(const QString &objectPath, PendingReady *ready);
+
+    AccountFactoryConstPtr mAccFactory;
+    ConnectionFactoryConstPtr mConnFactory;
+    ChannelFactoryConstPtr mChanFactory;
+    ContactFactoryConstPtr mContactFactory;
+
+    QHash<QString, PendingReady *> mInFlight;
+    QHash<PendingOperation *, QString> mInFlightPaths;
+    quint64 mRequests;
+    quint64 mSharedRequests;
+
+    quint64 mDispatches;
+    quint64 mPreparationTime;
+    quint64 mQueueTime;
+};
 
 class TP_QT_NO_EXPORT ClientAdaptor : public QDBusAbstractAdaptor
 {
@@ -94,6 +165,7 @@ class TP_QT_NO_EXPORT ClientObserverAdaptor : public QDBusAbstractAdaptor
 
 public:
     ClientObserverAdaptor(ClientRegistrar *registrar,
+            ProxyReadinessTable *readiness,
             AbstractClientObserver *client,
             QObject *parent);
     virtual ~ClientObserverAdaptor();
@@ -129,11 +201,14 @@ private Q_SLOTS:
 private:
     struct InvocationData : RefCounted
     {
-        InvocationData() : readyOp(0) {}
+        InvocationData() : readyOp(0), preparationTime(0) {}
 
         PendingOperation *readyOp;
         QString error, message;
 
+        QElapsedTimer received;
+        int preparationTime;
+
         MethodInvocationContextPtr<> ctx;
         AccountPtr acc;
         ConnectionPtr conn;
@@ -145,6 +220,7 @@ private:
     QLinkedList<SharedPtr<InvocationData> > mInvocations;
 
     ClientRegistrar *mRegistrar;
+    ProxyReadinessTable *mReadiness;
     QDBusConnection mBus;
     AbstractClientObserver *mClient;
 };
@@ -168,6 +244,7 @@ class TP_QT_NO_EXPORT ClientApproverAdaptor : public QDBusAbstractAdaptor
 
 public:
     ClientApproverAdaptor(ClientRegistrar *registrar,
+            ProxyReadinessTable *readiness,
             AbstractClientApprover *client,
             QObject *parent);
     virtual ~ClientApproverAdaptor();
@@ -195,11 +272,14 @@ private Q_SLOTS:
 private:
     struct InvocationData : RefCounted
     {
-        InvocationData() : readyOp(0) {}
+        InvocationData() : readyOp(0), preparationTime(0) {}
 
         PendingOperation *readyOp;
         QString error, message;
 
+        QElapsedTimer received;
+        int preparationTime;
+
         MethodInvocationContextPtr<> ctx;
         QList<ChannelPtr> chans;
         ChannelDispatchOperationPtr dispatchOp;
@@ -208,6 +288,7 @@ private:
 
 private:
     ClientRegistrar *mRegistrar;
+    ProxyReadinessTable *mReadiness;
     QDBusConnection mBus;
     AbstractClientApprover *mClient;
 };
@@ -240,6 +321,7 @@ class TP_QT_NO_EXPORT ClientHandlerAdaptor : public QDBusAbstractAdaptor
 
 public:
     ClientHandlerAdaptor(ClientRegistrar *registrar,
+            ProxyReadinessTable *readiness,
             AbstractClientHandler *client,
             QObject *parent);
     virtual ~ClientHandlerAdaptor();
@@ -285,11 +367,14 @@ private Q_SLOTS:
 private:
     struct InvocationData : RefCounted
     {
-        InvocationData() : readyOp(0) {}
+        InvocationData() : readyOp(0), preparationTime(0) {}
 
         PendingOperation *readyOp;
         QString error, message;
 
+        QElapsedTimer received;
+        int preparationTime;
+
         MethodInvocationContextPtr<> ctx;
         AccountPtr acc;
         ConnectionPtr conn;
@@ -305,6 +390,7 @@ private:
             const QList<ChannelPtr> &channels, ClientHandlerAdaptor *self);
 
     ClientRegistrar *mRegistrar;
+    ProxyReadinessTable *mReadiness;
     QDBusConnection mBus;
     AbstractClientHandler *mClient;
 
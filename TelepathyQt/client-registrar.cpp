@@ -84,6 +84,102 @@ private:
     void *mFinishedCbData;
 };
 
+ProxyReadinessTable::ProxyReadinessTable(const AccountFactoryConstPtr &accFactory,
+        const ConnectionFactoryConstPtr &connFactory,
+        const ChannelFactoryConstPtr &chanFactory,
+        const ContactFactoryConstPtr &contactFactory)
+    : mAccFactory(accFactory),
+      mConnFactory(connFactory),
+      mChanFactory(chanFactory),
+      mContactFactory(contactFactory),
+      mRequests(0),
+      mSharedRequests(0),
+      mDispatches(0),
+      mPreparationTime(0),
+      mQueueTime(0)
+{
+}
+
+ProxyReadinessTable::~ProxyReadinessTable()
+{
+}
+
+PendingReady *ProxyReadinessTable::accountReady(const QString &objectPath)
+{
+    PendingReady *ready = inFlight(objectPath);
+    if (!ready) {
+        ready = track(objectPath, mAccFactory->proxy(TP_QT_ACCOUNT_MANAGER_BUS_NAME, objectPath,
+                    mConnFactory, mChanFactory, mContactFactory));
+    }
+    return ready;
+}
+
+PendingReady *ProxyReadinessTable::connectionReady(const QString &objectPath)
+{
+    PendingReady *ready = inFlight(objectPath);
+    if (!ready) {
+        QString busName = objectPath.mid(1).replace(QLatin1String("/"), QLatin1String("."));
+        ready = track(objectPath, mConnFactory->proxy(busName, objectPath,
+                    mChanFactory, mContactFactory));
+    }
+    return ready;
+}
+
+PendingReady *ProxyReadinessTable::channelReady(const ConnectionPtr &connection,
+        const QString &objectPath, const QVariantMap &immutableProperties)
+{
+    PendingReady *ready = inFlight(objectPath);
+    if (!ready) {
+        ready = track(objectPath, mChanFactory->proxy(connection, objectPath,
+                    immutableProperties));
+    }
+    return ready;
+}
+
+void ProxyReadinessTable::recordDispatch(const char *method, int preparationTime,
+        int queueTime)
+{
+    ++mDispatches;
+    mPreparationTime += preparationTime;
+    mQueueTime += queueTime;
+
+    debug() << method << "proxies ready in" << preparationTime << "ms, queued for" <<
+        queueTime << "ms (average" << averagePreparationTime() << "ms /" <<
+        averageQueueTime() << "ms over" << mDispatches << "dispatches," <<
+        mSharedRequests << "of" << mRequests << "proxy preparations shared)";
+}
+
+void ProxyReadinessTable::onProxyReady(Tp::PendingOperation *op)
+{
+    QString objectPath = mInFlightPaths.take(op);
+    if (mInFlight.value(objectPath) == op) {
+        mInFlight.remove(objectPath);
+    }
+}
+
+PendingReady *ProxyReadinessTable::inFlight(const QString &objectPath)
+{
+    ++mRequests;
+
+    PendingReady *ready = mInFlight.value(objectPath);
+    if (ready) {
+        ++mSharedRequests;
+    }
+    return ready;
+}
+
+PendingReady *ProxyReadinessTable::track(const QString &objectPath, PendingReady *ready)
+{
+    // The entry is dropped as soon as the operation finishes, before it deletes itself; from then
+    // on the factory cache hands out the ready proxy directly
+    mInFlight.insert(objectPath, ready);
+    mInFlightPaths.insert(ready, objectPath);
+    connect(ready,
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onProxyReady(Tp::PendingOperation*)));
+    return ready;
+}
+
 ClientAdaptor::ClientAdaptor(ClientRegistrar *registrar, const QStringList &interfaces,
         QObject *parent)
     : QDBusAbstractAdaptor(parent),
@@ -97,10 +193,12 @@ ClientAdaptor::~ClientAdaptor()
 }
 
 ClientObserverAdaptor::ClientObserverAdaptor(ClientRegistrar *registrar,
+        ProxyReadinessTable *readiness,
         AbstractClientObserver *client,
         QObject *parent)
     : QDBusAbstractAdaptor(parent),
       mRegistrar(registrar),
+      mReadiness(readiness),
       mBus(registrar->dbusConnection()),
       mClient(client)
 {
@@ -127,26 +225,20 @@ void ClientObserverAdaptor::ObserveChannels(const QDBusObjectPath &accountPath,
     ContactFactoryConstPtr contactFactory = mRegistrar->contactFactory();
 
     SharedPtr<InvocationData> invocation(new InvocationData());
+    invocation->received.start();
 
     QList<PendingOperation *> readyOps;
 
-    PendingReady *accReady = accFactory->proxy(TP_QT_ACCOUNT_MANAGER_BUS_NAME,
-            accountPath.path(),
-            connFactory,
-            chanFactory,
-            contactFactory);
+    PendingReady *accReady = mReadiness->accountReady(accountPath.path());
     invocation->acc = AccountPtr::qObjectCast(accReady->proxy());
     readyOps.append(accReady);
 
-    QString connectionBusName = connectionPath.path().mid(1).replace(
-            QLatin1String("/"), QLatin1String("."));
-    PendingReady *connReady = connFactory->proxy(connectionBusName, connectionPath.path(),
-            chanFactory, contactFactory);
+    PendingReady *connReady = mReadiness->connectionReady(connectionPath.path());
     invocation->conn = ConnectionPtr::qObjectCast(connReady->proxy());
     readyOps.append(connReady);
 
     foreach (const ChannelDetails &channelDetails, channelDetailsList) {
-        PendingReady *chanReady = chanFactory->proxy(invocation->conn,
+        PendingReady *chanReady = mReadiness->channelReady(invocation->conn,
                 channelDetails.channel.path(), channelDetails.properties);
         ChannelPtr channel = ChannelPtr::qObjectCast(chanReady->proxy());
         invocation->chans.append(channel);
@@ -207,6 +299,11 @@ void ClientObserverAdaptor::ObserveChannels(const QDBusObjectPath &accountPath,
 
     invocation->ctx = MethodInvocationContextPtr<>(new MethodInvocationContext<>(mBus, message));
 
+    if (mClient->shouldReplyEarly() && !mClient->shouldRecover()) {
+        debug() << "Replying to ObserveChannels before preparing proxies for client" << mClient;
+        invocation->ctx->setFinished();
+    }
+
     invocation->readyOp = new PendingComposite(readyOps, invocation->ctx);
     connect(invocation->readyOp,
             SIGNAL(finished(Tp::PendingOperation*)),
@@ -230,6 +327,7 @@ void ClientObserverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
         }
 
         (*i)->readyOp = 0;
+        (*i)->preparationTime = int((*i)->received.elapsed());
 
         if (op->isError()) {
             warning() << "Preparing proxies for ObserveChannels failed with" << op->errorName()
@@ -251,6 +349,9 @@ void ClientObserverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
             continue;
         }
 
+        mReadiness->recordDispatch("ObserveChannels", invocation->preparationTime,
+                int(invocation->received.elapsed()) - invocation->preparationTime);
+
         debug() << "Invoking application observeChannels with" << invocation->chans.size()
             << "channels on" << mClient;
 
@@ -261,10 +362,12 @@ void ClientObserverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
 }
 
 ClientApproverAdaptor::ClientApproverAdaptor(ClientRegistrar *registrar,
+        ProxyReadinessTable *readiness,
         AbstractClientApprover *client,
         QObject *parent)
     : QDBusAbstractAdaptor(parent),
       mRegistrar(registrar),
+      mReadiness(readiness),
       mBus(registrar->dbusConnection()),
       mClient(client)
 {
@@ -290,18 +393,16 @@ void ClientApproverAdaptor::AddDispatchOperation(const Tp::ChannelDetailsList &c
             properties.value(
                 TP_QT_IFACE_CHANNEL_DISPATCH_OPERATION + QLatin1String(".Connection")));
     debug() << "addDispatchOperation: connection:" << connectionPath.path();
-    QString connectionBusName = connectionPath.path().mid(1).replace(
-            QLatin1String("/"), QLatin1String("."));
-    PendingReady *connReady = connFactory->proxy(connectionBusName, connectionPath.path(), chanFactory,
-                contactFactory);
+    PendingReady *connReady = mReadiness->connectionReady(connectionPath.path());
     ConnectionPtr connection = ConnectionPtr::qObjectCast(connReady->proxy());
     readyOps.append(connReady);
 
     SharedPtr<InvocationData> invocation(new InvocationData);
+    invocation->received.start();
 
     foreach (const ChannelDetails &channelDetails, channelDetailsList) {
-        PendingReady *chanReady = chanFactory->proxy(connection, channelDetails.channel.path(),
-                channelDetails.properties);
+        PendingReady *chanReady = mReadiness->channelReady(connection,
+                channelDetails.channel.path(), channelDetails.properties);
         invocation->chans.append(ChannelPtr::qObjectCast(chanReady->proxy()));
         readyOps.append(chanReady);
     }
@@ -333,6 +434,7 @@ void ClientApproverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
         }
 
         (*i)->readyOp = 0;
+        (*i)->preparationTime = int((*i)->received.elapsed());
 
         if (op->isError()) {
             warning() << "Preparing proxies for AddDispatchOperation failed with" << op->errorName()
@@ -354,6 +456,9 @@ void ClientApproverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
             continue;
         }
 
+        mReadiness->recordDispatch("AddDispatchOperation", invocation->preparationTime,
+                int(invocation->received.elapsed()) - invocation->preparationTime);
+
         debug() << "Invoking application addDispatchOperation with CDO"
             << invocation->dispatchOp->objectPath() << "on" << mClient;
 
@@ -364,10 +469,12 @@ void ClientApproverAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
 QHash<QPair<QString, QString>, QList<ClientHandlerAdaptor *> > ClientHandlerAdaptor::mAdaptorsForConnection;
 
 ClientHandlerAdaptor::ClientHandlerAdaptor(ClientRegistrar *registrar,
+        ProxyReadinessTable *readiness,
         AbstractClientHandler *client,
         QObject *parent)
     : QDBusAbstractAdaptor(parent),
       mRegistrar(registrar),
+      mReadiness(readiness),
       mBus(registrar->dbusConnection()),
       mClient(client)
 {
@@ -398,12 +505,8 @@ void ClientHandlerAdaptor::HandleChannels(const QDBusObjectPath &accountPath,
     debug() << "HandleChannels: account:" << accountPath.path() <<
         ", connection:" << connectionPath.path();
 
-    AccountFactoryConstPtr accFactory = mRegistrar->accountFactory();
-    ConnectionFactoryConstPtr connFactory = mRegistrar->connectionFactory();
-    ChannelFactoryConstPtr chanFactory = mRegistrar->channelFactory();
-    ContactFactoryConstPtr contactFactory = mRegistrar->contactFactory();
-
     SharedPtr<InvocationData> invocation(new InvocationData());
+    invocation->received.start();
     QList<PendingOperation *> readyOps;
 
     RequestTemporaryHandler *tempHandler = dynamic_cast<RequestTemporaryHandler *>(mClient);
@@ -413,23 +516,16 @@ void ClientHandlerAdaptor::HandleChannels(const QDBusObjectPath &accountPath,
         tempHandler->setDBusHandlerInvoked();
     }
 
-    PendingReady *accReady = accFactory->proxy(TP_QT_ACCOUNT_MANAGER_BUS_NAME,
-            accountPath.path(),
-            connFactory,
-            chanFactory,
-            contactFactory);
+    PendingReady *accReady = mReadiness->accountReady(accountPath.path());
     invocation->acc = AccountPtr::qObjectCast(accReady->proxy());
     readyOps.append(accReady);
 
-    QString connectionBusName = connectionPath.path().mid(1).replace(
-            QLatin1String("/"), QLatin1String("."));
-    PendingReady *connReady = connFactory->proxy(connectionBusName, connectionPath.path(),
-            chanFactory, contactFactory);
+    PendingReady *connReady = mReadiness->connectionReady(connectionPath.path());
     invocation->conn = ConnectionPtr::qObjectCast(connReady->proxy());
     readyOps.append(connReady);
 
     foreach (const ChannelDetails &channelDetails, channelDetailsList) {
-        PendingReady *chanReady = chanFactory->proxy(invocation->conn,
+        PendingReady *chanReady = mReadiness->channelReady(invocation->conn,
                 channelDetails.channel.path(), channelDetails.properties);
         ChannelPtr channel = ChannelPtr::qObjectCast(chanReady->proxy());
         invocation->chans.append(channel);
@@ -487,6 +583,7 @@ void ClientHandlerAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
         }
 
         (*i)->readyOp = 0;
+        (*i)->preparationTime = int((*i)->received.elapsed());
 
         if (op->isError()) {
             warning() << "Preparing proxies for HandleChannels failed with" << op->errorName()
@@ -514,6 +611,9 @@ void ClientHandlerAdaptor::onReadyOpFinished(Tp::PendingOperation *op)
             continue;
         }
 
+        mReadiness->recordDispatch("HandleChannels", invocation->preparationTime,
+                int(invocation->received.elapsed()) - invocation->preparationTime);
+
         debug() << "Invoking application handleChannels with" << invocation->chans.size()
             << "channels on" << mClient;
 
@@ -602,6 +702,13 @@ struct TP_QT_NO_EXPORT ClientRegistrar::Private
         if (chanFactory->dbusConnection().name() != bus.name()) {
             warning() << "  The D-Bus connection in the channel factory is not the proxy connection";
         }
+
+        readiness = new ProxyReadinessTable(accFactory, connFactory, chanFactory, contactFactory);
+    }
+
+    ~Private()
+    {
+        delete readiness;
     }
 
     QDBusConnection bus;
@@ -614,6 +721,8 @@ struct TP_QT_NO_EXPORT ClientRegistrar::Private
     QHash<AbstractClientPtr, QString> clients;
     QHash<AbstractClientPtr, QObject*> clientObjects;
     QSet<QString> services;
+
+    ProxyReadinessTable *readiness;
 };
 
 /**
@@ -917,7 +1026,7 @@ bool ClientRegistrar::registerClient(const AbstractClientPtr &client,
         dynamic_cast<AbstractClientHandler*>(client.data());
     if (handler) {
         // export o.f.T.Client.Handler
-        new ClientHandlerAdaptor(this, handler, object);
+        new ClientHandlerAdaptor(this, mPriv->readiness, handler, object);
         interfaces.append(
                 QLatin1String("org.freedesktop.Telepathy.Client.Handler"));
         if (handler->wantsRequestNotification()) {
@@ -933,7 +1042,7 @@ bool ClientRegistrar::registerClient(const AbstractClientPtr &client,
         dynamic_cast<AbstractClientObserver*>(client.data());
     if (observer) {
         // export o.f.T.Client.Observer
-        new ClientObserverAdaptor(this, observer, object);
+        new ClientObserverAdaptor(this, mPriv->readiness, observer, object);
         interfaces.append(
                 QLatin1String("org.freedesktop.Telepathy.Client.Observer"));
     }
@@ -942,7 +1051,7 @@ bool ClientRegistrar::registerClient(const AbstractClientPtr &client,
         dynamic_cast<AbstractClientApprover*>(client.data());
     if (approver) {
         // export o.f.T.Client.Approver
-        new ClientApproverAdaptor(this, approver, object);
+        new ClientApproverAdaptor(this, mPriv->readiness, approver, object);
         interfaces.append(
                 QLatin1String("org.freedesktop.Telepathy.Client.Approver"));
     }
@@ -1047,4 +1156,70 @@ void ClientRegistrar::unregisterClients()
     }
 }
 
+/**
+ * Return the number of ObserveChannels, AddDispatchOperation and HandleChannels calls dispatched
+ * to the clients registered on this client registrar.
+ *
+ * \return The number of dispatches.
+ * \sa averagePreparationTime(), averageQueueTime()
+ */
+quint64 ClientRegistrar::dispatches() const
+{
+    return mPriv->readiness->dispatches();
+}
+
+/**
+ * Return how long, on average, the account, connection and channel proxies of a dispatch took to
+ * become ready, from the moment the call was received.
+ *
+ * \return The average preparation time in milliseconds, or 0 if nothing was dispatched yet.
+ * \sa dispatches(), averageQueueTime()
+ */
+int ClientRegistrar::averagePreparationTime() const
+{
+    return mPriv->readiness->averagePreparationTime();
+}
+
+/**
+ * Return how long, on average, a dispatch waited for the earlier ones to be passed to their
+ * clients, once its proxies were ready.
+ *
+ * Calls are passed to the clients in the order they were received, so a dispatch whose proxies
+ * become ready quickly can still wait behind a slower one.
+ *
+ * \return The average queue time in milliseconds, or 0 if nothing was dispatched yet.
+ * \sa dispatches(), averagePreparationTime()
+ */
+int ClientRegistrar::averageQueueTime() const
+{
+    return mPriv->readiness->averageQueueTime();
+}
+
+/**
+ * Return the number of account, connection and channel proxies requested to be made ready for
+ * the dispatches to the clients registered on this client registrar.
+ *
+ * \return The number of proxy requests.
+ * \sa sharedProxyRequests()
+ */
+quint64 ClientRegistrar::proxyRequests() const
+{
+    return mPriv->readiness->requests();
+}
+
+/**
+ * Return the number of proxy requests which were served by a proxy already being made ready for
+ * another dispatch, instead of starting a new preparation.
+ *
+ * This happens when the channel dispatcher sends the same channels to several clients registered
+ * on this client registrar at about the same time.
+ *
+ * \return The number of shared proxy requests.
+ * \sa proxyRequests()
+ */
+quint64 ClientRegistrar::sharedProxyRequests() const
+{
+    return mPriv->readiness->sharedRequests();
+}
+
 } // Tp
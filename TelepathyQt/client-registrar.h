@@ -78,6 +78,12 @@ public:
     bool unregisterClient(const AbstractClientPtr &client);
     void unregisterClients();
 
+    quint64 dispatches() const;
+    int averagePreparationTime() const;
+    int averageQueueTime() const;
+    quint64 proxyRequests() const;
+    quint64 sharedProxyRequests() const;
+
 private:
     ClientRegistrar(const QDBusConnection &bus,
             const AccountFactoryConstPtr &accountFactory,
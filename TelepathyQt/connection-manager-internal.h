@@ -46,6 +46,8 @@ struct TP_QT_NO_EXPORT ConnectionManager::Private
     ~Private();
 
     bool parseConfigFile();
+    bool loadCachedProtocols();
+    void storeCachedProtocols();
 
     static void introspectMain(Private *self);
     void introspectProtocolsLegacy();
@@ -79,6 +81,10 @@ struct TP_QT_NO_EXPORT ConnectionManager::Private
     QQueue<QString> parametersQueue;
     ProtocolInfoList protocols;
     QSet<SharedPtr<ProtocolWrapper> > wrappers;
+
+    // On-disk cache of the introspected protocols
+    QString cacheKey;
+    bool introspectionPartial;
 };
 
 struct TP_QT_NO_EXPORT ConnectionManagerLowlevel::Private
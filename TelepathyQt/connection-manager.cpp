@@ -32,6 +32,7 @@
 
 #include "TelepathyQt/debug-internal.h"
 #include "TelepathyQt/manager-file.h"
+#include "TelepathyQt/protocol-info-cache-internal.h"
 
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/Constants>
@@ -43,6 +44,7 @@
 #include <TelepathyQt/Utils>
 
 #include <QDBusConnectionInterface>
+#include <QDataStream>
 #include <QQueue>
 #include <QStringList>
 #include <QTimer>
@@ -530,7 +532,8 @@ ConnectionManager::Private::Private(ConnectionManager *parent, const QString &na
       readinessHelper(parent->readinessHelper()),
       connFactory(connFactory),
       chanFactory(chanFactory),
-      contactFactory(contactFactory)
+      contactFactory(contactFactory),
+      introspectionPartial(false)
 {
     debug() << "Creating new ConnectionManager:" << parent->busName();
 
@@ -590,9 +593,186 @@ bool ConnectionManager::Private::parseConfigFile()
     return true;
 }
 
+// Only values QDataStream knows how to serialize without custom stream operators can be cached
+static bool isStorable(const QVariant &value)
+{
+    if (value.type() == QVariant::Map) {
+        foreach (const QVariant &item, value.toMap()) {
+            if (!isStorable(item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return value.userType() < QMetaType::User;
+}
+
+bool ConnectionManager::Private::loadCachedProtocols()
+{
+    QByteArray data;
+    if (!ProtocolInfoCache::instance()->load(name, cacheKey, data)) {
+        return false;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    QStringList cmInterfaces;
+    quint32 protocolsCount;
+    stream >> cmInterfaces >> protocolsCount;
+
+    ProtocolInfoList cachedProtocols;
+    for (quint32 i = 0; i < protocolsCount && stream.status() == QDataStream::Ok; ++i) {
+        QString protocolName;
+        stream >> protocolName;
+        ProtocolInfo info(ConnectionManagerPtr(parent), protocolName);
+
+        quint32 paramsCount;
+        stream >> paramsCount;
+        for (quint32 j = 0; j < paramsCount && stream.status() == QDataStream::Ok; ++j) {
+            ParamSpec spec;
+            QVariant defaultValue;
+            stream >> spec.name >> spec.flags >> spec.signature >> defaultValue;
+            spec.defaultValue = QDBusVariant(defaultValue);
+            info.addParameter(spec);
+        }
+
+        quint32 rccsCount;
+        stream >> rccsCount;
+        RequestableChannelClassList rccs;
+        for (quint32 j = 0; j < rccsCount && stream.status() == QDataStream::Ok; ++j) {
+            RequestableChannelClass rcc;
+            stream >> rcc.fixedProperties >> rcc.allowedProperties;
+            rccs.append(rcc);
+        }
+        info.setRequestableChannelClasses(rccs);
+
+        QString vcardField, englishName, iconName;
+        stream >> vcardField >> englishName >> iconName;
+        info.setVCardField(vcardField);
+        info.setEnglishName(englishName);
+        info.setIconName(iconName);
+
+        quint32 statusesCount;
+        stream >> statusesCount;
+        SimpleStatusSpecMap statuses;
+        for (quint32 j = 0; j < statusesCount && stream.status() == QDataStream::Ok; ++j) {
+            QString status;
+            SimpleStatusSpec spec;
+            stream >> status >> spec.type >> spec.maySetOnSelf >> spec.canHaveMessage;
+            statuses.insert(status, spec);
+        }
+        info.setAllowedPresenceStatuses(PresenceSpecList(statuses));
+
+        QStringList supportedMimeTypes;
+        quint32 minHeight, maxHeight, recommendedHeight;
+        quint32 minWidth, maxWidth, recommendedWidth, maxBytes;
+        stream >> supportedMimeTypes >> minHeight >> maxHeight >> recommendedHeight >>
+            minWidth >> maxWidth >> recommendedWidth >> maxBytes;
+        info.setAvatarRequirements(AvatarSpec(supportedMimeTypes,
+                    minHeight, maxHeight, recommendedHeight,
+                    minWidth, maxWidth, recommendedWidth,
+                    maxBytes));
+
+        QStringList vcardFields, uriSchemes;
+        stream >> vcardFields >> uriSchemes;
+        info.setAddressableVCardFields(vcardFields);
+        info.setAddressableUriSchemes(uriSchemes);
+
+        cachedProtocols.append(info);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        warning() << "Ignoring corrupt protocol cache for connection manager" << name;
+        return false;
+    }
+
+    debug() << "Got" << cachedProtocols.size() << "protocols for" << name << "from the cache";
+
+    if (!cmInterfaces.isEmpty()) {
+        parent->setInterfaces(cmInterfaces);
+        readinessHelper->setInterfaces(cmInterfaces);
+    }
+    protocols = cachedProtocols;
+    return true;
+}
+
+void ConnectionManager::Private::storeCachedProtocols()
+{
+    // Don't make a transient failure to introspect some protocol persistent
+    if (cacheKey.isEmpty() || introspectionPartial) {
+        return;
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    stream << parent->interfaces() << (quint32) protocols.size();
+
+    foreach (const ProtocolInfo &info, protocols) {
+        stream << info.name();
+
+        ProtocolParameterList params = info.parameters();
+        stream << (quint32) params.size();
+        foreach (const ProtocolParameter &param, params) {
+            if (!isStorable(param.defaultValue())) {
+                debug() << "Not caching protocols for" << name << "- parameter" <<
+                    param.name() << "has a complex default value";
+                return;
+            }
+            stream << param.name() << param.bareParameter().flags <<
+                param.dbusSignature().signature() << param.defaultValue();
+        }
+
+        RequestableChannelClassList rccs = info.capabilities().allClassSpecs().bareClasses();
+        stream << (quint32) rccs.size();
+        foreach (const RequestableChannelClass &rcc, rccs) {
+            if (!isStorable(rcc.fixedProperties)) {
+                debug() << "Not caching protocols for" << name << "- a requestable channel "
+                    "class has complex fixed properties";
+                return;
+            }
+            stream << rcc.fixedProperties << rcc.allowedProperties;
+        }
+
+        stream << info.vcardField() << info.englishName() << info.iconName();
+
+        SimpleStatusSpecMap statuses = info.allowedPresenceStatuses().bareSpecs();
+        stream << (quint32) statuses.size();
+        SimpleStatusSpecMap::const_iterator i = statuses.constBegin();
+        SimpleStatusSpecMap::const_iterator end = statuses.constEnd();
+        for (; i != end; ++i) {
+            stream << i.key() << i.value().type << i.value().maySetOnSelf <<
+                i.value().canHaveMessage;
+        }
+
+        AvatarSpec avatarReqs = info.avatarRequirements();
+        stream << avatarReqs.supportedMimeTypes() <<
+            (quint32) avatarReqs.minimumHeight() << (quint32) avatarReqs.maximumHeight() <<
+            (quint32) avatarReqs.recommendedHeight() << (quint32) avatarReqs.minimumWidth() <<
+            (quint32) avatarReqs.maximumWidth() << (quint32) avatarReqs.recommendedWidth() <<
+            (quint32) avatarReqs.maximumBytes();
+
+        stream << info.addressableVCardFields() << info.addressableUriSchemes();
+    }
+
+    ProtocolInfoCache::instance()->store(name, cacheKey, data);
+}
+
 void ConnectionManager::Private::introspectMain(ConnectionManager::Private *self)
 {
+    // Warm start: the protocols of an unchanged CM installation are read back from the disk cache
+    // shared by all clients, without parsing the .manager file or any D-Bus traffic
+    self->cacheKey = ProtocolInfoCache::sourceKey(self->name);
+    if (self->loadCachedProtocols()) {
+        self->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+        return;
+    }
+
     if (self->parseConfigFile()) {
+        self->storeCachedProtocols();
         self->readinessHelper->setIntrospectCompleted(FeatureCore, true);
         return;
     }
@@ -1055,6 +1235,7 @@ void ConnectionManager::gotProtocolsLegacy(QDBusPendingCallWatcher *watcher)
             mPriv->introspectParametersLegacy();
         } else {
             //no protocols - introspection finished
+            mPriv->storeCachedProtocols();
             mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
         }
     } else {
@@ -1099,6 +1280,7 @@ void ConnectionManager::gotParametersLegacy(QDBusPendingCallWatcher *watcher)
     } else {
         // let's remove this protocol as we can't get the params
         mPriv->protocols.removeAt(pos);
+        mPriv->introspectionPartial = true;
 
         warning().nospace() <<
             QString(QLatin1String("ConnectionManager.GetParameters(%1) failed: ")).arg(protocolName) <<
@@ -1107,6 +1289,7 @@ void ConnectionManager::gotParametersLegacy(QDBusPendingCallWatcher *watcher)
 
     if (mPriv->parametersQueue.isEmpty()) {
         if (!mPriv->protocols.isEmpty()) {
+            mPriv->storeCachedProtocols();
             mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
         } else {
             // we could not retrieve the params for any protocol, fail core.
@@ -1131,10 +1314,12 @@ void ConnectionManager::onProtocolReady(Tp::PendingOperation *op)
     } else {
         warning().nospace() << "Protocol(" << info.name() << ")::becomeReady "
             "failed: " << op->errorName() << ": " << op->errorMessage();
+        mPriv->introspectionPartial = true;
     }
 
     if (mPriv->wrappers.isEmpty()) {
         if (!mPriv->protocols.isEmpty()) {
+            mPriv->storeCachedProtocols();
             mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
         } else {
             // we could not make any Protocol objects ready, fail core.
@@ -31,6 +31,7 @@
 #include "TelepathyQt/_gen/connection-lowlevel.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/method-index-internal.h"
 
 #include <TelepathyQt/ChannelFactory>
 #include <TelepathyQt/ConnectionCapabilities>
@@ -46,6 +47,9 @@
 #include <TelepathyQt/PendingVoid>
 #include <TelepathyQt/ReferencedHandles>
 
+#include <QDBusPendingCall>
+#include <QDBusPendingCallWatcher>
+#include <QHash>
 #include <QMetaObject>
 #include <QMutex>
 #include <QMutexLocker>
@@ -80,7 +84,12 @@ struct TP_QT_NO_EXPORT Connection::Private
     static void introspectBalance(Private *self);
     static void introspectConnected(Private *self);
 
+    void watchMainIntrospectionCall(const QDBusPendingCall &call, const MethodIndex &slot);
+    bool isCurrentMainIntrospectionReply(QDBusPendingCallWatcher *watcher);
     void continueMainIntrospection();
+    void finishMainIntrospectionStep();
+    void prefetchRequestedFeatures();
+    QDBusPendingCallWatcher *prefetchedWatcher(const QString &interface);
     void setCurrentStatus(uint status);
     void forceCurrentStatus(uint status);
     void setInterfaces(const QStringList &interfaces);
@@ -111,6 +120,17 @@ struct TP_QT_NO_EXPORT Connection::Private
 
     // Introspection
     QQueue<void (Private::*)()> introspectMainQueue;
+    // The queued steps don't depend on each other, so they are all started at once and FeatureCore
+    // is completed when the last of them lands
+    int introspectMainInFlight;
+    bool introspectMainFailed;
+    // Bumped on every introspectMain() round, replies to the calls of an earlier round must not
+    // touch the counters above
+    uint introspectMainGeneration;
+    QHash<QDBusPendingCallWatcher *, uint> introspectMainCalls;
+    // Property fetches for the other requested features, started as soon as the interfaces are
+    // known instead of waiting for FeatureCore to complete, keyed by interface
+    QHash<QString, QDBusPendingCall> prefetchedCalls;
 
     // FeatureCore
     // keep pendingStatus and pendingStatusReason until we emit statusChanged
@@ -173,23 +193,43 @@ struct TP_QT_NO_EXPORT Connection::Private::HandleContext
         QHash<uint, uint> refcounts;
         QSet<uint> toRelease;
         uint requestsInFlight;
-        bool releaseScheduled;
 
         Type()
-            : requestsInFlight(0),
-              releaseScheduled(false)
+            : requestsInFlight(0)
         {
         }
+
+        inline void ref(uint handle)
+        {
+            // Only a handle which had lost all of its references can be pending release
+            if (!refcounts[handle]++ && !toRelease.isEmpty()) {
+                toRelease.remove(handle);
+            }
+        }
+
+        inline void unref(uint handle)
+        {
+            QHash<uint, uint>::iterator i = refcounts.find(handle);
+            Q_ASSERT(i != refcounts.end());
+
+            if (!--i.value()) {
+                refcounts.erase(i);
+                toRelease.insert(handle);
+            }
+        }
     };
 
     HandleContext()
-        : refcount(0)
+        : refcount(0),
+          releaseScheduled(false)
     {
     }
 
     int refcount;
     QMutex lock;
     QHash<uint, Type> types;
+    // A single release sweep covers every handle type
+    bool releaseScheduled;
 };
 
 Connection::Private::Private(Connection *parent,
@@ -203,6 +243,9 @@ Connection::Private::Private(Connection *parent,
       properties(parent->interface<Client::DBus::PropertiesInterface>()),
       simplePresence(0),
       readinessHelper(parent->readinessHelper()),
+      introspectMainInFlight(0),
+      introspectMainFailed(false),
+      introspectMainGeneration(0),
       introspectingConnected(false),
       pendingStatus((uint) -1),
       pendingStatusReason(ConnectionStatusReasonNoneSpecified),
@@ -402,73 +445,70 @@ void Connection::Private::init()
 
 void Connection::Private::introspectMain(Connection::Private *self)
 {
+    static const MethodIndex gotMainPropertiesSlot(&Connection::staticMetaObject,
+            "gotMainProperties(QDBusPendingCallWatcher*)");
+
+    self->introspectMainInFlight = 0;
+    self->introspectMainFailed = false;
+    ++self->introspectMainGeneration;
+    self->introspectMainCalls.clear();
+
     debug() << "Calling Properties::GetAll(Connection)";
-    QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(
-                self->properties->GetAll(TP_QT_IFACE_CONNECTION),
-                self->parent);
-    self->parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotMainProperties(QDBusPendingCallWatcher*)));
+    self->watchMainIntrospectionCall(self->properties->GetAll(TP_QT_IFACE_CONNECTION),
+            gotMainPropertiesSlot);
 }
 
 void Connection::Private::introspectMainFallbackStatus()
 {
+    static const MethodIndex gotStatusSlot(&Connection::staticMetaObject,
+            "gotStatus(QDBusPendingCallWatcher*)");
+
     debug() << "Calling GetStatus()";
-    QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(baseInterface->GetStatus(),
-                parent);
-    parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotStatus(QDBusPendingCallWatcher*)));
+    watchMainIntrospectionCall(baseInterface->GetStatus(), gotStatusSlot);
 }
 
 void Connection::Private::introspectMainFallbackInterfaces()
 {
+    static const MethodIndex gotInterfacesSlot(&Connection::staticMetaObject,
+            "gotInterfaces(QDBusPendingCallWatcher*)");
+
     debug() << "Calling GetInterfaces()";
-    QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(baseInterface->GetInterfaces(),
-                parent);
-    parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotInterfaces(QDBusPendingCallWatcher*)));
+    watchMainIntrospectionCall(baseInterface->GetInterfaces(), gotInterfacesSlot);
 }
 
 void Connection::Private::introspectMainFallbackSelfHandle()
 {
+    static const MethodIndex gotSelfHandleSlot(&Connection::staticMetaObject,
+            "gotSelfHandle(QDBusPendingCallWatcher*)");
+
     debug() << "Calling GetSelfHandle()";
-    QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(baseInterface->GetSelfHandle(),
-                parent);
-    parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotSelfHandle(QDBusPendingCallWatcher*)));
+    watchMainIntrospectionCall(baseInterface->GetSelfHandle(), gotSelfHandleSlot);
 }
 
 void Connection::Private::introspectCapabilities()
 {
+    static const MethodIndex gotCapabilitiesSlot(&Connection::staticMetaObject,
+            "gotCapabilities(QDBusPendingCallWatcher*)");
+
     debug() << "Retrieving capabilities";
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+    watchMainIntrospectionCall(
             properties->Get(
                 TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS,
-                QLatin1String("RequestableChannelClasses")), parent);
-    parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotCapabilities(QDBusPendingCallWatcher*)));
+                QLatin1String("RequestableChannelClasses")),
+            gotCapabilitiesSlot);
 }
 
 void Connection::Private::introspectContactAttributeInterfaces()
 {
+    static const MethodIndex gotContactAttributeInterfacesSlot(&Connection::staticMetaObject,
+            "gotContactAttributeInterfaces(QDBusPendingCallWatcher*)");
+
     debug() << "Retrieving contact attribute interfaces";
-    QDBusPendingCall call =
-        properties->Get(
+    watchMainIntrospectionCall(
+            properties->Get(
                 TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS,
-                QLatin1String("ContactAttributeInterfaces"));
-    QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(call, parent);
-    parent->connect(watcher,
-                    SIGNAL(finished(QDBusPendingCallWatcher*)),
-                    SLOT(gotContactAttributeInterfaces(QDBusPendingCallWatcher*)));
+                QLatin1String("ContactAttributeInterfaces")),
+            gotContactAttributeInterfacesSlot);
 }
 
 void Connection::Private::introspectSelfContact(Connection::Private *self)
@@ -489,18 +529,22 @@ void Connection::Private::introspectSelfContact(Connection::Private *self)
 
 void Connection::Private::introspectSimplePresence(Connection::Private *self)
 {
+    static const MethodIndex gotSimpleStatusesSlot(&Connection::staticMetaObject,
+            "gotSimpleStatuses(QDBusPendingCallWatcher*)");
+
     Q_ASSERT(self->properties != 0);
 
-    debug() << "Calling Properties::Get("
-        "Connection.I.SimplePresence.Statuses)";
-    QDBusPendingCall call =
-        self->properties->GetAll(
-                TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE);
     QDBusPendingCallWatcher *watcher =
-        new QDBusPendingCallWatcher(call, self->parent);
-    self->parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotSimpleStatuses(QDBusPendingCallWatcher*)));
+        self->prefetchedWatcher(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE);
+    if (watcher) {
+        connectPendingCallWatcher(watcher, self->parent, gotSimpleStatusesSlot);
+    } else {
+        debug() << "Calling Properties::Get("
+            "Connection.I.SimplePresence.Statuses)";
+        watchPendingCall(self->properties->GetAll(
+                    TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE),
+                self->parent, gotSimpleStatusesSlot);
+    }
 }
 
 void Connection::Private::introspectRoster(Connection::Private *self)
@@ -525,6 +569,9 @@ void Connection::Private::introspectRosterGroups(Connection::Private *self)
 
 void Connection::Private::introspectBalance(Connection::Private *self)
 {
+    static const MethodIndex gotBalanceSlot(&Connection::staticMetaObject,
+            "gotBalance(QDBusPendingCallWatcher*)");
+
     debug() << "Introspecting balance";
 
     // we already checked if balance interface exists, so bypass requests
@@ -537,14 +584,17 @@ void Connection::Private::introspectBalance(Connection::Private *self)
             SIGNAL(BalanceChanged(Tp::CurrencyAmount)),
             SLOT(onBalanceChanged(Tp::CurrencyAmount)));
 
-    debug() << "Retrieving balance";
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
-            self->properties->Get(
-                TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE,
-                QLatin1String("AccountBalance")), self->parent);
-    self->parent->connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(gotBalance(QDBusPendingCallWatcher*)));
+    QDBusPendingCallWatcher *watcher =
+        self->prefetchedWatcher(TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE);
+    if (watcher) {
+        connectPendingCallWatcher(watcher, self->parent, gotBalanceSlot);
+    } else {
+        debug() << "Retrieving balance";
+        watchPendingCall(self->properties->Get(
+                    TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE,
+                    QLatin1String("AccountBalance")),
+                self->parent, gotBalanceSlot);
+    }
 }
 
 void Connection::Private::introspectConnected(Connection::Private *self)
@@ -558,6 +608,24 @@ void Connection::Private::introspectConnected(Connection::Private *self)
     }
 }
 
+void Connection::Private::watchMainIntrospectionCall(const QDBusPendingCall &call,
+        const MethodIndex &slot)
+{
+    introspectMainCalls.insert(watchPendingCall(call, parent, slot), introspectMainGeneration);
+}
+
+bool Connection::Private::isCurrentMainIntrospectionReply(QDBusPendingCallWatcher *watcher)
+{
+    // Calls of earlier rounds were forgotten when the current one started
+    if (introspectMainCalls.take(watcher) != introspectMainGeneration) {
+        debug() << "Ignoring reply to a call made by an earlier round of main introspection";
+        watcher->deleteLater();
+        return false;
+    }
+
+    return true;
+}
+
 void Connection::Private::continueMainIntrospection()
 {
     if (!parent->isValid()) {
@@ -565,11 +633,60 @@ void Connection::Private::continueMainIntrospection()
         return;
     }
 
-    if (introspectMainQueue.isEmpty()) {
-        readinessHelper->setIntrospectCompleted(FeatureCore, true);
-    } else {
+    while (!introspectMainQueue.isEmpty()) {
+        ++introspectMainInFlight;
         (this->*(introspectMainQueue.dequeue()))();
     }
+
+    if (!introspectMainInFlight && !introspectMainFailed) {
+        readinessHelper->setIntrospectCompleted(FeatureCore, true);
+    }
+}
+
+void Connection::Private::finishMainIntrospectionStep()
+{
+    Q_ASSERT(introspectMainInFlight > 0);
+    --introspectMainInFlight;
+    continueMainIntrospection();
+}
+
+void Connection::Private::prefetchRequestedFeatures()
+{
+    Features requested = readinessHelper->requestedFeatures();
+
+    if (requested.contains(FeatureSimplePresence) &&
+        (pendingStatus == ConnectionStatusDisconnected ||
+         pendingStatus == ConnectionStatusConnected) &&
+        parent->hasInterface(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE) &&
+        !prefetchedCalls.contains(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE)) {
+        debug() << "Prefetching Connection.I.SimplePresence properties";
+        prefetchedCalls.insert(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+                properties->GetAll(TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE));
+    }
+
+    if (requested.contains(FeatureAccountBalance) &&
+        pendingStatus == ConnectionStatusConnected &&
+        parent->hasInterface(TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE) &&
+        !prefetchedCalls.contains(TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE)) {
+        debug() << "Prefetching balance";
+        prefetchedCalls.insert(TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE,
+                properties->Get(TP_QT_IFACE_CONNECTION_INTERFACE_BALANCE,
+                    QLatin1String("AccountBalance")));
+    }
+}
+
+QDBusPendingCallWatcher *Connection::Private::prefetchedWatcher(const QString &interface)
+{
+    QHash<QString, QDBusPendingCall>::iterator i = prefetchedCalls.find(interface);
+    if (i == prefetchedCalls.end()) {
+        return 0;
+    }
+
+    debug() << "Using prefetched properties for" << interface;
+    // If the call has already finished, the watcher emits finished() once back in the mainloop
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(i.value(), parent);
+    prefetchedCalls.erase(i);
+    return watcher;
 }
 
 void Connection::Private::setCurrentStatus(uint status)
@@ -582,6 +699,8 @@ void Connection::Private::setCurrentStatus(uint status)
     // pending introspect ops from our local introspection queue when it's waiting for us.
 
     introspectMainQueue.clear();
+    // The prefetched replies might not be valid for the new status
+    prefetchedCalls.clear();
 
     if (introspectingConnected) {
         // On the other hand, we have to finish the Connected introspection for now, as
@@ -1526,6 +1645,10 @@ void Connection::onConnectionError(const QString &error,
 
 void Connection::gotMainProperties(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<QVariantMap> reply = *watcher;
     QVariantMap props;
 
@@ -1580,6 +1703,12 @@ void Connection::gotMainProperties(QDBusPendingCallWatcher *watcher)
                 &Private::introspectContactAttributeInterfaces);
     }
 
+    // Don't wait for FeatureCore to fetch the properties of the other requested features, so that
+    // they are all in flight together with the remaining core steps
+    if (props.contains(QLatin1String("Interfaces"))) {
+        mPriv->prefetchRequestedFeatures();
+    }
+
     mPriv->continueMainIntrospection();
 
     watcher->deleteLater();
@@ -1587,15 +1716,21 @@ void Connection::gotMainProperties(QDBusPendingCallWatcher *watcher)
 
 void Connection::gotStatus(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<uint> reply = *watcher;
 
     if (!reply.isError()) {
         mPriv->forceCurrentStatus(reply.value());
 
-        mPriv->continueMainIntrospection();
+        mPriv->finishMainIntrospectionStep();
     } else {
         warning().nospace() << "GetStatus() failed with " <<
             reply.error().name() << ": " << reply.error().message();
+        --mPriv->introspectMainInFlight;
+        mPriv->introspectMainFailed = true;
         mPriv->invalidateResetCaps(reply.error().name(), reply.error().message());
     }
 
@@ -1604,6 +1739,10 @@ void Connection::gotStatus(QDBusPendingCallWatcher *watcher)
 
 void Connection::gotInterfaces(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<QStringList> reply = *watcher;
 
     if (!reply.isError()) {
@@ -1616,25 +1755,33 @@ void Connection::gotInterfaces(QDBusPendingCallWatcher *watcher)
         // let's not fail if GetInterfaces fail
     }
 
-    mPriv->continueMainIntrospection();
+    mPriv->finishMainIntrospectionStep();
 
     watcher->deleteLater();
 }
 
 void Connection::gotSelfHandle(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<uint> reply = *watcher;
 
     if (!reply.isError()) {
         mPriv->selfHandle = reply.value();
         debug() << "Got self handle:" << mPriv->selfHandle;
 
-        mPriv->continueMainIntrospection();
+        mPriv->finishMainIntrospectionStep();
     } else {
         warning().nospace() << "GetSelfHandle() failed with " <<
             reply.error().name() << ": " << reply.error().message();
-        mPriv->readinessHelper->setIntrospectCompleted(FeatureCore,
-                false, reply.error());
+        --mPriv->introspectMainInFlight;
+        if (!mPriv->introspectMainFailed) {
+            mPriv->introspectMainFailed = true;
+            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore,
+                    false, reply.error());
+        }
     }
 
     watcher->deleteLater();
@@ -1642,6 +1789,10 @@ void Connection::gotSelfHandle(QDBusPendingCallWatcher *watcher)
 
 void Connection::gotCapabilities(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<QDBusVariant> reply = *watcher;
 
     if (!reply.isError()) {
@@ -1654,13 +1805,17 @@ void Connection::gotCapabilities(QDBusPendingCallWatcher *watcher)
         // let's not fail if retrieving capabilities fail
     }
 
-    mPriv->continueMainIntrospection();
+    mPriv->finishMainIntrospectionStep();
 
     watcher->deleteLater();
 }
 
 void Connection::gotContactAttributeInterfaces(QDBusPendingCallWatcher *watcher)
 {
+    if (!mPriv->isCurrentMainIntrospectionReply(watcher)) {
+        return;
+    }
+
     QDBusPendingReply<QDBusVariant> reply = *watcher;
 
     if (!reply.isError()) {
@@ -1673,7 +1828,7 @@ void Connection::gotContactAttributeInterfaces(QDBusPendingCallWatcher *watcher)
         // TODO should we remove Contacts interface from interfaces?
     }
 
-    mPriv->continueMainIntrospection();
+    mPriv->finishMainIntrospectionStep();
 
     watcher->deleteLater();
 }
@@ -2310,11 +2465,25 @@ void Connection::refHandle(HandleType handleType, uint handle)
     Private::HandleContext *handleContext = mPriv->handleContext;
     QMutexLocker locker(&handleContext->lock);
 
-    if (handleContext->types[handleType].toRelease.contains(handle)) {
-        handleContext->types[handleType].toRelease.remove(handle);
+    handleContext->types[handleType].ref(handle);
+}
+
+/**
+ * Reference all of \a handles at once, taking the handle context lock only once.
+ */
+void Connection::refHandles(HandleType handleType, const UIntList &handles)
+{
+    if (mPriv->immortalHandles || handles.isEmpty()) {
+        return;
     }
 
-    handleContext->types[handleType].refcounts[handle]++;
+    Private::HandleContext *handleContext = mPriv->handleContext;
+    QMutexLocker locker(&handleContext->lock);
+
+    Private::HandleContext::Type &type = handleContext->types[handleType];
+    for (UIntList::const_iterator i = handles.constBegin(); i != handles.constEnd(); ++i) {
+        type.ref(*i);
+    }
 }
 
 void Connection::unrefHandle(HandleType handleType, uint handle)
@@ -2327,28 +2496,17 @@ void Connection::unrefHandle(HandleType handleType, uint handle)
     QMutexLocker locker(&handleContext->lock);
 
     Q_ASSERT(handleContext->types.contains(handleType));
-    Q_ASSERT(handleContext->types[handleType].refcounts.contains(handle));
-
-    if (!--handleContext->types[handleType].refcounts[handle]) {
-        handleContext->types[handleType].refcounts.remove(handle);
-        handleContext->types[handleType].toRelease.insert(handle);
-
-        if (!handleContext->types[handleType].releaseScheduled) {
-            if (!handleContext->types[handleType].requestsInFlight) {
-                debug() << "Lost last reference to at least one handle of type" <<
-                    handleType <<
-                    "and no requests in flight for that type - scheduling a release sweep";
-                QMetaObject::invokeMethod(this, "doReleaseSweep",
-                        Qt::QueuedConnection, Q_ARG(uint, handleType));
-                handleContext->types[handleType].releaseScheduled = true;
-            }
-        }
-    }
+
+    handleContext->types[handleType].unref(handle);
+    scheduleReleaseSweep(handleType);
 }
 
-void Connection::doReleaseSweep(uint handleType)
+/**
+ * Unreference all of \a handles at once, taking the handle context lock only once.
+ */
+void Connection::unrefHandles(HandleType handleType, const UIntList &handles)
 {
-    if (mPriv->immortalHandles) {
+    if (mPriv->immortalHandles || handles.isEmpty()) {
         return;
     }
 
@@ -2356,25 +2514,63 @@ void Connection::doReleaseSweep(uint handleType)
     QMutexLocker locker(&handleContext->lock);
 
     Q_ASSERT(handleContext->types.contains(handleType));
-    Q_ASSERT(handleContext->types[handleType].releaseScheduled);
 
-    debug() << "Entering handle release sweep for type" << handleType;
-    handleContext->types[handleType].releaseScheduled = false;
+    Private::HandleContext::Type &type = handleContext->types[handleType];
+    for (UIntList::const_iterator i = handles.constBegin(); i != handles.constEnd(); ++i) {
+        type.unref(*i);
+    }
+    scheduleReleaseSweep(handleType);
+}
 
-    if (handleContext->types[handleType].requestsInFlight > 0) {
-        debug() << " There are requests in flight, deferring sweep to when they have been completed";
-        return;
+// Must be called with the handle context lock held
+void Connection::scheduleReleaseSweep(HandleType handleType)
+{
+    Private::HandleContext *handleContext = mPriv->handleContext;
+    const Private::HandleContext::Type &type = handleContext->types[handleType];
+
+    if (!handleContext->releaseScheduled && !type.requestsInFlight && !type.toRelease.isEmpty()) {
+        debug() << "Lost last reference to at least one handle of type" <<
+            handleType <<
+            "and no requests in flight for that type - scheduling a release sweep";
+        QMetaObject::invokeMethod(this, "doReleaseSweep", Qt::QueuedConnection);
+        handleContext->releaseScheduled = true;
     }
+}
 
-    if (handleContext->types[handleType].toRelease.isEmpty()) {
-        debug() << " No handles to release - every one has been resurrected";
+void Connection::doReleaseSweep()
+{
+    if (mPriv->immortalHandles) {
         return;
     }
 
-    debug() << " Releasing" << handleContext->types[handleType].toRelease.size() << "handles";
+    Private::HandleContext *handleContext = mPriv->handleContext;
+    QMutexLocker locker(&handleContext->lock);
+
+    Q_ASSERT(handleContext->releaseScheduled);
+
+    debug() << "Entering handle release sweep";
+    handleContext->releaseScheduled = false;
 
-    mPriv->baseInterface->ReleaseHandles(handleType, handleContext->types[handleType].toRelease.toList());
-    handleContext->types[handleType].toRelease.clear();
+    QHash<uint, Private::HandleContext::Type>::iterator i = handleContext->types.begin();
+    for (; i != handleContext->types.end(); ++i) {
+        uint handleType = i.key();
+        Private::HandleContext::Type &type = i.value();
+
+        if (type.toRelease.isEmpty()) {
+            continue;
+        }
+
+        if (type.requestsInFlight > 0) {
+            debug() << " There are requests in flight for handle type" << handleType <<
+                "deferring its sweep to when they have been completed";
+            continue;
+        }
+
+        debug() << " Releasing" << type.toRelease.size() << "handles of type" << handleType;
+
+        mPriv->baseInterface->ReleaseHandles(handleType, type.toRelease.toList());
+        type.toRelease.clear();
+    }
 }
 
 void Connection::handleRequestLanded(HandleType handleType)
@@ -2389,13 +2585,8 @@ void Connection::handleRequestLanded(HandleType handleType)
     Q_ASSERT(handleContext->types.contains(handleType));
     Q_ASSERT(handleContext->types[handleType].requestsInFlight > 0);
 
-    if (!--handleContext->types[handleType].requestsInFlight &&
-        !handleContext->types[handleType].toRelease.isEmpty() &&
-        !handleContext->types[handleType].releaseScheduled) {
-        debug() << "All handle requests for type" << handleType <<
-            "landed and there are handles of that type to release - scheduling a release sweep";
-        QMetaObject::invokeMethod(this, "doReleaseSweep", Qt::QueuedConnection, Q_ARG(uint, handleType));
-        handleContext->types[handleType].releaseScheduled = true;
+    if (!--handleContext->types[handleType].requestsInFlight) {
+        scheduleReleaseSweep(handleType);
     }
 }
 
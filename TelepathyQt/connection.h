@@ -216,7 +216,7 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void onIntrospectRosterFinished(Tp::PendingOperation *op);
     TP_QT_NO_EXPORT void onIntrospectRosterGroupsFinished(Tp::PendingOperation *op);
 
-    TP_QT_NO_EXPORT void doReleaseSweep(uint handleType);
+    TP_QT_NO_EXPORT void doReleaseSweep();
 
     TP_QT_NO_EXPORT void onSelfHandleChanged(uint);
 
@@ -234,7 +234,10 @@ private:
     friend class ReferencedHandles;
 
     TP_QT_NO_EXPORT void refHandle(HandleType handleType, uint handle);
+    TP_QT_NO_EXPORT void refHandles(HandleType handleType, const UIntList &handles);
     TP_QT_NO_EXPORT void unrefHandle(HandleType handleType, uint handle);
+    TP_QT_NO_EXPORT void unrefHandles(HandleType handleType, const UIntList &handles);
+    TP_QT_NO_EXPORT void scheduleReleaseSweep(HandleType handleType);
     TP_QT_NO_EXPORT void handleRequestLanded(HandleType handleType);
 
     struct Private;
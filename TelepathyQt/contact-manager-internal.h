@@ -26,11 +26,13 @@
 #include <TelepathyQt/ContactManager>
 #include <TelepathyQt/Global>
 #include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/ReferencedHandles>
 #include <TelepathyQt/Types>
 
 #include <QList>
 #include <QObject>
 #include <QQueue>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 
@@ -383,6 +385,36 @@ private:
     QSet<uint> mToRequest;
 };
 
+class TP_QT_NO_EXPORT ContactManager::PendingAttributesBatch : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    PendingAttributesBatch(const ConnectionPtr &conn);
+    ~PendingAttributesBatch();
+
+    void addRequest(const QSet<uint> &handles, const QStringList &interfaces);
+    int requests() const { return mRequests; }
+
+    void flush();
+    void cancel();
+
+    ReferencedHandles validHandles() const { return mValidHandles; }
+    ContactAttributesMap attributes() const { return mAttributes; }
+
+private Q_SLOTS:
+    void onAttributesFinished(Tp::PendingOperation *op);
+
+private:
+    ConnectionPtr mConn;
+    int mRequests;
+    int mHandlesRequested;
+    QSet<uint> mHandles;
+    QSet<QString> mInterfaces;
+    ReferencedHandles mValidHandles;
+    ContactAttributesMap mAttributes;
+};
+
 } // Tp
 
 #endif
@@ -25,8 +25,10 @@
 
 #include "TelepathyQt/_gen/contact-manager.moc.hpp"
 
+#include "TelepathyQt/avatar-cache-internal.h"
 #include "TelepathyQt/debug-internal.h"
 #include "TelepathyQt/future-internal.h"
+#include "TelepathyQt/method-index-internal.h"
 
 #include <TelepathyQt/AvatarData>
 #include <TelepathyQt/Connection>
@@ -41,19 +43,38 @@
 #include <TelepathyQt/ReferencedHandles>
 #include <TelepathyQt/Utils>
 
+#include <QElapsedTimer>
 #include <QMap>
+#include <QTimer>
 
 namespace Tp
 {
 
+// Defaults for the avatar fetch pipeline, see setAvatarRequestBatchSize(),
+// setMaxConcurrentAvatarRequests() and setAvatarRequestGracePeriod()
+static const int AVATAR_REQUEST_BATCH_SIZE = 50;
+static const int AVATAR_REQUEST_MAX_BATCHES = 2;
+// The CM does not emit AvatarRetrieved for contacts without an avatar, so a batch may never be
+// fully answered. It stops counting towards the concurrency limit a grace period after the
+// RequestAvatars reply, which CMs send once they have started fetching, or after the timeout if
+// the reply doesn't come.
+static const int AVATAR_REQUEST_GRACE_PERIOD = 1000;
+static const int AVATAR_REQUEST_BATCH_TIMEOUT = 10000;
+
 struct TP_QT_NO_EXPORT ContactManager::Private
 {
     Private(ContactManager *parent, Connection *connection);
     ~Private();
 
     // avatar specific methods
-    bool buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName);
+    QString avatarFileName(const QString &token);
+    void requestAvatars(const UIntList &handles);
+    bool queueAvatarRequest(uint handle);
+    void sendAvatarRequests();
+    void finishAvatarRequest(uint handle, bool retrieved);
+    void forgetAvatarRequest(uint handle, bool retrieved);
+    void finishAvatarBatch(uint batchId);
+    void scheduleAvatarBatchTimeout();
     Features realFeatures(const Features &features);
     QSet<QString> interfacesForFeatures(const Features &features);
 
@@ -67,11 +88,73 @@ struct TP_QT_NO_EXPORT ContactManager::Private
     Features supportedFeatures;
 
     // avatar
+    struct AvatarStore
+    {
+        QString token;
+        QString mimeType;
+        QSet<uint> handles;
+    };
+
+    struct AvatarRequest
+    {
+        QElapsedTimer queued;
+        // empty if the token is not known
+        QString avatarFileName;
+    };
+
+    struct AvatarBatch
+    {
+        AvatarBatch() { replied.invalidate(); }
+
+        int remainingTime(int gracePeriod) const;
+
+        QSet<uint> handles;
+        QElapsedTimer sent;
+        // invalid until the RequestAvatars reply arrives
+        QElapsedTimer replied;
+    };
+
     QSet<ContactPtr> requestAvatarsQueue;
     bool requestAvatarsIdle;
+    QString avatarDirectory;
+    // avatar file name -> handles waiting for the disk cache to be checked
+    QHash<QString, QSet<uint> > avatarLoadsPending;
+    // avatar file name -> retrieved avatar being written to the disk cache
+    QHash<QString, AvatarStore> avatarStoresPending;
+    // handles waiting for a RequestAvatars batch, in request order
+    QList<uint> avatarRequestQueue;
+    // handles queued or in flight -> request
+    QHash<uint, AvatarRequest> avatarRequests;
+    // avatar file name -> handle the avatar is being requested for
+    QHash<QString, uint> avatarRequestsByFile;
+    // avatar file name -> other handles with the same token, served by that request
+    QHash<QString, QSet<uint> > avatarRequestWaiters;
+    QHash<uint, AvatarBatch> avatarBatches;
+    QHash<uint, uint> avatarBatchByHandle;
+    QHash<QDBusPendingCallWatcher *, uint> avatarBatchWatchers;
+    QTimer *avatarBatchTimer;
+    uint nextAvatarBatchId;
+    QSet<uint> visibleHandles;
+    int avatarRequestBatchSize;
+    int maxConcurrentAvatarRequests;
+    int avatarRequestGracePeriod;
+    quint64 avatarRequestsRetrieved;
+    quint64 avatarRequestsTime;
 
     // contact info
     PendingRefreshContactInfo *refreshInfoOp;
+
+    // aggregated change signals
+    bool aggregateContactChanges;
+    // contacts whose client types changed in the current main loop iteration
+    Contacts clientTypesChanged;
+
+    // contact attributes requested in the current batch window, coalesced into a single
+    // GetContactAttributes call
+    PendingAttributesBatch *attributesBatch;
+    int attributesBatchWindow;
+    quint64 attributesRequests;
+    quint64 attributesCalls;
 };
 
 ContactManager::Private::Private(ContactManager *parent, Connection *connection)
@@ -79,38 +162,228 @@ ContactManager::Private::Private(ContactManager *parent, Connection *connection)
       connection(connection),
       roster(new ContactManager::Roster(parent)),
       requestAvatarsIdle(false),
-      refreshInfoOp(0)
-{
+      avatarBatchTimer(new QTimer(parent)),
+      nextAvatarBatchId(0),
+      avatarRequestBatchSize(AVATAR_REQUEST_BATCH_SIZE),
+      maxConcurrentAvatarRequests(AVATAR_REQUEST_MAX_BATCHES),
+      avatarRequestGracePeriod(AVATAR_REQUEST_GRACE_PERIOD),
+      avatarRequestsRetrieved(0),
+      avatarRequestsTime(0),
+      refreshInfoOp(0),
+      aggregateContactChanges(false),
+      attributesBatch(0),
+      attributesBatchWindow(0),
+      attributesRequests(0),
+      attributesCalls(0)
+{
+    avatarBatchTimer->setSingleShot(true);
+#if QT_VERSION >= 0x050000
+    avatarBatchTimer->setTimerType(Qt::PreciseTimer);
+#endif
+    parent->connect(avatarBatchTimer, SIGNAL(timeout()), SLOT(onAvatarBatchTimeout()));
 }
 
 ContactManager::Private::~Private()
 {
+    // The PendingContacts waiting for the batch still need to finish
+    if (attributesBatch) {
+        attributesBatch->cancel();
+    }
     delete refreshInfoOp;
     delete roster;
 }
 
-bool ContactManager::Private::buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName)
+QString ContactManager::Private::avatarFileName(const QString &token)
+{
+    if (avatarDirectory.isEmpty()) {
+        ConnectionPtr conn(parent->connection());
+        avatarDirectory = AvatarCache::instance()->avatarDirectory(conn->cmName(),
+                conn->protocolName());
+    }
+
+    return QString(QLatin1String("%1/%2")).arg(avatarDirectory).arg(escapeAsIdentifier(token));
+}
+
+void ContactManager::Private::requestAvatars(const UIntList &handles)
 {
-    QString cacheDir = QString(QLatin1String(qgetenv("XDG_CACHE_HOME")));
-    if (cacheDir.isEmpty()) {
-        cacheDir = QString(QLatin1String("%1/.cache")).arg(QLatin1String(qgetenv("HOME")));
+    if (handles.isEmpty()) {
+        return;
     }
 
-    ConnectionPtr conn(parent->connection());
-    QString path = QString(QLatin1String("%1/telepathy/avatars/%2/%3")).
-        arg(cacheDir).arg(conn->cmName()).arg(conn->protocolName());
+    int queued = 0;
+    foreach (uint handle, handles) {
+        if (queueAvatarRequest(handle)) {
+            ++queued;
+        }
+    }
+
+    if (queued > 0) {
+        debug() << "Queued avatar request(s) for" << queued << "contact(s), queue depth:" <<
+            avatarRequests.size();
+    }
+
+    sendAvatarRequests();
+}
 
-    if (createDir && !QDir().mkpath(path)) {
+bool ContactManager::Private::queueAvatarRequest(uint handle)
+{
+    if (avatarRequests.contains(handle)) {
         return false;
     }
 
-    avatarFileName = QString(QLatin1String("%1/%2")).arg(path).arg(escapeAsIdentifier(token));
-    mimeTypeFileName = QString(QLatin1String("%1.mime")).arg(avatarFileName);
+    AvatarRequest request;
+    ContactPtr contact = parent->lookupContactByHandle(handle);
+    if (contact && contact->isAvatarTokenKnown()) {
+        request.avatarFileName = avatarFileName(contact->avatarToken());
+
+        /* Contacts sharing a token are served by a single request */
+        QHash<QString, uint>::const_iterator i =
+            avatarRequestsByFile.constFind(request.avatarFileName);
+        if (i != avatarRequestsByFile.constEnd() && i.value() != handle) {
+            avatarRequestWaiters[request.avatarFileName].insert(handle);
+            return false;
+        }
+        avatarRequestsByFile.insert(request.avatarFileName, handle);
+    }
 
+    request.queued.start();
+    avatarRequests.insert(handle, request);
+    avatarRequestQueue.append(handle);
     return true;
 }
 
+void ContactManager::Private::sendAvatarRequests()
+{
+    while (avatarBatches.size() < maxConcurrentAvatarRequests && !avatarRequestQueue.isEmpty()) {
+        UIntList handles;
+
+        /* Visible contacts go first */
+        if (!visibleHandles.isEmpty()) {
+            QList<uint>::iterator i = avatarRequestQueue.begin();
+            while (i != avatarRequestQueue.end() && handles.size() < avatarRequestBatchSize) {
+                if (visibleHandles.contains(*i)) {
+                    handles << *i;
+                    i = avatarRequestQueue.erase(i);
+                } else {
+                    ++i;
+                }
+            }
+        }
+
+        while (handles.size() < avatarRequestBatchSize && !avatarRequestQueue.isEmpty()) {
+            handles << avatarRequestQueue.takeFirst();
+        }
+
+        uint batchId = nextAvatarBatchId++;
+        AvatarBatch &batch = avatarBatches[batchId];
+        batch.handles = handles.toSet();
+        batch.sent.start();
+        foreach (uint handle, handles) {
+            avatarBatchByHandle.insert(handle, batchId);
+        }
+
+        debug() << "Requesting avatar(s) for" << handles.size() << "contact(s)," <<
+            avatarRequestQueue.size() << "left in queue";
+
+        static const MethodIndex avatarsRequestedSlot(&ContactManager::staticMetaObject,
+                "onAvatarsRequested(QDBusPendingCallWatcher*)");
+        Client::ConnectionInterfaceAvatarsInterface *avatarsInterface =
+            parent->connection()->interface<Client::ConnectionInterfaceAvatarsInterface>();
+        QDBusPendingCallWatcher *watcher = watchPendingCall(
+            avatarsInterface->RequestAvatars(handles),
+            parent, avatarsRequestedSlot);
+        avatarBatchWatchers.insert(watcher, batchId);
+    }
+
+    scheduleAvatarBatchTimeout();
+}
+
+void ContactManager::Private::finishAvatarRequest(uint handle, bool retrieved)
+{
+    QHash<uint, AvatarRequest>::iterator i = avatarRequests.find(handle);
+    if (i == avatarRequests.end()) {
+        return;
+    }
+
+    if (retrieved) {
+        ++avatarRequestsRetrieved;
+        avatarRequestsTime += i->queued.elapsed();
+    }
+    forgetAvatarRequest(handle, retrieved);
+
+    QHash<uint, uint>::iterator j = avatarBatchByHandle.find(handle);
+    if (j == avatarBatchByHandle.end()) {
+        avatarRequestQueue.removeOne(handle);
+        return;
+    }
+    uint batchId = j.value();
+    avatarBatchByHandle.erase(j);
+
+    AvatarBatch &batch = avatarBatches[batchId];
+    batch.handles.remove(handle);
+    if (batch.handles.isEmpty()) {
+        finishAvatarBatch(batchId);
+    }
+}
+
+void ContactManager::Private::forgetAvatarRequest(uint handle, bool retrieved)
+{
+    AvatarRequest request = avatarRequests.take(handle);
+    if (request.avatarFileName.isEmpty()) {
+        return;
+    }
+
+    avatarRequestsByFile.remove(request.avatarFileName);
+
+    // Contacts sharing the token were already taken if the avatar was retrieved. Otherwise the
+    // request failed or timed out for this contact only, so give the next one a go.
+    QSet<uint> waiters = avatarRequestWaiters.take(request.avatarFileName);
+    if (!retrieved) {
+        foreach (uint waiter, waiters) {
+            queueAvatarRequest(waiter);
+        }
+    }
+}
+
+void ContactManager::Private::finishAvatarBatch(uint batchId)
+{
+    AvatarBatch batch = avatarBatches.take(batchId);
+    foreach (uint handle, batch.handles) {
+        avatarBatchByHandle.remove(handle);
+        forgetAvatarRequest(handle, false);
+    }
+
+    if (avatarRequestsRetrieved > 0) {
+        debug() << "Avatar request batch finished after" << batch.sent.elapsed() << "ms," <<
+            "queue depth:" << avatarRequests.size() << "average fetch time:" <<
+            avatarRequestsTime / avatarRequestsRetrieved << "ms";
+    }
+
+    sendAvatarRequests();
+}
+
+void ContactManager::Private::scheduleAvatarBatchTimeout()
+{
+    if (avatarBatches.isEmpty()) {
+        avatarBatchTimer->stop();
+        return;
+    }
+
+    int remaining = AVATAR_REQUEST_BATCH_TIMEOUT;
+    foreach (const AvatarBatch &batch, avatarBatches) {
+        remaining = qMin(remaining, batch.remainingTime(avatarRequestGracePeriod));
+    }
+    avatarBatchTimer->start(qMax(remaining, 0));
+}
+
+int ContactManager::Private::AvatarBatch::remainingTime(int gracePeriod) const
+{
+    if (replied.isValid()) {
+        return gracePeriod - int(replied.elapsed());
+    }
+    return AVATAR_REQUEST_BATCH_TIMEOUT - int(sent.elapsed());
+}
+
 Features ContactManager::Private::realFeatures(const Features &features)
 {
     Features ret(features);
@@ -193,6 +466,59 @@ void ContactManager::PendingRefreshContactInfo::onRefreshInfoFinished(PendingOpe
     }
 }
 
+ContactManager::PendingAttributesBatch::PendingAttributesBatch(const ConnectionPtr &conn)
+    : PendingOperation(conn),
+      mConn(conn),
+      mRequests(0),
+      mHandlesRequested(0)
+{
+}
+
+ContactManager::PendingAttributesBatch::~PendingAttributesBatch()
+{
+}
+
+void ContactManager::PendingAttributesBatch::addRequest(const QSet<uint> &handles,
+        const QStringList &interfaces)
+{
+    ++mRequests;
+    mHandlesRequested += handles.size();
+    mHandles.unite(handles);
+    mInterfaces.unite(interfaces.toSet());
+}
+
+void ContactManager::PendingAttributesBatch::flush()
+{
+    Q_ASSERT(!mHandles.isEmpty());
+
+    debug() << "Calling GetContactAttributes for" << mHandles.size() << "handles," <<
+        mRequests << "requests and" << mHandlesRequested << "handles coalesced";
+    PendingContactAttributes *pendingAttributes =
+        mConn->lowlevel()->contactAttributes(mHandles.toList(), mInterfaces.toList(), true);
+    connect(pendingAttributes,
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onAttributesFinished(Tp::PendingOperation*)));
+}
+
+void ContactManager::PendingAttributesBatch::cancel()
+{
+    setFinishedWithError(TP_QT_ERROR_CANCELLED,
+            QLatin1String("ContactManager destroyed before the contact attributes were requested"));
+}
+
+void ContactManager::PendingAttributesBatch::onAttributesFinished(PendingOperation *op)
+{
+    if (op->isError()) {
+        setFinishedWithError(op->errorName(), op->errorMessage());
+        return;
+    }
+
+    PendingContactAttributes *pendingAttributes = qobject_cast<PendingContactAttributes *>(op);
+    mValidHandles = pendingAttributes->validHandles();
+    mAttributes = pendingAttributes->attributes();
+    setFinished();
+}
+
 /**
  * \class ContactManager
  * \ingroup clientconn
@@ -1219,6 +1545,189 @@ void ContactManager::requestContactAvatars(const QList<ContactPtr> &contacts)
     mPriv->requestAvatarsQueue.unite(contacts.toSet());
 }
 
+/**
+ * Set the contacts currently shown by the application.
+ *
+ * Avatar requests for these contacts are sent to the connection manager before the other
+ * queued requests made through requestContactAvatars(). Calling this method replaces the
+ * previously set contacts.
+ *
+ * \param contacts The visible contacts.
+ * \sa requestContactAvatars()
+ */
+void ContactManager::setVisibleContacts(const QList<ContactPtr> &contacts)
+{
+    mPriv->visibleHandles.clear();
+    foreach (const ContactPtr &contact, contacts) {
+        if (contact) {
+            mPriv->visibleHandles.insert(contact->handle()[0]);
+        }
+    }
+}
+
+/**
+ * Return the maximum number of contacts whose avatars are requested from the connection
+ * manager in a single call.
+ *
+ * \return The batch size.
+ * \sa setAvatarRequestBatchSize()
+ */
+int ContactManager::avatarRequestBatchSize() const
+{
+    return mPriv->avatarRequestBatchSize;
+}
+
+/**
+ * Set the maximum number of contacts whose avatars are requested from the connection
+ * manager in a single call.
+ *
+ * Avatars which are not in the disk cache are requested in batches of at most \a size
+ * contacts, with at most maxConcurrentAvatarRequests() batches in flight. The default is 50.
+ *
+ * \param size The batch size.
+ */
+void ContactManager::setAvatarRequestBatchSize(int size)
+{
+    mPriv->avatarRequestBatchSize = qMax(size, 1);
+}
+
+/**
+ * Return the maximum number of avatar request batches in flight.
+ *
+ * \return The number of batches.
+ * \sa setMaxConcurrentAvatarRequests()
+ */
+int ContactManager::maxConcurrentAvatarRequests() const
+{
+    return mPriv->maxConcurrentAvatarRequests;
+}
+
+/**
+ * Set the maximum number of avatar request batches in flight.
+ *
+ * A batch is in flight until all its avatars have been retrieved, the request failed, or
+ * avatarRequestGracePeriod() after the connection manager acknowledged the request. The default
+ * is 2.
+ *
+ * \param requests The number of batches.
+ * \sa setAvatarRequestBatchSize(), setAvatarRequestGracePeriod()
+ */
+void ContactManager::setMaxConcurrentAvatarRequests(int requests)
+{
+    mPriv->maxConcurrentAvatarRequests = qMax(requests, 1);
+    mPriv->sendAvatarRequests();
+}
+
+/**
+ * Return how long an acknowledged avatar request batch keeps counting towards
+ * maxConcurrentAvatarRequests().
+ *
+ * \return The grace period in milliseconds.
+ * \sa setAvatarRequestGracePeriod()
+ */
+int ContactManager::avatarRequestGracePeriod() const
+{
+    return mPriv->avatarRequestGracePeriod;
+}
+
+/**
+ * Set how long an acknowledged avatar request batch keeps counting towards
+ * maxConcurrentAvatarRequests().
+ *
+ * Connection managers acknowledge RequestAvatars once they have started fetching the avatars,
+ * and don't tell when the contacts without an avatar are done. The avatars they already have
+ * usually follow right away, so the next batch is sent once all the avatars of a batch have been
+ * retrieved or this long after the acknowledgement, whichever comes first. The default is 1000
+ * milliseconds.
+ *
+ * \param msec The grace period in milliseconds.
+ * \sa setMaxConcurrentAvatarRequests()
+ */
+void ContactManager::setAvatarRequestGracePeriod(int msec)
+{
+    mPriv->avatarRequestGracePeriod = qMax(msec, 0);
+    mPriv->scheduleAvatarBatchTimeout();
+}
+
+/**
+ * Return the number of contacts whose avatars are queued or being requested from the
+ * connection manager.
+ *
+ * \return The queue depth.
+ */
+int ContactManager::pendingAvatarRequests() const
+{
+    return mPriv->avatarRequests.size();
+}
+
+/**
+ * Return the average time between an avatar being queued for request and it being retrieved
+ * from the connection manager.
+ *
+ * \return The average time in milliseconds, or 0 if no avatar was retrieved yet.
+ */
+int ContactManager::averageAvatarRequestTime() const
+{
+    if (mPriv->avatarRequestsRetrieved == 0) {
+        return 0;
+    }
+    return int(mPriv->avatarRequestsTime / mPriv->avatarRequestsRetrieved);
+}
+
+/**
+ * Return the maximum number of avatars the in-memory avatar cache holds.
+ *
+ * \return The number of avatars.
+ * \sa setAvatarCacheSize()
+ */
+int ContactManager::avatarCacheSize() const
+{
+    return AvatarCache::instance()->maxEntries();
+}
+
+/**
+ * Set the maximum number of avatars the in-memory avatar cache holds.
+ *
+ * The in-memory cache remembers which avatars are in the disk cache, so they can be handed out
+ * without touching the disk. The least recently used avatars are dropped from it once it is
+ * full, and are then looked up on disk again when requested. The cache is shared by all the
+ * contact managers of the process, and holds 8192 avatars by default.
+ *
+ * \param entries The number of avatars.
+ * \sa avatarCacheHits(), avatarCacheMisses()
+ */
+void ContactManager::setAvatarCacheSize(int entries)
+{
+    AvatarCache::instance()->setMaxEntries(entries);
+}
+
+/**
+ * Return the number of avatars found in the in-memory avatar cache.
+ *
+ * The count covers all the contact managers of the process, as they share the cache.
+ *
+ * \return The number of cache hits.
+ * \sa avatarCacheMisses(), setAvatarCacheSize()
+ */
+quint64 ContactManager::avatarCacheHits() const
+{
+    return AvatarCache::instance()->hits();
+}
+
+/**
+ * Return the number of avatars which were not found in the in-memory avatar cache, and were
+ * looked up in the disk cache or requested from the connection manager instead.
+ *
+ * The count covers all the contact managers of the process, as they share the cache.
+ *
+ * \return The number of cache misses.
+ * \sa avatarCacheHits(), setAvatarCacheSize()
+ */
+quint64 ContactManager::avatarCacheMisses() const
+{
+    return AvatarCache::instance()->misses();
+}
+
 /**
  * Refresh information for the given contact.
  *
@@ -1244,17 +1753,111 @@ PendingOperation *ContactManager::refreshContactInfo(const QList<ContactPtr> &co
     return mPriv->refreshInfoOp;
 }
 
+/**
+ * Return whether the aggregated contact change signals are emitted.
+ *
+ * \return \c true if presencesChanged(), aliasesChanged(), capabilitiesChanged() and
+ *         clientTypesChanged() are emitted, \c false otherwise.
+ * \sa setAggregateContactChanges()
+ */
+bool ContactManager::isAggregatingContactChanges() const
+{
+    return mPriv->aggregateContactChanges;
+}
+
+/**
+ * Set whether the aggregated contact change signals are emitted.
+ *
+ * When enabled, each presence, alias or capabilities change notification from the
+ * connection manager results in a single presencesChanged(), aliasesChanged() or
+ * capabilitiesChanged() signal with the contacts whose value actually changed, so views
+ * can update all of them in one pass. Client type changes, which the connection manager
+ * reports one contact at a time, are merged within a main loop iteration.
+ *
+ * The per-contact signals, such as Contact::presenceChanged(), are emitted either way.
+ * This is disabled by default.
+ *
+ * \param aggregate Whether the aggregated signals should be emitted.
+ */
+void ContactManager::setAggregateContactChanges(bool aggregate)
+{
+    mPriv->aggregateContactChanges = aggregate;
+    if (!aggregate) {
+        mPriv->clientTypesChanged.clear();
+    }
+}
+
+/**
+ * Return the time contact attribute requests are held back for so they can be merged with
+ * other requests.
+ *
+ * \return The batch window in milliseconds.
+ * \sa setContactAttributesBatchWindow()
+ */
+int ContactManager::contactAttributesBatchWindow() const
+{
+    return mPriv->attributesBatchWindow;
+}
+
+/**
+ * Set the time contact attribute requests are held back for so they can be merged with other
+ * requests.
+ *
+ * All the contactsForHandles() and upgradeContacts() calls made within the window share a
+ * single GetContactAttributes D-Bus call for the union of their handles and features. The
+ * default window of 0 merges the requests made within the same main loop iteration.
+ *
+ * \param msec The batch window in milliseconds.
+ * \sa contactAttributesRequests(), contactAttributesCalls()
+ */
+void ContactManager::setContactAttributesBatchWindow(int msec)
+{
+    mPriv->attributesBatchWindow = qMax(msec, 0);
+}
+
+/**
+ * Return the number of contact attribute requests made through contactsForHandles() and
+ * upgradeContacts() which have been sent to the connection manager so far.
+ *
+ * Dividing it by contactAttributesCalls() gives the average number of requests merged into
+ * each GetContactAttributes call.
+ *
+ * \return The number of requests.
+ * \sa contactAttributesCalls(), setContactAttributesBatchWindow()
+ */
+quint64 ContactManager::contactAttributesRequests() const
+{
+    return mPriv->attributesRequests;
+}
+
+/**
+ * Return the number of GetContactAttributes calls the contact attribute requests have been
+ * merged into so far.
+ *
+ * \return The number of D-Bus calls.
+ * \sa contactAttributesRequests(), setContactAttributesBatchWindow()
+ */
+quint64 ContactManager::contactAttributesCalls() const
+{
+    return mPriv->attributesCalls;
+}
+
 void ContactManager::onAliasesChanged(const AliasPairList &aliases)
 {
     debug() << "Got AliasesChanged for" << aliases.size() << "contacts";
 
-    foreach (AliasPair pair, aliases) {
+    Contacts changed;
+    foreach (const AliasPair &pair, aliases) {
         ContactPtr contact = lookupContactByHandle(pair.handle);
 
-        if (contact) {
-            contact->receiveAlias(pair.alias);
+        if (contact && contact->receiveAlias(pair.alias)) {
+            changed.insert(contact);
         }
     }
+
+    if (mPriv->aggregateContactChanges && !changed.isEmpty()) {
+        emit aliasesChanged(changed);
+    }
 }
 
 void ContactManager::doRequestAvatars()
@@ -1266,53 +1869,122 @@ void ContactManager::doRequestAvatars()
     mPriv->requestAvatarsQueue.clear();
     mPriv->requestAvatarsIdle = false;
 
+    AvatarCache *cache = AvatarCache::instance();
     int found = 0;
+    QStringList toLoad;
     UIntList notFound;
     foreach (const ContactPtr &contact, contacts) {
         if (!contact) {
             continue;
         }
 
-        QString avatarFileName;
-        QString mimeTypeFileName;
-        bool success = (contact->isAvatarTokenKnown() &&
-            mPriv->buildAvatarFileName(contact->avatarToken(), false,
-                avatarFileName, mimeTypeFileName));
-
-        /* Check if the avatar is already in the cache */
-        if (success && QFile::exists(avatarFileName)) {
-            QFile mimeTypeFile(mimeTypeFileName);
-            mimeTypeFile.open(QIODevice::ReadOnly);
-            QString mimeType = QString(QLatin1String(mimeTypeFile.readAll()));
-            mimeTypeFile.close();
+        if (!contact->isAvatarTokenKnown()) {
+            notFound << contact->handle()[0];
+            continue;
+        }
 
+        /* Check if the avatar is already known to be in the cache */
+        QString avatarFileName = mPriv->avatarFileName(contact->avatarToken());
+        QString mimeType;
+        if (cache->lookup(avatarFileName, mimeType)) {
             found++;
-
             contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
-
             continue;
         }
 
-        notFound << contact->handle()[0];
+        /* Otherwise check the disk cache on the avatar cache worker thread */
+        if (!mPriv->avatarLoadsPending.contains(avatarFileName)) {
+            toLoad << avatarFileName;
+        }
+        mPriv->avatarLoadsPending[avatarFileName].insert(contact->handle()[0]);
     }
 
     if (found > 0) {
-        debug() << "Avatar(s) found in cache for" << found << "contact(s)";
+        debug() << "Avatar(s) found in memory cache for" << found << "contact(s)" <<
+            "(cache hits:" << cache->hits() << "misses:" << cache->misses() << ")";
     }
 
-    if (found == contacts.size()) {
-        return;
+    if (!toLoad.isEmpty()) {
+        connect(cache->load(toLoad, connection()),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onAvatarsLoaded(Tp::PendingOperation*)));
     }
 
-    debug() << "Requesting avatar(s) for" << contacts.size() - found << "contact(s)";
+    mPriv->requestAvatars(notFound);
+}
+
+void ContactManager::onAvatarsLoaded(PendingOperation *op)
+{
+    AvatarCache::PendingOp *load = qobject_cast<AvatarCache::PendingOp *>(op);
+    Q_ASSERT(load);
+
+    QHash<QString, QString> avatars = load->avatars();
+    if (!avatars.isEmpty()) {
+        debug() << "Avatar(s) found in disk cache for" << avatars.size() << "token(s)";
+    }
+
+    QHash<QString, QString>::const_iterator i = avatars.constBegin();
+    for (; i != avatars.constEnd(); ++i) {
+        foreach (uint handle, mPriv->avatarLoadsPending.take(i.key())) {
+            ContactPtr contact = lookupContactByHandle(handle);
+            // the token may have changed while the disk cache was being checked
+            if (contact && contact->isAvatarTokenKnown() &&
+                mPriv->avatarFileName(contact->avatarToken()) == i.key()) {
+                contact->receiveAvatarData(AvatarData(i.key(), i.value()));
+            }
+        }
+    }
+
+    UIntList notFound;
+    foreach (const QString &avatarFileName, load->missing()) {
+        foreach (uint handle, mPriv->avatarLoadsPending.take(avatarFileName)) {
+            notFound << handle;
+        }
+    }
 
-    Client::ConnectionInterfaceAvatarsInterface *avatarsInterface =
-        connection()->interface<Client::ConnectionInterfaceAvatarsInterface>();
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
-        avatarsInterface->RequestAvatars(notFound),
-        this);
-    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), watcher,
-        SLOT(deleteLater()));
+    mPriv->requestAvatars(notFound);
+}
+
+void ContactManager::onAvatarsRequested(QDBusPendingCallWatcher *watcher)
+{
+    uint batchId = mPriv->avatarBatchWatchers.take(watcher);
+    QDBusPendingReply<> reply = *watcher;
+
+    QHash<uint, Private::AvatarBatch>::iterator i = mPriv->avatarBatches.find(batchId);
+    if (i != mPriv->avatarBatches.end()) {
+        if (reply.isError()) {
+            warning().nospace() << "RequestAvatars failed with " <<
+                reply.error().name() << ": " << reply.error().message();
+            mPriv->finishAvatarBatch(batchId);
+        } else {
+            // The avatars the CM already has follow right away, the others won't come at all or
+            // take a network round trip, which isn't worth holding up the next batch for
+            i->replied.start();
+            mPriv->scheduleAvatarBatchTimeout();
+        }
+    }
+
+    watcher->deleteLater();
+}
+
+void ContactManager::onAvatarBatchTimeout()
+{
+    QList<uint> expired;
+    QHash<uint, Private::AvatarBatch>::const_iterator i = mPriv->avatarBatches.constBegin();
+    for (; i != mPriv->avatarBatches.constEnd(); ++i) {
+        if (i->remainingTime(mPriv->avatarRequestGracePeriod) <= 0) {
+            expired << i.key();
+        }
+    }
+
+    foreach (uint batchId, expired) {
+        debug() << "Avatar request batch expired," <<
+            mPriv->avatarBatches[batchId].handles.size() << "avatar(s) not retrieved";
+        mPriv->finishAvatarBatch(batchId);
+    }
+
+    // Timers may fire a bit early, in which case nothing expired yet
+    mPriv->scheduleAvatarBatchTimeout();
 }
 
 void ContactManager::onAvatarUpdated(uint handle, const QString &token)
@@ -1328,46 +2000,73 @@ void ContactManager::onAvatarUpdated(uint handle, const QString &token)
 void ContactManager::onAvatarRetrieved(uint handle, const QString &token,
     const QByteArray &data, const QString &mimeType)
 {
-    QString avatarFileName;
-    QString mimeTypeFileName;
-
     debug() << "Got AvatarRetrieved for contact with handle" << handle;
 
-    bool success = mPriv->buildAvatarFileName(token, true, avatarFileName,
-        mimeTypeFileName);
-
-    if (success) {
-        debug() << "Write avatar in cache for handle" << handle;
-        debug() << "Filename:" << avatarFileName;
-        debug() << "MimeType:" << mimeType;
-
-        if (!QFile::exists(mimeTypeFileName)) {
-            QTemporaryFile mimeTypeFile(mimeTypeFileName);
-            if (mimeTypeFile.open()) {
-                mimeTypeFile.write(mimeType.toLatin1());
-                mimeTypeFile.setAutoRemove(false);
-                if (!mimeTypeFile.rename(mimeTypeFileName)) {
-                    mimeTypeFile.remove();
-                }
-            }
+    AvatarCache *cache = AvatarCache::instance();
+    QString avatarFileName = mPriv->avatarFileName(token);
+    QString cachedMimeType;
+
+    /* Contacts with the same token which were waiting for this avatar */
+    QSet<uint> handles;
+    handles.insert(handle);
+    foreach (uint waiter, mPriv->avatarRequestWaiters.take(avatarFileName)) {
+        ContactPtr contact = lookupContactByHandle(waiter);
+        if (contact && contact->avatarToken() == token) {
+            handles.insert(waiter);
         }
+    }
+    mPriv->finishAvatarRequest(handle, true);
 
-        if (!QFile::exists(avatarFileName)) {
-            QTemporaryFile avatarFile(avatarFileName);
-            if (avatarFile.open()) {
-                avatarFile.write(data);
-                avatarFile.setAutoRemove(false);
-                if (!avatarFile.rename(avatarFileName)) {
-                    avatarFile.remove();
-                }
+    if (cache->lookup(avatarFileName, cachedMimeType)) {
+        /* Another contact with the same token already got it written */
+        foreach (uint handle, handles) {
+            ContactPtr contact = lookupContactByHandle(handle);
+            if (contact) {
+                contact->setAvatarToken(token);
+                contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
             }
         }
+        return;
     }
 
-    ContactPtr contact = lookupContactByHandle(handle);
-    if (contact) {
-        contact->setAvatarToken(token);
-        contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
+    if (mPriv->avatarStoresPending.contains(avatarFileName)) {
+        mPriv->avatarStoresPending[avatarFileName].handles.unite(handles);
+        return;
+    }
+
+    debug() << "Write avatar in cache for handle" << handle;
+    debug() << "Filename:" << avatarFileName;
+    debug() << "MimeType:" << mimeType;
+
+    Private::AvatarStore &store = mPriv->avatarStoresPending[avatarFileName];
+    store.token = token;
+    store.mimeType = mimeType;
+    store.handles = handles;
+
+    connect(cache->store(avatarFileName, data, mimeType, connection()),
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onAvatarStored(Tp::PendingOperation*)));
+}
+
+void ContactManager::onAvatarStored(PendingOperation *op)
+{
+    AvatarCache::PendingOp *store = qobject_cast<AvatarCache::PendingOp *>(op);
+    Q_ASSERT(store);
+
+    QStringList avatarFileNames = store->avatars().keys() + store->missing();
+    foreach (const QString &avatarFileName, avatarFileNames) {
+        Private::AvatarStore pending = mPriv->avatarStoresPending.take(avatarFileName);
+        // The contact is told about the token even if the avatar could not be written
+        AvatarData avatar(store->missing().contains(avatarFileName) ?
+                QString() : avatarFileName, pending.mimeType);
+
+        foreach (uint handle, pending.handles) {
+            ContactPtr contact = lookupContactByHandle(handle);
+            if (contact) {
+                contact->setAvatarToken(pending.token);
+                contact->receiveAvatarData(avatar);
+            }
+        }
     }
 }
 
@@ -1375,26 +2074,38 @@ void ContactManager::onPresencesChanged(const SimpleContactPresences &presences)
 {
     debug() << "Got PresencesChanged for" << presences.size() << "contacts";
 
-    foreach (uint handle, presences.keys()) {
-        ContactPtr contact = lookupContactByHandle(handle);
+    Contacts changed;
+    SimpleContactPresences::const_iterator i = presences.constBegin();
+    for (; i != presences.constEnd(); ++i) {
+        ContactPtr contact = lookupContactByHandle(i.key());
 
-        if (contact) {
-            contact->receiveSimplePresence(presences[handle]);
+        if (contact && contact->receiveSimplePresence(i.value())) {
+            changed.insert(contact);
         }
     }
+
+    if (mPriv->aggregateContactChanges && !changed.isEmpty()) {
+        emit presencesChanged(changed);
+    }
 }
 
 void ContactManager::onCapabilitiesChanged(const ContactCapabilitiesMap &caps)
 {
     debug() << "Got ContactCapabilitiesChanged for" << caps.size() << "contacts";
 
-    foreach (uint handle, caps.keys()) {
-        ContactPtr contact = lookupContactByHandle(handle);
+    Contacts changed;
+    ContactCapabilitiesMap::const_iterator i = caps.constBegin();
+    for (; i != caps.constEnd(); ++i) {
+        ContactPtr contact = lookupContactByHandle(i.key());
 
-        if (contact) {
-            contact->receiveCapabilities(caps[handle]);
+        if (contact && contact->receiveCapabilities(i.value())) {
+            changed.insert(contact);
         }
     }
+
+    if (mPriv->aggregateContactChanges && !changed.isEmpty()) {
+        emit capabilitiesChanged(changed);
+    }
 }
 
 void ContactManager::onLocationUpdated(uint handle, const QVariantMap &location)
@@ -1425,8 +2136,23 @@ void ContactManager::onClientTypesUpdated(uint handle, const QStringList &client
 
     ContactPtr contact = lookupContactByHandle(handle);
 
-    if (contact) {
-        contact->receiveClientTypes(clientTypes);
+    if (contact && contact->receiveClientTypes(clientTypes) &&
+        mPriv->aggregateContactChanges) {
+        /* ClientTypesUpdated is per contact, so merge the ones from the same main loop
+         * iteration */
+        if (mPriv->clientTypesChanged.isEmpty()) {
+            QTimer::singleShot(0, this, SLOT(doEmitClientTypesChanged()));
+        }
+        mPriv->clientTypesChanged.insert(contact);
+    }
+}
+
+void ContactManager::doEmitClientTypesChanged()
+{
+    Contacts changed = mPriv->clientTypesChanged;
+    mPriv->clientTypesChanged.clear();
+    if (!changed.isEmpty()) {
+        emit clientTypesChanged(changed);
     }
 }
 
@@ -1438,6 +2164,20 @@ void ContactManager::doRefreshInfo()
     op->refreshInfo();
 }
 
+void ContactManager::doFlushContactAttributes()
+{
+    PendingAttributesBatch *batch = mPriv->attributesBatch;
+    Q_ASSERT(batch);
+    mPriv->attributesBatch = 0;
+
+    mPriv->attributesRequests += batch->requests();
+    ++mPriv->attributesCalls;
+    debug().nospace() << "Contact attributes merge ratio: " << mPriv->attributesRequests <<
+        " requests in " << mPriv->attributesCalls << " calls";
+
+    batch->flush();
+}
+
 ContactPtr ContactManager::ensureContact(const ReferencedHandles &handle,
         const Features &features, const QVariantMap &attributes)
 {
@@ -1593,6 +2333,18 @@ void ContactManager::resetRoster()
     mPriv->roster->reset();
 }
 
+ContactManager::PendingAttributesBatch *ContactManager::queueContactAttributes(
+        const QSet<uint> &handles, const QStringList &interfaces)
+{
+    if (!mPriv->attributesBatch) {
+        mPriv->attributesBatch = new PendingAttributesBatch(connection());
+        QTimer::singleShot(mPriv->attributesBatchWindow, this, SLOT(doFlushContactAttributes()));
+    }
+
+    mPriv->attributesBatch->addRequest(handles, interfaces);
+    return mPriv->attributesBatch;
+}
+
 /**
  * \fn void ContactManager::presencePublicationRequested(const Tp::Contacts &contacts)
  *
@@ -1664,4 +2416,52 @@ void ContactManager::resetRoster()
  * \sa allKnownContacts()
  */
 
+/**
+ * \fn void ContactManager::presencesChanged(const Tp::Contacts &contacts)
+ *
+ * Emitted when the presence of one or more contacts changes, once per batch of changes
+ * received from the connection manager.
+ *
+ * This signal is only emitted if isAggregatingContactChanges() returns \c true.
+ *
+ * \param contacts The contacts whose presence changed.
+ * \sa Contact::presence(), setAggregateContactChanges()
+ */
+
+/**
+ * \fn void ContactManager::aliasesChanged(const Tp::Contacts &contacts)
+ *
+ * Emitted when the alias of one or more contacts changes, once per batch of changes
+ * received from the connection manager.
+ *
+ * This signal is only emitted if isAggregatingContactChanges() returns \c true.
+ *
+ * \param contacts The contacts whose alias changed.
+ * \sa Contact::alias(), setAggregateContactChanges()
+ */
+
+/**
+ * \fn void ContactManager::capabilitiesChanged(const Tp::Contacts &contacts)
+ *
+ * Emitted when the capabilities of one or more contacts change, once per batch of changes
+ * received from the connection manager.
+ *
+ * This signal is only emitted if isAggregatingContactChanges() returns \c true.
+ *
+ * \param contacts The contacts whose capabilities changed.
+ * \sa Contact::capabilities(), setAggregateContactChanges()
+ */
+
+/**
+ * \fn void ContactManager::clientTypesChanged(const Tp::Contacts &contacts)
+ *
+ * Emitted when the client types of one or more contacts change, at most once per main loop
+ * iteration.
+ *
+ * This signal is only emitted if isAggregatingContactChanges() returns \c true.
+ *
+ * \param contacts The contacts whose client types changed.
+ * \sa Contact::clientTypes(), setAggregateContactChanges()
+ */
+
 } // Tp
@@ -126,9 +126,32 @@ public:
             const Features &features);
 
     void requestContactAvatars(const QList<ContactPtr> &contacts);
+    void setVisibleContacts(const QList<ContactPtr> &contacts);
+
+    int avatarRequestBatchSize() const;
+    void setAvatarRequestBatchSize(int size);
+    int maxConcurrentAvatarRequests() const;
+    void setMaxConcurrentAvatarRequests(int requests);
+    int avatarRequestGracePeriod() const;
+    void setAvatarRequestGracePeriod(int msec);
+    int pendingAvatarRequests() const;
+    int averageAvatarRequestTime() const;
+
+    int avatarCacheSize() const;
+    void setAvatarCacheSize(int entries);
+    quint64 avatarCacheHits() const;
+    quint64 avatarCacheMisses() const;
 
     PendingOperation *refreshContactInfo(const QList<ContactPtr> &contact);
 
+    bool isAggregatingContactChanges() const;
+    void setAggregateContactChanges(bool aggregate);
+
+    int contactAttributesBatchWindow() const;
+    void setContactAttributesBatchWindow(int msec);
+    quint64 contactAttributesRequests() const;
+    quint64 contactAttributesCalls() const;
+
 Q_SIGNALS:
     void stateChanged(Tp::ContactListState state);
 
@@ -147,23 +170,36 @@ Q_SIGNALS:
             const Tp::Contacts &contactsRemoved,
             const Tp::Channel::GroupMemberChangeDetails &details);
 
+    void presencesChanged(const Tp::Contacts &contacts);
+    void aliasesChanged(const Tp::Contacts &contacts);
+    void capabilitiesChanged(const Tp::Contacts &contacts);
+    void clientTypesChanged(const Tp::Contacts &contacts);
+
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onAliasesChanged(const Tp::AliasPairList &);
     TP_QT_NO_EXPORT void doRequestAvatars();
+    TP_QT_NO_EXPORT void onAvatarsLoaded(Tp::PendingOperation *);
+    TP_QT_NO_EXPORT void onAvatarsRequested(QDBusPendingCallWatcher *);
+    TP_QT_NO_EXPORT void onAvatarBatchTimeout();
     TP_QT_NO_EXPORT void onAvatarUpdated(uint, const QString &);
     TP_QT_NO_EXPORT void onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &);
+    TP_QT_NO_EXPORT void onAvatarStored(Tp::PendingOperation *);
     TP_QT_NO_EXPORT void onPresencesChanged(const Tp::SimpleContactPresences &);
     TP_QT_NO_EXPORT void onCapabilitiesChanged(const Tp::ContactCapabilitiesMap &);
     TP_QT_NO_EXPORT void onLocationUpdated(uint, const QVariantMap &);
     TP_QT_NO_EXPORT void onContactInfoChanged(uint, const Tp::ContactInfoFieldList &);
     TP_QT_NO_EXPORT void onClientTypesUpdated(uint, const QStringList &);
+    TP_QT_NO_EXPORT void doEmitClientTypesChanged();
     TP_QT_NO_EXPORT void doRefreshInfo();
+    TP_QT_NO_EXPORT void doFlushContactAttributes();
 
 private:
+    class PendingAttributesBatch;
     class PendingRefreshContactInfo;
     class Roster;
     friend class Channel;
     friend class Connection;
+    friend class PendingAttributesBatch;
     friend class PendingContacts;
     friend class PendingRefreshContactInfo;
     friend class Roster;
@@ -187,6 +223,9 @@ private:
 
     TP_QT_NO_EXPORT PendingOperation *refreshContactInfo(Contact *contact);
 
+    TP_QT_NO_EXPORT PendingAttributesBatch *queueContactAttributes(const QSet<uint> &handles,
+            const QStringList &interfaces);
+
     struct Private;
     friend struct Private;
     Private *mPriv;
@@ -1130,10 +1130,10 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
     }
 }
 
-void Contact::receiveAlias(const QString &alias)
+bool Contact::receiveAlias(const QString &alias)
 {
     if (!mPriv->requestedFeatures.contains(FeatureAlias)) {
-        return;
+        return false;
     }
 
     mPriv->actualFeatures.insert(FeatureAlias);
@@ -1141,7 +1141,10 @@ void Contact::receiveAlias(const QString &alias)
     if (mPriv->alias != alias) {
         mPriv->alias = alias;
         emit aliasChanged(alias);
+        return true;
     }
+
+    return false;
 }
 
 void Contact::receiveAvatarToken(const QString &token)
@@ -1176,10 +1179,10 @@ void Contact::receiveAvatarData(const AvatarData &avatar)
     }
 }
 
-void Contact::receiveSimplePresence(const SimplePresence &presence)
+bool Contact::receiveSimplePresence(const SimplePresence &presence)
 {
     if (!mPriv->requestedFeatures.contains(FeatureSimplePresence)) {
-        return;
+        return false;
     }
 
     mPriv->actualFeatures.insert(FeatureSimplePresence);
@@ -1188,13 +1191,16 @@ void Contact::receiveSimplePresence(const SimplePresence &presence)
         mPriv->presence.statusMessage() != presence.statusMessage) {
         mPriv->presence.setStatus(presence);
         emit presenceChanged(mPriv->presence);
+        return true;
     }
+
+    return false;
 }
 
-void Contact::receiveCapabilities(const RequestableChannelClassList &caps)
+bool Contact::receiveCapabilities(const RequestableChannelClassList &caps)
 {
     if (!mPriv->requestedFeatures.contains(FeatureCapabilities)) {
-        return;
+        return false;
     }
 
     mPriv->actualFeatures.insert(FeatureCapabilities);
@@ -1202,7 +1208,10 @@ void Contact::receiveCapabilities(const RequestableChannelClassList &caps)
     if (mPriv->caps.allClassSpecs().bareClasses() != caps) {
         mPriv->caps.updateRequestableChannelClasses(caps);
         emit capabilitiesChanged(mPriv->caps);
+        return true;
     }
+
+    return false;
 }
 
 void Contact::receiveLocation(const QVariantMap &location)
@@ -1246,10 +1255,10 @@ void Contact::receiveAddresses(const QMap<QString, QString> &addresses,
     mPriv->uris = uris;
 }
 
-void Contact::receiveClientTypes(const QStringList &clientTypes)
+bool Contact::receiveClientTypes(const QStringList &clientTypes)
 {
     if (!mPriv->requestedFeatures.contains(FeatureClientTypes)) {
-        return;
+        return false;
     }
 
     mPriv->actualFeatures.insert(FeatureClientTypes);
@@ -1257,7 +1266,10 @@ void Contact::receiveClientTypes(const QStringList &clientTypes)
     if (mPriv->clientTypes != clientTypes) {
         mPriv->clientTypes = clientTypes;
         emit clientTypesChanged(mPriv->clientTypes);
+        return true;
     }
+
+    return false;
 }
 
 Contact::PresenceState Contact::subscriptionStateToPresenceState(uint subscriptionState)
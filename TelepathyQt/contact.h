@@ -213,17 +213,17 @@ protected:
 private:
     static const Feature FeatureRosterGroups;
 
-    TP_QT_NO_EXPORT void receiveAlias(const QString &alias);
+    TP_QT_NO_EXPORT bool receiveAlias(const QString &alias);
     TP_QT_NO_EXPORT void receiveAvatarToken(const QString &avatarToken);
     TP_QT_NO_EXPORT void setAvatarToken(const QString &token);
     TP_QT_NO_EXPORT void receiveAvatarData(const AvatarData &);
-    TP_QT_NO_EXPORT void receiveSimplePresence(const SimplePresence &presence);
-    TP_QT_NO_EXPORT void receiveCapabilities(const RequestableChannelClassList &caps);
+    TP_QT_NO_EXPORT bool receiveSimplePresence(const SimplePresence &presence);
+    TP_QT_NO_EXPORT bool receiveCapabilities(const RequestableChannelClassList &caps);
     TP_QT_NO_EXPORT void receiveLocation(const QVariantMap &location);
     TP_QT_NO_EXPORT void receiveInfo(const ContactInfoFieldList &info);
     TP_QT_NO_EXPORT void receiveAddresses(const QMap<QString, QString> &addresses,
             const QStringList &uris);
-    TP_QT_NO_EXPORT void receiveClientTypes(const QStringList &clientTypes);
+    TP_QT_NO_EXPORT bool receiveClientTypes(const QStringList &clientTypes);
 
     TP_QT_NO_EXPORT static PresenceState subscriptionStateToPresenceState(uint subscriptionState);
     TP_QT_NO_EXPORT void setSubscriptionState(SubscriptionState state);
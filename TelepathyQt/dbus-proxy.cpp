@@ -27,11 +27,11 @@
 #include "TelepathyQt/_gen/dbus-proxy.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/name-owner-cache-internal.h"
 
 #include <TelepathyQt/Constants>
 
 #include <QDBusConnection>
-#include <QDBusConnectionInterface>
 #include <QDBusError>
 #include <QDBusServiceWatcher>
 #include <QTimer>
@@ -327,15 +327,9 @@ QString StatefulDBusProxy::uniqueNameFrom(const QDBusConnection &bus, const QStr
     }
 
     // For a stateful interface, it makes no sense to follow name-owner
-    // changes, so we want to bind to the unique name.
-    QDBusReply<QString> reply = bus.interface()->serviceOwner(name);
-    if (reply.isValid()) {
-        return reply.value();
-    } else {
-        error = reply.error().name();
-        message = reply.error().message();
-        return QString();
-    }
+    // changes, so we want to bind to the unique name. The cache only blocks on
+    // the bus daemon if the name hasn't been resolved asynchronously before.
+    return NameOwnerCache::forBus(bus)->uniqueNameFrom(name, error, message);
 }
 
 void StatefulDBusProxy::onServiceOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner)
@@ -23,13 +23,18 @@
 #ifndef _TelepathyQt_debug_HEADER_GUARD_
 #define _TelepathyQt_debug_HEADER_GUARD_
 
+#include <QAtomicInt>
 #include <QDebug>
+#include <QString>
 
 #include <TelepathyQt/Global>
 
 namespace Tp
 {
 
+// Kept with its original layout and inline members, as enabledDebug() and enabledWarning() return
+// it by value to binaries built against older versions of this header. The library itself formats
+// messages with DebugStream.
 class TP_QT_EXPORT Debug
 {
 public:
@@ -104,12 +109,116 @@ public:
     }
 
 private:
+    friend class DebugStream;
 
     QString msg;
     QtMsgType type;
     QDebug *debug;
 
     void invokeDebugCallback();
+    static void invokeDebugCallback(QtMsgType type, const QString &msg);
+};
+
+// Exported so the tests can use it even if they link dynamically
+// The header is not installed though, so this should be considered private API
+class TP_QT_EXPORT DebugStream
+{
+public:
+    // A message being formatted. Records are recycled through a small per-thread ring, so
+    // formatting a message normally doesn't allocate, and copies of a DebugStream share the record
+    // instead of formatting the message again.
+    struct Record
+    {
+        Record() : type(QtDebugMsg), stream(&msg), pooled(false), inUse(false)
+        {
+            msg.reserve(256);
+        }
+
+        QAtomicInt ref;
+        QtMsgType type;
+        QString msg;
+        QDebug stream;
+        bool pooled;
+        bool inUse;
+    };
+
+    // A stream which formats messages of the given type if someone is going to receive them,
+    // and discards everything otherwise
+    static DebugStream enabled(QtMsgType type);
+
+    inline DebugStream() : record(0) { }
+    inline DebugStream(QtMsgType type) : record(acquireRecord(type)) { }
+    inline DebugStream(const DebugStream &a) : record(a.record)
+    {
+        if (record) {
+            record->ref.ref();
+        }
+    }
+
+    inline DebugStream &operator=(const DebugStream &a)
+    {
+        if (record != a.record) {
+            if (a.record) {
+                a.record->ref.ref();
+            }
+            if (record && !record->ref.deref()) {
+                releaseRecord(record);
+            }
+            record = a.record;
+        }
+
+        return *this;
+    }
+
+    inline ~DebugStream()
+    {
+        if (record && !record->ref.deref()) {
+            releaseRecord(record);
+        }
+    }
+
+    inline DebugStream &space()
+    {
+        if (record) {
+            record->stream.space();
+        }
+
+        return *this;
+    }
+
+    inline DebugStream &nospace()
+    {
+        if (record) {
+            record->stream.nospace();
+        }
+
+        return *this;
+    }
+
+    inline DebugStream &maybeSpace()
+    {
+        if (record) {
+            record->stream.maybeSpace();
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+    inline DebugStream &operator<<(T a)
+    {
+        if (record) {
+            record->stream << a;
+        }
+
+        return *this;
+    }
+
+private:
+    Record *record;
+
+    static Record *acquireRecord(QtMsgType type);
+    static void releaseRecord(Record *record);
 };
 
 // The telepathy-farsight Qt 4 binding links to these - they're not API outside
@@ -119,14 +228,14 @@ TP_QT_EXPORT Debug enabledWarning();
 
 #ifdef ENABLE_DEBUG
 
-inline Debug debug()
+inline DebugStream debug()
 {
-    return enabledDebug();
+    return DebugStream::enabled(QtDebugMsg);
 }
 
-inline Debug warning()
+inline DebugStream warning()
 {
-    return enabledWarning();
+    return DebugStream::enabled(QtWarningMsg);
 }
 
 #else /* #ifdef ENABLE_DEBUG */
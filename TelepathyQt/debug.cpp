@@ -26,6 +26,12 @@
 
 #include "config-version.h"
 
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThreadStorage>
+
 /**
  * \defgroup debug Common debug support
  *
@@ -37,6 +43,9 @@
  * warning messages. Normal debug output results in the normal operation of the
  * library, warning messages are output only when something goes wrong. Each
  * category can be invidually enabled.
+ *
+ * Besides the debug callback, the output can be received by any number of
+ * DebugSink subclasses, each for the categories it is interested in.
  */
 
 namespace Tp
@@ -94,33 +103,243 @@ namespace Tp
  * \sa DebugCallback
  */
 
+/**
+ * \class DebugSink
+ * \ingroup debug
+ * \headerfile TelepathyQt/debug.h <TelepathyQt/Debug>
+ *
+ * \brief The DebugSink class is the base class for receivers of the library debug output in
+ * addition to the debug callback.
+ *
+ * Each attached sink gets the messages of its minimumType() or more severe, whether or not
+ * output of that type has been enabled with enableDebug() and enableWarnings(), which only control
+ * the output to the debug callback. Messages are only formatted if the debug callback or some sink
+ * is going to receive them, so attaching a sink only for warnings keeps debug messages as cheap as
+ * when they are disabled.
+ *
+ * message() is called from whichever thread the message was produced in, but never concurrently
+ * for the same or different sinks. As the base class destructor can't prevent message() from being
+ * called on a partially destroyed subclass, subclasses receiving messages from several threads
+ * should detach() in their own destructor.
+ *
+ * If the library is not compiled with debug support enabled, sinks never receive any messages.
+ */
+
+/**
+ * \fn void DebugSink::message(QtMsgType type, const QString &msg)
+ *
+ * Reimplement to handle the debug message \a msg of type \a type.
+ *
+ * \param type The type of the message.
+ * \param msg The message.
+ */
+
+struct TP_QT_NO_EXPORT DebugSink::Private
+{
+    Private(QtMsgType minimumType)
+        : minimumType(minimumType),
+          attached(false)
+    {
+    }
+
+    QtMsgType minimumType;
+    bool attached;
+};
+
+/**
+ * Construct a new detached sink for messages of the given \a minimumType or more severe.
+ *
+ * \param minimumType The least severe type of message to receive.
+ */
+DebugSink::DebugSink(QtMsgType minimumType)
+    : mPriv(new Private(minimumType))
+{
+}
+
+/**
+ * Class destructor. Detaches the sink if it is attached.
+ */
+DebugSink::~DebugSink()
+{
+    detach();
+    delete mPriv;
+}
+
+/**
+ * Return the least severe type of message the sink receives.
+ *
+ * \return The type as QtMsgType.
+ */
+QtMsgType DebugSink::minimumType() const
+{
+    return mPriv->minimumType;
+}
+
 #ifdef ENABLE_DEBUG
 
 namespace
 {
+
+// Bits of the message types there is someone to output to, checked before formatting anything
+enum {
+    DebugBit = 1,
+    WarningBit = 2
+};
+
+// Each thread recycles a few records, which covers messages formatted while formatting another
+// one. Any record needed beyond those is allocated and freed on its own.
+const int RECORDS_PER_THREAD = 4;
+
 bool debugEnabled = false;
 bool warningsEnabled = true;
 DebugCallback debugCallback = NULL;
+QList<DebugSink *> sinks;
+QBasicAtomicInt sinkTypes = Q_BASIC_ATOMIC_INITIALIZER(0);
+QBasicAtomicInt outputTypes = Q_BASIC_ATOMIC_INITIALIZER(WarningBit);
+
+// Protects the settings above, and serializes the output. It's recursive so the debug callback and
+// sinks can use the library themselves.
+QMutex outputMutex(QMutex::Recursive);
+
+struct RecordRing
+{
+    RecordRing()
+    {
+        for (int i = 0; i < RECORDS_PER_THREAD; ++i) {
+            records[i].pooled = true;
+        }
+    }
+
+    DebugStream::Record records[RECORDS_PER_THREAD];
+};
+
+QThreadStorage<RecordRing *> recordRings;
+
+int typeBit(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:
+        return DebugBit;
+    case QtWarningMsg:
+        return WarningBit;
+    default:
+        return 0;
+    }
+}
+
+int typesFrom(QtMsgType minimumType)
+{
+    return minimumType == QtDebugMsg ? DebugBit | WarningBit : typeBit(minimumType);
+}
+
+// Must be called with outputMutex held
+void updateOutputTypes()
+{
+    int types = 0;
+    foreach (DebugSink *sink, sinks) {
+        types |= typesFrom(sink->minimumType());
+    }
+    sinkTypes.fetchAndStoreOrdered(types);
+
+    if (debugEnabled) {
+        types |= DebugBit;
+    }
+    if (warningsEnabled) {
+        types |= WarningBit;
+    }
+    outputTypes.fetchAndStoreOrdered(types);
+}
+
+// A plain read of the value, rather than a locked read-modify-write
+inline int loadTypes(const QBasicAtomicInt &types)
+{
+#if QT_VERSION >= 0x050000
+    return types.load();
+#else
+    return types;
+#endif
+}
+
+inline bool wantsOutput(int bit)
+{
+    return loadTypes(outputTypes) & bit;
+}
+
+QTextStream &resetFormat(QTextStream &stream)
+{
+    stream.reset();
+    return stream;
+}
+
 }
 
 void enableDebug(bool enable)
 {
+    QMutexLocker locker(&outputMutex);
     debugEnabled = enable;
+    updateOutputTypes();
 }
 
 void enableWarnings(bool enable)
 {
+    QMutexLocker locker(&outputMutex);
     warningsEnabled = enable;
+    updateOutputTypes();
 }
 
 void setDebugCallback(DebugCallback cb)
 {
+    QMutexLocker locker(&outputMutex);
     debugCallback = cb;
 }
 
+/**
+ * Return whether the sink is attached and receiving messages.
+ *
+ * \return \c true if attached, \c false otherwise.
+ */
+bool DebugSink::isAttached() const
+{
+    QMutexLocker locker(&outputMutex);
+    return mPriv->attached;
+}
+
+/**
+ * Start receiving messages in message().
+ */
+void DebugSink::attach()
+{
+    QMutexLocker locker(&outputMutex);
+    if (mPriv->attached) {
+        return;
+    }
+
+    mPriv->attached = true;
+    sinks.append(this);
+    updateOutputTypes();
+}
+
+/**
+ * Stop receiving messages.
+ *
+ * Once this returns, message() is not running in any other thread and won't be called anymore,
+ * so the sink can be safely destroyed.
+ */
+void DebugSink::detach()
+{
+    QMutexLocker locker(&outputMutex);
+    if (!mPriv->attached) {
+        return;
+    }
+
+    mPriv->attached = false;
+    sinks.removeOne(this);
+    updateOutputTypes();
+}
+
 Debug enabledDebug()
 {
-    if (debugEnabled) {
+    if (wantsOutput(DebugBit)) {
         return Debug(QtDebugMsg);
     } else {
         return Debug();
@@ -129,7 +348,7 @@ Debug enabledDebug()
 
 Debug enabledWarning()
 {
-    if (warningsEnabled) {
+    if (wantsOutput(WarningBit)) {
         return Debug(QtWarningMsg);
     } else {
         return Debug();
@@ -138,20 +357,99 @@ Debug enabledWarning()
 
 void Debug::invokeDebugCallback()
 {
-    if (debugCallback) {
-        debugCallback(QLatin1String("tp-qt"), QLatin1String(PACKAGE_VERSION), type, msg);
+    invokeDebugCallback(type, msg);
+}
+
+DebugStream DebugStream::enabled(QtMsgType type)
+{
+    if (wantsOutput(typeBit(type))) {
+        return DebugStream(type);
     } else {
-        switch (type) {
-        case QtDebugMsg:
-            qDebug() << "tp-qt " PACKAGE_VERSION " DEBUG:" << qPrintable(msg);
-            break;
-        case QtWarningMsg:
-            qWarning() << "tp-qt " PACKAGE_VERSION " WARN:" << qPrintable(msg);
-            break;
-        default:
+        return DebugStream();
+    }
+}
+
+DebugStream::Record *DebugStream::acquireRecord(QtMsgType type)
+{
+    if (!recordRings.hasLocalData()) {
+        recordRings.setLocalData(new RecordRing);
+    }
+
+    RecordRing *ring = recordRings.localData();
+    Record *record = 0;
+    for (int i = 0; i < RECORDS_PER_THREAD; ++i) {
+        if (!ring->records[i].inUse) {
+            record = &ring->records[i];
             break;
         }
     }
+
+    if (!record) {
+        record = new Record;
+    }
+
+    record->inUse = true;
+    record->ref.fetchAndStoreRelaxed(1);
+    record->type = type;
+
+    // Undo whatever the previous message did to the formatting
+    record->stream << resetFormat;
+    record->stream.space();
+#if QT_VERSION >= 0x050400
+    record->stream.quote();
+#endif
+
+    return record;
+}
+
+void DebugStream::releaseRecord(Record *record)
+{
+    if (!record->msg.isEmpty()) {
+        Debug::invokeDebugCallback(record->type, record->msg);
+    }
+
+    if (record->pooled) {
+        // Keeps the capacity reserved by the constructor, unless the callback or a sink
+        // held on to the message
+        record->msg.resize(0);
+        record->inUse = false;
+    } else {
+        delete record;
+    }
+}
+
+void Debug::invokeDebugCallback(QtMsgType type, const QString &msg)
+{
+    int bit = typeBit(type);
+
+    QMutexLocker locker(&outputMutex);
+
+    if ((type == QtDebugMsg && debugEnabled) || (type == QtWarningMsg && warningsEnabled)) {
+        if (debugCallback) {
+            debugCallback(QLatin1String("tp-qt"), QLatin1String(PACKAGE_VERSION), type, msg);
+        } else {
+            switch (type) {
+            case QtDebugMsg:
+                qDebug() << "tp-qt " PACKAGE_VERSION " DEBUG:" << qPrintable(msg);
+                break;
+            case QtWarningMsg:
+                qWarning() << "tp-qt " PACKAGE_VERSION " WARN:" << qPrintable(msg);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    if (loadTypes(sinkTypes) & bit) {
+        // Sinks may detach themselves or each other from message()
+        const QList<DebugSink *> currentSinks = sinks;
+        foreach (DebugSink *sink, currentSinks) {
+            if (sinks.contains(sink) && (typesFrom(sink->minimumType()) & bit)) {
+                sink->message(type, msg);
+            }
+        }
+    }
 }
 
 #else /* !defined(ENABLE_DEBUG) */
@@ -168,6 +466,19 @@ void setDebugCallback(DebugCallback cb)
 {
 }
 
+bool DebugSink::isAttached() const
+{
+    return false;
+}
+
+void DebugSink::attach()
+{
+}
+
+void DebugSink::detach()
+{
+}
+
 Debug enabledDebug()
 {
     return Debug();
@@ -182,6 +493,24 @@ void Debug::invokeDebugCallback()
 {
 }
 
+void Debug::invokeDebugCallback(QtMsgType type, const QString &msg)
+{
+}
+
+DebugStream DebugStream::enabled(QtMsgType type)
+{
+    return DebugStream();
+}
+
+DebugStream::Record *DebugStream::acquireRecord(QtMsgType type)
+{
+    return 0;
+}
+
+void DebugStream::releaseRecord(Record *record)
+{
+}
+
 #endif /* !defined(ENABLE_DEBUG) */
 
 } // Tp
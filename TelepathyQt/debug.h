@@ -41,6 +41,31 @@ typedef void (*DebugCallback)(const QString &libraryName,
                               const QString &msg);
 TP_QT_EXPORT void setDebugCallback(DebugCallback cb);
 
+class TP_QT_EXPORT DebugSink
+{
+    Q_DISABLE_COPY(DebugSink)
+
+public:
+    DebugSink(QtMsgType minimumType = QtDebugMsg);
+    virtual ~DebugSink();
+
+    QtMsgType minimumType() const;
+
+    bool isAttached() const;
+    void attach();
+    void detach();
+
+protected:
+    virtual void message(QtMsgType type, const QString &msg) = 0;
+
+private:
+    friend class Debug;
+
+    struct Private;
+    friend struct Private;
+    Private *mPriv;
+};
+
 } // Tp
 
 #endif
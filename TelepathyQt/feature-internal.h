@@ -0,0 +1,69 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_feature_internal_h_HEADER_GUARD_
+#define _TelepathyQt_feature_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Feature>
+#include <TelepathyQt/Global>
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Process-wide interning of (className, id) pairs into small integers, so feature sets can be
+// kept as bit arrays
+class TP_QT_NO_EXPORT FeatureRegistry
+{
+    Q_DISABLE_COPY(FeatureRegistry)
+
+public:
+    static int index(const Feature &feature);
+    static Feature feature(int index);
+    static int count();
+
+private:
+    friend class Feature;
+
+    FeatureRegistry() { }
+
+    static FeatureRegistry *instance();
+
+    int intern(const QString &className, uint id);
+    void setFeature(int index, const Feature &feature);
+
+    QMutex mMutex;
+    QHash<QPair<QString, uint>, int> mIndexes;
+    QList<Feature> mFeatures;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
@@ -22,16 +22,90 @@
 
 #include <TelepathyQt/Feature>
 
+#include "TelepathyQt/feature-internal.h"
+
+#include <QHash>
+#include <QMutexLocker>
+
 namespace Tp
 {
 
 struct TP_QT_NO_EXPORT Feature::Private : public QSharedData
 {
-    Private(bool critical) : critical(critical) {}
+    Private(bool critical, int index) : critical(critical), index(index) {}
 
     bool critical;
+    int index;
 };
 
+FeatureRegistry *FeatureRegistry::instance()
+{
+    // Features are mostly static members, so this is first called during static initialization
+    static FeatureRegistry registry;
+    return &registry;
+}
+
+/**
+ * Return the small integer assigned to \a feature, or -1 if \a feature is not valid.
+ *
+ * The index is assigned when the feature is constructed and shared by all its copies, so this
+ * doesn't hash the class name.
+ */
+int FeatureRegistry::index(const Feature &feature)
+{
+    if (!feature.isValid()) {
+        return -1;
+    }
+
+    return feature.mPriv.constData()->index;
+}
+
+/**
+ * Return the feature interned at \a index, as it was first constructed.
+ */
+Feature FeatureRegistry::feature(int index)
+{
+    FeatureRegistry *registry = instance();
+    QMutexLocker locker(&registry->mMutex);
+    if (index < 0 || index >= registry->mFeatures.size()) {
+        return Feature();
+    }
+    return registry->mFeatures[index];
+}
+
+/**
+ * Return the number of features interned so far. All the indexes are smaller than this.
+ */
+int FeatureRegistry::count()
+{
+    FeatureRegistry *registry = instance();
+    QMutexLocker locker(&registry->mMutex);
+    return registry->mFeatures.size();
+}
+
+int FeatureRegistry::intern(const QString &className, uint id)
+{
+    QMutexLocker locker(&mMutex);
+    QPair<QString, uint> key(className, id);
+    QHash<QPair<QString, uint>, int>::const_iterator i = mIndexes.constFind(key);
+    if (i != mIndexes.constEnd()) {
+        return i.value();
+    }
+
+    int index = mFeatures.size();
+    mIndexes.insert(key, index);
+    mFeatures.append(Feature());
+    return index;
+}
+
+void FeatureRegistry::setFeature(int index, const Feature &feature)
+{
+    QMutexLocker locker(&mMutex);
+    if (!mFeatures[index].isValid()) {
+        mFeatures[index] = feature;
+    }
+}
+
 /**
  * \class Feature
  * \ingroup utils
@@ -48,8 +122,9 @@ Feature::Feature()
 
 Feature::Feature(const QString &className, uint id, bool critical)
     : QPair<QString, uint>(className, id),
-      mPriv(new Private(critical))
+      mPriv(new Private(critical, FeatureRegistry::instance()->intern(className, id)))
 {
+    FeatureRegistry::instance()->setFeature(mPriv.constData()->index, *this);
 }
 
 Feature::Feature(const Feature &other)
@@ -64,7 +139,7 @@ Feature::~Feature()
 
 Feature &Feature::operator=(const Feature &other)
 {
-    *this = other;
+    QPair<QString, uint>::operator=(other);
     this->mPriv = other.mPriv;
     return *this;
 }
@@ -32,6 +32,8 @@
 namespace Tp
 {
 
+static const qint64 FT_DEFAULT_CHUNK_SIZE = 64 * 1024;
+
 struct TP_QT_NO_EXPORT FileTransferChannel::Private
 {
     Private(FileTransferChannel *parent);
@@ -66,6 +68,8 @@ struct TP_QT_NO_EXPORT FileTransferChannel::Private
     qulonglong transferredBytes;
     SupportedSocketMap availableSocketTypes;
 
+    qint64 transferChunkSize;
+
     bool connected;
     bool finished;
 };
@@ -83,6 +87,7 @@ FileTransferChannel::Private::Private(FileTransferChannel *parent)
       initialOffset(0),
       size(0),
       transferredBytes(0),
+      transferChunkSize(FT_DEFAULT_CHUNK_SIZE),
       connected(false),
       finished(false)
 {
@@ -467,6 +472,39 @@ qulonglong FileTransferChannel::transferredBytes() const
     return mPriv->transferredBytes;
 }
 
+/**
+ * Return the maximum number of bytes moved between the socket and the local
+ * device in a single step of the transfer.
+ *
+ * \return The chunk size in bytes.
+ * \sa setTransferChunkSize()
+ */
+qint64 FileTransferChannel::transferChunkSize() const
+{
+    return mPriv->transferChunkSize;
+}
+
+/**
+ * Set the maximum number of bytes moved between the socket and the local
+ * device in a single step of the transfer.
+ *
+ * Bigger chunks reduce the per-step overhead of large transfers, at the
+ * expense of memory usage and event loop latency. The default is 64 KiB.
+ *
+ * \param chunkSize The chunk size in bytes, which must be positive.
+ * \sa transferChunkSize()
+ */
+void FileTransferChannel::setTransferChunkSize(qint64 chunkSize)
+{
+    if (chunkSize <= 0) {
+        warning() << "FileTransferChannel::setTransferChunkSize called with an "
+            "invalid chunk size" << chunkSize;
+        return;
+    }
+
+    mPriv->transferChunkSize = chunkSize;
+}
+
 /**
  * Return a mapping from address types (members of #SocketAddressType) to arrays
  * of access-control type (members of #SocketAccessControl) that the CM
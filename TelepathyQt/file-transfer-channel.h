@@ -64,6 +64,9 @@ public:
 
     qulonglong transferredBytes() const;
 
+    qint64 transferChunkSize() const;
+    void setTransferChunkSize(qint64 chunkSize);
+
     PendingOperation *cancel();
 
 Q_SIGNALS:
@@ -54,6 +54,8 @@ struct TP_QT_NO_EXPORT IncomingFileTransferChannel::Private
 
     qulonglong requestedOffset;
     qint64 pos;
+
+    QByteArray buffer;
 };
 
 IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *parent)
@@ -334,22 +336,35 @@ void IncomingFileTransferChannel::onSocketError(QAbstractSocket::SocketError err
 
 void IncomingFileTransferChannel::doTransfer()
 {
-    QByteArray data;
-    while (mPriv->socket->bytesAvailable()) {
-        data = mPriv->socket->readAll();
+    // read into a buffer reused across calls, instead of allocating a new
+    // QByteArray for every chunk available in the socket
+    qint64 chunkSize = transferChunkSize();
+    if (mPriv->buffer.size() != chunkSize) {
+        mPriv->buffer.resize(chunkSize);
+    }
+
+    while (mPriv->socket->bytesAvailable() > 0) {
+        qint64 len = mPriv->socket->read(mPriv->buffer.data(), chunkSize);
+        if (len <= 0) {
+            break;
+        }
 
-        // skip until we reach requetedOffset and start writing from there
+        const char *p = mPriv->buffer.constData();
+
+        // skip until we reach requestedOffset and start writing from there
         if ((qulonglong) mPriv->pos < mPriv->requestedOffset) {
-            if ((qulonglong) data.length() <= (mPriv->requestedOffset - mPriv->pos)) {
-                break;
-            }
-            data = data.mid(mPriv->requestedOffset - mPriv->pos);
+            qint64 skip = (qint64) qMin(mPriv->requestedOffset - mPriv->pos,
+                    (qulonglong) len);
+            mPriv->pos += skip;
+            p += skip;
+            len -= skip;
         }
 
-        mPriv->output->write(data); // never fails
+        if (len > 0) {
+            mPriv->output->write(p, len); // never fails
+            mPriv->pos += len;
+        }
     }
-
-    mPriv->pos += data.length();
 }
 
 void IncomingFileTransferChannel::setFinished()
@@ -32,20 +32,48 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 
+#include <cstring>
+
 namespace Tp
 {
 
 struct TP_QT_NO_EXPORT KeyFile::Private
 {
+    // A value is kept as a range of the file contents and only unescaped the first time it is
+    // asked for, as most keys of a manager or profile file are never looked at
+    struct Value
+    {
+        enum Flag {
+            HasString = 0x1,
+            StringValid = 0x2,
+            HasStringList = 0x4,
+            StringListValid = 0x8
+        };
+
+        Value() : from(0), to(0), flags(0) { }
+        Value(int from, int to) : from(from), to(to), flags(0) { }
+
+        int from;
+        int to;
+        mutable uint flags;
+        mutable QString string;
+        mutable QStringList stringList;
+    };
+
+    typedef QHash<QString, Value> Group;
+
     Private();
     Private(const QString &fName);
 
     void setFileName(const QString &fName);
     void setError(KeyFile::Status status, const QString &reason);
     bool read();
+    bool parse(const char *data, int size);
 
     bool validateKey(const QByteArray &data, int from, int to, QString &result);
 
+    const Value *find(const QString &key) const;
+
     QStringList allGroups() const;
     QStringList allKeys() const;
     QStringList keys() const;
@@ -56,7 +84,9 @@ struct TP_QT_NO_EXPORT KeyFile::Private
 
     QString fileName;
     KeyFile::Status status;
-    QHash<QString, QHash<QString, QByteArray> > groups;
+    // The whole file, values point into it
+    QByteArray contents;
+    QHash<QString, Group> groups;
     QString currentGroup;
 };
 
@@ -78,6 +108,7 @@ void KeyFile::Private::setFileName(const QString &fName)
     status = KeyFile::NoError;
     currentGroup = QString();
     groups.clear();
+    contents.clear();
     read();
 }
 
@@ -87,6 +118,7 @@ void KeyFile::Private::setError(KeyFile::Status st, const QString &reason)
                          .arg(fileName).arg(reason);
     status = st;
     groups.clear();
+    contents.clear();
 }
 
 bool KeyFile::Private::read()
@@ -104,23 +136,64 @@ bool KeyFile::Private::read()
         return false;
     }
 
-    QByteArray data;
-    QByteArray group;
+    // The file is scanned straight from the mapping and copied once, the values can't point into
+    // the mapping itself as the file may be rewritten (say by a package upgrade) while we use it
+    qint64 size = file.size();
+    uchar *mapped = size > 0 ? file.map(0, size) : 0;
+    if (mapped) {
+        bool ret = parse(reinterpret_cast<const char *>(mapped), static_cast<int>(size));
+        if (ret) {
+            contents = QByteArray(reinterpret_cast<const char *>(mapped), size);
+        }
+        file.unmap(mapped);
+        return ret;
+    }
+
+    // Not a regular file (or an empty one), fall back to reading it
+    QByteArray data = file.readAll();
+    if (!parse(data.constData(), data.size())) {
+        return false;
+    }
+    contents = data;
+    return true;
+}
+
+static inline bool isSpace(char ch)
+{
+    // Same set as QByteArray::trimmed()
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+bool KeyFile::Private::parse(const char *data, int size)
+{
     QString currentGroup;
-    QHash<QString, QByteArray> groupMap;
-    QByteArray rawValue;
+    Group groupMap;
     int line = 0;
-    int idx;
-    while (!file.atEnd()) {
-        data = file.readLine().trimmed();
+    int pos = 0;
+    while (pos < size) {
+        // find the line boundaries and trim them, without copying anything
+        int lineEnd = pos;
+        while (lineEnd < size && data[lineEnd] != '\n') {
+            ++lineEnd;
+        }
+        int next = lineEnd + 1;
+        int from = pos;
+        int to = lineEnd;
+        while (from < to && isSpace(data[from])) {
+            ++from;
+        }
+        while (to > from && isSpace(data[to - 1])) {
+            --to;
+        }
+        pos = next;
         line++;
 
-        if (data.size() == 0) {
+        if (from == to) {
             // skip empty lines
             continue;
         }
 
-        char ch = data.at(0);
+        char ch = data[from];
         if (ch == '#') {
             // skip comments
             continue;
@@ -131,8 +204,8 @@ bool KeyFile::Private::read()
                 groupMap.clear();
             }
 
-            idx = data.indexOf(']');
-            if (idx == -1) {
+            const char *close = static_cast<const char *>(memchr(data + from, ']', to - from));
+            if (!close) {
                 // line starts with [ and it's not a group
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("invalid group at line %2 - missing ']'"))
@@ -140,11 +213,20 @@ bool KeyFile::Private::read()
                 return false;
             }
 
-            group = data.mid(1, idx - 1).trimmed();
-            if (groups.contains(QLatin1String(group))) {
+            int groupFrom = from + 1;
+            int groupTo = close - data;
+            while (groupFrom < groupTo && isSpace(data[groupFrom])) {
+                ++groupFrom;
+            }
+            while (groupTo > groupFrom && isSpace(data[groupTo - 1])) {
+                --groupTo;
+            }
+            QByteArray group = QByteArray::fromRawData(data + groupFrom, groupTo - groupFrom);
+            QString rawGroup = QString::fromLatin1(group.constData(), group.size());
+            if (groups.contains(rawGroup)) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("duplicated group '%1' at line %2"))
-                                 .arg(QLatin1String(group)).arg(line));
+                                 .arg(rawGroup).arg(line));
                 return false;
             }
 
@@ -157,8 +239,8 @@ bool KeyFile::Private::read()
             }
         }
         else {
-            idx = data.indexOf('=');
-            if (idx == -1) {
+            const char *equals = static_cast<const char *>(memchr(data + from, '=', to - from));
+            if (!equals) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("format error at line %1 - missing '='"))
                                  .arg(line));
@@ -166,14 +248,15 @@ bool KeyFile::Private::read()
             }
 
             // remove trailing spaces
-            char ch;
+            int idx = equals - data;
             int idxKeyEnd = idx;
-            while ((ch = data.at(idxKeyEnd - 1)) == ' ' || ch == '\t') {
+            while (idxKeyEnd > from && ((ch = data[idxKeyEnd - 1]) == ' ' || ch == '\t')) {
                 --idxKeyEnd;
             }
 
             QString key;
-            if (!validateKey(data, 0, idxKeyEnd, key)) {
+            QByteArray lineData = QByteArray::fromRawData(data + from, idxKeyEnd - from);
+            if (!validateKey(lineData, 0, lineData.size(), key)) {
                 setError(KeyFile::FormatError,
                          QString(QLatin1String("invalid key '%1' at line %2"))
                                  .arg(key).arg(line));
@@ -187,9 +270,11 @@ bool KeyFile::Private::read()
                 return false;
             }
 
-            data = data.mid(idx + 1).trimmed();
-            rawValue = data.mid(0, data.size());
-            groupMap[key] = rawValue;
+            int valueFrom = idx + 1;
+            while (valueFrom < to && isSpace(data[valueFrom])) {
+                ++valueFrom;
+            }
+            groupMap.insert(key, Value(valueFrom, to));
         }
     }
 
@@ -224,6 +309,21 @@ bool KeyFile::Private::validateKey(const QByteArray &data, int from, int to, QSt
     return ret;
 }
 
+const KeyFile::Private::Value *KeyFile::Private::find(const QString &key) const
+{
+    QHash<QString, Group>::const_iterator itrGroup = groups.constFind(currentGroup);
+    if (itrGroup == groups.constEnd()) {
+        return 0;
+    }
+
+    Group::const_iterator itrValue = itrGroup.value().constFind(key);
+    if (itrValue == itrGroup.value().constEnd()) {
+        return 0;
+    }
+
+    return &itrValue.value();
+}
+
 QStringList KeyFile::Private::allGroups() const
 {
     return groups.keys();
@@ -232,7 +332,7 @@ QStringList KeyFile::Private::allGroups() const
 QStringList KeyFile::Private::allKeys() const
 {
     QStringList keys;
-    QHash<QString, QHash<QString, QByteArray> >::const_iterator itrGroups = groups.begin();
+    QHash<QString, Group>::const_iterator itrGroups = groups.begin();
     while (itrGroups != groups.end()) {
         keys << itrGroups.value().keys();
         ++itrGroups;
@@ -242,43 +342,59 @@ QStringList KeyFile::Private::allKeys() const
 
 QStringList KeyFile::Private::keys() const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    return groupMap.keys();
+    return groups.value(currentGroup).keys();
 }
 
 bool KeyFile::Private::contains(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    return groupMap.contains(key);
+    return find(key) != 0;
 }
 
 QString KeyFile::Private::rawValue(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    QByteArray rawValue = groupMap.value(key);
-    return QLatin1String(rawValue);
+    const Value *v = find(key);
+    if (!v) {
+        return QString();
+    }
+    return QString::fromLatin1(contents.constData() + v->from, v->to - v->from);
 }
 
 QString KeyFile::Private::value(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    QString result;
-    QByteArray rawValue = groupMap.value(key);
-    if (unescapeString(rawValue, 0, rawValue.size(), result)) {
-        return result;
+    const Value *v = find(key);
+    if (!v) {
+        return QString();
     }
-    return QString();
+
+    if (!(v->flags & Value::HasString)) {
+        QString result;
+        if (unescapeString(contents, v->from, v->to, result)) {
+            v->string = result;
+            v->flags |= Value::StringValid;
+        }
+        v->flags |= Value::HasString;
+    }
+
+    return (v->flags & Value::StringValid) ? v->string : QString();
 }
 
 QStringList KeyFile::Private::valueAsStringList(const QString &key) const
 {
-    QHash<QString, QByteArray> groupMap = groups[currentGroup];
-    QStringList result;
-    QByteArray rawValue = groupMap.value(key);
-    if (unescapeStringList(rawValue, 0, rawValue.size(), result)) {
-        return result;
+    const Value *v = find(key);
+    if (!v) {
+        return QStringList();
     }
-    return QStringList();
+
+    if (!(v->flags & Value::HasStringList)) {
+        QStringList result;
+        if (unescapeStringList(contents, v->from, v->to, result)) {
+            v->stringList = result;
+            v->flags |= Value::StringListValid;
+        }
+        v->flags |= Value::HasStringList;
+    }
+
+    return (v->flags & Value::StringListValid) ? v->stringList : QStringList();
 }
 
 /**
@@ -322,6 +438,7 @@ KeyFile::KeyFile(const KeyFile &other)
 {
     mPriv->fileName = other.mPriv->fileName;
     mPriv->status = other.mPriv->status;
+    mPriv->contents = other.mPriv->contents;
     mPriv->groups = other.mPriv->groups;
     mPriv->currentGroup = other.mPriv->currentGroup;
 }
@@ -338,6 +455,7 @@ KeyFile &KeyFile::operator=(const KeyFile &other)
 {
     mPriv->fileName = other.mPriv->fileName;
     mPriv->status = other.mPriv->status;
+    mPriv->contents = other.mPriv->contents;
     mPriv->groups = other.mPriv->groups;
     mPriv->currentGroup = other.mPriv->currentGroup;
     return *this;
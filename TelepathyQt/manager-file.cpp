@@ -93,28 +93,7 @@ ManagerFile::Private::Private(const QString &cmName)
 
 void ManagerFile::Private::init()
 {
-    // TODO: should we cache the configDirs anywhere?
-    QStringList configDirs;
-
-    QString xdgDataHome = QString::fromLocal8Bit(qgetenv("XDG_DATA_HOME"));
-    if (xdgDataHome.isEmpty()) {
-        configDirs << QDir::homePath() + QLatin1String("/.local/share/data/telepathy/managers/");
-    }
-    else {
-        configDirs << xdgDataHome + QLatin1String("/telepathy/managers/");
-    }
-
-    QString xdgDataDirsEnv = QString::fromLocal8Bit(qgetenv("XDG_DATA_DIRS"));
-    if (xdgDataDirsEnv.isEmpty()) {
-        configDirs << QLatin1String("/usr/local/share/telepathy/managers/");
-        configDirs << QLatin1String("/usr/share/telepathy/managers/");
-    }
-    else {
-        QStringList xdgDataDirs = xdgDataDirsEnv.split(QLatin1Char(':'));
-        foreach (const QString xdgDataDir, xdgDataDirs) {
-            configDirs << xdgDataDir + QLatin1String("/telepathy/managers/");
-        }
-    }
+    QStringList configDirs = ManagerFile::configDirs();
 
     foreach (const QString configDir, configDirs) {
         QString fileName = configDir + cmName + QLatin1String(".manager");
@@ -381,6 +360,36 @@ QVariant ManagerFile::Private::valueForKey(const QString &param,
  * files according to the \telepathy_spec.
  */
 
+/**
+ * Return the directories searched for .manager files, in order of precedence.
+ */
+QStringList ManagerFile::configDirs()
+{
+    QStringList configDirs;
+
+    QString xdgDataHome = QString::fromLocal8Bit(qgetenv("XDG_DATA_HOME"));
+    if (xdgDataHome.isEmpty()) {
+        configDirs << QDir::homePath() + QLatin1String("/.local/share/data/telepathy/managers/");
+    }
+    else {
+        configDirs << xdgDataHome + QLatin1String("/telepathy/managers/");
+    }
+
+    QString xdgDataDirsEnv = QString::fromLocal8Bit(qgetenv("XDG_DATA_DIRS"));
+    if (xdgDataDirsEnv.isEmpty()) {
+        configDirs << QLatin1String("/usr/local/share/telepathy/managers/");
+        configDirs << QLatin1String("/usr/share/telepathy/managers/");
+    }
+    else {
+        QStringList xdgDataDirs = xdgDataDirsEnv.split(QLatin1Char(':'));
+        foreach (const QString xdgDataDir, xdgDataDirs) {
+            configDirs << xdgDataDir + QLatin1String("/telepathy/managers/");
+        }
+    }
+
+    return configDirs;
+}
+
 /**
  * Create a ManagerFile object used to read .manager compliant files.
  */
@@ -45,6 +45,8 @@ public:
 
     ManagerFile &operator=(const ManagerFile &other);
 
+    static QStringList configDirs();
+
     QString cmName() const;
 
     bool isValid() const;
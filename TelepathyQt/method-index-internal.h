@@ -0,0 +1,110 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_method_index_internal_h_HEADER_GUARD_
+#define _TelepathyQt_method_index_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+
+#include <QDBusPendingCall>
+#include <QDBusPendingCallWatcher>
+#include <QMetaMethod>
+#include <QMetaObject>
+#include <QObject>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+/*
+ * The index of a signal or slot, resolved from its normalized signature the first time it is
+ * needed.
+ *
+ * The string based QObject::connect() and QMetaObject::invokeMethod() normalize and look up the
+ * signature on every call. Hot paths keep a static MethodIndex instead and connect or invoke by
+ * index. The lookup always gives the same result, so concurrent first uses are harmless.
+ */
+class TP_QT_NO_EXPORT MethodIndex
+{
+public:
+    MethodIndex(const QMetaObject *metaObject, const char *signature)
+        : mMetaObject(metaObject), mSignature(signature), mIndex(-1)
+    {
+    }
+
+    int index() const
+    {
+        if (mIndex < 0) {
+            mIndex = mMetaObject->indexOfMethod(mSignature);
+            Q_ASSERT(mIndex >= 0);
+        }
+        return mIndex;
+    }
+
+    bool connect(const QObject *sender, const QObject *receiver,
+            const MethodIndex &method) const
+    {
+        return QMetaObject::connect(sender, index(), receiver, method.index());
+    }
+
+    bool invokeQueued(QObject *object) const
+    {
+        return mMetaObject->method(index()).invoke(object, Qt::QueuedConnection);
+    }
+
+private:
+    const QMetaObject *mMetaObject;
+    const char *mSignature;
+    mutable int mIndex;
+};
+
+/*
+ * Deliver QDBusPendingCallWatcher::finished() of \a watcher to \a slot of \a receiver.
+ */
+inline bool connectPendingCallWatcher(QDBusPendingCallWatcher *watcher, QObject *receiver,
+        const MethodIndex &slot)
+{
+    static const MethodIndex finishedSignal(&QDBusPendingCallWatcher::staticMetaObject,
+            "finished(QDBusPendingCallWatcher*)");
+
+    return finishedSignal.connect(watcher, receiver, slot);
+}
+
+/*
+ * Watch \a call and deliver QDBusPendingCallWatcher::finished() to \a slot of \a receiver.
+ *
+ * The watcher is a child of \a receiver, so it goes away with it instead of needing its own
+ * deleteLater(). Receivers which outlive many calls should still delete the watcher once done.
+ */
+inline QDBusPendingCallWatcher *watchPendingCall(const QDBusPendingCall &call, QObject *receiver,
+        const MethodIndex &slot)
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, receiver);
+    connectPendingCallWatcher(watcher, receiver, slot);
+    return watcher;
+}
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
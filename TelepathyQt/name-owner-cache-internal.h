@@ -0,0 +1,113 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_name_owner_cache_internal_h_HEADER_GUARD_
+#define _TelepathyQt_name_owner_cache_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+#include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/SharedPtr>
+
+#include <QDBusConnection>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QDBusPendingCallWatcher;
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+class TP_QT_NO_EXPORT NameOwnerCache : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(NameOwnerCache)
+
+public:
+    class PendingResolve;
+
+    static NameOwnerCache *forBus(const QDBusConnection &bus);
+
+    bool lookup(const QString &name, QString &owner) const;
+    QString uniqueNameFrom(const QString &name, QString &error, QString &message);
+    PendingOperation *resolve(const QStringList &names, const SharedPtr<RefCounted> &object);
+
+    quint64 synchronousCalls() const { return mSynchronousCalls; }
+
+private Q_SLOTS:
+    void onNameOwnerChanged(const QString &name, const QString &oldOwner,
+            const QString &newOwner);
+    void onGetNameOwnerFinished(QDBusPendingCallWatcher *watcher);
+
+private:
+    NameOwnerCache(const QDBusConnection &bus);
+    ~NameOwnerCache();
+
+    bool isKnown(const QString &name) const;
+    void watch(const QString &name);
+    void unwatch(const QString &name);
+    void setOwner(const QString &name, const QString &owner);
+    void setError(const QString &name, const QString &error, const QString &message);
+    void notifyResolved(const QString &name);
+
+    static QMutex mInstancesMutex;
+    static QHash<QString, NameOwnerCache *> mInstances;
+
+    QDBusConnection mBus;
+    QHash<QString, QString> mOwners;
+    // Names which had no owner when last asked for, until NameOwnerChanged says otherwise
+    QHash<QString, QPair<QString, QString> > mErrors;
+    QHash<QDBusPendingCallWatcher *, QString> mCalls;
+    QSet<QString> mNamesInFlight;
+    // Names we have a NameOwnerChanged match rule for
+    QSet<QString> mWatched;
+    QList<PendingResolve *> mResolves;
+    quint64 mSynchronousCalls;
+};
+
+class TP_QT_NO_EXPORT NameOwnerCache::PendingResolve : public PendingOperation
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(PendingResolve)
+
+public:
+    PendingResolve(const QSet<QString> &names, const SharedPtr<RefCounted> &object);
+    ~PendingResolve();
+
+private:
+    friend class NameOwnerCache;
+
+    QSet<QString> mNames;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
@@ -0,0 +1,292 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/name-owner-cache-internal.h"
+
+#include "TelepathyQt/_gen/name-owner-cache-internal.moc.hpp"
+
+#include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/test-backdoors.h"
+
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusReply>
+#include <QMutexLocker>
+
+namespace Tp
+{
+
+NameOwnerCache::PendingResolve::PendingResolve(const QSet<QString> &names,
+        const SharedPtr<RefCounted> &object)
+    : PendingOperation(object),
+      mNames(names)
+{
+}
+
+NameOwnerCache::PendingResolve::~PendingResolve()
+{
+}
+
+QMutex NameOwnerCache::mInstancesMutex;
+QHash<QString, NameOwnerCache *> NameOwnerCache::mInstances;
+
+/**
+ * Return the process-wide name owner cache for \a bus.
+ *
+ * The cache adds a NameOwnerChanged match rule for each name it is asked about, so once a name is
+ * known its owner stays up to date without further calls. The rule is removed again when the name
+ * loses its owner, and the entry with it.
+ */
+NameOwnerCache *NameOwnerCache::forBus(const QDBusConnection &bus)
+{
+    QMutexLocker locker(&mInstancesMutex);
+    NameOwnerCache *cache = mInstances.value(bus.name());
+    if (!cache) {
+        cache = new NameOwnerCache(bus);
+        mInstances.insert(bus.name(), cache);
+    }
+    return cache;
+}
+
+NameOwnerCache::NameOwnerCache(const QDBusConnection &bus)
+    : mBus(bus),
+      mSynchronousCalls(0)
+{
+}
+
+NameOwnerCache::~NameOwnerCache()
+{
+}
+
+/**
+ * Look up the unique name owning \a name, without making any D-Bus call.
+ *
+ * \return \c true and set \a owner if the owner of \a name is known.
+ */
+bool NameOwnerCache::lookup(const QString &name, QString &owner) const
+{
+    if (name.startsWith(QLatin1String(":"))) {
+        owner = name;
+        return true;
+    }
+
+    QHash<QString, QString>::const_iterator i = mOwners.constFind(name);
+    if (i == mOwners.constEnd()) {
+        return false;
+    }
+
+    owner = i.value();
+    return true;
+}
+
+/**
+ * Return the unique name owning \a name, or an empty string and set \a error and \a message if it
+ * has no owner.
+ *
+ * This only blocks on a GetNameOwner call if \a name is neither in the cache nor known to have no
+ * owner, which can be avoided by using resolve() first.
+ */
+QString NameOwnerCache::uniqueNameFrom(const QString &name, QString &error, QString &message)
+{
+    QString owner;
+    if (lookup(name, owner)) {
+        return owner;
+    }
+
+    QHash<QString, QPair<QString, QString> >::const_iterator i = mErrors.constFind(name);
+    if (i != mErrors.constEnd()) {
+        error = i.value().first;
+        message = i.value().second;
+        return QString();
+    }
+
+    // Watch first, so an owner change racing with the call is not missed
+    watch(name);
+
+    ++mSynchronousCalls;
+    QDBusReply<QString> reply = mBus.interface()->serviceOwner(name);
+    if (!reply.isValid()) {
+        error = reply.error().name();
+        message = reply.error().message();
+        setError(name, error, message);
+        return QString();
+    }
+
+    setOwner(name, reply.value());
+    return reply.value();
+}
+
+/**
+ * Asynchronously find out the owners of \a names, so that uniqueNameFrom() doesn't need to block
+ * for any of them.
+ *
+ * The returned operation always succeeds, names without an owner are remembered as such. Names
+ * which are already being resolved are not asked for twice.
+ */
+PendingOperation *NameOwnerCache::resolve(const QStringList &names,
+        const SharedPtr<RefCounted> &object)
+{
+    QSet<QString> pending;
+    foreach (const QString &name, names) {
+        if (isKnown(name)) {
+            continue;
+        }
+
+        pending.insert(name);
+
+        if (mNamesInFlight.contains(name)) {
+            continue;
+        }
+
+        watch(name);
+
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+                mBus.interface()->asyncCall(QLatin1String("GetNameOwner"), name), this);
+        connect(watcher,
+                SIGNAL(finished(QDBusPendingCallWatcher*)),
+                SLOT(onGetNameOwnerFinished(QDBusPendingCallWatcher*)));
+        mCalls.insert(watcher, name);
+        mNamesInFlight.insert(name);
+    }
+
+    PendingResolve *op = new PendingResolve(pending, object);
+    if (pending.isEmpty()) {
+        op->setFinished();
+    } else {
+        mResolves.append(op);
+    }
+    return op;
+}
+
+void NameOwnerCache::onNameOwnerChanged(const QString &name, const QString &oldOwner,
+        const QString &newOwner)
+{
+    Q_UNUSED(oldOwner);
+
+    if (name.startsWith(QLatin1String(":"))) {
+        return;
+    }
+
+    if (newOwner.isEmpty()) {
+        mOwners.remove(name);
+        mErrors.remove(name);
+
+        // A call in flight will still fill in the entry, so keep following the name until then
+        if (!mNamesInFlight.contains(name)) {
+            unwatch(name);
+        }
+    } else {
+        setOwner(name, newOwner);
+    }
+}
+
+void NameOwnerCache::onGetNameOwnerFinished(QDBusPendingCallWatcher *watcher)
+{
+    QString name = mCalls.take(watcher);
+    mNamesInFlight.remove(name);
+
+    QDBusPendingReply<QString> reply = *watcher;
+    // A NameOwnerChanged signal received while the call was pending is more recent than the reply
+    if (!isKnown(name)) {
+        if (reply.isError()) {
+            setError(name, reply.error().name(), reply.error().message());
+        } else {
+            setOwner(name, reply.value());
+        }
+    }
+
+    notifyResolved(name);
+    watcher->deleteLater();
+}
+
+bool NameOwnerCache::isKnown(const QString &name) const
+{
+    return name.startsWith(QLatin1String(":")) || mOwners.contains(name) ||
+        mErrors.contains(name);
+}
+
+void NameOwnerCache::watch(const QString &name)
+{
+    if (name.startsWith(QLatin1String(":")) || mWatched.contains(name)) {
+        return;
+    }
+
+    mBus.connect(QLatin1String("org.freedesktop.DBus"), QLatin1String("/org/freedesktop/DBus"),
+            QLatin1String("org.freedesktop.DBus"), QLatin1String("NameOwnerChanged"),
+            QStringList() << name, QString(),
+            this, SLOT(onNameOwnerChanged(QString,QString,QString)));
+    mWatched.insert(name);
+}
+
+void NameOwnerCache::unwatch(const QString &name)
+{
+    if (!mWatched.remove(name)) {
+        return;
+    }
+
+    mBus.disconnect(QLatin1String("org.freedesktop.DBus"), QLatin1String("/org/freedesktop/DBus"),
+            QLatin1String("org.freedesktop.DBus"), QLatin1String("NameOwnerChanged"),
+            QStringList() << name, QString(),
+            this, SLOT(onNameOwnerChanged(QString,QString,QString)));
+}
+
+void NameOwnerCache::setOwner(const QString &name, const QString &owner)
+{
+    mErrors.remove(name);
+    mOwners.insert(name, owner);
+}
+
+void NameOwnerCache::setError(const QString &name, const QString &error, const QString &message)
+{
+    mOwners.remove(name);
+    mErrors.insert(name, QPair<QString, QString>(error, message));
+}
+
+void NameOwnerCache::notifyResolved(const QString &name)
+{
+    foreach (PendingResolve *op, mResolves) {
+        op->mNames.remove(name);
+        if (op->mNames.isEmpty()) {
+            mResolves.removeOne(op);
+            op->setFinished();
+        }
+    }
+}
+
+PendingOperation *TestBackdoors::resolveNameOwners(const QDBusConnection &bus,
+        const QStringList &names)
+{
+    return NameOwnerCache::forBus(bus)->resolve(names, SharedPtr<RefCounted>());
+}
+
+bool TestBackdoors::lookupNameOwner(const QDBusConnection &bus, const QString &name,
+        QString &owner)
+{
+    return NameOwnerCache::forBus(bus)->lookup(name, owner);
+}
+
+quint64 TestBackdoors::nameOwnerSynchronousCalls(const QDBusConnection &bus)
+{
+    return NameOwnerCache::forBus(bus)->synchronousCalls();
+}
+
+} // Tp
@@ -32,14 +32,13 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/types-internal.h>
 
+#include <QFile>
 #include <QIODevice>
 #include <QTcpSocket>
 
 namespace Tp
 {
 
-static const int FT_BLOCK_SIZE = 16 * 1024;
-
 struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
 {
     Private(OutgoingFileTransferChannel *parent);
@@ -55,6 +54,15 @@ struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
     QTcpSocket *socket;
     SocketAddressIPv4 addr;
 
+    // Set when input is a QFile which could be memory-mapped, in which case data is written to
+    // the socket straight from the mapping
+    QFile *mappedFile;
+    uchar *map;
+    qint64 mapSize;
+
+    // Used when reading from input into memory is required
+    QByteArray buffer;
+
     qint64 pos;
 };
 
@@ -63,6 +71,9 @@ OutgoingFileTransferChannel::Private::Private(OutgoingFileTransferChannel *paren
       fileTransferInterface(parent->interface<Client::ChannelTypeFileTransferInterface>()),
       input(0),
       socket(0),
+      mappedFile(0),
+      map(0),
+      mapSize(0),
       pos(0)
 {
 }
@@ -254,8 +265,21 @@ void OutgoingFileTransferChannel::onSocketConnected()
     connect(mPriv->input, SIGNAL(readyRead()),
             SLOT(doTransfer()));
 
+    // regular files are sent straight from a memory mapping, avoiding a copy through a buffer
+    QFile *file = qobject_cast<QFile *>(mPriv->input);
+    if (file && !file->isSequential() && file->size() > 0 &&
+        initialOffset() <= (qulonglong) file->size()) {
+        mPriv->map = file->map(0, file->size());
+        if (mPriv->map) {
+            debug() << "Sending file from a memory mapping";
+            mPriv->mappedFile = file;
+            mPriv->mapSize = file->size();
+            mPriv->pos = initialOffset();
+        }
+    }
+
     // for non sequential devices, let's seek to the initialOffset
-    if (!mPriv->input->isSequential()) {
+    if (!mPriv->map && !mPriv->input->isSequential()) {
         if (mPriv->input->seek(initialOffset())) {
             mPriv->pos = initialOffset();
         }
@@ -283,9 +307,16 @@ void OutgoingFileTransferChannel::onInputAboutToClose()
 
     // read all remaining data from input device and write to output device
     if (isConnected()) {
-        QByteArray data;
-        data = mPriv->input->readAll();
-        mPriv->socket->write(data); // never fails
+        if (mPriv->map) {
+            if (mPriv->pos < mPriv->mapSize) {
+                mPriv->socket->write(reinterpret_cast<const char *>(mPriv->map) + mPriv->pos,
+                        mPriv->mapSize - mPriv->pos); // never fails
+            }
+        } else {
+            QByteArray data;
+            data = mPriv->input->readAll();
+            mPriv->socket->write(data); // never fails
+        }
     }
 
     setFinished();
@@ -293,16 +324,40 @@ void OutgoingFileTransferChannel::onInputAboutToClose()
 
 void OutgoingFileTransferChannel::doTransfer()
 {
-    // read FT_BLOCK_SIZE each time, as input can be a QFile, we don't want to
+    qint64 chunkSize = transferChunkSize();
+
+    if (mPriv->map) {
+        // only keep one chunk queued in the socket, bytesWritten() will bring us back here
+        if (mPriv->socket->bytesToWrite() >= chunkSize) {
+            return;
+        }
+
+        qint64 len = qMin(chunkSize, mPriv->mapSize - mPriv->pos);
+        if (len > 0) {
+            mPriv->socket->write(reinterpret_cast<const char *>(mPriv->map) + mPriv->pos,
+                    len); // never fails
+            mPriv->pos += len;
+        }
+
+        if (mPriv->pos >= mPriv->mapSize) {
+            // EOF
+            setFinished();
+        }
+        return;
+    }
+
+    // read chunkSize bytes each time, as input can be a QFile, we don't want to
     // block reading the whole file
-    char buffer[FT_BLOCK_SIZE];
-    char *p = buffer;
+    if (mPriv->buffer.size() != chunkSize) {
+        mPriv->buffer.resize(chunkSize);
+    }
+    char *p = mPriv->buffer.data();
 
-    memset(buffer, 0, sizeof(buffer));
-    qint64 len = mPriv->input->read(buffer, sizeof(buffer));
+    qint64 len = mPriv->input->read(p, chunkSize);
 
     bool scheduleTransfer = false;
     if (((qulonglong) mPriv->pos < initialOffset()) && (len > 0)) {
+        // only sequential devices get here, the others were seeked to initialOffset
         qint64 skip = (qint64) qMin(initialOffset() - mPriv->pos,
                 (qulonglong) len);
 
@@ -317,6 +372,7 @@ void OutgoingFileTransferChannel::doTransfer()
 
         p += skip;
         len -= skip;
+        mPriv->pos += skip;
     }
 
     if (len > 0) {
@@ -333,7 +389,7 @@ end:
     mPriv->pos += len;
 
     if (scheduleTransfer) {
-        QMetaObject::invokeMethod(this, SLOT(doTransfer()),
+        QMetaObject::invokeMethod(this, "doTransfer",
                 Qt::QueuedConnection);
     }
 }
@@ -357,6 +413,12 @@ void OutgoingFileTransferChannel::setFinished()
         mPriv->socket->close();
     }
 
+    if (mPriv->map) {
+        mPriv->mappedFile->unmap(mPriv->map);
+        mPriv->map = 0;
+        mPriv->mappedFile = 0;
+    }
+
     if (mPriv->input) {
         disconnect(mPriv->input, SIGNAL(aboutToClose()),
                    this, SLOT(onInputAboutToClose()));
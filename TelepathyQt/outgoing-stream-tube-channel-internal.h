@@ -102,6 +102,10 @@ struct TP_QT_NO_EXPORT OutgoingStreamTubeChannel::Private
     QHash<QPair<QHostAddress, quint16>, uint> connectionsForSourceAddresses;
     QHash<uchar, uint> connectionsForCredentials;
 
+    // Reverse indices, so closing a connection doesn't need to scan the hashes above
+    QHash<uint, QPair<QHostAddress, quint16> > sourceAddressesForConnections;
+    QHash<uint, uchar> credentialsForConnections;
+
     QHash<QUuid, QPair<uint, QDBusVariant> > pendingNewConnections;
 
     struct ClosedConnection {
@@ -717,6 +717,46 @@ QHash<uint, ContactPtr> OutgoingStreamTubeChannel::contactsForConnections() cons
     return mPriv->contactsForConnections;
 }
 
+/**
+ * Return the contact the connection with the given id is from.
+ *
+ * Unlike contactsForConnections(), this doesn't check that the tube is open, and just returns a
+ * null ContactPtr for unknown connections. It is meant for looking up connections as they are
+ * reported by the StreamTubeChannel::newConnection() and StreamTubeChannel::connectionClosed()
+ * signals.
+ *
+ * This method requires StreamTubeChannel::FeatureConnectionMonitoring to be ready.
+ *
+ * \param connectionId The id of the connection.
+ * \return A pointer to the Contact object, or a null ContactPtr if the connection is unknown.
+ * \sa contactsForConnections()
+ */
+ContactPtr OutgoingStreamTubeChannel::contactForConnection(uint connectionId) const
+{
+    return mPriv->contactsForConnections.value(connectionId);
+}
+
+/**
+ * Return the source address of the connection with the given id.
+ *
+ * Unlike connectionsForSourceAddresses(), this doesn't check that the tube is open, and just
+ * returns (\c QHostAddress::Null, 0) for unknown connections and connections without a known source
+ * address. It is meant for looking up connections as they are reported by the
+ * StreamTubeChannel::newConnection() and StreamTubeChannel::connectionClosed() signals.
+ *
+ * This method requires StreamTubeChannel::FeatureConnectionMonitoring to be ready.
+ *
+ * \param connectionId The id of the connection.
+ * \return The source address as a (QHostAddress, port in native byte order) pair.
+ * \sa connectionsForSourceAddresses()
+ */
+QPair<QHostAddress, quint16> OutgoingStreamTubeChannel::sourceAddressForConnection(
+        uint connectionId) const
+{
+    return mPriv->sourceAddressesForConnections.value(connectionId,
+            qMakePair(QHostAddress(QHostAddress::Null), quint16(0)));
+}
+
 void OutgoingStreamTubeChannel::onNewRemoteConnection(
         uint contactId,
         const QDBusVariant &parameter,
@@ -747,25 +787,35 @@ void OutgoingStreamTubeChannel::onContactsRetrieved(
             // (like StreamTubeServer) has a chance to recover the source address / contact
             removeConnection(conn.id, conn.error, conn.message);
 
-            // Remove stuff from our hashes
+            // Remove stuff from our hashes, only walking the entries sharing the connection's key
             mPriv->contactsForConnections.remove(conn.id);
 
-            QHash<QPair<QHostAddress, quint16>, uint>::iterator srcAddrIter =
-                mPriv->connectionsForSourceAddresses.begin();
-            while (srcAddrIter != mPriv->connectionsForSourceAddresses.end()) {
-                if (srcAddrIter.value() == conn.id) {
-                    srcAddrIter = mPriv->connectionsForSourceAddresses.erase(srcAddrIter);
-                } else {
-                    ++srcAddrIter;
+            if (mPriv->sourceAddressesForConnections.contains(conn.id)) {
+                QPair<QHostAddress, quint16> address =
+                    mPriv->sourceAddressesForConnections.take(conn.id);
+                QHash<QPair<QHostAddress, quint16>, uint>::iterator srcAddrIter =
+                    mPriv->connectionsForSourceAddresses.find(address);
+                while (srcAddrIter != mPriv->connectionsForSourceAddresses.end() &&
+                        srcAddrIter.key() == address) {
+                    if (srcAddrIter.value() == conn.id) {
+                        srcAddrIter = mPriv->connectionsForSourceAddresses.erase(srcAddrIter);
+                    } else {
+                        ++srcAddrIter;
+                    }
                 }
             }
 
-            QHash<uchar, uint>::iterator credIter = mPriv->connectionsForCredentials.begin();
-            while (credIter != mPriv->connectionsForCredentials.end()) {
-                if (credIter.value() == conn.id) {
-                    credIter = mPriv->connectionsForCredentials.erase(credIter);
-                } else {
-                    ++credIter;
+            if (mPriv->credentialsForConnections.contains(conn.id)) {
+                uchar credentialByte = mPriv->credentialsForConnections.take(conn.id);
+                QHash<uchar, uint>::iterator credIter =
+                    mPriv->connectionsForCredentials.find(credentialByte);
+                while (credIter != mPriv->connectionsForCredentials.end() &&
+                        credIter.key() == credentialByte) {
+                    if (credIter.value() == conn.id) {
+                        credIter = mPriv->connectionsForCredentials.erase(credIter);
+                    } else {
+                        ++credIter;
+                    }
                 }
             }
         } else {
@@ -805,12 +855,14 @@ void OutgoingStreamTubeChannel::onContactsRetrieved(
         if (accessControl() == SocketAccessControlCredentials) {
             uchar credentialByte = qdbus_cast<uchar>(connectionProperties.second.variant());
             mPriv->connectionsForCredentials.insertMulti(credentialByte, connectionProperties.first);
+            mPriv->credentialsForConnections.insert(connectionProperties.first, credentialByte);
         }
     }
 
     if (address.first != QHostAddress::Null) {
         // We can map it to a source address as well
         mPriv->connectionsForSourceAddresses.insertMulti(address, connectionProperties.first);
+        mPriv->sourceAddressesForConnections.insert(connectionProperties.first, address);
     }
 
     // Time for us to emit the signal
@@ -64,6 +64,9 @@ public:
     QHash<QPair<QHostAddress,quint16>, uint> connectionsForSourceAddresses() const;
     QHash<uchar, uint> connectionsForCredentials() const;
 
+    Tp::ContactPtr contactForConnection(uint connectionId) const;
+    QPair<QHostAddress, quint16> sourceAddressForConnection(uint connectionId) const;
+
 protected:
     OutgoingStreamTubeChannel(const ConnectionPtr &connection, const QString &objectPath,
             const QVariantMap &immutableProperties,
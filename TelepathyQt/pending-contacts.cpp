@@ -26,13 +26,13 @@
 #include "TelepathyQt/_gen/pending-contacts.moc.hpp"
 #include "TelepathyQt/_gen/pending-contacts-internal.moc.hpp"
 
+#include "TelepathyQt/contact-manager-internal.h"
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/ConnectionLowlevel>
 #include <TelepathyQt/ContactManager>
 #include <TelepathyQt/ContactFactory>
-#include <TelepathyQt/PendingContactAttributes>
 #include <TelepathyQt/PendingHandles>
 #include <TelepathyQt/ReferencedHandles>
 
@@ -42,6 +42,18 @@
 namespace Tp
 {
 
+// Position of each handle in handles, to avoid scanning the list for every handle looked up
+static QHash<uint, int> indexHandles(const ReferencedHandles &handles)
+{
+    QHash<uint, int> indexes;
+    indexes.reserve(handles.size());
+    for (int i = handles.size() - 1; i >= 0; --i) {
+        // the first occurrence wins, as with indexOf()
+        indexes.insert(handles.at(i), i);
+    }
+    return indexes;
+}
+
 struct TP_QT_NO_EXPORT PendingContacts::Private
 {
     Private(PendingContacts *parent, const ContactManagerPtr &manager, const UIntList &handles,
@@ -196,9 +208,9 @@ PendingContacts::PendingContacts(const ContactManagerPtr &manager,
     if (!otherContacts.isEmpty()) {
         ConnectionPtr conn = manager->connection();
         if (conn->interfaces().contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS)) {
-            PendingContactAttributes *attributes =
-                conn->lowlevel()->contactAttributes(otherContacts.toList(),
-                        interfaces, true);
+            // merged with the other requests made in the same batch window
+            PendingOperation *attributes = manager->queueContactAttributes(otherContacts,
+                    interfaces);
 
             connect(attributes,
                     SIGNAL(finished(Tp::PendingOperation*)),
@@ -481,8 +493,8 @@ QStringList PendingContacts::invalidUris() const
 
 void PendingContacts::onAttributesFinished(PendingOperation *operation)
 {
-    PendingContactAttributes *pendingAttributes =
-        qobject_cast<PendingContactAttributes *>(operation);
+    ContactManager::PendingAttributesBatch *pendingAttributes =
+        qobject_cast<ContactManager::PendingAttributesBatch *>(operation);
 
     if (pendingAttributes->isError()) {
         debug() << "PendingAttrs error" << pendingAttributes->errorName()
@@ -493,10 +505,11 @@ void PendingContacts::onAttributesFinished(PendingOperation *operation)
 
     ReferencedHandles validHandles = pendingAttributes->validHandles();
     ContactAttributesMap attributes = pendingAttributes->attributes();
+    QHash<uint, int> validIndexes = indexHandles(validHandles);
 
     foreach (uint handle, mPriv->handles) {
         if (!mPriv->satisfyingContacts.contains(handle)) {
-            int indexInValid = validHandles.indexOf(handle);
+            int indexInValid = validIndexes.value(handle, -1);
             if (indexInValid >= 0) {
                 ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
                 QVariantMap handleAttributes = attributes[handle];
@@ -548,9 +561,10 @@ void PendingContacts::onAddressingGetContactsFinished(PendingOperation *operatio
     ContactAttributesMap attributes = pa->attributes();
     UIntList handles = attributes.keys();
     ReferencedHandles referencedHandles(conn, HandleTypeContact, handles);
+    QHash<uint, int> referencedIndexes = indexHandles(referencedHandles);
 
     foreach (uint handle, handles) {
-        int indexInValid = referencedHandles.indexOf(handle);
+        int indexInValid = referencedIndexes.value(handle, -1);
         Q_ASSERT(indexInValid >= 0);
         ReferencedHandles referencedHandle = referencedHandles.mid(indexInValid, 1);
         QVariantMap handleAttributes = attributes[handle];
@@ -577,9 +591,10 @@ void PendingContacts::onReferenceHandlesFinished(PendingOperation *operation)
     UIntList invalidHandles = pendingHandles->invalidHandles();
     ConnectionPtr conn = mPriv->manager->connection();
     mPriv->handlesToInspect = ReferencedHandles(conn, HandleTypeContact, UIntList());
+    QHash<uint, int> validIndexes = indexHandles(validHandles);
     foreach (uint handle, mPriv->handles) {
         if (!mPriv->satisfyingContacts.contains(handle)) {
-            int indexInValid = validHandles.indexOf(handle);
+            int indexInValid = validIndexes.value(handle, -1);
             if (indexInValid >= 0) {
                 ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
                 mPriv->handlesToInspect.append(referencedHandle);
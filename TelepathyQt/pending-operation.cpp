@@ -30,10 +30,10 @@
 #include "TelepathyQt/_gen/simple-pending-operations.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/method-index-internal.h"
 
 #include <QDBusPendingCall>
 #include <QDBusPendingCallWatcher>
-#include <QTimer>
 
 namespace Tp
 {
@@ -143,7 +143,10 @@ void PendingOperation::setFinished()
 
     mPriv->finished = true;
     Q_ASSERT(isValid());
-    QTimer::singleShot(0, this, SLOT(emitFinished()));
+    // A queued call rather than a zero timer, which would allocate a timer object per
+    // operation
+    static const MethodIndex emitFinishedSlot(&staticMetaObject, "emitFinished()");
+    emitFinishedSlot.invokeQueued(this);
 }
 
 /**
@@ -178,7 +181,8 @@ void PendingOperation::setFinishedWithError(const QString &name,
     mPriv->errorMessage = message;
     mPriv->finished = true;
     Q_ASSERT(isError());
-    QTimer::singleShot(0, this, SLOT(emitFinished()));
+    static const MethodIndex emitFinishedSlot(&staticMetaObject, "emitFinished()");
+    emitFinishedSlot.invokeQueued(this);
 }
 
 /**
@@ -315,9 +319,9 @@ QString PendingOperation::errorMessage() const
 PendingVoid::PendingVoid(QDBusPendingCall call, const SharedPtr<RefCounted> &object)
     : PendingOperation(object)
 {
-    connect(new QDBusPendingCallWatcher(call),
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(watcherFinished(QDBusPendingCallWatcher*)));
+    static const MethodIndex watcherFinishedSlot(&staticMetaObject,
+            "watcherFinished(QDBusPendingCallWatcher*)");
+    watchPendingCall(call, this, watcherFinishedSlot);
 }
 
 void PendingVoid::watcherFinished(QDBusPendingCallWatcher *watcher)
@@ -327,8 +331,6 @@ void PendingVoid::watcherFinished(QDBusPendingCallWatcher *watcher)
     } else {
         setFinished();
     }
-
-    watcher->deleteLater();
 }
 
 struct TP_QT_NO_EXPORT PendingComposite::Private
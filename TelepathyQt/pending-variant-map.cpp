@@ -24,6 +24,7 @@
 
 #include "TelepathyQt/_gen/pending-variant-map.moc.hpp"
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/method-index-internal.h"
 
 #include <TelepathyQt/Global>
 
@@ -52,10 +53,23 @@ PendingVariantMap::PendingVariantMap(QDBusPendingCall call, const SharedPtr<RefC
     : PendingOperation(object),
       mPriv(new Private)
 {
-    connect(new QDBusPendingCallWatcher(call),
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            this,
-            SLOT(watcherFinished(QDBusPendingCallWatcher*)));
+    static const MethodIndex watcherFinishedSlot(&staticMetaObject,
+            "watcherFinished(QDBusPendingCallWatcher*)");
+    watchPendingCall(call, this, watcherFinishedSlot);
+}
+
+/**
+ * Construct a PendingVariantMap which is already finished with \a result.
+ *
+ * This is used when the result is known without a D-Bus round trip, for example when it
+ * comes from a property cache.
+ */
+PendingVariantMap::PendingVariantMap(const QVariantMap &result, const SharedPtr<RefCounted> &object)
+    : PendingOperation(object),
+      mPriv(new Private)
+{
+    mPriv->result = result;
+    setFinished();
 }
 
 /**
@@ -84,8 +98,6 @@ void PendingVariantMap::watcherFinished(QDBusPendingCallWatcher* watcher)
             reply.error().name() << ": " << reply.error().message();
         setFinishedWithError(reply.error());
     }
-
-    watcher->deleteLater();
 }
 
 } // Tp
@@ -42,6 +42,7 @@ class TP_QT_EXPORT PendingVariantMap : public PendingOperation
 
 public:
     PendingVariantMap(QDBusPendingCall call, const SharedPtr<RefCounted> &object);
+    PendingVariantMap(const QVariantMap &result, const SharedPtr<RefCounted> &object);
     ~PendingVariantMap();
 
     QVariantMap result() const;
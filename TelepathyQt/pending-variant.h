@@ -42,6 +42,7 @@ class TP_QT_EXPORT PendingVariant : public PendingOperation
 
 public:
     PendingVariant(QDBusPendingCall call, const SharedPtr<RefCounted> &object);
+    PendingVariant(const QVariant &result, const SharedPtr<RefCounted> &object);
     ~PendingVariant();
 
     QVariant result() const;
@@ -0,0 +1,101 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_profile_index_internal_h_HEADER_GUARD_
+#define _TelepathyQt_profile_index_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+#include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/Profile>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/SharedPtr>
+#include <TelepathyQt/Types>
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+class TP_QT_NO_EXPORT ProfileIndex
+{
+public:
+    struct Entry
+    {
+        Entry() : mtime(0), size(0), valid(false) { }
+
+        QString fileName;
+        uint mtime;
+        qint64 size;
+        QString serviceName;
+        QString type;
+        QString cmName;
+        QString protocolName;
+        bool valid;
+    };
+
+    class PendingScan;
+
+    static PendingScan *scan(const QStringList &searchDirs, const SharedPtr<RefCounted> &object);
+
+    static QString indexFileName();
+
+private:
+    class ScanJob;
+    friend class ScanJob;
+
+    static QHash<QString, Entry> load();
+    static bool save(const QHash<QString, Entry> &entries);
+    static void runScan(PendingScan *op, const QStringList &searchDirs);
+};
+
+class TP_QT_NO_EXPORT ProfileIndex::PendingScan : public PendingOperation
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(PendingScan)
+
+public:
+    PendingScan(const SharedPtr<RefCounted> &object);
+    ~PendingScan();
+
+    // serviceName -> index entry for every valid IM profile found
+    QHash<QString, Entry> entries() const { return mEntries; }
+    // serviceName -> profile for the profiles which had to be parsed as they were not indexed yet
+    QHash<QString, ProfilePtr> parsedProfiles() const { return mParsedProfiles; }
+
+private Q_SLOTS:
+    void onJobFinished();
+
+private:
+    friend class ProfileIndex;
+
+    QHash<QString, Entry> mEntries;
+    QHash<QString, ProfilePtr> mParsedProfiles;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
@@ -0,0 +1,247 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/profile-index-internal.h"
+
+#include "TelepathyQt/_gen/profile-index-internal.moc.hpp"
+
+#include "TelepathyQt/cache-file-internal.h"
+#include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/test-backdoors.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace Tp
+{
+
+// Bump whenever the layout of the index changes, older indexes are then rebuilt from scratch
+static const quint32 PROFILE_INDEX_MAGIC = 0x54505049; // "TPPI"
+static const quint32 PROFILE_INDEX_VERSION = 1;
+
+class TP_QT_NO_EXPORT ProfileIndex::ScanJob : public QRunnable
+{
+public:
+    ScanJob(PendingScan *op, const QStringList &searchDirs)
+        : op(op), searchDirs(searchDirs)
+    {
+    }
+
+    void run()
+    {
+        ProfileIndex::runScan(op, searchDirs);
+    }
+
+private:
+    PendingScan *op;
+    QStringList searchDirs;
+};
+
+ProfileIndex::PendingScan::PendingScan(const SharedPtr<RefCounted> &object)
+    : PendingOperation(object)
+{
+}
+
+ProfileIndex::PendingScan::~PendingScan()
+{
+}
+
+void ProfileIndex::PendingScan::onJobFinished()
+{
+    setFinished();
+}
+
+/**
+ * List the .profile files in \a searchDirs on a worker thread.
+ *
+ * Only the files which are not in the on-disk index yet, or which changed since they were
+ * indexed, are parsed. The index is updated accordingly.
+ */
+ProfileIndex::PendingScan *ProfileIndex::scan(const QStringList &searchDirs,
+        const SharedPtr<RefCounted> &object)
+{
+    PendingScan *op = new PendingScan(object);
+    QThreadPool::globalInstance()->start(new ScanJob(op, searchDirs));
+    return op;
+}
+
+QString ProfileIndex::indexFileName()
+{
+    return QString(QLatin1String("%1/profiles.index")).arg(cacheDirectory());
+}
+
+QHash<QString, ProfileIndex::Entry> ProfileIndex::load()
+{
+    QHash<QString, Entry> entries;
+
+    QFile file(indexFileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version;
+    if (magic != PROFILE_INDEX_MAGIC || version != PROFILE_INDEX_VERSION) {
+        return entries;
+    }
+
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Entry entry;
+        stream >> entry.fileName >> entry.mtime >> entry.size >> entry.serviceName >>
+            entry.type >> entry.cmName >> entry.protocolName >> entry.valid;
+        entries.insert(entry.fileName, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        warning() << "Ignoring corrupt profile index" << file.fileName();
+        entries.clear();
+    }
+
+    return entries;
+}
+
+bool ProfileIndex::save(const QHash<QString, Entry> &entries)
+{
+    QString fileName = indexFileName();
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath())) {
+        warning() << "Unable to create profile index directory for" << fileName;
+        return false;
+    }
+
+    QByteArray contents;
+    QDataStream stream(&contents, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << PROFILE_INDEX_MAGIC << PROFILE_INDEX_VERSION << (quint32) entries.size();
+    foreach (const Entry &entry, entries) {
+        stream << entry.fileName << entry.mtime << entry.size << entry.serviceName <<
+            entry.type << entry.cmName << entry.protocolName << entry.valid;
+    }
+
+    return writeCacheFile(fileName, contents);
+}
+
+void ProfileIndex::runScan(PendingScan *op, const QStringList &searchDirs)
+{
+    QHash<QString, Entry> index = load();
+    QHash<QString, Entry> newIndex;
+    bool changed = false;
+
+    foreach (const QString &searchDir, searchDirs) {
+        QDir dir(searchDir);
+        dir.setFilter(QDir::Files);
+
+        foreach (const QFileInfo &fi, dir.entryInfoList()) {
+            if (fi.completeSuffix() != QLatin1String("profile")) {
+                continue;
+            }
+
+            QString fileName = fi.absoluteFilePath();
+            QString serviceName = fi.baseName();
+
+            if (op->mEntries.contains(serviceName)) {
+                debug() << "Profile for service" << serviceName << "already "
+                    "exists. Ignoring profile file:" << fileName;
+                if (index.contains(fileName)) {
+                    newIndex.insert(fileName, index.value(fileName));
+                }
+                continue;
+            }
+
+            uint mtime = fi.lastModified().toTime_t();
+            Entry entry = index.value(fileName);
+            if (entry.fileName.isEmpty() || entry.mtime != mtime || entry.size != fi.size()) {
+                ProfilePtr profile = Profile::createForFileName(fileName);
+
+                entry = Entry();
+                entry.fileName = fileName;
+                entry.mtime = mtime;
+                entry.size = fi.size();
+                entry.serviceName = serviceName;
+                entry.valid = profile->isValid();
+                if (entry.valid) {
+                    entry.type = profile->type();
+                    entry.cmName = profile->cmName();
+                    entry.protocolName = profile->protocolName();
+                    if (entry.type == QLatin1String("IM")) {
+                        op->mParsedProfiles.insert(serviceName, profile);
+                    }
+                }
+                changed = true;
+            }
+            newIndex.insert(fileName, entry);
+
+            if (!entry.valid) {
+                continue;
+            }
+
+            if (entry.type != QLatin1String("IM")) {
+                debug() << "Ignoring profile for service" << serviceName <<
+                    ": type != IM. Profile file:" << fileName;
+                continue;
+            }
+
+            debug() << "Found profile for service" << serviceName <<
+                "- profile file:" << fileName;
+            op->mEntries.insert(serviceName, entry);
+        }
+    }
+
+    // Keep the entries for directories other processes search (with a different XDG_DATA_DIRS),
+    // but forget the removed files from the directories we just listed
+    QStringList scannedDirs;
+    foreach (const QString &searchDir, searchDirs) {
+        scannedDirs << QDir(searchDir).absolutePath();
+    }
+    foreach (const Entry &entry, index) {
+        if (newIndex.contains(entry.fileName)) {
+            continue;
+        }
+
+        if (scannedDirs.contains(QFileInfo(entry.fileName).absolutePath())) {
+            changed = true;
+        } else {
+            newIndex.insert(entry.fileName, entry);
+        }
+    }
+
+    if (changed) {
+        save(newIndex);
+    }
+
+    QMetaObject::invokeMethod(op, "onJobFinished", Qt::QueuedConnection);
+}
+
+QString TestBackdoors::profileIndexFileName()
+{
+    return ProfileIndex::indexFileName();
+}
+
+} // Tp
@@ -24,6 +24,7 @@
 
 #include "TelepathyQt/_gen/profile-manager.moc.hpp"
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/profile-index-internal.h"
 
 #include <TelepathyQt/ConnectionManager>
 #include <TelepathyQt/PendingComposite>
@@ -32,8 +33,6 @@
 #include <TelepathyQt/Profile>
 #include <TelepathyQt/ReadinessHelper>
 
-#include <QFile>
-#include <QFileInfo>
 #include <QString>
 #include <QStringList>
 
@@ -47,9 +46,16 @@ struct TP_QT_NO_EXPORT ProfileManager::Private
     static void introspectMain(Private *self);
     static void introspectFakeProfiles(Private *self);
 
+    ProfilePtr profile(const QString &serviceName);
+    QList<ProfilePtr> profilesMatching(const QString &cmName, const QString &protocolName);
+    bool hasProfile(const QString &serviceName, QString &cmName) const;
+
     ProfileManager *parent;
     ReadinessHelper *readinessHelper;
     QDBusConnection bus;
+    // serviceName -> index entry of the .profile files, which are only parsed on demand
+    QHash<QString, ProfileIndex::Entry> index;
+    // profiles parsed so far and fake profiles
     QHash<QString, ProfilePtr> profiles;
     QList<ConnectionManagerPtr> cms;
 };
@@ -82,47 +88,78 @@ ProfileManager::Private::Private(ProfileManager *parent, const QDBusConnection &
 
 void ProfileManager::Private::introspectMain(ProfileManager::Private *self)
 {
-    QStringList searchDirs = Profile::searchDirs();
-
-    foreach (const QString searchDir, searchDirs) {
-        QDir dir(searchDir);
-        dir.setFilter(QDir::Files);
+    // Listing the directories and (re)indexing the changed .profile files is done on a worker
+    // thread, the profiles themselves are only loaded when asked for
+    ProfileIndex::PendingScan *scan = ProfileIndex::scan(Profile::searchDirs(),
+            ProfileManagerPtr(self->parent));
+    self->parent->connect(scan,
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onProfilesScanned(Tp::PendingOperation*)));
+}
 
-        QFileInfoList list = dir.entryInfoList();
-        for (int i = 0; i < list.size(); ++i) {
-            QFileInfo fi = list.at(i);
+ProfilePtr ProfileManager::Private::profile(const QString &serviceName)
+{
+    ProfilePtr ret = profiles.value(serviceName);
+    if (ret || !index.contains(serviceName)) {
+        return ret;
+    }
 
-            if (fi.completeSuffix() !=  QLatin1String("profile")) {
-                continue;
-            }
+    ProfileIndex::Entry entry = index.value(serviceName);
+    ret = Profile::createForFileName(entry.fileName);
+    if (!ret->isValid() || ret->type() != QLatin1String("IM")) {
+        // the file changed since it was indexed
+        warning() << "Profile file" << entry.fileName << "for service" << serviceName <<
+            "is no longer a valid IM profile, ignoring it";
+        index.remove(serviceName);
+        return ProfilePtr();
+    }
 
-            QString fileName = fi.absoluteFilePath();
-            QString serviceName = fi.baseName();
+    profiles.insert(serviceName, ret);
+    return ret;
+}
 
-            if (self->profiles.contains(serviceName)) {
-                debug() << "Profile for service" << serviceName << "already "
-                    "exists. Ignoring profile file:" << fileName;
-                continue;
-            }
+QList<ProfilePtr> ProfileManager::Private::profilesMatching(const QString &cmName,
+        const QString &protocolName)
+{
+    QStringList serviceNames;
+    foreach (const ProfileIndex::Entry &entry, index) {
+        if ((cmName.isNull() || entry.cmName == cmName) &&
+            (protocolName.isNull() || entry.protocolName == protocolName)) {
+            serviceNames << entry.serviceName;
+        }
+    }
+    foreach (const ProfilePtr &profile, profiles) {
+        if (profile->isFake() &&
+            (cmName.isNull() || profile->cmName() == cmName) &&
+            (protocolName.isNull() || profile->protocolName() == protocolName)) {
+            serviceNames << profile->serviceName();
+        }
+    }
 
-            ProfilePtr profile = Profile::createForFileName(fileName);
-            if (!profile->isValid()) {
-                continue;
-            }
+    QList<ProfilePtr> ret;
+    foreach (const QString &serviceName, serviceNames) {
+        ProfilePtr profile = this->profile(serviceName);
+        if (profile) {
+            ret << profile;
+        }
+    }
+    return ret;
+}
 
-            if (profile->type() != QLatin1String("IM")) {
-                debug() << "Ignoring profile for service" << serviceName <<
-                    ": type != IM. Profile file:" << fileName;
-                continue;
-            }
+bool ProfileManager::Private::hasProfile(const QString &serviceName, QString &cmName) const
+{
+    if (index.contains(serviceName)) {
+        cmName = index.value(serviceName).cmName;
+        return true;
+    }
 
-            debug() << "Found profile for service" << serviceName <<
-                "- profile file:" << fileName;
-            self->profiles.insert(serviceName, profile);
-        }
+    ProfilePtr profile = profiles.value(serviceName);
+    if (profile) {
+        cmName = profile->cmName();
+        return true;
     }
 
-    self->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+    return false;
 }
 
 void ProfileManager::Private::introspectFakeProfiles(ProfileManager::Private *self)
@@ -211,7 +248,7 @@ ProfileManager::~ProfileManager()
  */
 QList<ProfilePtr> ProfileManager::profiles() const
 {
-    return mPriv->profiles.values();
+    return mPriv->profilesMatching(QString(), QString());
 }
 
 /**
@@ -222,13 +259,7 @@ QList<ProfilePtr> ProfileManager::profiles() const
  */
 QList<ProfilePtr> ProfileManager::profilesForCM(const QString &cmName) const
 {
-    QList<ProfilePtr> ret;
-    foreach (const ProfilePtr &profile, mPriv->profiles) {
-        if (profile->cmName() == cmName) {
-            ret << profile;
-        }
-    }
-    return ret;
+    return mPriv->profilesMatching(cmName.isNull() ? QString(QLatin1String("")) : cmName, QString());
 }
 
 /**
@@ -240,13 +271,8 @@ QList<ProfilePtr> ProfileManager::profilesForCM(const QString &cmName) const
 QList<ProfilePtr> ProfileManager::profilesForProtocol(
         const QString &protocolName) const
 {
-    QList<ProfilePtr> ret;
-    foreach (const ProfilePtr &profile, mPriv->profiles) {
-        if (profile->protocolName() == protocolName) {
-            ret << profile;
-        }
-    }
-    return ret;
+    return mPriv->profilesMatching(QString(),
+            protocolName.isNull() ? QString(QLatin1String("")) : protocolName);
 }
 
 /**
@@ -257,7 +283,27 @@ QList<ProfilePtr> ProfileManager::profilesForProtocol(
  */
 ProfilePtr ProfileManager::profileForService(const QString &serviceName) const
 {
-    return mPriv->profiles.value(serviceName);
+    return mPriv->profile(serviceName);
+}
+
+void ProfileManager::onProfilesScanned(Tp::PendingOperation *op)
+{
+    ProfileIndex::PendingScan *scan = qobject_cast<ProfileIndex::PendingScan *>(op);
+
+    mPriv->index = scan->entries();
+    // keep the profiles the scan had to parse anyway
+    QHash<QString, ProfilePtr> parsedProfiles = scan->parsedProfiles();
+    QHash<QString, ProfilePtr>::const_iterator i = parsedProfiles.constBegin();
+    for (; i != parsedProfiles.constEnd(); ++i) {
+        if (mPriv->index.contains(i.key())) {
+            mPriv->profiles.insert(i.key(), i.value());
+        }
+    }
+
+    debug() << "Found" << mPriv->index.size() << "profiles," << parsedProfiles.size() <<
+        "of them had to be parsed";
+
+    mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
 }
 
 void ProfileManager::onCmNamesRetrieved(Tp::PendingOperation *op)
@@ -306,14 +352,13 @@ void ProfileManager::onCMsReady(Tp::PendingOperation *op)
             /* check if there is a profile whose service name is protocolName, and if found,
              * check if the profile is for cm, if not check if there is a profile whose service
              * name is cm-protocolName, and if not found create one named cm-protocolName. */
-            profile = profileForService(protocolName);
-            if (profile && profile->cmName() == cm->name()) {
+            QString profileCmName;
+            if (mPriv->hasProfile(protocolName, profileCmName) && profileCmName == cm->name()) {
                 continue;
             }
 
             QString serviceName = QString(QLatin1String("%1-%2")).arg(cm->name()).arg(protocolName);
-            profile = profileForService(serviceName);
-            if (profile) {
+            if (mPriv->hasProfile(serviceName, profileCmName)) {
                 continue;
             }
 
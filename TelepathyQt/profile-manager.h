@@ -59,6 +59,7 @@ public:
     ProfilePtr profileForService(const QString &serviceName) const;
 
 private Q_SLOTS:
+    TP_QT_NO_EXPORT void onProfilesScanned(Tp::PendingOperation *op);
     TP_QT_NO_EXPORT void onCmNamesRetrieved(Tp::PendingOperation *op);
     TP_QT_NO_EXPORT void onCMsReady(Tp::PendingOperation *op);
 
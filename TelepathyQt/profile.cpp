@@ -31,11 +31,10 @@
 
 #include <QFile>
 #include <QFileInfo>
+#include <QStack>
 #include <QStringList>
-#include <QXmlAttributes>
-#include <QXmlDefaultHandler>
-#include <QXmlInputSource>
-#include <QXmlSimpleReader>
+#include <QXmlStreamAttributes>
+#include <QXmlStreamReader>
 
 namespace Tp
 {
@@ -97,22 +96,21 @@ void Profile::Private::Data::clear()
 }
 
 
-class TP_QT_NO_EXPORT Profile::Private::XmlHandler :
-                public QXmlDefaultHandler
+class TP_QT_NO_EXPORT Profile::Private::XmlHandler
 {
 public:
     XmlHandler(const QString &serviceName, bool allowNonIMType, Profile::Private::Data *outputData);
 
-    bool startElement(const QString &namespaceURI, const QString &localName,
-            const QString &qName, const QXmlAttributes &attributes);
-    bool endElement(const QString &namespaceURI, const QString &localName,
-            const QString &qName);
-    bool characters(const QString &str);
-    bool fatalError(const QXmlParseException &exception);
+    bool parse(QIODevice *device);
     QString errorString() const;
 
 private:
-    bool attributeValueAsBoolean(const QXmlAttributes &attributes,
+    bool startElement(const QString &namespaceURI, const QString &qName,
+            const QXmlStreamAttributes &attributes);
+    bool endElement(const QString &namespaceURI, const QString &qName);
+    bool characters(const QStringRef &str);
+
+    bool attributeValueAsBoolean(const QXmlStreamAttributes &attributes,
             const QString &qName);
 
     QString mServiceName;
@@ -188,9 +186,45 @@ Profile::Private::XmlHandler::XmlHandler(const QString &serviceName,
 {
 }
 
+/**
+ * Read the profile from \a device in a single streaming pass, stopping at the first error.
+ */
+bool Profile::Private::XmlHandler::parse(QIODevice *device)
+{
+    QXmlStreamReader reader(device);
+    bool ok = true;
+    while (ok && !reader.atEnd()) {
+        switch (reader.readNext()) {
+            case QXmlStreamReader::StartElement:
+                ok = startElement(reader.namespaceUri().toString(),
+                        reader.qualifiedName().toString(), reader.attributes());
+                break;
+            case QXmlStreamReader::EndElement:
+                ok = endElement(reader.namespaceUri().toString(),
+                        reader.qualifiedName().toString());
+                break;
+            case QXmlStreamReader::Characters:
+                ok = characters(reader.text());
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!ok || reader.hasError()) {
+        mErrorString = QString(QLatin1String("parse error at line %1, column %2: "
+                    "%3"))
+            .arg(reader.lineNumber())
+            .arg(reader.columnNumber())
+            .arg(ok ? reader.errorString() : mErrorString);
+        return false;
+    }
+
+    return true;
+}
+
 bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
-        const QString &localName, const QString &qName,
-        const QXmlAttributes &attributes)
+        const QString &qName, const QXmlStreamAttributes &attributes)
 {
     if (!mMetServiceTag && qName != elemService) {
         mErrorString = QLatin1String("the file is not a profile file");
@@ -212,7 +246,7 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         return false; \
     }
 #define CHECK_ELEMENT_ATTRIBUTES_COUNT(value) \
-    if (attributes.count() != value) { \
+    if (attributes.size() != value) { \
         mErrorString = QString(QLatin1String("element '%1' contains more " \
                     "than %2 attributes")) \
             .arg(qName) \
@@ -220,7 +254,7 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         return false; \
     }
 #define CHECK_ELEMENT_HAS_ATTRIBUTE(attribute) \
-    if (attributes.index(attribute) == -1) { \
+    if (!attributes.hasAttribute(attribute)) { \
         mErrorString = QString(QLatin1String("mandatory attribute '%1' " \
                     "missing on element '%2'")) \
             .arg(attribute) \
@@ -228,9 +262,9 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         return false; \
     }
 #define CHECK_ELEMENT_ATTRIBUTES(allowedAttrs) \
-    for (int i = 0; i < attributes.count(); ++i) { \
+    for (int i = 0; i < attributes.size(); ++i) { \
         bool valid = false; \
-        QString attrName = attributes.qName(i); \
+        QString attrName = attributes.at(i).qualifiedName().toString(); \
         foreach (const QString &allowedAttr, allowedAttrs) { \
             if (attrName == allowedAttr) { \
                 valid = true; \
@@ -257,7 +291,7 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
             elemAttrProtocol << elemAttrProvider << elemAttrIcon;
         CHECK_ELEMENT_ATTRIBUTES(allowedAttrs);
 
-        if (attributes.value(elemAttrId) != mServiceName) {
+        if (attributes.value(elemAttrId).toString() != mServiceName) {
             mErrorString = QString(QLatin1String("the '%1' attribute of the "
                         "element '%2' does not match the file name"))
                 .arg(elemAttrId)
@@ -266,17 +300,17 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         }
 
         mMetServiceTag = true;
-        mData->type = attributes.value(elemAttrType);
+        mData->type = attributes.value(elemAttrType).toString();
         if (mData->type != QLatin1String("IM") && !allowNonIMType) {
             mErrorString = QString(QLatin1String("unknown value of element "
                         "'type': %1"))
                 .arg(mCurrentText);
             return false;
         }
-        mData->provider = attributes.value(elemAttrProvider);
-        mData->cmName = attributes.value(elemAttrManager);
-        mData->protocolName = attributes.value(elemAttrProtocol);
-        mData->iconName = attributes.value(elemAttrIcon);
+        mData->provider = attributes.value(elemAttrProvider).toString();
+        mData->cmName = attributes.value(elemAttrManager).toString();
+        mData->protocolName = attributes.value(elemAttrProtocol).toString();
+        mData->iconName = attributes.value(elemAttrIcon).toString();
     } else if (qName == elemParams) {
         CHECK_ELEMENT_IS_CHILD_OF(elemService);
         CHECK_ELEMENT_ATTRIBUTES_COUNT(0);
@@ -287,13 +321,13 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
             elemAttrType << elemAttrMandatory << elemAttrLabel;
         CHECK_ELEMENT_ATTRIBUTES(allowedAttrs);
 
-        QString paramType = attributes.value(elemAttrType);
+        QString paramType = attributes.value(elemAttrType).toString();
         if (paramType.isEmpty()) {
             paramType = QLatin1String("s");
         }
-        mCurrentParameter.setName(attributes.value(elemAttrName));
+        mCurrentParameter.setName(attributes.value(elemAttrName).toString());
         mCurrentParameter.setDBusSignature(QDBusSignature(paramType));
-        mCurrentParameter.setLabel(attributes.value(elemAttrLabel));
+        mCurrentParameter.setLabel(attributes.value(elemAttrLabel).toString());
         mCurrentParameter.setMandatory(attributeValueAsBoolean(attributes,
                     elemAttrMandatory));
     } else if (qName == elemPresences) {
@@ -312,10 +346,10 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         CHECK_ELEMENT_ATTRIBUTES(allowedAttrs);
 
         mData->presences.append(Profile::Presence(
-                    attributes.value(elemAttrId),
-                    attributes.value(elemAttrLabel),
-                    attributes.value(elemAttrIcon),
-                    attributes.value(elemAttrMessage),
+                    attributes.value(elemAttrId).toString(),
+                    attributes.value(elemAttrLabel).toString(),
+                    attributes.value(elemAttrIcon).toString(),
+                    attributes.value(elemAttrMessage).toString(),
                     attributeValueAsBoolean(attributes, elemAttrDisabled)));
     } else if (qName == elemUnsupportedCCs) {
         CHECK_ELEMENT_IS_CHILD_OF(elemService);
@@ -329,8 +363,8 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
         CHECK_ELEMENT_HAS_ATTRIBUTE(elemAttrName);
         CHECK_ELEMENT_HAS_ATTRIBUTE(elemAttrType);
 
-        mCurrentPropertyName = attributes.value(elemAttrName);
-        mCurrentPropertyType = attributes.value(elemAttrType);
+        mCurrentPropertyName = attributes.value(elemAttrName).toString();
+        mCurrentPropertyType = attributes.value(elemAttrType).toString();
     } else {
         if (qName != elemName) {
             Tp::warning() << "Ignoring unknown element" << qName;
@@ -353,7 +387,7 @@ bool Profile::Private::XmlHandler::startElement(const QString &namespaceURI,
 }
 
 bool Profile::Private::XmlHandler::endElement(const QString &namespaceURI,
-        const QString &localName, const QString &qName)
+        const QString &qName)
 {
     if (namespaceURI != xmlNs) {
         // ignore all elements with unknown xmlns
@@ -378,32 +412,21 @@ bool Profile::Private::XmlHandler::endElement(const QString &namespaceURI,
     return true;
 }
 
-bool Profile::Private::XmlHandler::characters(const QString &str)
+bool Profile::Private::XmlHandler::characters(const QStringRef &str)
 {
     mCurrentText += str;
     return true;
 }
 
-bool Profile::Private::XmlHandler::fatalError(
-        const QXmlParseException &exception)
-{
-    mErrorString = QString(QLatin1String("parse error at line %1, column %2: "
-                "%3"))
-        .arg(exception.lineNumber())
-        .arg(exception.columnNumber())
-        .arg(exception.message());
-    return false;
-}
-
 QString Profile::Private::XmlHandler::errorString() const
 {
     return mErrorString;
 }
 
 bool Profile::Private::XmlHandler::attributeValueAsBoolean(
-        const QXmlAttributes &attributes, const QString &qName)
+        const QXmlStreamAttributes &attributes, const QString &qName)
 {
-    QString tmpStr = attributes.value(qName);
+    QStringRef tmpStr = attributes.value(qName);
     if (tmpStr == QLatin1String("1") ||
         tmpStr == QLatin1String("true")) {
         return true;
@@ -496,12 +519,7 @@ bool Profile::Private::parse(QFile *file)
     QFileInfo fi(file->fileName());
     XmlHandler xmlHandler(serviceName, allowNonIMType, &data);
 
-    QXmlSimpleReader xmlReader;
-    xmlReader.setContentHandler(&xmlHandler);
-    xmlReader.setErrorHandler(&xmlHandler);
-
-    QXmlInputSource xmlInputSource(file);
-    if (!xmlReader.parse(xmlInputSource)) {
+    if (!xmlHandler.parse(file)) {
         warning() << QString(QLatin1String("Error parsing profile file %1: %2"))
             .arg(file->fileName())
             .arg(xmlHandler.errorString());
@@ -0,0 +1,71 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_protocol_info_cache_internal_h_HEADER_GUARD_
+#define _TelepathyQt_protocol_info_cache_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+class TP_QT_NO_EXPORT ProtocolInfoCache
+{
+    Q_DISABLE_COPY(ProtocolInfoCache)
+
+public:
+    static ProtocolInfoCache *instance();
+
+    static QString sourceKey(const QString &cmName);
+
+    QString cacheFileName(const QString &cmName) const;
+
+    bool load(const QString &cmName, const QString &key, QByteArray &data);
+    bool store(const QString &cmName, const QString &key, const QByteArray &data);
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    ProtocolInfoCache();
+    ~ProtocolInfoCache();
+
+    static QString fileKey(const QString &kind, const QString &fileName);
+    static QString serviceExecutable(const QString &serviceFileName);
+
+    static ProtocolInfoCache *mInstance;
+
+    mutable QMutex mMutex;
+    quint64 mHits;
+    quint64 mMisses;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/protocol-info-cache-internal.h"
+
+#include "TelepathyQt/cache-file-internal.h"
+#include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/manager-file.h"
+#include "TelepathyQt/test-backdoors.h"
+
+#include <TelepathyQt/Constants>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStringList>
+
+namespace Tp
+{
+
+// Bump whenever the layout of the cache files changes, older files are then ignored and
+// overwritten on the next introspection
+static const quint32 PROTOCOL_INFO_CACHE_MAGIC = 0x54504349; // "TPCI"
+static const quint32 PROTOCOL_INFO_CACHE_VERSION = 1;
+
+ProtocolInfoCache *ProtocolInfoCache::mInstance = 0;
+
+ProtocolInfoCache *ProtocolInfoCache::instance()
+{
+    if (!mInstance) {
+        mInstance = new ProtocolInfoCache();
+    }
+    return mInstance;
+}
+
+ProtocolInfoCache::ProtocolInfoCache()
+    : mHits(0),
+      mMisses(0)
+{
+}
+
+ProtocolInfoCache::~ProtocolInfoCache()
+{
+    mInstance = 0;
+}
+
+/**
+ * Return a string identifying the installed version of the connection manager \a cmName, or an
+ * empty string if it can't be determined.
+ *
+ * The key is made of the path, size and modification time of the .manager file, if there is one,
+ * or else of the executable started by the D-Bus service file, so that upgrading or reinstalling
+ * the connection manager invalidates the cached information.
+ */
+QString ProtocolInfoCache::sourceKey(const QString &cmName)
+{
+    foreach (const QString &configDir, ManagerFile::configDirs()) {
+        QString fileName = configDir + cmName + QLatin1String(".manager");
+        if (QFile::exists(fileName)) {
+            return fileKey(QLatin1String("manager"), fileName);
+        }
+    }
+
+    QStringList dataDirs;
+
+    QString xdgDataHome = QString::fromLocal8Bit(qgetenv("XDG_DATA_HOME"));
+    if (xdgDataHome.isEmpty()) {
+        dataDirs << QDir::homePath() + QLatin1String("/.local/share");
+    } else {
+        dataDirs << xdgDataHome;
+    }
+
+    QString xdgDataDirsEnv = QString::fromLocal8Bit(qgetenv("XDG_DATA_DIRS"));
+    if (xdgDataDirsEnv.isEmpty()) {
+        dataDirs << QLatin1String("/usr/local/share");
+        dataDirs << QLatin1String("/usr/share");
+    } else {
+        dataDirs << xdgDataDirsEnv.split(QLatin1Char(':'));
+    }
+
+    QString serviceName = QString(QLatin1String("%1%2.service"))
+        .arg(TP_QT_CONNECTION_MANAGER_BUS_NAME_BASE).arg(cmName);
+    foreach (const QString &dataDir, dataDirs) {
+        QString serviceFileName = QString(QLatin1String("%1/dbus-1/services/%2"))
+            .arg(dataDir).arg(serviceName);
+        if (!QFile::exists(serviceFileName)) {
+            continue;
+        }
+
+        QString executable = serviceExecutable(serviceFileName);
+        if (!executable.isEmpty() && QFile::exists(executable)) {
+            return fileKey(QLatin1String("exec"), executable);
+        }
+        return fileKey(QLatin1String("service"), serviceFileName);
+    }
+
+    return QString();
+}
+
+QString ProtocolInfoCache::cacheFileName(const QString &cmName) const
+{
+    return QString(QLatin1String("%1/protocols/%2.cache")).arg(cacheDirectory()).arg(cmName);
+}
+
+/**
+ * Read the cached introspection data for \a cmName into \a data.
+ *
+ * \return \c true if the cache file exists, has the current format and was written for \a key.
+ */
+bool ProtocolInfoCache::load(const QString &cmName, const QString &key, QByteArray &data)
+{
+    bool found = false;
+
+    QFile file(cacheFileName(cmName));
+    if (!key.isEmpty() && file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_6);
+
+        quint32 magic, version;
+        QString fileKey;
+        stream >> magic >> version;
+        if (magic == PROTOCOL_INFO_CACHE_MAGIC && version == PROTOCOL_INFO_CACHE_VERSION) {
+            stream >> fileKey >> data;
+            found = (stream.status() == QDataStream::Ok && fileKey == key);
+        }
+        file.close();
+    }
+
+    QMutexLocker locker(&mMutex);
+    if (found) {
+        ++mHits;
+    } else {
+        ++mMisses;
+        data.clear();
+    }
+    return found;
+}
+
+/**
+ * Replace the cached introspection data for \a cmName with \a data, recorded as valid for \a key.
+ *
+ * Other processes reading the cache never see a partially written file.
+ */
+bool ProtocolInfoCache::store(const QString &cmName, const QString &key, const QByteArray &data)
+{
+    if (key.isEmpty()) {
+        return false;
+    }
+
+    QString fileName = cacheFileName(cmName);
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath())) {
+        warning() << "Unable to create protocol cache directory for" << fileName;
+        return false;
+    }
+
+    QByteArray contents;
+    QDataStream stream(&contents, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << PROTOCOL_INFO_CACHE_MAGIC << PROTOCOL_INFO_CACHE_VERSION << key << data;
+
+    if (!writeCacheFile(fileName, contents)) {
+        return false;
+    }
+
+    debug() << "Stored protocol information for" << cmName << "in" << fileName;
+    return true;
+}
+
+quint64 ProtocolInfoCache::hits() const
+{
+    QMutexLocker locker(&mMutex);
+    return mHits;
+}
+
+quint64 ProtocolInfoCache::misses() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMisses;
+}
+
+QString ProtocolInfoCache::fileKey(const QString &kind, const QString &fileName)
+{
+    QFileInfo info(fileName);
+    return QString(QLatin1String("%1:%2:%3:%4"))
+        .arg(kind)
+        .arg(info.absoluteFilePath())
+        .arg(info.size())
+        .arg(info.lastModified().toTime_t());
+}
+
+QString ProtocolInfoCache::serviceExecutable(const QString &serviceFileName)
+{
+    QFile file(serviceFileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if (line.startsWith(QLatin1String("Exec="))) {
+            return line.mid(5).split(QLatin1Char(' '), QString::SkipEmptyParts).value(0);
+        }
+    }
+
+    return QString();
+}
+
+QString TestBackdoors::protocolInfoCacheFileName(const QString &cmName)
+{
+    return ProtocolInfoCache::instance()->cacheFileName(cmName);
+}
+
+QString TestBackdoors::protocolInfoSourceKey(const QString &cmName)
+{
+    return ProtocolInfoCache::sourceKey(cmName);
+}
+
+quint64 TestBackdoors::protocolInfoCacheHits()
+{
+    return ProtocolInfoCache::instance()->hits();
+}
+
+quint64 TestBackdoors::protocolInfoCacheMisses()
+{
+    return ProtocolInfoCache::instance()->misses();
+}
+
+} // Tp
@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/readiness-helper.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/DBusProxy>
@@ -32,13 +33,66 @@
 #include <TelepathyQt/RefCounted>
 #include <TelepathyQt/SharedPtr>
 
+#include <QBitArray>
 #include <QDBusError>
+#include <QElapsedTimer>
 #include <QSharedData>
 #include <QTimer>
 
 namespace Tp
 {
 
+// Feature sets are kept as bit arrays indexed by FeatureRegistry::index(), which doesn't need
+// to hash the class names. Bit arrays may have different sizes, missing bits are unset.
+
+static inline bool hasFeature(const QBitArray &bits, int index)
+{
+    return index >= 0 && index < bits.size() && bits.testBit(index);
+}
+
+static inline void setFeature(QBitArray &bits, int index, bool value = true)
+{
+    if (index >= bits.size()) {
+        if (!value) {
+            return;
+        }
+        bits.resize(index + 1);
+    }
+    bits.setBit(index, value);
+}
+
+static inline bool isEmpty(const QBitArray &bits)
+{
+    return bits.count(true) == 0;
+}
+
+static QBitArray subtracted(const QBitArray &bits, const QBitArray &other)
+{
+    QBitArray mask(other);
+    mask.resize(bits.size());
+    return bits & ~mask;
+}
+
+static QBitArray featureBits(const Features &features)
+{
+    QBitArray bits;
+    foreach (const Feature &feature, features) {
+        setFeature(bits, FeatureRegistry::index(feature));
+    }
+    return bits;
+}
+
+static Features featureSet(const QBitArray &bits)
+{
+    Features features;
+    for (int i = 0; i < bits.size(); ++i) {
+        if (bits.testBit(i)) {
+            features.insert(FeatureRegistry::feature(i));
+        }
+    }
+    return features;
+}
+
 struct TP_QT_NO_EXPORT ReadinessHelper::Introspectable::Private : public QSharedData
 {
     Private(const QSet<uint> &makesSenseForStatuses,
@@ -103,12 +157,13 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
             const Introspectables &introspectables);
     ~Private();
 
+    void addIntrospectable(const Feature &feature, const Introspectable &introspectable);
     void setCurrentStatus(uint newStatus);
-    void setIntrospectCompleted(const Feature &feature, bool success,
+    void setIntrospectCompleted(int index, bool success,
             const QString &errorName = QString(),
             const QString &errorMessage = QString());
     void iterateIntrospection();
-    Features depsFor(const Feature &feature); // Recursive dependencies for a feature
+    QBitArray depsFor(int index); // Recursive dependencies for a feature
 
     void abortOperations(const QString &errorName, const QString &errorMessage);
 
@@ -117,16 +172,23 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
     DBusProxy *proxy;
     uint currentStatus;
     QStringList interfaces;
-    Introspectables introspectables;
+    QHash<int, Introspectable> introspectables;
+    QHash<int, QBitArray> dependsOnFeatures;
+    QHash<int, QBitArray> depsCache;
     QSet<uint> supportedStatuses;
-    Features supportedFeatures;
-    Features satisfiedFeatures;
-    Features requestedFeatures;
-    Features missingFeatures;
-    Features pendingFeatures;
-    Features inFlightFeatures;
-    QHash<Feature, QPair<QString, QString> > missingFeaturesErrors;
+    QBitArray supportedFeatures;
+    QBitArray satisfiedFeatures;
+    QBitArray requestedFeatures;
+    QBitArray missingFeatures;
+    QBitArray pendingFeatures;
+    QBitArray inFlightFeatures;
+    QHash<int, QPair<QString, QString> > missingFeaturesErrors;
     QList<PendingReady *> pendingOperations;
+    QHash<PendingReady *, QBitArray> pendingOperationsFeatures;
+
+    int maxInFlightIntrospections;
+    QHash<int, QElapsedTimer> introspectionsStarted;
+    QHash<int, int> introspectionTimes;
 
     bool pendingStatusChange;
     uint pendingStatus;
@@ -141,17 +203,13 @@ ReadinessHelper::Private::Private(
       object(object),
       proxy(0),
       currentStatus(currentStatus),
-      introspectables(introspectables),
+      maxInFlightIntrospections(0),
       pendingStatusChange(false),
       pendingStatus(-1)
 {
     for (Introspectables::const_iterator i = introspectables.constBegin();
             i != introspectables.constEnd(); ++i) {
-        Feature feature = i.key();
-        Introspectable introspectable = i.value();
-        Q_ASSERT(introspectable.mPriv->introspectFunc != 0);
-        supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-        supportedFeatures += feature;
+        addIntrospectable(i.key(), i.value());
     }
 }
 
@@ -164,7 +222,7 @@ ReadinessHelper::Private::Private(
       object(proxy),
       proxy(proxy),
       currentStatus(currentStatus),
-      introspectables(introspectables),
+      maxInFlightIntrospections(0),
       pendingStatusChange(false),
       pendingStatus(-1)
 {
@@ -172,11 +230,7 @@ ReadinessHelper::Private::Private(
 
     for (Introspectables::const_iterator i = introspectables.constBegin();
             i != introspectables.constEnd(); ++i) {
-        Feature feature = i.key();
-        Introspectable introspectable = i.value();
-        Q_ASSERT(introspectable.mPriv->introspectFunc != 0);
-        supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-        supportedFeatures += feature;
+        addIntrospectable(i.key(), i.value());
     }
 }
 
@@ -187,13 +241,26 @@ ReadinessHelper::Private::~Private()
     abortOperations(TP_QT_ERROR_CANCELLED, messageDestroyed);
 }
 
+void ReadinessHelper::Private::addIntrospectable(const Feature &feature,
+        const Introspectable &introspectable)
+{
+    Q_ASSERT(introspectable.mPriv->introspectFunc != 0);
+
+    int index = FeatureRegistry::index(feature);
+    introspectables.insert(index, introspectable);
+    dependsOnFeatures.insert(index, featureBits(introspectable.mPriv->dependsOnFeatures));
+    depsCache.clear();
+    supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
+    setFeature(supportedFeatures, index);
+}
+
 void ReadinessHelper::Private::setCurrentStatus(uint newStatus)
 {
     if (currentStatus == newStatus) {
         return;
     }
 
-    if (inFlightFeatures.isEmpty()) {
+    if (isEmpty(inFlightFeatures)) {
         currentStatus = newStatus;
         satisfiedFeatures.clear();
         missingFeatures.clear();
@@ -216,19 +283,20 @@ void ReadinessHelper::Private::setCurrentStatus(uint newStatus)
     }
 }
 
-void ReadinessHelper::Private::setIntrospectCompleted(const Feature &feature,
+void ReadinessHelper::Private::setIntrospectCompleted(int index,
         bool success, const QString &errorName, const QString &errorMessage)
 {
-    debug() << "ReadinessHelper::setIntrospectCompleted: feature:" << feature <<
-        "- success:" << success;
+    debug() << "ReadinessHelper::setIntrospectCompleted: feature:" <<
+        FeatureRegistry::feature(index) << "- success:" << success;
     if (pendingStatusChange) {
         debug() << "ReadinessHelper::setIntrospectCompleted called while there is "
             "a pending status change - ignoring";
 
-        inFlightFeatures.remove(feature);
+        setFeature(inFlightFeatures, index, false);
+        introspectionsStarted.remove(index);
 
         // ignore all introspection completed as the state changed
-        if (!inFlightFeatures.isEmpty()) {
+        if (!isEmpty(inFlightFeatures)) {
             return;
         }
         pendingStatusChange = false;
@@ -236,24 +304,34 @@ void ReadinessHelper::Private::setIntrospectCompleted(const Feature &feature,
         return;
     }
 
-    Q_ASSERT(pendingFeatures.contains(feature));
-    Q_ASSERT(inFlightFeatures.contains(feature));
+    Q_ASSERT(hasFeature(pendingFeatures, index));
+    Q_ASSERT(hasFeature(inFlightFeatures, index));
 
     if (success) {
-        satisfiedFeatures.insert(feature);
+        setFeature(satisfiedFeatures, index);
     }
     else {
-        missingFeatures.insert(feature);
-        missingFeaturesErrors.insert(feature,
+        setFeature(missingFeatures, index);
+        missingFeaturesErrors.insert(index,
                 QPair<QString, QString>(errorName, errorMessage));
         if (errorName.isEmpty()) {
             warning() << "ReadinessHelper::setIntrospectCompleted: Feature" <<
-                feature << "introspection failed but no error message was given";
+                FeatureRegistry::feature(index) <<
+                "introspection failed but no error message was given";
         }
     }
 
-    pendingFeatures.remove(feature);
-    inFlightFeatures.remove(feature);
+    setFeature(pendingFeatures, index, false);
+    setFeature(inFlightFeatures, index, false);
+
+    QHash<int, QElapsedTimer>::iterator started = introspectionsStarted.find(index);
+    if (started != introspectionsStarted.end()) {
+        int elapsed = int(started.value().elapsed());
+        introspectionTimes.insert(index, elapsed);
+        introspectionsStarted.erase(started);
+        debug() << "ReadinessHelper: feature" << FeatureRegistry::feature(index) <<
+            "introspected in" << elapsed << "ms";
+    }
 
     QTimer::singleShot(0, parent, SLOT(iterateIntrospection()));
 }
@@ -282,16 +360,16 @@ void ReadinessHelper::Private::iterateIntrospection()
 
     // Flag the currently pending reverse dependencies of any previously discovered missing features
     // as missing
-    foreach (const Feature &feature, pendingFeatures) {
-        if (!depsFor(feature).intersect(missingFeatures).isEmpty()) {
-            missingFeatures.insert(feature);
-            missingFeaturesErrors.insert(feature,
+    for (int i = 0; i < pendingFeatures.size(); ++i) {
+        if (pendingFeatures.testBit(i) && !isEmpty(depsFor(i) & missingFeatures)) {
+            setFeature(missingFeatures, i);
+            missingFeaturesErrors.insert(i,
                     QPair<QString, QString>(TP_QT_ERROR_NOT_AVAILABLE,
                         QLatin1String("Feature depends on other features that are not available")));
         }
     }
 
-    const Features completedFeatures = satisfiedFeatures + missingFeatures;
+    const QBitArray completedFeatures = satisfiedFeatures | missingFeatures;
 
     // check if any pending operations for becomeReady should finish now
     // based on their requested features having nothing more than what
@@ -299,7 +377,7 @@ void ReadinessHelper::Private::iterateIntrospection()
     QString errorName;
     QString errorMessage;
     foreach (PendingReady *operation, pendingOperations) {
-        if ((operation->requestedFeatures() - completedFeatures).isEmpty()) {
+        if (isEmpty(subtracted(pendingOperationsFeatures.value(operation), completedFeatures))) {
             if (parent->isReady(operation->requestedFeatures(), &errorName, &errorMessage)) {
                 operation->setFinished();
             } else {
@@ -311,10 +389,11 @@ void ReadinessHelper::Private::iterateIntrospection()
             // Qt foreach makes a copy of the container, which will be detached at this point, so
             // this is perfectly safe
             pendingOperations.removeOne(operation);
+            pendingOperationsFeatures.remove(operation);
         }
     }
 
-    if ((requestedFeatures - completedFeatures).isEmpty()) {
+    if (isEmpty(subtracted(requestedFeatures, completedFeatures))) {
         // Otherwise, we'd emit statusReady with currentStatus although we are supposed to be
         // introspecting the pendingStatus and only when that is complete, emit statusReady
         Q_ASSERT(!pendingStatusChange);
@@ -326,65 +405,96 @@ void ReadinessHelper::Private::iterateIntrospection()
 
     // update pendingFeatures with the difference of requested and
     // satisfied + missing
-    pendingFeatures -= completedFeatures;
+    pendingFeatures = subtracted(pendingFeatures, completedFeatures);
 
     // find out which features don't have dependencies that are still pending
-    Features readyToIntrospect;
-    foreach (const Feature &feature, pendingFeatures) {
+    QList<int> readyToIntrospect;
+    for (int i = 0; i < pendingFeatures.size(); ++i) {
         // missing doesn't have to be considered here anymore
-        if ((introspectables[feature].mPriv->dependsOnFeatures - satisfiedFeatures).isEmpty()) {
-            readyToIntrospect.insert(feature);
+        if (pendingFeatures.testBit(i) &&
+            isEmpty(subtracted(dependsOnFeatures.value(i), satisfiedFeatures))) {
+            readyToIntrospect.append(i);
         }
     }
 
     // now readyToIntrospect should contain all the features which have
-    // all their feature dependencies satisfied
-    foreach (const Feature &feature, readyToIntrospect) {
-        if (inFlightFeatures.contains(feature)) {
+    // all their feature dependencies satisfied, and they can all be introspected
+    // at once as they don't depend on each other
+    int inFlight = inFlightFeatures.count(true);
+    foreach (int index, readyToIntrospect) {
+        // An introspect function may complete its feature synchronously, and even change the
+        // status or invalidate the proxy
+        if (pendingStatusChange || (proxy && !proxy->isValid())) {
+            return;
+        }
+
+        if (hasFeature(inFlightFeatures, index) || !hasFeature(pendingFeatures, index)) {
             continue;
         }
 
-        inFlightFeatures.insert(feature);
+        if (maxInFlightIntrospections > 0 && inFlight >= maxInFlightIntrospections) {
+            // will be called with a single-shot again as soon as one of them completes
+            return;
+        }
 
-        Introspectable introspectable = introspectables[feature];
+        setFeature(inFlightFeatures, index);
+        ++inFlight;
+
+        Introspectable introspectable = introspectables.value(index);
 
         if (!introspectable.mPriv->makesSenseForStatuses.contains(currentStatus)) {
             // No-op satisfy features for which nothing has to be done in
             // the current state
-            setIntrospectCompleted(feature, true);
-            return; // will be called with a single-shot soon again
+            setIntrospectCompleted(index, true);
+            --inFlight;
+            continue;
         }
 
         foreach (const QString &interface, introspectable.mPriv->dependsOnInterfaces) {
             if (!interfaces.contains(interface)) {
                 // If a feature is ready to introspect and depends on a interface
                 // that is not present the feature can't possibly be satisfied
-                debug() << "feature" << feature << "depends on interfaces" <<
+                debug() << "feature" << FeatureRegistry::feature(index) << "depends on interfaces" <<
                     introspectable.mPriv->dependsOnInterfaces << ", but interface" << interface <<
                     "is not present";
-                setIntrospectCompleted(feature, false,
+                setIntrospectCompleted(index, false,
                         TP_QT_ERROR_NOT_AVAILABLE,
                         QLatin1String("Feature depend on interfaces that are not available"));
-                return; // will be called with a single-shot soon again
+                break;
             }
         }
 
-        // yes, with the dependency info, we can even parallelize
-        // introspection of several features at once, reducing total round trip
-        // time considerably with many independent features!
+        if (!hasFeature(inFlightFeatures, index)) {
+            --inFlight;
+            continue;
+        }
+
+        introspectionsStarted[index].start();
         (*(introspectable.mPriv->introspectFunc))(introspectable.mPriv->introspectFuncData);
+        if (!hasFeature(inFlightFeatures, index)) {
+            // Completed synchronously
+            --inFlight;
+        }
     }
 }
 
-Features ReadinessHelper::Private::depsFor(const Feature &feature)
+QBitArray ReadinessHelper::Private::depsFor(int index)
 {
-    Features deps;
+    QHash<int, QBitArray>::const_iterator cached = depsCache.constFind(index);
+    if (cached != depsCache.constEnd()) {
+        return cached.value();
+    }
 
-    foreach (Feature dep, introspectables[feature].mPriv->dependsOnFeatures) {
-        deps += dep;
-        deps += depsFor(dep);
+    QBitArray deps;
+    const QBitArray directDeps = dependsOnFeatures.value(index);
+    for (int i = 0; i < directDeps.size(); ++i) {
+        if (directDeps.testBit(i)) {
+            setFeature(deps, i);
+            deps |= depsFor(i);
+        }
     }
 
+    depsCache.insert(index, deps);
     return deps;
 }
 
@@ -395,6 +505,7 @@ void ReadinessHelper::Private::abortOperations(const QString &errorName,
         operation->setFinishedWithError(errorName, errorMessage);
     }
     pendingOperations.clear();
+    pendingOperationsFeatures.clear();
 }
 
 /**
@@ -445,20 +556,18 @@ void ReadinessHelper::addIntrospectables(const Introspectables &introspectables)
     for (Introspectables::const_iterator i = introspectables.constBegin();
             i != introspectables.constEnd(); ++i) {
         Feature feature = i.key();
-        if (mPriv->introspectables.contains(feature)) {
+        if (hasFeature(mPriv->supportedFeatures, FeatureRegistry::index(feature))) {
             warning() << "ReadinessHelper::addIntrospectables: trying to add an "
                 "introspectable for feature" << feature << "but introspectable "
                 "for this feature already exists";
         } else {
-            Introspectable introspectable = i.value();
-            mPriv->introspectables.insert(feature, introspectable);
-            mPriv->supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-            mPriv->supportedFeatures += feature;
+            mPriv->addIntrospectable(feature, i.value());
         }
     }
 
     debug() << "ReadinessHelper: new supportedStatuses =" << mPriv->supportedStatuses;
-    debug() << "ReadinessHelper: new supportedFeatures =" << mPriv->supportedFeatures;
+    debug() << "ReadinessHelper: new supportedFeatures =" <<
+        featureSet(mPriv->supportedFeatures);
 }
 
 uint ReadinessHelper::currentStatus() const
@@ -500,17 +609,57 @@ void ReadinessHelper::setInterfaces(const QStringList &interfaces)
 
 Features ReadinessHelper::requestedFeatures() const
 {
-    return mPriv->requestedFeatures;
+    return featureSet(mPriv->requestedFeatures);
 }
 
 Features ReadinessHelper::actualFeatures() const
 {
-    return mPriv->satisfiedFeatures;
+    return featureSet(mPriv->satisfiedFeatures);
 }
 
 Features ReadinessHelper::missingFeatures() const
 {
-    return mPriv->missingFeatures;
+    return featureSet(mPriv->missingFeatures);
+}
+
+/**
+ * Return the maximum number of features introspected at the same time.
+ *
+ * \return The maximum number of introspections in flight, or 0 if there is no limit.
+ * \sa setMaxInFlightIntrospections()
+ */
+int ReadinessHelper::maxInFlightIntrospections() const
+{
+    return mPriv->maxInFlightIntrospections;
+}
+
+/**
+ * Set the maximum number of features introspected at the same time to \a max.
+ *
+ * All the requested features whose dependencies are satisfied are introspected at the same time
+ * by default. Setting a limit is useful to avoid flooding a slow service with requests.
+ *
+ * \param max The maximum number of introspections in flight, or 0 for no limit.
+ * \sa maxInFlightIntrospections()
+ */
+void ReadinessHelper::setMaxInFlightIntrospections(int max)
+{
+    mPriv->maxInFlightIntrospections = qMax(max, 0);
+}
+
+/**
+ * Return how long the last introspection of \a feature took, from the call to its introspect
+ * function to setIntrospectCompleted().
+ *
+ * Features which didn't need to be introspected in the current status, or whose interfaces are
+ * missing, are not timed.
+ *
+ * \param feature The feature to check.
+ * \return The time in milliseconds, or -1 if \a feature has not been introspected.
+ */
+int ReadinessHelper::introspectionTime(const Feature &feature) const
+{
+    return mPriv->introspectionTimes.value(FeatureRegistry::index(feature), -1);
 }
 
 bool ReadinessHelper::isReady(const Feature &feature,
@@ -526,7 +675,8 @@ bool ReadinessHelper::isReady(const Feature &feature,
         return false;
     }
 
-    if (!mPriv->supportedFeatures.contains(feature)) {
+    int index = FeatureRegistry::index(feature);
+    if (!hasFeature(mPriv->supportedFeatures, index)) {
         if (errorName) {
             *errorName = TP_QT_ERROR_INVALID_ARGUMENT;
         }
@@ -539,18 +689,18 @@ bool ReadinessHelper::isReady(const Feature &feature,
     bool ret = true;
 
     if (feature.isCritical()) {
-        if (!mPriv->satisfiedFeatures.contains(feature)) {
+        if (!hasFeature(mPriv->satisfiedFeatures, index)) {
             ret = false;
         }
     } else {
-        if (!mPriv->satisfiedFeatures.contains(feature) &&
-            !mPriv->missingFeatures.contains(feature)) {
+        if (!hasFeature(mPriv->satisfiedFeatures, index) &&
+            !hasFeature(mPriv->missingFeatures, index)) {
             ret = false;
         }
     }
 
     if (!ret) {
-        QPair<QString, QString> error = mPriv->missingFeaturesErrors[feature];
+        QPair<QString, QString> error = mPriv->missingFeaturesErrors.value(index);
         if (errorName) {
             *errorName = error.first;
         }
@@ -604,10 +754,16 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
         }
     }
 
-    Features supportedFeatures = mPriv->supportedFeatures;
-    if (supportedFeatures.intersect(requestedFeatures) != requestedFeatures) {
+    bool supported = true;
+    foreach (const Feature &feature, requestedFeatures) {
+        if (!hasFeature(mPriv->supportedFeatures, FeatureRegistry::index(feature))) {
+            supported = false;
+            break;
+        }
+    }
+    if (!supported) {
         warning() << "ReadinessHelper::becomeReady called with invalid features: requestedFeatures =" <<
-            requestedFeatures << "- supportedFeatures =" << mPriv->supportedFeatures;
+            requestedFeatures << "- supportedFeatures =" << featureSet(mPriv->supportedFeatures);
         PendingReady *operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object),
                 requestedFeatures);
         operation->setFinishedWithError(
@@ -624,24 +780,29 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
         return operation;
     }
 
+    const QBitArray requestedBits = featureBits(requestedFeatures);
+
     PendingReady *operation;
     foreach (operation, mPriv->pendingOperations) {
-        if (operation->requestedFeatures() == requestedFeatures) {
+        if (mPriv->pendingOperationsFeatures.value(operation) == requestedBits) {
             return operation;
         }
     }
 
     // Insert the dependencies of the requested features too
-    Features requestedWithDeps = requestedFeatures;
-    foreach (const Feature &feature, requestedFeatures) {
-        requestedWithDeps.unite(mPriv->depsFor(feature));
+    QBitArray requestedWithDeps = requestedBits;
+    for (int i = 0; i < requestedBits.size(); ++i) {
+        if (requestedBits.testBit(i)) {
+            requestedWithDeps |= mPriv->depsFor(i);
+        }
     }
 
-    mPriv->requestedFeatures += requestedWithDeps;
-    mPriv->pendingFeatures += requestedWithDeps; // will be updated in iterateIntrospection
+    mPriv->requestedFeatures |= requestedWithDeps;
+    mPriv->pendingFeatures |= requestedWithDeps; // will be updated in iterateIntrospection
 
     operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object), requestedFeatures);
     mPriv->pendingOperations.append(operation);
+    mPriv->pendingOperationsFeatures.insert(operation, requestedBits);
     // Only we finish these PendingReadys, so we don't need destroyed or finished handling for them
     // - we already know when that happens, as we caused it!
 
@@ -657,7 +818,8 @@ void ReadinessHelper::setIntrospectCompleted(const Feature &feature, bool succes
         // proxy became invalid, ignore here
         return;
     }
-    mPriv->setIntrospectCompleted(feature, success, errorName, errorMessage);
+    mPriv->setIntrospectCompleted(FeatureRegistry::index(feature), success, errorName,
+            errorMessage);
 }
 
 void ReadinessHelper::setIntrospectCompleted(const Feature &feature, bool success,
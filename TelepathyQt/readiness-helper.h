@@ -99,6 +99,10 @@ public:
     Features actualFeatures() const;
     Features missingFeatures() const;
 
+    int maxInFlightIntrospections() const;
+    void setMaxInFlightIntrospections(int max);
+    int introspectionTime(const Feature &feature) const;
+
     bool isReady(const Feature &feature,
             QString *errorName = 0, QString *errorMessage = 0) const;
     bool isReady(const Features &features,
@@ -184,6 +184,7 @@ private Q_SLOTS:
     void onChannelsReady(Tp::PendingOperation *op);
 
 private:
+    void channelsReady(ContextInfo *info);
     Features featuresFor(const ChannelClassSpec &channelClass) const;
 
     WeakPtr<ClientRegistrar> mCr;
@@ -36,7 +36,6 @@
 #include <TelepathyQt/PendingContacts>
 #include <TelepathyQt/PendingComposite>
 #include <TelepathyQt/PendingReady>
-#include <TelepathyQt/PendingSuccess>
 
 namespace Tp
 {
@@ -248,17 +247,29 @@ void SimpleObserver::Private::Observer::observeChannels(
                 SLOT(onChannelInvalidated(Tp::AccountPtr,Tp::ChannelPtr,QString,QString)));
 
         newChannels.append(channel);
-        readyOps.append(wrapper->becomeReady());
+        PendingOperation *op = wrapper->becomeReady();
+        if (op) {
+            readyOps.append(op);
+        }
     }
 
-    if (readyOps.isEmpty()) {
+    if (newChannels.isEmpty()) {
         context->setFinished();
         return;
     }
 
+    ContextInfo *info = new ContextInfo(context, account, newChannels);
+
+    if (readyOps.isEmpty()) {
+        // The channel factory already made the extra features ready, no need to wait for another
+        // round of the main loop
+        channelsReady(info);
+        return;
+    }
+
     PendingComposite *pc = new PendingComposite(readyOps,
             false /* failOnFirstError */, SharedPtr<Observer>(this));
-    mObserveChannelsInfo.insert(pc, new ContextInfo(context, account, newChannels));
+    mObserveChannelsInfo.insert(pc, info);
     connect(pc,
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(onChannelsReady(Tp::PendingOperation*)));
@@ -279,8 +290,11 @@ void SimpleObserver::Private::Observer::onChannelInvalidated(const AccountPtr &c
 
 void SimpleObserver::Private::Observer::onChannelsReady(PendingOperation *op)
 {
-    ContextInfo *info = mObserveChannelsInfo.value(op);
+    channelsReady(mObserveChannelsInfo.take(op));
+}
 
+void SimpleObserver::Private::Observer::channelsReady(ContextInfo *info)
+{
     foreach (const ChannelPtr &channel, info->channels) {
         Q_ASSERT(mIncompleteChannels.contains(channel));
         ChannelWrapper *wrapper = mIncompleteChannels.take(channel);
@@ -298,7 +312,6 @@ void SimpleObserver::Private::Observer::onChannelsReady(PendingOperation *op)
         }
     }
 
-    mObserveChannelsInfo.remove(op);
     info->context->setFinished();
     delete info;
 }
@@ -329,19 +342,18 @@ SimpleObserver::Private::ChannelWrapper::ChannelWrapper(const AccountPtr &channe
             SLOT(onChannelInvalidated(Tp::DBusProxy*,QString,QString)));
 }
 
+/*
+ * Return an operation making the extra features ready, or 0 if they already are.
+ */
 PendingOperation *SimpleObserver::Private::ChannelWrapper::becomeReady()
 {
-    PendingOperation *op;
-
-    if (!mChannel->isReady(mExtraChannelFeatures)) {
-        // The channel factory passed to the Account used by SimpleObserver does
-        // not contain the extra features, request them
-        op = mChannel->becomeReady(mExtraChannelFeatures);
-    } else {
-        op = new PendingSuccess(mChannel);
+    if (mChannel->isReady(mExtraChannelFeatures)) {
+        return 0;
     }
 
-    return op;
+    // The channel factory passed to the Account used by SimpleObserver does
+    // not contain the extra features, request them
+    return mChannel->becomeReady(mExtraChannelFeatures);
 }
 
 void SimpleObserver::Private::ChannelWrapper::onChannelInvalidated(DBusProxy *proxy,
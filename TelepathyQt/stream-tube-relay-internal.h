@@ -0,0 +1,168 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_stream_tube_relay_internal_h_HEADER_GUARD_
+#define _TelepathyQt_stream_tube_relay_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QThread>
+
+class QTcpServer;
+class QTcpSocket;
+
+namespace Tp
+{
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+/*
+ * Listens on a loopback TCP socket which can be offered on stream tubes in place of a service
+ * socket, and relays every connection the CM makes to it to the service socket.
+ *
+ * The sockets live on a dedicated thread, so relaying doesn't compete with the D-Bus traffic
+ * processed by the owner's thread. Per-connection statistics, keyed by the source address of the
+ * CM side connection (which is the address the CM reports for Port access control), can be
+ * queried from any thread.
+ */
+class TP_QT_NO_EXPORT StreamTubeRelay
+{
+    Q_DISABLE_COPY(StreamTubeRelay)
+
+public:
+    typedef QPair<QHostAddress, quint16> Address;
+
+    struct Stats
+    {
+        Stats() : bytesReceived(0), bytesSent(0), stalls(0), duration(0), active(false) { }
+
+        qint64 bytesReceived;
+        qint64 bytesSent;
+        uint stalls;
+        QElapsedTimer started;
+        int duration;
+        bool active;
+    };
+
+    StreamTubeRelay(const QHostAddress &serviceAddress, quint16 servicePort,
+            bool keepClosedStats);
+    ~StreamTubeRelay();
+
+    bool isListening() const { return mListenPort != 0; }
+    QHostAddress listenAddress() const { return mListenAddress; }
+    quint16 listenPort() const { return mListenPort; }
+
+    Address serviceAddress() const { return qMakePair(mServiceAddress, mServicePort); }
+
+    bool stats(const Address &source, Stats &stats) const;
+    void forget(const Address &source);
+
+private:
+    class Worker;
+    class Link;
+    friend class Worker;
+    friend class Link;
+
+    void addStats(const Address &source, const Stats &stats);
+    void updateStats(const Address &source, const Stats &stats);
+
+    QHostAddress mServiceAddress;
+    quint16 mServicePort;
+    bool mKeepClosedStats;
+
+    QHostAddress mListenAddress;
+    quint16 mListenPort;
+
+    mutable QMutex mMutex;
+    QHash<Address, Stats> mStats;
+
+    QThread *mOwnerThread;
+    QThread mThread;
+    Worker *mWorker;
+};
+
+class TP_QT_NO_EXPORT StreamTubeRelay::Worker : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Worker)
+
+public:
+    Worker(StreamTubeRelay *relay);
+    ~Worker();
+
+public Q_SLOTS:
+    bool listen();
+    void shutdown();
+
+private Q_SLOTS:
+    void onNewConnection();
+
+private:
+    StreamTubeRelay *mRelay;
+    QTcpServer *mServer;
+};
+
+class TP_QT_NO_EXPORT StreamTubeRelay::Link : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Link)
+
+public:
+    Link(StreamTubeRelay *relay, QTcpSocket *tubeSocket, QObject *parent);
+    ~Link();
+
+private Q_SLOTS:
+    void onServiceConnected();
+    void onServiceError(QAbstractSocket::SocketError error);
+    void onTubeReadyRead();
+    void onServiceReadyRead();
+    void onTubeBytesWritten();
+    void onServiceBytesWritten();
+    void onTubeDisconnected();
+    void onServiceDisconnected();
+
+private:
+    void pump(QTcpSocket *from, QTcpSocket *to, qint64 &counter, bool &stalled, bool flush);
+    void finishIfDone();
+
+    StreamTubeRelay *mRelay;
+    Address mSource;
+    QTcpSocket *mTube;
+    QTcpSocket *mService;
+    Stats mStats;
+    bool mServiceConnected;
+    bool mTubeStalled;
+    bool mServiceStalled;
+    bool mFinished;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // Tp
+
+#endif
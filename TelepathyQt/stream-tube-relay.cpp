@@ -0,0 +1,320 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/stream-tube-relay-internal.h"
+
+#include "TelepathyQt/_gen/stream-tube-relay-internal.moc.hpp"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace Tp
+{
+
+// Largest amount of data moved from one socket to the other in one go
+static const qint64 RELAY_CHUNK_SIZE = 64 * 1024;
+
+// Reading from a socket stops while this much data is still waiting to be written to the other
+// socket, and resumes once the other socket has drained to the low water mark. The read buffers
+// are capped at the high water mark too, so a slow reader ends up throttling the writer at the
+// TCP level instead of making us buffer without bounds.
+static const qint64 RELAY_HIGH_WATER_MARK = 256 * 1024;
+static const qint64 RELAY_LOW_WATER_MARK = 64 * 1024;
+
+StreamTubeRelay::StreamTubeRelay(const QHostAddress &serviceAddress, quint16 servicePort,
+        bool keepClosedStats)
+    : mServiceAddress(serviceAddress),
+      mServicePort(servicePort),
+      mKeepClosedStats(keepClosedStats),
+      mListenPort(0),
+      mOwnerThread(QThread::currentThread()),
+      mWorker(new Worker(this))
+{
+    mWorker->moveToThread(&mThread);
+    mThread.start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(mWorker, "listen", Qt::BlockingQueuedConnection,
+            Q_RETURN_ARG(bool, listening));
+
+    if (!listening) {
+        warning() << "Unable to listen for connections to relay to" << mServiceAddress <<
+            mServicePort;
+    }
+}
+
+StreamTubeRelay::~StreamTubeRelay()
+{
+    QMetaObject::invokeMethod(mWorker, "shutdown", Qt::BlockingQueuedConnection);
+    mThread.quit();
+    mThread.wait();
+    delete mWorker;
+}
+
+bool StreamTubeRelay::stats(const Address &source, Stats &stats) const
+{
+    QMutexLocker locker(&mMutex);
+    QHash<Address, Stats>::const_iterator i = mStats.find(source);
+    if (i == mStats.constEnd()) {
+        return false;
+    }
+
+    stats = *i;
+    if (stats.active) {
+        stats.duration = int(stats.started.elapsed());
+    }
+    return true;
+}
+
+void StreamTubeRelay::forget(const Address &source)
+{
+    QMutexLocker locker(&mMutex);
+    mStats.remove(source);
+}
+
+void StreamTubeRelay::addStats(const Address &source, const Stats &stats)
+{
+    QMutexLocker locker(&mMutex);
+    mStats.insert(source, stats);
+}
+
+void StreamTubeRelay::updateStats(const Address &source, const Stats &stats)
+{
+    QMutexLocker locker(&mMutex);
+    QHash<Address, Stats>::iterator i = mStats.find(source);
+    if (i == mStats.end()) {
+        // Already forgotten by the owner
+        return;
+    }
+
+    if (!stats.active && !mKeepClosedStats) {
+        mStats.erase(i);
+    } else {
+        *i = stats;
+    }
+}
+
+StreamTubeRelay::Worker::Worker(StreamTubeRelay *relay)
+    : mRelay(relay),
+      mServer(0)
+{
+}
+
+StreamTubeRelay::Worker::~Worker()
+{
+}
+
+bool StreamTubeRelay::Worker::listen()
+{
+    mServer = new QTcpServer(this);
+    connect(mServer, SIGNAL(newConnection()), SLOT(onNewConnection()));
+
+    QHostAddress address = mRelay->mServiceAddress.protocol() == QAbstractSocket::IPv6Protocol ?
+        QHostAddress(QHostAddress::LocalHostIPv6) : QHostAddress(QHostAddress::LocalHost);
+    if (!mServer->listen(address)) {
+        warning() << "Relay QTcpServer failed to listen:" << mServer->errorString();
+        return false;
+    }
+
+    mRelay->mListenAddress = mServer->serverAddress();
+    mRelay->mListenPort = mServer->serverPort();
+
+    debug().nospace() << "Relaying " << mRelay->mListenAddress << ":" << mRelay->mListenPort <<
+        " to " << mRelay->mServiceAddress << ":" << mRelay->mServicePort;
+    return true;
+}
+
+void StreamTubeRelay::Worker::shutdown()
+{
+    // The links are the only other children, and the sockets are theirs
+    QObjectList objects = children();
+    qDeleteAll(objects);
+    mServer = 0;
+
+    // Hand ourselves back so the relay can delete us once the thread has finished
+    moveToThread(mRelay->mOwnerThread);
+}
+
+void StreamTubeRelay::Worker::onNewConnection()
+{
+    while (mServer->hasPendingConnections()) {
+        new Link(mRelay, mServer->nextPendingConnection(), this);
+    }
+}
+
+StreamTubeRelay::Link::Link(StreamTubeRelay *relay, QTcpSocket *tubeSocket, QObject *parent)
+    : QObject(parent),
+      mRelay(relay),
+      mSource(tubeSocket->peerAddress(), tubeSocket->peerPort()),
+      mTube(tubeSocket),
+      mService(new QTcpSocket(this)),
+      mServiceConnected(false),
+      mTubeStalled(false),
+      mServiceStalled(false),
+      mFinished(false)
+{
+    mTube->setParent(this);
+    mTube->setReadBufferSize(RELAY_HIGH_WATER_MARK);
+    mService->setReadBufferSize(RELAY_HIGH_WATER_MARK);
+
+    connect(mTube, SIGNAL(readyRead()), SLOT(onTubeReadyRead()));
+    connect(mTube, SIGNAL(bytesWritten(qint64)), SLOT(onTubeBytesWritten()));
+    connect(mTube, SIGNAL(disconnected()), SLOT(onTubeDisconnected()));
+
+    connect(mService, SIGNAL(connected()), SLOT(onServiceConnected()));
+    connect(mService, SIGNAL(error(QAbstractSocket::SocketError)),
+            SLOT(onServiceError(QAbstractSocket::SocketError)));
+    connect(mService, SIGNAL(readyRead()), SLOT(onServiceReadyRead()));
+    connect(mService, SIGNAL(bytesWritten(qint64)), SLOT(onServiceBytesWritten()));
+    connect(mService, SIGNAL(disconnected()), SLOT(onServiceDisconnected()));
+
+    mStats.started.start();
+    mStats.active = true;
+    mRelay->addStats(mSource, mStats);
+
+    mService->connectToHost(mRelay->mServiceAddress, mRelay->mServicePort);
+}
+
+StreamTubeRelay::Link::~Link()
+{
+}
+
+void StreamTubeRelay::Link::onServiceConnected()
+{
+    mServiceConnected = true;
+
+    // Pass on whatever the CM sent while we were connecting, and finish up if it already gave up
+    pump(mTube, mService, mStats.bytesReceived, mTubeStalled, false);
+    if (mTube->state() == QAbstractSocket::UnconnectedState) {
+        onTubeDisconnected();
+    }
+}
+
+void StreamTubeRelay::Link::onServiceError(QAbstractSocket::SocketError error)
+{
+    if (mServiceConnected) {
+        // Errors after connecting are followed by disconnected()
+        return;
+    }
+
+    warning() << "Relay failed to connect to" << mRelay->mServiceAddress << mRelay->mServicePort <<
+        "- error" << error << ':' << mService->errorString();
+    mTube->abort();
+    finishIfDone();
+}
+
+void StreamTubeRelay::Link::onTubeReadyRead()
+{
+    pump(mTube, mService, mStats.bytesReceived, mTubeStalled, false);
+}
+
+void StreamTubeRelay::Link::onServiceReadyRead()
+{
+    pump(mService, mTube, mStats.bytesSent, mServiceStalled, false);
+}
+
+void StreamTubeRelay::Link::onTubeBytesWritten()
+{
+    if (mServiceStalled && mTube->bytesToWrite() <= RELAY_LOW_WATER_MARK) {
+        mServiceStalled = false;
+        pump(mService, mTube, mStats.bytesSent, mServiceStalled, false);
+    }
+}
+
+void StreamTubeRelay::Link::onServiceBytesWritten()
+{
+    if (mTubeStalled && mService->bytesToWrite() <= RELAY_LOW_WATER_MARK) {
+        mTubeStalled = false;
+        pump(mTube, mService, mStats.bytesReceived, mTubeStalled, false);
+    }
+}
+
+void StreamTubeRelay::Link::onTubeDisconnected()
+{
+    if (mService->state() == QAbstractSocket::HostLookupState ||
+            mService->state() == QAbstractSocket::ConnectingState) {
+        // onServiceConnected() will flush and close the service side once it's up
+        return;
+    }
+
+    pump(mTube, mService, mStats.bytesReceived, mTubeStalled, true);
+    if (mService->state() == QAbstractSocket::ConnectedState) {
+        mService->disconnectFromHost();
+    }
+    finishIfDone();
+}
+
+void StreamTubeRelay::Link::onServiceDisconnected()
+{
+    pump(mService, mTube, mStats.bytesSent, mServiceStalled, true);
+    if (mTube->state() == QAbstractSocket::ConnectedState) {
+        mTube->disconnectFromHost();
+    }
+    finishIfDone();
+}
+
+void StreamTubeRelay::Link::pump(QTcpSocket *from, QTcpSocket *to, qint64 &counter,
+        bool &stalled, bool flush)
+{
+    if (to->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    qint64 before = counter;
+    while (from->bytesAvailable() > 0) {
+        if (!flush && to->bytesToWrite() >= RELAY_HIGH_WATER_MARK) {
+            if (!stalled) {
+                stalled = true;
+                ++mStats.stalls;
+            }
+            break;
+        }
+
+        QByteArray chunk = from->read(RELAY_CHUNK_SIZE);
+        to->write(chunk);
+        counter += chunk.size();
+    }
+
+    if (counter != before || stalled) {
+        mRelay->updateStats(mSource, mStats);
+    }
+}
+
+void StreamTubeRelay::Link::finishIfDone()
+{
+    if (mFinished || mTube->state() != QAbstractSocket::UnconnectedState ||
+            mService->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+
+    mFinished = true;
+    mStats.duration = int(mStats.started.elapsed());
+    mStats.active = false;
+    mRelay->updateStats(mSource, mStats);
+
+    deleteLater();
+}
+
+} // Tp
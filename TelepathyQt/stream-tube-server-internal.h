@@ -23,9 +23,13 @@
 #include <TelepathyQt/StreamTubeServer>
 #include <TelepathyQt/Types>
 
+#include <QSharedPointer>
+
 namespace Tp
 {
 
+class StreamTubeRelay;
+
 class TP_QT_NO_EXPORT StreamTubeServer::TubeWrapper :
                 public QObject
 {
@@ -40,6 +44,7 @@ public:
 
     AccountPtr mAcc;
     OutgoingStreamTubeChannelPtr mTube;
+    QSharedPointer<StreamTubeRelay> mRelay;
 
 Q_SIGNALS:
     void offerFinished(TubeWrapper *wrapper, Tp::PendingOperation *op);
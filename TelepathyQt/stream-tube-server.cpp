@@ -28,9 +28,11 @@
 
 #include "TelepathyQt/debug-internal.h"
 #include "TelepathyQt/simple-stream-tube-handler.h"
+#include "TelepathyQt/stream-tube-relay-internal.h"
 
 #include <QScopedPointer>
 #include <QSharedData>
+#include <QSharedPointer>
 #include <QTcpServer>
 
 #include <TelepathyQt/AccountManager>
@@ -288,6 +290,123 @@ StreamTubeServer::Tube &StreamTubeServer::Tube::operator=(
  * \return A pointer to the channel.
  */
 
+struct TP_QT_NO_EXPORT StreamTubeServer::RelayStats::Private : public QSharedData
+{
+    StreamTubeRelay::Stats stats;
+};
+
+/**
+ * \class StreamTubeServer::RelayStats
+ * \ingroup serverclient
+ * \headerfile TelepathyQt/stream-tube-server.h <TelepathyQt/StreamTubeServer>
+ *
+ * \brief The StreamTubeServer::RelayStats class is a snapshot of the traffic relayed for a
+ * connection when the server relays the exported socket.
+ *
+ * See StreamTubeServer::relayTcpSocket() and StreamTubeServer::relayStats().
+ */
+
+/**
+ * Constructs a new invalid RelayStats instance.
+ */
+StreamTubeServer::RelayStats::RelayStats()
+{
+    // invalid instance
+}
+
+/**
+ * Copy constructor.
+ */
+StreamTubeServer::RelayStats::RelayStats(
+        const RelayStats &other)
+    : mPriv(other.mPriv)
+{
+}
+
+/**
+ * Class destructor.
+ */
+StreamTubeServer::RelayStats::~RelayStats()
+{
+    // mPriv deleted automatically
+}
+
+/**
+ * Assignment operator.
+ */
+StreamTubeServer::RelayStats &StreamTubeServer::RelayStats::operator=(
+        const RelayStats &other)
+{
+    mPriv = other.mPriv;
+    return *this;
+}
+
+/**
+ * \fn bool StreamTubeServer::RelayStats::isValid() const
+ *
+ * Return whether or not the statistics are valid or are just the null object created using the
+ * default constructor.
+ *
+ * \return \c true if valid, \c false otherwise.
+ */
+
+/**
+ * Return whether the relay was still passing data for the connection when the snapshot was taken.
+ *
+ * \return \c true if the connection was still being relayed, \c false if it had been closed.
+ */
+bool StreamTubeServer::RelayStats::isActive() const
+{
+    return isValid() ? mPriv->stats.active : false;
+}
+
+/**
+ * Return the number of bytes received from the remote contact and passed on to the exported
+ * socket.
+ *
+ * \return The byte count.
+ */
+qint64 StreamTubeServer::RelayStats::bytesReceived() const
+{
+    return isValid() ? mPriv->stats.bytesReceived : 0;
+}
+
+/**
+ * Return the number of bytes read from the exported socket and sent to the remote contact.
+ *
+ * \return The byte count.
+ */
+qint64 StreamTubeServer::RelayStats::bytesSent() const
+{
+    return isValid() ? mPriv->stats.bytesSent : 0;
+}
+
+/**
+ * Return how many times the relay had to stop reading from one side of the connection because
+ * the other side was not keeping up with the data already passed to it.
+ *
+ * A steadily growing count means one of the endpoints is consistently slower than the other.
+ *
+ * \return The number of stalls in either direction.
+ */
+uint StreamTubeServer::RelayStats::stalls() const
+{
+    return isValid() ? mPriv->stats.stalls : 0;
+}
+
+/**
+ * Return for how long the connection has been relayed, or was relayed in total if it has already
+ * been closed.
+ *
+ * Together with bytesReceived() and bytesSent() this gives the throughput of the connection.
+ *
+ * \return The duration in milliseconds.
+ */
+int StreamTubeServer::RelayStats::duration() const
+{
+    return isValid() ? mPriv->stats.duration : 0;
+}
+
 struct StreamTubeServer::Private
 {
     Private(const ClientRegistrarPtr &registrar,
@@ -336,6 +455,7 @@ struct StreamTubeServer::Private
     quint16 exportedPort;
     ParametersGenerator *generator;
     QScopedPointer<FixedParametersGenerator> fixedGenerator;
+    QSharedPointer<StreamTubeRelay> relay;
 
     QHash<StreamTubeChannelPtr, TubeWrapper *> tubes;
 
@@ -729,6 +849,7 @@ void StreamTubeServer::exportTcpSocket(
 
     mPriv->exportedAddr = address;
     mPriv->exportedPort = port;
+    mPriv->relay.clear();
 
     mPriv->generator = 0;
     if (!parameters.isEmpty()) {
@@ -802,6 +923,7 @@ void StreamTubeServer::exportTcpSocket(
 
     mPriv->exportedAddr = address;
     mPriv->exportedPort = port;
+    mPriv->relay.clear();
     mPriv->generator = generator;
 
     mPriv->ensureRegistered();
@@ -840,6 +962,151 @@ void StreamTubeServer::exportTcpSocket(
     }
 }
 
+/**
+ * Set the server to relay connections made over tubes handled in the future to the socket
+ * listening at the given (\a address, \a port) combination.
+ *
+ * Instead of offering the socket itself, the server then offers a loopback socket of its own on
+ * the tubes, and passes the data of each connection the connection manager makes to it on to a new
+ * connection to the given socket, and back. The relay runs in a dedicated thread, so it doesn't
+ * compete with the event processing of the application. Relaying is mostly useful to get the
+ * traffic statistics of each connection through relayStats(), and to protect a service which can't
+ * cope with slow peers from them: the relay stops reading from either side of a connection while
+ * the other one is not keeping up.
+ *
+ * exportedTcpSocketAddress() returns the address of the relay socket, and
+ * relayedTcpSocketAddress() the given address, until the next call to exportTcpSocket() or
+ * relayTcpSocket(). Connections over tubes which were offered earlier keep being relayed until
+ * they are closed.
+ *
+ * The parameters are handled like for exportTcpSocket(const QHostAddress &, quint16, const
+ * QVariantMap &).
+ *
+ * \param address The listen address of the socket.
+ * \param port The port of the socket.
+ * \param parameters The bootstrapping parameters in a string-value map.
+ */
+void StreamTubeServer::relayTcpSocket(
+        const QHostAddress &address,
+        quint16 port,
+        const QVariantMap &parameters)
+{
+    if (address.isNull() || port == 0) {
+        warning() << "Attempted to relay null TCP socket address or zero port, ignoring";
+        return;
+    }
+
+    QSharedPointer<StreamTubeRelay> relay(
+            new StreamTubeRelay(address, port, monitorsConnections()));
+    if (!relay->isListening()) {
+        return;
+    }
+
+    exportTcpSocket(relay->listenAddress(), relay->listenPort(), parameters);
+    mPriv->relay = relay;
+}
+
+/**
+ * Set the server to relay connections made over tubes handled in the future to the socket
+ * listening at the given (\a address, \a port) combination, sending the parameters from the given
+ * \a generator along with the offers.
+ *
+ * See relayTcpSocket(const QHostAddress &, quint16, const QVariantMap &) for how the relaying
+ * works.
+ *
+ * \param address The listen address of the socket.
+ * \param port The port of the socket.
+ * \param generator A pointer to the bootstrapping parameters generator.
+ */
+void StreamTubeServer::relayTcpSocket(
+        const QHostAddress &address,
+        quint16 port,
+        ParametersGenerator *generator)
+{
+    if (address.isNull() || port == 0) {
+        warning() << "Attempted to relay null TCP socket address or zero port, ignoring";
+        return;
+    }
+
+    QSharedPointer<StreamTubeRelay> relay(
+            new StreamTubeRelay(address, port, monitorsConnections()));
+    if (!relay->isListening()) {
+        return;
+    }
+
+    exportTcpSocket(relay->listenAddress(), relay->listenPort(), generator);
+    mPriv->relay = relay;
+}
+
+/**
+ * Return whether tubes handled in the future will be relayed to the exported socket.
+ *
+ * \return \c true if relayTcpSocket() was used to set the socket, \c false otherwise.
+ */
+bool StreamTubeServer::isRelaying() const
+{
+    return !mPriv->relay.isNull();
+}
+
+/**
+ * Return the host address and port of the socket the relay passes connections on to, if the
+ * server is relaying.
+ *
+ * QHostAddress::Null is reported as the address and 0 as the port if isRelaying() is \c false.
+ *
+ * \return The host address and port values in a pair structure.
+ */
+QPair<QHostAddress, quint16> StreamTubeServer::relayedTcpSocketAddress() const
+{
+    if (mPriv->relay.isNull()) {
+        return qMakePair(QHostAddress(QHostAddress::Null), quint16(0));
+    }
+
+    return mPriv->relay->serviceAddress();
+}
+
+/**
+ * Return the traffic statistics of the relayed connection from the given source address.
+ *
+ * The source address is the one signaled by newTcpConnection() and tcpConnectionClosed(). If
+ * connection monitoring is enabled, the statistics of a connection stay available until
+ * tcpConnectionClosed() has been emitted for it, so they can be read from a slot connected to it.
+ * Otherwise, they are dropped as soon as the relay has closed the connection.
+ *
+ * Each call returns a new snapshot; the returned object is not updated as more data is relayed.
+ *
+ * \param sourceAddress The source host address of the connection.
+ * \param sourcePort The source port of the connection.
+ * \return The statistics, or an invalid RelayStats if the connection is not known to a relay of
+ *         this server.
+ */
+StreamTubeServer::RelayStats StreamTubeServer::relayStats(const QHostAddress &sourceAddress,
+        quint16 sourcePort) const
+{
+    StreamTubeRelay::Address source(sourceAddress, sourcePort);
+    StreamTubeRelay::Stats stats;
+    RelayStats ret;
+
+    if (mPriv->relay && mPriv->relay->stats(source, stats)) {
+        ret.mPriv = new RelayStats::Private;
+        ret.mPriv->stats = stats;
+        return ret;
+    }
+
+    // The connection might be over a tube offered before the socket was last changed
+    for (QHash<StreamTubeChannelPtr, TubeWrapper *>::const_iterator i = mPriv->tubes.constBegin();
+            i != mPriv->tubes.constEnd(); ++i) {
+        const QSharedPointer<StreamTubeRelay> &relay = (*i)->mRelay;
+        if (relay && relay != mPriv->relay && relay->stats(source, stats)) {
+            ret.mPriv = new RelayStats::Private;
+            ret.mPriv->stats = stats;
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
 /**
  * Return the tubes currently handled by the server.
  *
@@ -849,9 +1116,11 @@ void StreamTubeServer::exportTcpSocket(
 QList<StreamTubeServer::Tube> StreamTubeServer::tubes() const
 {
     QList<Tube> tubes;
+    tubes.reserve(mPriv->tubes.size());
 
-    foreach (TubeWrapper *wrapper, mPriv->tubes.values()) {
-        tubes.push_back(Tube(wrapper->mAcc, wrapper->mTube));
+    for (QHash<StreamTubeChannelPtr, TubeWrapper *>::const_iterator i = mPriv->tubes.constBegin();
+            i != mPriv->tubes.constEnd(); ++i) {
+        tubes.push_back(Tube((*i)->mAcc, (*i)->mTube));
     }
 
     return tubes;
@@ -884,37 +1153,29 @@ QHash<QPair<QHostAddress, quint16>,
         return conns;
     }
 
-    foreach (const Tube &tube, tubes()) {
+    for (QHash<StreamTubeChannelPtr, TubeWrapper *>::const_iterator i = mPriv->tubes.constBegin();
+            i != mPriv->tubes.constEnd(); ++i) {
+        const OutgoingStreamTubeChannelPtr &tube = (*i)->mTube;
+
         // Ignore invalid and non-Open tubes to prevent a few useless warnings in corner cases where
         // a tube is still being opened, or has been invalidated but we haven't processed that event
         // yet.
-        if (!tube.channel()->isValid() || tube.channel()->state() != TubeChannelStateOpen) {
+        if (!tube->isValid() || tube->state() != TubeChannelStateOpen) {
             continue;
         }
 
-        if (tube.channel()->addressType() != SocketAddressTypeIPv4 &&
-                tube.channel()->addressType() != SocketAddressTypeIPv6) {
+        if (tube->addressType() != SocketAddressTypeIPv4 &&
+                tube->addressType() != SocketAddressTypeIPv6) {
             continue;
         }
 
-        QHash<QPair<QHostAddress,quint16>, uint> srcAddrConns =
-            tube.channel()->connectionsForSourceAddresses();
-        QHash<uint, ContactPtr> connContacts =
-            tube.channel()->contactsForConnections();
-
-        QPair<QHostAddress, quint16> srcAddr;
-        foreach (srcAddr, srcAddrConns.keys()) {
-            ContactPtr contact = connContacts.take(srcAddrConns.value(srcAddr));
-            conns.insert(srcAddr, RemoteContact(tube.account(), contact));
-        }
-
-        // The remaining values in our copy of connContacts are those which didn't have a
-        // corresponding source address, probably because the service doesn't properly implement
-        // Port AC
-        foreach (const ContactPtr &contact, connContacts.values()) {
-            // Insert them with an invalid source address as the key
-            conns.insertMulti(qMakePair(QHostAddress(QHostAddress::Null), quint16(0)),
-                    RemoteContact(tube.account(), contact));
+        // Connections which don't have a source address, probably because the service doesn't
+        // properly implement Port AC, are inserted with the invalid source address as the key
+        const QHash<uint, ContactPtr> connContacts = tube->contactsForConnections();
+        for (QHash<uint, ContactPtr>::const_iterator j = connContacts.constBegin();
+                j != connContacts.constEnd(); ++j) {
+            conns.insertMulti(tube->sourceAddressForConnection(j.key()),
+                    RemoteContact((*i)->mAcc, j.value()));
         }
     }
 
@@ -955,6 +1216,7 @@ void StreamTubeServer::onInvokedForTube(
 
         TubeWrapper *wrapper =
             new TubeWrapper(acc, outgoing, mPriv->exportedAddr, mPriv->exportedPort, params, this);
+        wrapper->mRelay = mPriv->relay;
 
         connect(wrapper,
                 SIGNAL(offerFinished(TubeWrapper*,Tp::PendingOperation*)),
@@ -1028,14 +1290,9 @@ void StreamTubeServer::onNewConnection(
 
     if (wrapper->mTube->addressType() == SocketAddressTypeIPv4
             || wrapper->mTube->addressType() == SocketAddressTypeIPv6) {
-        QHash<QPair<QHostAddress,quint16>, uint> srcAddrConns =
-            wrapper->mTube->connectionsForSourceAddresses();
-        QHash<uint, Tp::ContactPtr> connContacts =
-            wrapper->mTube->contactsForConnections();
-
-        QPair<QHostAddress, quint16> srcAddr = srcAddrConns.key(conn);
+        QPair<QHostAddress, quint16> srcAddr = wrapper->mTube->sourceAddressForConnection(conn);
         emit newTcpConnection(srcAddr.first, srcAddr.second, wrapper->mAcc,
-                connContacts.value(conn), wrapper->mTube);
+                wrapper->mTube->contactForConnection(conn), wrapper->mTube);
     } else {
         // No UNIX socket should ever have been offered yet
         Q_ASSERT(false);
@@ -1052,14 +1309,13 @@ void StreamTubeServer::onConnectionClosed(
 
     if (wrapper->mTube->addressType() == SocketAddressTypeIPv4
             || wrapper->mTube->addressType() == SocketAddressTypeIPv6) {
-        QHash<QPair<QHostAddress,quint16>, uint> srcAddrConns =
-            wrapper->mTube->connectionsForSourceAddresses();
-        QHash<uint, Tp::ContactPtr> connContacts =
-            wrapper->mTube->contactsForConnections();
-
-        QPair<QHostAddress, quint16> srcAddr = srcAddrConns.key(conn);
+        QPair<QHostAddress, quint16> srcAddr = wrapper->mTube->sourceAddressForConnection(conn);
         emit tcpConnectionClosed(srcAddr.first, srcAddr.second, wrapper->mAcc,
-                connContacts.value(conn), error, message, wrapper->mTube);
+                wrapper->mTube->contactForConnection(conn), error, message, wrapper->mTube);
+
+        if (wrapper->mRelay) {
+            wrapper->mRelay->forget(srcAddr);
+        }
     } else {
         // No UNIX socket should ever have been offered yet
         Q_ASSERT(false);
@@ -115,6 +115,31 @@ public:
         QSharedDataPointer<Private> mPriv;
     };
 
+    class RelayStats
+    {
+    public:
+        RelayStats();
+        RelayStats(const RelayStats &other);
+        ~RelayStats();
+
+        bool isValid() const { return mPriv.constData() != 0; }
+
+        RelayStats &operator=(const RelayStats &other);
+
+        bool isActive() const;
+        qint64 bytesReceived() const;
+        qint64 bytesSent() const;
+        uint stalls() const;
+        int duration() const;
+
+    private:
+        friend class StreamTubeServer;
+
+        struct Private;
+        friend struct Private;
+        QSharedDataPointer<Private> mPriv;
+    };
+
     static StreamTubeServerPtr create(
             const QStringList &p2pServices,
             const QStringList &roomServices = QStringList(),
@@ -180,6 +205,19 @@ public:
             const QTcpServer *server,
             ParametersGenerator *generator);
 
+    void relayTcpSocket(
+            const QHostAddress &address,
+            quint16 port,
+            const QVariantMap &parameters = QVariantMap());
+    void relayTcpSocket(
+            const QHostAddress &address,
+            quint16 port,
+            ParametersGenerator *generator);
+
+    bool isRelaying() const;
+    QPair<QHostAddress, quint16> relayedTcpSocketAddress() const;
+    RelayStats relayStats(const QHostAddress &sourceAddress, quint16 sourcePort) const;
+
     QList<Tube> tubes() const;
 
     QHash<QPair<QHostAddress, quint16>, RemoteContact> tcpConnections() const;
@@ -31,7 +31,11 @@
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/ContactCapabilities>
 
+#include <QByteArray>
+#include <QDBusConnection>
+#include <QHash>
 #include <QString>
+#include <QStringList>
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -39,6 +43,7 @@ namespace Tp
 {
 
 class DBusProxy;
+class PendingOperation;
 
 // Exported so the tests can use it even if they link dynamically
 // The header is not installed though, so this should be considered private API
@@ -50,6 +55,27 @@ struct TP_QT_EXPORT TestBackdoors
             const RequestableChannelClassSpecList &rccSpecs);
     static ContactCapabilities createContactCapabilities(
             const RequestableChannelClassSpecList &rccSpecs, bool specificToContact);
+
+    // These are defined next to NameOwnerCache in the library itself, as the class isn't exported
+    static PendingOperation *resolveNameOwners(const QDBusConnection &bus,
+            const QStringList &names);
+    static bool lookupNameOwner(const QDBusConnection &bus, const QString &name, QString &owner);
+    static quint64 nameOwnerSynchronousCalls(const QDBusConnection &bus);
+
+    // Likewise defined next to AvatarCache
+    static PendingOperation *storeAvatar(const QString &avatarFileName, const QByteArray &data,
+            const QString &mimeType);
+    static PendingOperation *loadAvatars(const QStringList &avatarFileNames);
+    static QHash<QString, QString> avatarsFound(PendingOperation *op);
+    static QStringList avatarsMissing(PendingOperation *op);
+    static bool lookupAvatar(const QString &avatarFileName, QString &mimeType);
+
+    // Likewise defined next to ProtocolInfoCache and ProfileIndex
+    static QString protocolInfoCacheFileName(const QString &cmName);
+    static QString protocolInfoSourceKey(const QString &cmName);
+    static quint64 protocolInfoCacheHits();
+    static quint64 protocolInfoCacheMisses();
+    static QString profileIndexFileName();
 };
 
 } // Tp
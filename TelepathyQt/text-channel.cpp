@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/text-channel.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/method-index-internal.h"
 
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/ConnectionLowlevel>
@@ -37,6 +38,8 @@
 #include <TelepathyQt/ReferencedHandles>
 
 #include <QDateTime>
+#include <QHash>
+#include <QLinkedList>
 
 namespace Tp
 {
@@ -54,11 +57,16 @@ struct TP_QT_NO_EXPORT TextChannel::Private
     void updateInitialMessages();
     void updateCapabilities();
 
+    struct MessageEvent;
+
+    void queueMessageEvent(MessageEvent *e);
     void processMessageQueue();
     void processChatStateQueue();
 
-    void contactLost(uint handle);
-    void contactFound(ContactPtr contact);
+    void appendMessage(const ReceivedMessage &message);
+    bool removeMessage(const ReceivedMessage &message);
+
+    void updateContacts(const QHash<uint, ContactPtr> &found, const QSet<uint> &lost);
 
     // Public object
     TextChannel *parent;
@@ -95,8 +103,16 @@ struct TP_QT_NO_EXPORT TextChannel::Private
         ReceivedMessage message;
         uint removed;
     };
-    QList<ReceivedMessage> messages;
+    // Main queue, in reception order
+    QLinkedList<ReceivedMessage> messages;
+    // pending message id -> positions in the main queue (there should be at
+    // most one under normal circumstances)
+    QMultiHash<uint, QLinkedList<ReceivedMessage>::iterator> messagePositions;
+    mutable QList<ReceivedMessage> messageQueueCache;
+    mutable bool messageQueueCacheValid;
     QList<MessageEvent *> incompleteMessages;
+    // Senders of incomplete messages that don't have a Contact object yet
+    HandleIdentifierMap missingSenders;
     QHash<QDBusPendingCallWatcher *, UIntList> acknowledgeBatches;
 
     // FeatureChatState
@@ -125,7 +141,8 @@ TextChannel::Private::Private(TextChannel *parent)
       gotProperties(false),
       messagePartSupport(0),
       deliveryReportingSupport(0),
-      initialMessagesReceived(false)
+      initialMessagesReceived(false),
+      messageQueueCacheValid(true)
 {
     ReadinessHelper::Introspectables introspectables;
 
@@ -338,6 +355,18 @@ void TextChannel::Private::updateCapabilities()
     readinessHelper->setIntrospectCompleted(FeatureMessageCapabilities, true);
 }
 
+void TextChannel::Private::queueMessageEvent(MessageEvent *e)
+{
+    incompleteMessages << e;
+
+    if (e->isMessage) {
+        uint handle = e->message.senderHandle();
+        if (handle != 0 && !e->message.sender()) {
+            missingSenders.insert(handle, e->message.senderId());
+        }
+    }
+}
+
 void TextChannel::Private::processMessageQueue()
 {
     // Proceed as far as we can with the processing of incoming messages
@@ -359,20 +388,21 @@ void TextChannel::Private::processMessageQueue()
 
             // if we reach here, the message is ready
             debug() << "Message is usable, copying to main queue";
-            messages << e->message;
+            appendMessage(e->message);
             emit parent->messageReceived(e->message);
         } else {
             // forget about the message(s) with ID e->removed (there should be
             // at most one under normal circumstances)
-            int i = 0;
-            while (i < messages.size()) {
-                if (messages.at(i).pendingId() == e->removed) {
-                    ReceivedMessage removedMessage = messages.at(i);
-                    messages.removeAt(i);
-                    emit parent->pendingMessageRemoved(removedMessage);
-                } else {
-                    i++;
-                }
+            // values() returns the most recently queued first, so walk it
+            // backwards to keep the reception order
+            QList<QLinkedList<ReceivedMessage>::iterator> positions =
+                messagePositions.values(e->removed);
+            messagePositions.remove(e->removed);
+            for (int i = positions.size() - 1; i >= 0; --i) {
+                ReceivedMessage removedMessage = *positions.at(i);
+                messages.erase(positions.at(i));
+                messageQueueCacheValid = false;
+                emit parent->pendingMessageRemoved(removedMessage);
             }
         }
 
@@ -381,6 +411,8 @@ void TextChannel::Private::processMessageQueue()
     }
 
     if (incompleteMessages.isEmpty()) {
+        missingSenders.clear();
+
         if (readinessHelper->requestedFeatures().contains(FeatureMessageQueue) &&
             !readinessHelper->isReady(Features() << FeatureMessageQueue)) {
             debug() << "incompleteMessages empty for the first time: "
@@ -393,13 +425,10 @@ void TextChannel::Private::processMessageQueue()
     // What Contact objects do we need in order to proceed, ignoring those
     // for which we've already sent a request?
     HandleIdentifierMap contactsRequired;
-    foreach (const MessageEvent *e, incompleteMessages) {
-        if (e->isMessage) {
-            uint handle = e->message.senderHandle();
-            if (handle != 0 && !e->message.sender()
-                    && !awaitingContacts.contains(handle)) {
-                contactsRequired.insert(handle, e->message.senderId());
-            }
+    HandleIdentifierMap::const_iterator i = missingSenders.constBegin();
+    for (; i != missingSenders.constEnd(); ++i) {
+        if (!awaitingContacts.contains(i.key())) {
+            contactsRequired.insert(i.key(), i.value());
         }
     }
 
@@ -464,42 +493,69 @@ void TextChannel::Private::processChatStateQueue()
     awaitingContacts |= contactsRequired;
 }
 
-void TextChannel::Private::contactLost(uint handle)
+void TextChannel::Private::appendMessage(const ReceivedMessage &message)
 {
-    // we're not going to get a Contact object for this handle, so mark the
-    // messages from that handle as "unknown sender"
-    foreach (MessageEvent *e, incompleteMessages) {
-        if (e->isMessage && e->message.senderHandle() == handle
-                && !e->message.sender()) {
-            e->message.clearSenderHandle();
-        }
-    }
+    messagePositions.insert(message.pendingId(), messages.insert(messages.end(), message));
+    messageQueueCacheValid = false;
+}
 
-    // there is no point in sending chat state notifications for unknown
-    // contacts, removing chat state events from queue that refer to this handle
-    foreach (ChatStateEvent *e, chatStateQueue) {
-        if (e->contactHandle == handle) {
-            chatStateQueue.removeOne(e);
-            delete e;
+bool TextChannel::Private::removeMessage(const ReceivedMessage &message)
+{
+    uint id = message.pendingId();
+    QMultiHash<uint, QLinkedList<ReceivedMessage>::iterator>::iterator i =
+        messagePositions.find(id);
+    for (; i != messagePositions.end() && i.key() == id; ++i) {
+        if (*i.value() == message) {
+            messages.erase(i.value());
+            messagePositions.erase(i);
+            messageQueueCacheValid = false;
+            return true;
         }
     }
+    return false;
 }
 
-void TextChannel::Private::contactFound(ContactPtr contact)
+void TextChannel::Private::updateContacts(const QHash<uint, ContactPtr> &found,
+        const QSet<uint> &lost)
 {
-    uint handle = contact->handle().at(0);
+    foreach (uint handle, found.keys()) {
+        missingSenders.remove(handle);
+    }
+    foreach (uint handle, lost) {
+        missingSenders.remove(handle);
+    }
 
     foreach (MessageEvent *e, incompleteMessages) {
-        if (e->isMessage && e->message.senderHandle() == handle
-                && !e->message.sender()) {
+        if (!e->isMessage || e->message.senderHandle() == 0 || e->message.sender()) {
+            continue;
+        }
+
+        uint handle = e->message.senderHandle();
+        ContactPtr contact = found.value(handle);
+        if (contact) {
             e->message.setSender(contact);
+        } else if (lost.contains(handle)) {
+            // we're not going to get a Contact object for this handle, so mark the
+            // messages from that handle as "unknown sender"
+            e->message.clearSenderHandle();
         }
     }
 
-    foreach (ChatStateEvent *e, chatStateQueue) {
-        if (e->contactHandle == handle) {
-            e->contact = contact;
+    QList<ChatStateEvent *>::iterator i = chatStateQueue.begin();
+    while (i != chatStateQueue.end()) {
+        ChatStateEvent *e = *i;
+        if (lost.contains(e->contactHandle)) {
+            // there is no point in sending chat state notifications for unknown
+            // contacts, removing chat state events from queue that refer to this handle
+            delete e;
+            i = chatStateQueue.erase(i);
+            continue;
+        }
+
+        if (found.contains(e->contactHandle)) {
+            e->contact = found.value(e->contactHandle);
         }
+        ++i;
     }
 }
 
@@ -825,7 +881,15 @@ DeliveryReportingSupportFlags TextChannel::deliveryReportingSupport() const
  */
 QList<ReceivedMessage> TextChannel::messageQueue() const
 {
-    return mPriv->messages;
+    if (!mPriv->messageQueueCacheValid) {
+        mPriv->messageQueueCache.clear();
+        mPriv->messageQueueCache.reserve(mPriv->messages.size());
+        foreach (const ReceivedMessage &message, mPriv->messages) {
+            mPriv->messageQueueCache << message;
+        }
+        mPriv->messageQueueCacheValid = true;
+    }
+    return mPriv->messageQueueCache;
 }
 
 /**
@@ -891,9 +955,17 @@ void TextChannel::onAcknowledgePendingMessagesReply(
 void TextChannel::acknowledge(const QList<ReceivedMessage> &messages)
 {
     UIntList ids;
+    TextChannelPtr self(this);
 
+    // we're going to acknowledge these messages (or as many as possible, if
+    // we lose a race with another acknowledging process), so let's remove
+    // them from the list immediately
     foreach (const ReceivedMessage &m, messages) {
-        if (m.isFromChannel(TextChannelPtr(this))) {
+        // messages found in the queue are known to come from this channel
+        if (mPriv->removeMessage(m)) {
+            ids << m.pendingId();
+            emit pendingMessageRemoved(m);
+        } else if (m.isFromChannel(self)) {
             ids << m.pendingId();
         } else {
             warning() << "message did not come from this channel, ignoring";
@@ -904,17 +976,11 @@ void TextChannel::acknowledge(const QList<ReceivedMessage> &messages)
         return;
     }
 
-    // we're going to acknowledge these messages (or as many as possible, if
-    // we lose a race with another acknowledging process), so let's remove
-    // them from the list immediately
-    forget(messages);
-
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+    static const MethodIndex acknowledgeReplySlot(&staticMetaObject,
+            "onAcknowledgePendingMessagesReply(QDBusPendingCallWatcher*)");
+    QDBusPendingCallWatcher *watcher = watchPendingCall(
             mPriv->textInterface->AcknowledgePendingMessages(ids),
-            this);
-    connect(watcher,
-            SIGNAL(finished(QDBusPendingCallWatcher*)),
-            SLOT(onAcknowledgePendingMessagesReply(QDBusPendingCallWatcher*)));
+            this, acknowledgeReplySlot);
     mPriv->acknowledgeBatches[watcher] = ids;
 }
 
@@ -933,11 +999,14 @@ void TextChannel::acknowledge(const QList<ReceivedMessage> &messages)
  */
 void TextChannel::forget(const QList<ReceivedMessage> &messages)
 {
+    TextChannelPtr self(this);
+
     foreach (const ReceivedMessage &m, messages) {
-        if (!m.isFromChannel(TextChannelPtr(this))) {
-            warning() << "message did not come from this channel, ignoring";
-        } else if (mPriv->messages.removeOne(m)) {
+        // messages found in the queue are known to come from this channel
+        if (mPriv->removeMessage(m)) {
             emit pendingMessageRemoved(m);
+        } else if (!m.isFromChannel(self)) {
+            warning() << "message did not come from this channel, ignoring";
         }
     }
 }
@@ -1081,20 +1150,19 @@ void TextChannel::onContactsFinished(PendingOperation *op)
         mPriv->awaitingContacts -= handle;
     }
 
+    QHash<uint, ContactPtr> found;
+    QSet<uint> lost;
     if (pc->isError()) {
         warning().nospace() << "Gathering contacts failed: "
             << pc->errorName() << ": " << pc->errorMessage();
-        foreach (uint handle, pc->handles()) {
-            mPriv->contactLost(handle);
-        }
+        lost = pc->handles().toSet();
     } else {
         foreach (const ContactPtr &contact, pc->contacts()) {
-            mPriv->contactFound(contact);
-        }
-        foreach (uint handle, pc->invalidHandles()) {
-            mPriv->contactLost(handle);
+            found.insert(contact->handle().at(0), contact);
         }
+        lost = pc->invalidHandles().toSet();
     }
+    mPriv->updateContacts(found, lost);
 
     // all contacts for messages and chat state events we were asking about
     // should now be ready
@@ -1108,8 +1176,8 @@ void TextChannel::onMessageReceived(const MessagePartList &parts)
         return;
     }
 
-    mPriv->incompleteMessages << new Private::MessageEvent(
-            ReceivedMessage(parts, TextChannelPtr(this)));
+    mPriv->queueMessageEvent(new Private::MessageEvent(
+            ReceivedMessage(parts, TextChannelPtr(this))));
     mPriv->processMessageQueue();
 }
 
@@ -1119,7 +1187,7 @@ void TextChannel::onPendingMessagesRemoved(const UIntList &ids)
         return;
     }
     foreach (uint id, ids) {
-        mPriv->incompleteMessages << new Private::MessageEvent(id);
+        mPriv->queueMessageEvent(new Private::MessageEvent(id));
     }
     mPriv->processMessageQueue();
 }
@@ -1177,7 +1245,7 @@ void TextChannel::onTextReceived(uint id, uint timestamp, uint sender,
         m.setForceNonText();
     }
 
-    mPriv->incompleteMessages << new Private::MessageEvent(m);
+    mPriv->queueMessageEvent(new Private::MessageEvent(m));
     mPriv->processMessageQueue();
 }
 
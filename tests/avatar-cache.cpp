@@ -0,0 +1,172 @@
+#include <QtTest/QtTest>
+
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/test-backdoors.h>
+
+using namespace Tp;
+
+class TestAvatarCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestAvatarCache(QObject *parent = 0);
+
+protected Q_SLOTS:
+    void onOperationFinished(Tp::PendingOperation *op);
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testStore();
+    void testStoreFailure();
+    void testRemovedFile();
+
+    void cleanupTestCase();
+
+private:
+    void waitForFinished(PendingOperation *op);
+    QString avatarFileName(const QString &name) const;
+    bool removeDirectory(const QString &path);
+
+    QString mDirectory;
+    QEventLoop *mLoop;
+    // the result of the last operation waited for
+    QHash<QString, QString> mFound;
+    QStringList mMissing;
+};
+
+TestAvatarCache::TestAvatarCache(QObject *parent)
+    : QObject(parent),
+      mLoop(new QEventLoop(this))
+{
+    Tp::enableDebug(true);
+    Tp::enableWarnings(true);
+}
+
+void TestAvatarCache::onOperationFinished(PendingOperation *op)
+{
+    mFound = TestBackdoors::avatarsFound(op);
+    mMissing = TestBackdoors::avatarsMissing(op);
+    mLoop->exit(0);
+}
+
+void TestAvatarCache::waitForFinished(PendingOperation *op)
+{
+    QVERIFY(connect(op, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onOperationFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+}
+
+QString TestAvatarCache::avatarFileName(const QString &name) const
+{
+    return QString(QLatin1String("%1/%2")).arg(mDirectory).arg(name);
+}
+
+bool TestAvatarCache::removeDirectory(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QFileInfo &info,
+            dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot)) {
+        if (info.isDir() ? !removeDirectory(info.filePath()) : !QFile::remove(info.filePath())) {
+            return false;
+        }
+    }
+    return QDir().rmdir(path);
+}
+
+void TestAvatarCache::initTestCase()
+{
+    mDirectory = QString(QLatin1String("%1/avatar-cache-test-%2")).arg(QDir::tempPath())
+        .arg(QCoreApplication::applicationPid());
+    QVERIFY(QDir().mkpath(mDirectory));
+}
+
+void TestAvatarCache::testStore()
+{
+    QString fileName = avatarFileName(QLatin1String("stored"));
+    QString mimeType;
+
+    QVERIFY(!TestBackdoors::lookupAvatar(fileName, mimeType));
+
+    PendingOperation *op = TestBackdoors::storeAvatar(fileName, "avatar-data",
+            QLatin1String("image/png"));
+    waitForFinished(op);
+    QCOMPARE(mFound.value(fileName), QLatin1String("image/png"));
+    QVERIFY(mMissing.isEmpty());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QByteArray("avatar-data"));
+    file.close();
+
+    QVERIFY(TestBackdoors::lookupAvatar(fileName, mimeType));
+    QCOMPARE(mimeType, QLatin1String("image/png"));
+
+    // Loading finds it, and tells apart the avatars which were never stored
+    QString otherFileName = avatarFileName(QLatin1String("never-stored"));
+    op = TestBackdoors::loadAvatars(QStringList() << fileName << otherFileName);
+    waitForFinished(op);
+    QCOMPARE(mFound.size(), 1);
+    QCOMPARE(mFound.value(fileName), QLatin1String("image/png"));
+    QCOMPARE(mMissing, QStringList() << otherFileName);
+}
+
+void TestAvatarCache::testStoreFailure()
+{
+    // A regular file is in the way of the directory the avatar should go to
+    QString blocker = avatarFileName(QLatin1String("blocker"));
+    QFile file(blocker);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.close();
+
+    QString fileName = QString(QLatin1String("%1/failed")).arg(blocker);
+    PendingOperation *op = TestBackdoors::storeAvatar(fileName, "avatar-data",
+            QLatin1String("image/png"));
+    waitForFinished(op);
+    QVERIFY(mFound.isEmpty());
+    QCOMPARE(mMissing, QStringList() << fileName);
+
+    // A failed store is not remembered
+    QString mimeType;
+    QVERIFY(!TestBackdoors::lookupAvatar(fileName, mimeType));
+}
+
+void TestAvatarCache::testRemovedFile()
+{
+    QString fileName = avatarFileName(QLatin1String("removed"));
+    QString mimeType;
+
+    PendingOperation *op = TestBackdoors::storeAvatar(fileName, "avatar-data",
+            QLatin1String("image/jpeg"));
+    waitForFinished(op);
+    QVERIFY(TestBackdoors::lookupAvatar(fileName, mimeType));
+
+    // Lookups don't touch the disk, so the hit is still handed out once the file went away...
+    QVERIFY(QFile::remove(fileName));
+    QVERIFY(TestBackdoors::lookupAvatar(fileName, mimeType));
+
+    // ...but it is checked on the worker thread, which is done by the time a load queued after it
+    // finishes, and dropped
+    op = TestBackdoors::loadAvatars(QStringList() << fileName);
+    waitForFinished(op);
+    QCOMPARE(mMissing, QStringList() << fileName);
+    QVERIFY(!TestBackdoors::lookupAvatar(fileName, mimeType));
+
+    // And it can be stored again
+    op = TestBackdoors::storeAvatar(fileName, "avatar-data", QLatin1String("image/jpeg"));
+    waitForFinished(op);
+    QVERIFY(QFile::exists(fileName));
+    QVERIFY(TestBackdoors::lookupAvatar(fileName, mimeType));
+    QCOMPARE(mimeType, QLatin1String("image/jpeg"));
+}
+
+void TestAvatarCache::cleanupTestCase()
+{
+    QVERIFY(removeDirectory(mDirectory));
+}
+
+QTEST_MAIN(TestAvatarCache)
+
+#include "_gen/avatar-cache.cpp.moc.hpp"
@@ -353,7 +353,11 @@ void TestAccountSet::testFilters()
                     SIGNAL(accountAdded(Tp::AccountPtr)),
                     SLOT(onAccountAdded(Tp::AccountPtr))));
 
+        // sets with the same filter share the same evaluation but are still updated separately
+        AccountSetPtr otherEnabledAccounts = mAM->enabledAccounts();
+
         QCOMPARE(enabledAccounts->accounts().size(), 2);
+        QCOMPARE(otherEnabledAccounts->accounts().size(), 2);
         QCOMPARE(disabledAccounts->accounts().size(), 0);
 
         QVERIFY(connect(fooAcc->setEnabled(false),
@@ -373,6 +377,7 @@ void TestAccountSet::testFilters()
 
         QCOMPARE(enabledAccounts->accounts().size(), 1);
         QVERIFY(enabledAccounts->accounts().contains(spuriousAcc));
+        QCOMPARE(otherEnabledAccounts->accounts(), enabledAccounts->accounts());
         QCOMPARE(disabledAccounts->accounts().size(), 1);
         QVERIFY(disabledAccounts->accounts().contains(fooAcc));
     }
@@ -0,0 +1,368 @@
+#include <tests/lib/test.h>
+#include <tests/lib/test-thread-helper.h>
+
+#define TP_QT_ENABLE_LOWLEVEL_API
+
+#include <TelepathyQt/BaseChannel>
+#include <TelepathyQt/BaseConnectionManager>
+#include <TelepathyQt/BaseProtocol>
+#include <TelepathyQt/BaseConnection>
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/ConnectionManager>
+#include <TelepathyQt/ConnectionManagerLowlevel>
+#include <TelepathyQt/DBusError>
+#include <TelepathyQt/PendingReady>
+#include <TelepathyQt/PendingConnection>
+
+using namespace Tp;
+
+class TestBaseConnectionCM;
+typedef SharedPtr<TestBaseConnectionCM> TestBaseConnectionCMPtr;
+
+class TestBaseConnectionCM : public BaseConnectionManager
+{
+public:
+    TestBaseConnectionCM(const QDBusConnection &conn, const QString & name)
+        : BaseConnectionManager(conn, name)
+    { }
+
+    static void createCM(TestBaseConnectionCMPtr &cm);
+
+private:
+    static BaseConnectionPtr createConnectionCb(const QVariantMap &parameters,
+            Tp::DBusError *error);
+    static QString identifyAccountCb(const QVariantMap &parameters, Tp::DBusError *error);
+
+    static void requestHandlesCb(uint handleType, const QStringList &identifiers,
+            const BaseConnection::RequestHandlesContextPtr &context);
+    static void getContactAttributesCb(const Tp::UIntList &handles,
+            const QStringList &interfaces,
+            const BaseConnectionContactsInterface::GetContactAttributesContextPtr &context);
+    static void requestAvatarsCb(const Tp::UIntList &contacts,
+            const BaseConnectionAvatarsInterface::RequestAvatarsContextPtr &context);
+
+    static QStringList mIdentifiers;
+    static QList<QPair<Tp::UIntList,
+            BaseConnectionContactsInterface::GetContactAttributesContextPtr> > mPendingAttributes;
+};
+
+QStringList TestBaseConnectionCM::mIdentifiers;
+QList<QPair<Tp::UIntList,
+        BaseConnectionContactsInterface::GetContactAttributesContextPtr> >
+    TestBaseConnectionCM::mPendingAttributes;
+
+class TestBaseConnection : public Test
+{
+    Q_OBJECT
+public:
+    TestBaseConnection(QObject *parent = 0)
+        : Test(parent), mAttributesFinished(0)
+    { }
+
+protected Q_SLOTS:
+    void onGetContactAttributesFinished(QDBusPendingCallWatcher *watcher);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testAsyncCallbacks();
+    void testChannelIndex();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    TestThreadHelper<TestBaseConnectionCMPtr> *mThreadHelper;
+    QList<ContactAttributesMap> mAttributes;
+    int mAttributesFinished;
+};
+
+void TestBaseConnectionCM::createCM(TestBaseConnectionCMPtr &cm)
+{
+    cm = BaseConnectionManager::create<TestBaseConnectionCM>(QLatin1String("testcm"));
+
+    BaseProtocolPtr protocol = BaseProtocol::create(QLatin1String("example"));
+    protocol->setParameters(ProtocolParameterList() <<
+            ProtocolParameter(QLatin1String("account"), QDBusSignature("s"),
+                    Tp::ConnMgrParamFlagRequired | Tp::ConnMgrParamFlagRegister));
+    protocol->setCreateConnectionCallback(ptrFun(&TestBaseConnectionCM::createConnectionCb));
+    protocol->setIdentifyAccountCallback(ptrFun(&TestBaseConnectionCM::identifyAccountCb));
+    QVERIFY(cm->addProtocol(protocol));
+
+    Tp::DBusError err;
+    QVERIFY(cm->registerObject(&err));
+    QVERIFY(!err.isValid());
+    QVERIFY(cm->isRegistered());
+}
+
+BaseConnectionPtr TestBaseConnectionCM::createConnectionCb(const QVariantMap &parameters,
+        Tp::DBusError *error)
+{
+    Q_UNUSED(error);
+
+    BaseConnectionPtr connection = BaseConnection::create(QLatin1String("testcm"),
+            QLatin1String("example"), parameters);
+    connection->setRequestHandlesAsyncCallback(
+            ptrFun(&TestBaseConnectionCM::requestHandlesCb));
+
+    BaseConnectionContactsInterfacePtr contactsIface = BaseConnectionContactsInterface::create();
+    contactsIface->setContactAttributeInterfaces(QStringList() << TP_QT_IFACE_CONNECTION);
+    contactsIface->setGetContactAttributesAsyncCallback(
+            ptrFun(&TestBaseConnectionCM::getContactAttributesCb));
+    connection->plugInterface(AbstractConnectionInterfacePtr::dynamicCast(contactsIface));
+
+    BaseConnectionAvatarsInterfacePtr avatarsIface = BaseConnectionAvatarsInterface::create();
+    avatarsIface->setRequestAvatarsAsyncCallback(
+            ptrFun(&TestBaseConnectionCM::requestAvatarsCb));
+    connection->plugInterface(AbstractConnectionInterfacePtr::dynamicCast(avatarsIface));
+
+    return connection;
+}
+
+QString TestBaseConnectionCM::identifyAccountCb(const QVariantMap &parameters,
+        Tp::DBusError *error)
+{
+    Q_UNUSED(error);
+    return parameters.value(QLatin1String("account")).toString();
+}
+
+void TestBaseConnectionCM::requestHandlesCb(uint handleType, const QStringList &identifiers,
+        const BaseConnection::RequestHandlesContextPtr &context)
+{
+    if (handleType != HandleTypeContact) {
+        context->setFinishedWithError(TP_QT_ERROR_NOT_IMPLEMENTED,
+                QLatin1String("Only contact handles are supported"));
+        return;
+    }
+
+    Tp::UIntList handles;
+    foreach (const QString &identifier, identifiers) {
+        if (!mIdentifiers.contains(identifier)) {
+            mIdentifiers.append(identifier);
+        }
+        handles.append(mIdentifiers.indexOf(identifier) + 1);
+    }
+    context->setFinished(handles);
+}
+
+void TestBaseConnectionCM::getContactAttributesCb(const Tp::UIntList &handles,
+        const QStringList &interfaces,
+        const BaseConnectionContactsInterface::GetContactAttributesContextPtr &context)
+{
+    Q_UNUSED(interfaces);
+
+    // Hold the replies until a second request comes in, which can only happen if the first
+    // one did not block the service, then answer them in reverse order
+    mPendingAttributes.append(qMakePair(handles, context));
+    if (mPendingAttributes.size() < 2) {
+        return;
+    }
+
+    while (!mPendingAttributes.isEmpty()) {
+        QPair<Tp::UIntList,
+              BaseConnectionContactsInterface::GetContactAttributesContextPtr> pending =
+            mPendingAttributes.takeLast();
+
+        ContactAttributesMap attributes;
+        foreach (uint handle, pending.first) {
+            QVariantMap contactAttributes;
+            contactAttributes.insert(TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id"),
+                    mIdentifiers.value(handle - 1));
+            attributes.insert(handle, contactAttributes);
+        }
+        pending.second->setFinished(attributes);
+    }
+}
+
+void TestBaseConnectionCM::requestAvatarsCb(const Tp::UIntList &contacts,
+        const BaseConnectionAvatarsInterface::RequestAvatarsContextPtr &context)
+{
+    if (contacts.isEmpty()) {
+        context->setFinishedWithError(TP_QT_ERROR_INVALID_ARGUMENT,
+                QLatin1String("No contacts given"));
+        return;
+    }
+
+    context->setFinished();
+}
+
+void TestBaseConnection::onGetContactAttributesFinished(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<ContactAttributesMap> reply = *watcher;
+    if (reply.isError()) {
+        qWarning().nospace() << reply.error().name()
+            << ": " << reply.error().message();
+        mLoop->exit(1);
+        return;
+    }
+
+    mAttributes.append(reply.value());
+    if (++mAttributesFinished == 2) {
+        mLoop->exit(0);
+    }
+    watcher->deleteLater();
+}
+
+void TestBaseConnection::initTestCase()
+{
+    initTestCaseImpl();
+}
+
+void TestBaseConnection::init()
+{
+    initImpl();
+    mThreadHelper = new TestThreadHelper<TestBaseConnectionCMPtr>();
+    TEST_THREAD_HELPER_EXECUTE(mThreadHelper, &TestBaseConnectionCM::createCM);
+
+    mAttributes.clear();
+    mAttributesFinished = 0;
+}
+
+void TestBaseConnection::testAsyncCallbacks()
+{
+    ConnectionManagerPtr cliCM = ConnectionManager::create(QLatin1String("testcm"));
+    PendingReady *pr = cliCM->becomeReady(ConnectionManager::FeatureCore);
+    connect(pr, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QVariantMap parameters;
+    parameters.insert(QLatin1String("account"), QLatin1String("me@example.com"));
+    PendingConnection *pc = cliCM->lowlevel()->requestConnection(QLatin1String("example"),
+            parameters);
+    connect(pc, SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(expectSuccessfulCall(Tp::PendingOperation*)));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(pc->connection());
+
+    QString busName = pc->connection()->busName();
+    QString objectPath = pc->connection()->objectPath();
+
+    Client::ConnectionInterface connIface(busName, objectPath);
+    QDBusPendingReply<Tp::UIntList> handlesReply = connIface.RequestHandles(HandleTypeContact,
+            QStringList() << QLatin1String("alice") << QLatin1String("bob"));
+    connect(new QDBusPendingCallWatcher(handlesReply),
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(expectSuccessfulCall(QDBusPendingCallWatcher*)));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(handlesReply.value(), Tp::UIntList() << 1 << 2);
+
+    handlesReply = connIface.RequestHandles(HandleTypeRoom,
+            QStringList() << QLatin1String("room"));
+    handlesReply.waitForFinished();
+    QVERIFY(handlesReply.isError());
+    QCOMPARE(handlesReply.error().name(), TP_QT_ERROR_NOT_IMPLEMENTED);
+
+    // Both requests are in flight at once, the service only answers after seeing the second
+    Client::ConnectionInterfaceContactsInterface contactsIface(busName, objectPath);
+    connect(new QDBusPendingCallWatcher(
+                contactsIface.GetContactAttributes(Tp::UIntList() << 1, QStringList(), false)),
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onGetContactAttributesFinished(QDBusPendingCallWatcher*)));
+    connect(new QDBusPendingCallWatcher(
+                contactsIface.GetContactAttributes(Tp::UIntList() << 2, QStringList(), false)),
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onGetContactAttributesFinished(QDBusPendingCallWatcher*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mAttributes.size(), 2);
+    QString contactIdAttribute = TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id");
+    QCOMPARE(mAttributes[0].value(2).value(contactIdAttribute).toString(),
+            QLatin1String("bob"));
+    QCOMPARE(mAttributes[1].value(1).value(contactIdAttribute).toString(),
+            QLatin1String("alice"));
+
+    Client::ConnectionInterfaceAvatarsInterface avatarsIface(busName, objectPath);
+    connect(new QDBusPendingCallWatcher(avatarsIface.RequestAvatars(Tp::UIntList() << 1 << 2)),
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(expectSuccessfulCall(QDBusPendingCallWatcher*)));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QDBusPendingReply<> avatarsReply = avatarsIface.RequestAvatars(Tp::UIntList());
+    avatarsReply.waitForFinished();
+    QVERIFY(avatarsReply.isError());
+    QCOMPARE(avatarsReply.error().name(), TP_QT_ERROR_INVALID_ARGUMENT);
+}
+
+void TestBaseConnection::testChannelIndex()
+{
+    BaseConnectionPtr connection = BaseConnection::create(QLatin1String("testcm"),
+            QLatin1String("example"), QVariantMap());
+    Tp::DBusError error;
+    QVERIFY(connection->registerObject(&error));
+    QVERIFY(!error.isValid());
+
+    BaseChannelPtr alice = BaseChannel::create(connection.data(), TP_QT_IFACE_CHANNEL_TYPE_TEXT,
+            1, HandleTypeContact);
+    BaseChannelPtr bob = BaseChannel::create(connection.data(), TP_QT_IFACE_CHANNEL_TYPE_TEXT,
+            2, HandleTypeContact);
+    connection->addChannel(alice);
+    connection->addChannel(bob);
+
+    bool yours = true;
+    QCOMPARE(connection->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT, HandleTypeContact, 2,
+                yours, 0, false, QVariantMap(), &error), bob);
+    QVERIFY(!yours);
+    QCOMPARE(connection->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT, HandleTypeContact, 1,
+                yours, 0, false, QVariantMap(), &error), alice);
+    QVERIFY(!yours);
+    QVERIFY(!error.isValid());
+
+    // There is no create channel callback, so anything not in the index can't be ensured
+    QVERIFY(!connection->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT, HandleTypeRoom, 1,
+                yours, 0, false, QVariantMap(), &error));
+    QVERIFY(yours);
+    QCOMPARE(error.name(), TP_QT_ERROR_NOT_IMPLEMENTED);
+
+    // Interfaces plugged in after the channel was added, but before it was registered, are in
+    // its details
+    QVERIFY(alice->plugInterface(AbstractChannelInterfacePtr::dynamicCast(
+                    BaseChannelSecurableInterface::create())));
+    Tp::DBusError channelError;
+    QVERIFY(alice->registerObject(&channelError));
+    QVERIFY(!channelError.isValid());
+
+    Tp::ChannelDetailsList details = connection->channelsDetails();
+    QCOMPARE(details.size(), 2);
+    bool found = false;
+    foreach (const Tp::ChannelDetails &channelDetails, details) {
+        if (channelDetails.channel.path() != alice->objectPath()) {
+            continue;
+        }
+        found = true;
+        QStringList interfaces = channelDetails.properties.value(
+                TP_QT_IFACE_CHANNEL + QLatin1String(".Interfaces")).toStringList();
+        QCOMPARE(interfaces, QStringList() << TP_QT_IFACE_CHANNEL_INTERFACE_SECURABLE);
+    }
+    QVERIFY(found);
+
+    // Closed channels leave the index
+    alice->close();
+    details = connection->channelsDetails();
+    QCOMPARE(details.size(), 1);
+    QCOMPARE(details.first().channel.path(), bob->objectPath());
+
+    Tp::DBusError ensureError;
+    QVERIFY(!connection->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT, HandleTypeContact, 1,
+                yours, 0, false, QVariantMap(), &ensureError));
+    QVERIFY(yours);
+    QCOMPARE(ensureError.name(), TP_QT_ERROR_NOT_IMPLEMENTED);
+    QCOMPARE(connection->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT, HandleTypeContact, 2,
+                yours, 0, false, QVariantMap(), &ensureError), bob);
+    QVERIFY(!yours);
+}
+
+void TestBaseConnection::cleanup()
+{
+    delete mThreadHelper;
+    cleanupImpl();
+}
+
+void TestBaseConnection::cleanupTestCase()
+{
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestBaseConnection)
+#include "_gen/base-connection.cpp.moc.hpp"
@@ -38,6 +38,12 @@ protected Q_SLOTS:
             const Tp::Contacts &groupRemotePendingMembersAdded,
             const Tp::Contacts &groupMembersRemoved,
             const Tp::Channel::GroupMemberChangeDetails &details);
+    void onGroupMembersChangedRecord(
+            const Tp::Contacts &groupMembersAdded,
+            const Tp::Contacts &groupLocalPendingMembersAdded,
+            const Tp::Contacts &groupRemotePendingMembersAdded,
+            const Tp::Contacts &groupMembersRemoved,
+            const Tp::Channel::GroupMemberChangeDetails &details);
     void onGroupFlagsChanged(Tp::ChannelGroupFlags flags,
             Tp::ChannelGroupFlags added, Tp::ChannelGroupFlags removed);
 
@@ -51,6 +57,7 @@ private Q_SLOTS:
     void testLeave();
     void testLeaveWithFallback();
     void testGroupFlagsChange();
+    void testMembersChangedBurst();
 
     void cleanup();
     void cleanupTestCase();
@@ -70,6 +77,11 @@ private:
     Contacts mChangedRP;
     Contacts mChangedRemoved;
     Channel::GroupMemberChangeDetails mDetails;
+    // every groupMembersChanged() seen by onGroupMembersChangedRecord, in emission order
+    QList<Contacts> mRecordedCurrent;
+    QList<Contacts> mRecordedLP;
+    QList<Contacts> mRecordedRemoved;
+    QList<Channel::GroupMemberChangeDetails> mRecordedDetails;
     UIntList mInitialMembers;
     bool mGotGroupFlagsChanged;
     ChannelGroupFlags mGroupFlags;
@@ -94,6 +106,23 @@ void TestChanGroup::onGroupMembersChanged(
     mLoop->exit(0);
 }
 
+void TestChanGroup::onGroupMembersChangedRecord(
+        const Contacts &groupMembersAdded,
+        const Contacts &groupLocalPendingMembersAdded,
+        const Contacts &groupRemotePendingMembersAdded,
+        const Contacts &groupMembersRemoved,
+        const Channel::GroupMemberChangeDetails &details)
+{
+    Q_UNUSED(groupRemotePendingMembersAdded);
+
+    qDebug() << "group members changed:" << details.message();
+    mRecordedCurrent.append(groupMembersAdded);
+    mRecordedLP.append(groupLocalPendingMembersAdded);
+    mRecordedRemoved.append(groupMembersRemoved);
+    mRecordedDetails.append(details);
+    mLoop->exit(0);
+}
+
 void TestChanGroup::onGroupFlagsChanged(Tp::ChannelGroupFlags flags,
         Tp::ChannelGroupFlags added, Tp::ChannelGroupFlags removed)
 {
@@ -157,6 +186,10 @@ void TestChanGroup::init()
     mChangedRP.clear();
     mChangedRemoved.clear();
     mDetails = Channel::GroupMemberChangeDetails();
+    mRecordedCurrent.clear();
+    mRecordedLP.clear();
+    mRecordedRemoved.clear();
+    mRecordedDetails.clear();
     mGotGroupFlagsChanged = false;
     mGroupFlags = (ChannelGroupFlags) 0;
     mGroupFlagsAdded = (ChannelGroupFlags) 0;
@@ -484,6 +517,130 @@ void TestChanGroup::testGroupFlagsChange()
     QCOMPARE(mGroupFlagsRemoved, (ChannelGroupFlags) 0);
 }
 
+static QStringList contactIds(const Contacts &contacts)
+{
+    QStringList ids;
+    Q_FOREACH (const ContactPtr &contact, contacts) {
+        ids.append(contact->id());
+    }
+    ids.sort();
+    return ids;
+}
+
+void TestChanGroup::testMembersChangedBurst()
+{
+    mChanObjectPath = QString(QLatin1String("%1/ChannelForTpQtBurstTest"))
+        .arg(mConn->objectPath());
+    QByteArray chanPathLatin1(mChanObjectPath.toLatin1());
+
+    mChanService = TP_TESTS_TEXT_CHANNEL_GROUP(g_object_new(
+                TP_TESTS_TYPE_TEXT_CHANNEL_GROUP,
+                "connection", mConn->service(),
+                "object-path", chanPathLatin1.data(),
+                "detailed", TRUE,
+                "properties", TRUE,
+                NULL));
+    QVERIFY(mChanService != 0);
+
+    TpIntSet *members = tp_intset_new_containing(mConn->client()->selfHandle());
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "be there or be []",
+                members, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(members);
+
+    mChan = Channel::create(mConn->client(), mChanObjectPath, QVariantMap());
+    QVERIFY(mChan);
+
+    QVERIFY(connect(mChan->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->isReady(), true);
+    QCOMPARE(mChan->groupContacts().count(), 1);
+
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(groupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &)),
+                    SLOT(onGroupMembersChangedRecord(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &))));
+
+    // None of these contacts have been built yet, so all of the changes below queue up on the
+    // client side while their contacts are being built
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()),
+            TP_HANDLE_TYPE_CONTACT);
+    guint alice = tp_handle_ensure(contactRepo, "alice@example.com", 0, 0);
+    guint bob = tp_handle_ensure(contactRepo, "bob@example.com", 0, 0);
+    guint carol = tp_handle_ensure(contactRepo, "carol@example.com", 0, 0);
+    guint self = mConn->client()->selfHandle();
+
+    // Emit the whole burst without going back to the main loop in between
+    TpIntSet *set = tp_intset_new();
+    tp_intset_add(set, alice);
+    tp_intset_add(set, bob);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "first",
+                set, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(set);
+
+    set = tp_intset_new_containing(carol);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "second",
+                NULL, NULL, set, NULL, alice, TP_CHANNEL_GROUP_CHANGE_REASON_INVITED));
+    tp_intset_destroy(set);
+
+    set = tp_intset_new_containing(alice);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "third",
+                NULL, set, NULL, NULL, self, TP_CHANNEL_GROUP_CHANGE_REASON_KICKED));
+    tp_intset_destroy(set);
+
+    while (mRecordedDetails.size() < 3) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    processDBusQueue(mConn->client().data());
+    QCOMPARE(mRecordedDetails.size(), 3);
+
+    // Each change is signalled on its own, in the order the CM made them, with its own details
+    QCOMPARE(contactIds(mRecordedCurrent[0]),
+            QStringList() << QLatin1String("alice@example.com") <<
+                QLatin1String("bob@example.com"));
+    QVERIFY(mRecordedLP[0].isEmpty());
+    QVERIFY(mRecordedRemoved[0].isEmpty());
+    QCOMPARE(mRecordedDetails[0].message(), QLatin1String("first"));
+    QCOMPARE(mRecordedDetails[0].reason(), ChannelGroupChangeReasonNone);
+    QVERIFY(!mRecordedDetails[0].hasActor());
+
+    QVERIFY(mRecordedCurrent[1].isEmpty());
+    QCOMPARE(contactIds(mRecordedLP[1]), QStringList() << QLatin1String("carol@example.com"));
+    QVERIFY(mRecordedRemoved[1].isEmpty());
+    QCOMPARE(mRecordedDetails[1].message(), QLatin1String("second"));
+    QCOMPARE(mRecordedDetails[1].reason(), ChannelGroupChangeReasonInvited);
+    QVERIFY(mRecordedDetails[1].hasActor());
+    QCOMPARE(mRecordedDetails[1].actor()->id(), QLatin1String("alice@example.com"));
+
+    QVERIFY(mRecordedCurrent[2].isEmpty());
+    QVERIFY(mRecordedLP[2].isEmpty());
+    QCOMPARE(contactIds(mRecordedRemoved[2]), QStringList() << QLatin1String("alice@example.com"));
+    QCOMPARE(mRecordedDetails[2].message(), QLatin1String("third"));
+    QCOMPARE(mRecordedDetails[2].reason(), ChannelGroupChangeReasonKicked);
+    QVERIFY(mRecordedDetails[2].hasActor());
+    QVERIFY(mRecordedDetails[2].actor() == mConn->client()->selfContact());
+
+    // The end result is the same as applying the changes one by one
+    QStringList expectedIds;
+    expectedIds << QLatin1String("bob@example.com") << mConn->client()->selfContact()->id();
+    expectedIds.sort();
+    QCOMPARE(contactIds(mChan->groupContacts()), expectedIds);
+    QCOMPARE(contactIds(mChan->groupLocalPendingContacts()),
+            QStringList() << QLatin1String("carol@example.com"));
+    QVERIFY(mChan->groupRemotePendingContacts().isEmpty());
+}
+
 void TestChanGroup::cleanup()
 {
     if (mChanService) {
@@ -383,6 +383,7 @@ private Q_SLOTS:
     void testRequests();
     void testHandleChannels();
     void testChannelFactoryAccessors();
+    void testChannelFactoryLookupBenchmark();
 
     void cleanup();
     void cleanupTestCase();
@@ -1168,6 +1169,51 @@ void TestClientFactories::testChannelFactoryAccessors()
     QCOMPARE(chanFact->featuresFor(ChannelClassSpec::unnamedStreamedMediaVideoCallWithAudio()), unnamedStreamedMediaAudioFeatures);
 }
 
+void TestClientFactories::testChannelFactoryLookupBenchmark()
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    ChannelFactoryPtr chanFact = ChannelFactory::create(bus);
+    chanFact->addCommonFeatures(Channel::FeatureCore);
+    chanFact->addFeaturesForTextChats(TextChannel::FeatureMessageQueue);
+    chanFact->addFeaturesForTextChatrooms(TextChannel::FeatureMessageCapabilities);
+    chanFact->addFeaturesForStreamedMediaCalls(StreamedMediaChannel::FeatureStreams);
+    chanFact->addFeaturesForOutgoingFileTransfers(FileTransferChannel::FeatureCore);
+    chanFact->addFeaturesForIncomingFileTransfers(FileTransferChannel::FeatureCore);
+    chanFact->addFeaturesForOutgoingStreamTubes(StreamTubeChannel::FeatureCore);
+    chanFact->addFeaturesForIncomingStreamTubes(StreamTubeChannel::FeatureCore);
+    chanFact->addFeaturesForContactSearches(ContactSearchChannel::FeatureCore);
+
+    // What a channel observed on the bus looks like, with some unrelated properties
+    QVariantMap immutableProperties;
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType"),
+            TP_QT_IFACE_CHANNEL_TYPE_TEXT);
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType"),
+            (uint) HandleTypeRoom);
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"),
+            QLatin1String("room@conference.example.com"));
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle"), 42U);
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".Requested"), false);
+    immutableProperties.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorID"),
+            QLatin1String("alice@example.com"));
+    ChannelClassSpec channelClass(immutableProperties);
+
+    Features expected = Features() << Channel::FeatureCore
+        << TextChannel::FeatureMessageCapabilities;
+    QCOMPARE(chanFact->featuresFor(channelClass), expected);
+    QCOMPARE(chanFact->constructorFor(channelClass), chanFact->constructorForTextChatrooms());
+
+    // Adding a class afterwards is taken into account
+    chanFact->addFeaturesFor(ChannelClassSpec::textChatroom(), TextChannel::FeatureMessageQueue);
+    expected << TextChannel::FeatureMessageQueue;
+    QCOMPARE(chanFact->featuresFor(channelClass), expected);
+
+    QBENCHMARK {
+        chanFact->featuresFor(channelClass);
+        chanFact->constructorFor(channelClass);
+    }
+}
+
 void TestClientFactories::cleanup()
 {
     cleanupImpl();
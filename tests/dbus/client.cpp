@@ -266,6 +266,11 @@ public:
         return mBypassApproval;
     }
 
+    void setReplyEarly(bool replyEarly)
+    {
+        setShouldReplyEarly(replyEarly);
+    }
+
     void handleChannels(const MethodInvocationContextPtr<> &context,
             const AccountPtr &account,
             const ConnectionPtr &connection,
@@ -349,7 +354,7 @@ public:
         : Test(parent),
           mConn(0), mContactRepo(0),
           mText1ChanService(0), mText2ChanService(0), mCDO(0),
-          mClaimFinished(false)
+          mClaimFinished(false), mObserveChannelsError(false), mObserveChannelsFinished(0)
     { }
 
     void testObserveChannelsCommon(const AbstractClientPtr &clientObject,
@@ -358,6 +363,8 @@ public:
 protected Q_SLOTS:
     void expectSignalEmission();
     void onClaimFinished();
+    void onObserveChannelsReply(QDBusPendingCallWatcher *watcher);
+    void onObserveChannelsFinished();
 
 private Q_SLOTS:
     void initTestCase();
@@ -366,6 +373,8 @@ private Q_SLOTS:
     void testRegister();
     void testCapabilities();
     void testObserveChannels();
+    void testObserveChannelsReplyEarly();
+    void testObserveChannelsShared();
     void testAddDispatchOperation();
     void testRequests();
     void testHandleChannels();
@@ -400,6 +409,8 @@ private:
     uint mUserActionTime;
 
     bool mClaimFinished;
+    bool mObserveChannelsError;
+    int mObserveChannelsFinished;
 };
 
 void TestClient::expectSignalEmission()
@@ -412,6 +423,20 @@ void TestClient::onClaimFinished()
     mClaimFinished = true;
 }
 
+void TestClient::onObserveChannelsReply(QDBusPendingCallWatcher *watcher)
+{
+    mObserveChannelsError = watcher->isError();
+    watcher->deleteLater();
+    mLoop->exit(0);
+}
+
+void TestClient::onObserveChannelsFinished()
+{
+    if (++mObserveChannelsFinished == 2) {
+        mLoop->exit(0);
+    }
+}
+
 void TestClient::initTestCase()
 {
     initTestCaseImpl();
@@ -705,6 +730,98 @@ void TestClient::testObserveChannels()
             mClientObject2BusName, mClientObject2Path);
 }
 
+void TestClient::testObserveChannelsReplyEarly()
+{
+    QDBusConnection bus = mClientRegistrar->dbusConnection();
+
+    ClientObserverInterface *observeIface = new ClientObserverInterface(bus,
+            mClientObject1BusName, mClientObject1Path, this);
+    MyClient *client = dynamic_cast<MyClient*>(mClientObject1.data());
+
+    // The channel doesn't exist, so its proxy can't be made ready
+    ChannelDetailsList channelDetailsList;
+    ChannelDetails channelDetails = {
+        QDBusObjectPath(mConn->objectPath() + QLatin1String("/NoSuchChannel")), QVariantMap() };
+    channelDetailsList.append(channelDetails);
+
+    for (int i = 0; i < 2; ++i) {
+        bool replyEarly = (i == 1);
+        client->setReplyEarly(replyEarly);
+        QCOMPARE(client->shouldReplyEarly(), replyEarly);
+
+        connect(new QDBusPendingCallWatcher(observeIface->ObserveChannels(
+                        QDBusObjectPath(mAccount->objectPath()),
+                        QDBusObjectPath(mConn->objectPath()),
+                        channelDetailsList,
+                        QDBusObjectPath("/"),
+                        ObjectPathList(),
+                        QVariantMap()), this),
+                SIGNAL(finished(QDBusPendingCallWatcher*)),
+                SLOT(onObserveChannelsReply(QDBusPendingCallWatcher*)));
+        QCOMPARE(mLoop->exec(), 0);
+
+        // Replying early doesn't wait for the proxies, so the error is not reported back
+        QCOMPARE(mObserveChannelsError, !replyEarly);
+    }
+
+    client->setReplyEarly(false);
+}
+
+void TestClient::testObserveChannelsShared()
+{
+    QDBusConnection bus = mClientRegistrar->dbusConnection();
+
+    // The second text channel hasn't been made ready yet, so it is still being introspected for
+    // the first observer when the second one asks for it
+    ChannelDetailsList channelDetailsList;
+    ChannelDetails channelDetails = { QDBusObjectPath(mText2ChanPath), QVariantMap() };
+    channelDetailsList.append(channelDetails);
+
+    quint64 dispatches = mClientRegistrar->dispatches();
+    quint64 requests = mClientRegistrar->proxyRequests();
+    quint64 sharedRequests = mClientRegistrar->sharedProxyRequests();
+
+    mObserveChannelsFinished = 0;
+    QList<MyClient *> clients;
+    clients << dynamic_cast<MyClient*>(mClientObject1.data());
+    clients << dynamic_cast<MyClient*>(mClientObject2.data());
+    QStringList busNames = QStringList() << mClientObject1BusName << mClientObject2BusName;
+    QStringList objectPaths = QStringList() << mClientObject1Path << mClientObject2Path;
+    for (int i = 0; i < clients.size(); ++i) {
+        QVERIFY(connect(clients[i],
+                        SIGNAL(observeChannelsFinished()),
+                        SLOT(onObserveChannelsFinished())));
+
+        ClientObserverInterface *observeIface = new ClientObserverInterface(bus,
+                busNames[i], objectPaths[i], this);
+        observeIface->ObserveChannels(QDBusObjectPath(mAccount->objectPath()),
+                QDBusObjectPath(mConn->objectPath()),
+                channelDetailsList,
+                QDBusObjectPath("/"),
+                ObjectPathList(),
+                QVariantMap());
+    }
+    QCOMPARE(mLoop->exec(), 0);
+
+    for (int i = 0; i < clients.size(); ++i) {
+        QVERIFY(disconnect(clients[i],
+                           SIGNAL(observeChannelsFinished()),
+                           this,
+                           SLOT(onObserveChannelsFinished())));
+        QCOMPARE(clients[i]->mObserveChannelsChannels.size(), 1);
+        QCOMPARE(clients[i]->mObserveChannelsChannels.first()->objectPath(), mText2ChanPath);
+    }
+    QCOMPARE(clients[0]->mObserveChannelsChannels.first(),
+             clients[1]->mObserveChannelsChannels.first());
+
+    // Each dispatch asks for the account, the connection and the channel, and the second one at
+    // least gets the channel being prepared for the first
+    QCOMPARE(mClientRegistrar->dispatches(), dispatches + 2);
+    QCOMPARE(mClientRegistrar->proxyRequests(), requests + 6);
+    QVERIFY(mClientRegistrar->sharedProxyRequests() > sharedRequests);
+    QVERIFY(mClientRegistrar->sharedProxyRequests() <= sharedRequests + 3);
+}
+
 void TestClient::testAddDispatchOperation()
 {
     QDBusConnection bus = mClientRegistrar->dbusConnection();
@@ -10,6 +10,11 @@
 #include <TelepathyQt/PendingStringList>
 #include <TelepathyQt/PresenceSpec>
 
+#include <TelepathyQt/test-backdoors.h>
+
+#include <QDir>
+#include <QFile>
+
 #include <telepathy-glib/debug.h>
 
 using namespace Tp;
@@ -48,6 +53,7 @@ private Q_SLOTS:
 
     void testBasics();
     void testLegacy();
+    void testCache();
     void testListNames();
 
     void cleanup();
@@ -309,6 +315,89 @@ void TestCmBasics::testLegacy()
     QCOMPARE(mCMLegacy->supportedProtocols(), QStringList() << QLatin1String("simple"));
 }
 
+void TestCmBasics::testCache()
+{
+    // The cache itself goes to the XDG_CACHE_HOME set up by the test environment
+    QByteArray oldDataHome = qgetenv("XDG_DATA_HOME");
+
+    QString tmpDir = QString(QLatin1String("%1/cm-basics-%2"))
+        .arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QString servicesDir = tmpDir + QLatin1String("/dbus-1/services");
+    QVERIFY(QDir().mkpath(servicesDir));
+    qputenv("XDG_DATA_HOME", QFile::encodeName(tmpDir));
+
+    // The cache is keyed by the executable the service file points to
+    QFile serviceFile(servicesDir +
+            QLatin1String("/org.freedesktop.Telepathy.ConnectionManager.example_echo_2.service"));
+    QVERIFY(serviceFile.open(QIODevice::WriteOnly));
+    serviceFile.write("[D-BUS Service]\n"
+            "Name=org.freedesktop.Telepathy.ConnectionManager.example_echo_2\n"
+            "Exec=");
+    serviceFile.write(QFile::encodeName(QCoreApplication::applicationFilePath()));
+    serviceFile.write("\n");
+    serviceFile.close();
+
+    QString cacheFileName = TestBackdoors::protocolInfoCacheFileName(
+            QLatin1String("example_echo_2"));
+    QVERIFY(!TestBackdoors::protocolInfoSourceKey(QLatin1String("example_echo_2")).isEmpty());
+
+    // Cold start: introspected over D-Bus, then written to the cache
+    quint64 misses = TestBackdoors::protocolInfoCacheMisses();
+    mCM = ConnectionManager::create(QLatin1String("example_echo_2"));
+    QVERIFY(connect(mCM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(TestBackdoors::protocolInfoCacheMisses(), misses + 1);
+    QVERIFY(QFile::exists(cacheFileName));
+
+    // Warm start: read back from the cache
+    quint64 hits = TestBackdoors::protocolInfoCacheHits();
+    ConnectionManagerPtr cachedCM = ConnectionManager::create(QLatin1String("example_echo_2"));
+    QVERIFY(connect(cachedCM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(TestBackdoors::protocolInfoCacheHits(), hits + 1);
+
+    QCOMPARE(cachedCM->interfaces(), mCM->interfaces());
+    QCOMPARE(cachedCM->supportedProtocols(), mCM->supportedProtocols());
+
+    ProtocolInfo info = mCM->protocol(QLatin1String("example"));
+    ProtocolInfo cachedInfo = cachedCM->protocol(QLatin1String("example"));
+    QVERIFY(cachedInfo.isValid());
+    QCOMPARE(cachedInfo.cmName(), info.cmName());
+    QCOMPARE(cachedInfo.parameters().size(), info.parameters().size());
+    ProtocolParameter param = cachedInfo.parameters().at(0);
+    QCOMPARE(param.name(), QLatin1String("account"));
+    QCOMPARE(param.dbusSignature().signature(), QLatin1String("s"));
+    QCOMPARE(param.isRequired(), true);
+    QCOMPARE(param.defaultValue().isNull(), true);
+    QCOMPARE(cachedInfo.capabilities().textChats(), info.capabilities().textChats());
+    QCOMPARE(cachedInfo.capabilities().textChatrooms(), info.capabilities().textChatrooms());
+    QCOMPARE(cachedInfo.vcardField(), info.vcardField());
+    QCOMPARE(cachedInfo.englishName(), info.englishName());
+    QCOMPARE(cachedInfo.iconName(), info.iconName());
+    QCOMPARE(cachedInfo.allowedPresenceStatuses().size(), info.allowedPresenceStatuses().size());
+    PresenceSpec spec = getPresenceSpec(cachedInfo.allowedPresenceStatuses(),
+            QLatin1String("available"));
+    QVERIFY(spec.presence().type() == ConnectionPresenceTypeAvailable);
+    QCOMPARE(spec.canHaveStatusMessage(), true);
+    QCOMPARE(cachedInfo.avatarRequirements().supportedMimeTypes(),
+             info.avatarRequirements().supportedMimeTypes());
+    QCOMPARE(cachedInfo.avatarRequirements().maximumBytes(), (uint) 37748736);
+    QCOMPARE(cachedInfo.addressableVCardFields(), info.addressableVCardFields());
+    QCOMPARE(cachedInfo.addressableUriSchemes(), info.addressableUriSchemes());
+
+    QVERIFY(QFile::remove(cacheFileName));
+    QVERIFY(serviceFile.remove());
+    QVERIFY(QDir().rmdir(servicesDir));
+    QVERIFY(QDir().rmdir(tmpDir + QLatin1String("/dbus-1")));
+    QVERIFY(QDir().rmdir(tmpDir));
+
+    qputenv("XDG_DATA_HOME", oldDataHome);
+}
+
 // TODO add a test for the case of getting the information from a .manager file, and if possible,
 // also for using the fallbacks for the CM::Protocols property not being present.
 
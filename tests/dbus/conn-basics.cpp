@@ -13,6 +13,7 @@
 #include <TelepathyQt/ContactFactory>
 #include <TelepathyQt/PendingChannel>
 #include <TelepathyQt/PendingReady>
+#include <TelepathyQt/PendingVoid>
 #include <TelepathyQt/Debug>
 
 #include <telepathy-glib/dbus.h>
@@ -37,6 +38,7 @@ protected Q_SLOTS:
     void expectConnInvalidated();
     void expectPresenceAvailable(const Tp::SimplePresence &);
     void onRequestConnectFinished(Tp::PendingOperation *);
+    void onPendingVoidFinished(Tp::PendingOperation *);
 
 private Q_SLOTS:
     void initTestCase();
@@ -44,6 +46,9 @@ private Q_SLOTS:
 
     void testBasics();
     void testSimplePresence();
+    void testIsReadyBenchmark();
+    void testIntrospectionBenchmark();
+    void testPendingVoidBenchmark();
 
     void cleanup();
     void cleanupTestCase();
@@ -53,6 +58,7 @@ private:
     TpTestsContactsConnection *mConnService;
     ConnectionPtr mConn;
     QList<ConnectionStatus> mStatuses;
+    int mPendingVoidsFinished;
 };
 
 void TestConnBasics::expectConnReady(Tp::ConnectionStatus newStatus)
@@ -102,6 +108,19 @@ void TestConnBasics::onRequestConnectFinished(Tp::PendingOperation *op)
     mLoop->exit(0);
 }
 
+void TestConnBasics::onPendingVoidFinished(Tp::PendingOperation *op)
+{
+    if (op->isError()) {
+        qWarning().nospace() << op->errorName() << ": " << op->errorMessage();
+        mLoop->exit(1);
+        return;
+    }
+
+    if (--mPendingVoidsFinished == 0) {
+        mLoop->exit(0);
+    }
+}
+
 void TestConnBasics::initTestCase()
 {
     initTestCaseImpl();
@@ -233,6 +252,62 @@ void TestConnBasics::testSimplePresence()
     QCOMPARE(mConn->lowlevel()->maxPresenceStatusMessageLength(), (uint) 512);
 }
 
+void TestConnBasics::testIsReadyBenchmark()
+{
+    Features features = Features() << Connection::FeatureCore << Connection::FeatureConnected;
+    QVERIFY(connect(mConn->becomeReady(features),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // isReady() is called by most of the public accessors, so it should not need to hash the
+    // feature class names
+    QBENCHMARK {
+        QVERIFY(mConn->isReady(Connection::FeatureCore));
+        QVERIFY(mConn->isReady(features));
+        QVERIFY(!mConn->isReady(Connection::FeatureSimplePresence));
+    }
+}
+
+void TestConnBasics::testIntrospectionBenchmark()
+{
+    // The properties of FeatureSimplePresence are fetched together with the remaining
+    // FeatureCore ones, so making a fresh proxy ready shouldn't take more round trips than
+    // FeatureCore alone
+    Features features = Features() << Connection::FeatureCore
+        << Connection::FeatureSimplePresence;
+
+    QBENCHMARK {
+        ConnectionPtr conn = Connection::create(mConnName, mConnPath,
+                ChannelFactory::create(QDBusConnection::sessionBus()),
+                ContactFactory::create());
+        QVERIFY(connect(conn->becomeReady(features),
+                        SIGNAL(finished(Tp::PendingOperation*)),
+                        SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+        QVERIFY(conn->isReady(features));
+        QVERIFY(!conn->lowlevel()->allowedPresenceStatuses().isEmpty());
+    }
+}
+
+void TestConnBasics::testPendingVoidBenchmark()
+{
+    // Connect() is a no-op on a connected connection, so this measures the cost of creating
+    // and completing PendingVoids against the CM, 100 at a time
+    Client::ConnectionInterface iface(mConnName, mConnPath);
+    const int ops = 100;
+
+    QBENCHMARK {
+        mPendingVoidsFinished = ops;
+        for (int i = 0; i < ops; ++i) {
+            QVERIFY(connect(new PendingVoid(iface.Connect(), mConn),
+                            SIGNAL(finished(Tp::PendingOperation*)),
+                            SLOT(onPendingVoidFinished(Tp::PendingOperation*))));
+        }
+        QCOMPARE(mLoop->exec(), 0);
+    }
+}
+
 void TestConnBasics::cleanup()
 {
     if (mConn) {
@@ -70,6 +70,8 @@ private Q_SLOTS:
 
     void testAvatar();
     void testRequestAvatars();
+    void testRequestAvatarsSharedToken();
+    void testRequestAvatarsVisibleFirst();
 
     void cleanup();
     void cleanupTestCase();
@@ -78,18 +80,19 @@ private:
     TestConnHelper *mConn;
     QList<ContactPtr> mContacts;
     bool mGotAvatarRetrieved;
+    QList<uint> mAvatarsRetrieved;
     int mAvatarDatasChanged;
 };
 
 void TestContactsAvatar::onAvatarRetrieved(uint handle, const QString &token,
     const QByteArray &data, const QString &mimeType)
 {
-    Q_UNUSED(handle);
     Q_UNUSED(token);
     Q_UNUSED(data);
     Q_UNUSED(mimeType);
 
     mGotAvatarRetrieved = true;
+    mAvatarsRetrieved << handle;
 }
 
 void TestContactsAvatar::onAvatarDataChanged(const AvatarData &avatar)
@@ -165,6 +168,15 @@ void TestContactsAvatar::initTestCase()
             "protocol", "foo",
             NULL);
     QCOMPARE(mConn->connect(), true);
+
+    Client::ConnectionInterfaceAvatarsInterface *connAvatarsInterface =
+        mConn->client()->optionalInterface<Client::ConnectionInterfaceAvatarsInterface>();
+    QVERIFY(connAvatarsInterface);
+
+    /* Check if AvatarRetrieved gets called */
+    QVERIFY(connect(connAvatarsInterface,
+            SIGNAL(AvatarRetrieved(uint, const QString &, const QByteArray &, const QString &)),
+            SLOT(onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &))));
 }
 
 void TestContactsAvatar::init()
@@ -172,6 +184,7 @@ void TestContactsAvatar::init()
     initImpl();
 
     mGotAvatarRetrieved = false;
+    mAvatarsRetrieved.clear();
     mAvatarDatasChanged = 0;
 }
 
@@ -192,14 +205,6 @@ void TestContactsAvatar::testAvatar()
     QByteArray a = tmpDir.toLatin1();
     setenv ("XDG_CACHE_HOME", a.constData(), true);
 
-    Client::ConnectionInterfaceAvatarsInterface *connAvatarsInterface =
-        mConn->client()->optionalInterface<Client::ConnectionInterfaceAvatarsInterface>();
-
-    /* Check if AvatarRetrieved gets called */
-    connect(connAvatarsInterface,
-            SIGNAL(AvatarRetrieved(uint, const QString &, const QByteArray &, const QString &)),
-            SLOT(onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &)));
-
     /* First time we create a contact, avatar should not be in cache, so
      * AvatarRetrieved should be called */
     mGotAvatarRetrieved = false;
@@ -207,10 +212,25 @@ void TestContactsAvatar::testAvatar()
     QVERIFY(mGotAvatarRetrieved);
 
     /* Second time we create a contact, avatar should be in cache now, so
-     * AvatarRetrieved should NOT be called */
+     * AvatarRetrieved should NOT be called, and the in-memory cache answers */
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    quint64 hits = manager->avatarCacheHits();
     mGotAvatarRetrieved = false;
     createContactWithFakeAvatar("bar");
     QVERIFY(!mGotAvatarRetrieved);
+    QVERIFY(manager->avatarCacheHits() > hits);
+
+    /* With no room in memory, the avatar is found on disk instead */
+    int cacheSize = manager->avatarCacheSize();
+    manager->setAvatarCacheSize(0);
+    QCOMPARE(manager->avatarCacheSize(), 0);
+    hits = manager->avatarCacheHits();
+    quint64 misses = manager->avatarCacheMisses();
+    createContactWithFakeAvatar("baz");
+    QVERIFY(!mGotAvatarRetrieved);
+    QCOMPARE(manager->avatarCacheHits(), hits);
+    QVERIFY(manager->avatarCacheMisses() > misses);
+    manager->setAvatarCacheSize(cacheSize);
 
     QVERIFY(SmartDir(tmpDir).removeDirectory());
 }
@@ -279,9 +299,22 @@ void TestContactsAvatar::testRequestAvatars()
         }
     }
 
-    // let's call ContactManager::requestContactAvatars now, it should update all contacts
+    // let's call ContactManager::requestContactAvatars now, it should update all contacts,
+    // a few at a time and the visible ones first
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    manager->setAvatarRequestBatchSize(10);
+    manager->setMaxConcurrentAvatarRequests(1);
+    manager->setAvatarRequestGracePeriod(500);
+    QCOMPARE(manager->avatarRequestBatchSize(), 10);
+    QCOMPARE(manager->maxConcurrentAvatarRequests(), 1);
+    QCOMPARE(manager->avatarRequestGracePeriod(), 500);
+    manager->setVisibleContacts(contacts.mid(90));
+
+    TpTestsContactsConnection *connService = TP_TESTS_CONTACTS_CONNECTION(mConn->service());
+    guint avatarRequests = tp_tests_contacts_connection_get_n_avatar_requests(connService);
+
     mAvatarDatasChanged = 0;
-    mConn->client()->contactManager()->requestContactAvatars(contacts);
+    manager->requestContactAvatars(contacts);
     processDBusQueue(mConn->client().data());
 
     // the other half will now receive the avatar
@@ -291,6 +324,12 @@ void TestContactsAvatar::testRequestAvatars()
 
     // check the only half got the updates
     QCOMPARE(mAvatarDatasChanged, contacts.size() / 2);
+    QCOMPARE(manager->pendingAvatarRequests(), 0);
+
+    // The avatars of the 50 contacts were requested 10 at a time
+    QCOMPARE(tp_tests_contacts_connection_get_n_avatar_requests(connService) - avatarRequests,
+            5U);
+    manager->setAvatarRequestGracePeriod(1000);
 
     for (int i = 0; i < contacts.size(); ++i) {
         ContactPtr contact = contacts[i];
@@ -314,6 +353,138 @@ void TestContactsAvatar::testRequestAvatars()
     QCOMPARE(mAvatarDatasChanged, 0);
 }
 
+void TestContactsAvatar::testRequestAvatarsSharedToken()
+{
+    TpHandleRepoIface *serviceRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    const gchar avatarData[] = "fake-avatar-data";
+    const gchar avatarMimeType[] = "fake-avatar-mime-type";
+    // Not in the disk cache from a previous run
+    QByteArray avatarToken = QString(QLatin1String("shared-avatar-token-%1"))
+        .arg(QDateTime::currentMSecsSinceEpoch()).toLatin1();
+    GArray *array;
+
+    array = g_array_new(FALSE, FALSE, sizeof(gchar));
+    g_array_append_vals(array, avatarData, strlen(avatarData));
+
+    // The contacts all have the same avatar, which the client knows the token of but doesn't
+    // have yet
+    Tp::UIntList handles;
+    for (int i = 0; i < 5; ++i) {
+        QString contactId = QLatin1String("shared") + QString::number(i);
+        TpHandle handle = tp_handle_ensure(serviceRepo, contactId.toLatin1().constData(),
+                NULL, NULL);
+        tp_tests_contacts_connection_change_avatar_data(
+                TP_TESTS_CONTACTS_CONNECTION(mConn->service()), handle,
+                array, avatarMimeType, avatarToken.constData(), false);
+        handles << handle;
+    }
+    g_array_unref(array);
+
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    manager->setAvatarRequestBatchSize(10);
+    manager->setMaxConcurrentAvatarRequests(1);
+    manager->setVisibleContacts(QList<ContactPtr>());
+
+    TpTestsContactsConnection *connService = TP_TESTS_CONTACTS_CONNECTION(mConn->service());
+    guint avatarRequests = tp_tests_contacts_connection_get_n_avatar_requests(connService);
+
+    // Building the contacts requests their avatars, as the tokens are known
+    Features features = Features() << Contact::FeatureAvatarToken << Contact::FeatureAvatarData;
+    QList<ContactPtr> contacts = mConn->contacts(handles, features);
+    QCOMPARE(contacts.size(), handles.size());
+
+    foreach (const ContactPtr &contact, contacts) {
+        QCOMPARE(contact->avatarToken(), QLatin1String(avatarToken));
+        if (contact->avatarData().fileName.isEmpty()) {
+            QVERIFY(connect(contact.data(),
+                            SIGNAL(avatarDataChanged(const Tp::AvatarData &)),
+                            SLOT(onAvatarDataChanged(const Tp::AvatarData &))));
+        } else {
+            mAvatarDatasChanged++;
+        }
+    }
+
+    while (mAvatarDatasChanged < contacts.size()) {
+        mLoop->processEvents();
+    }
+
+    // The avatar was requested for one of the contacts only, and all of them got it
+    QCOMPARE(tp_tests_contacts_connection_get_n_avatar_requests(connService) - avatarRequests,
+            1U);
+    QCOMPARE(mAvatarsRetrieved.size(), 1);
+    QVERIFY(handles.contains(mAvatarsRetrieved.first()));
+
+    QString fileName = contacts.first()->avatarData().fileName;
+    QVERIFY(!fileName.isEmpty());
+    foreach (const ContactPtr &contact, contacts) {
+        QCOMPARE(contact->avatarData().fileName, fileName);
+        QCOMPARE(contact->avatarData().mimeType, QLatin1String(avatarMimeType));
+    }
+
+    processDBusQueue(mConn->client().data());
+    QCOMPARE(manager->pendingAvatarRequests(), 0);
+}
+
+void TestContactsAvatar::testRequestAvatarsVisibleFirst()
+{
+    TpHandleRepoIface *serviceRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    const gchar avatarData[] = "fake-avatar-data";
+    const gchar avatarMimeType[] = "fake-avatar-mime-type";
+    GArray *array;
+
+    // The client doesn't know the tokens, so nothing is requested until asked to
+    Tp::UIntList handles;
+    for (int i = 0; i < 6; ++i) {
+        QString contactId = QLatin1String("visible") + QString::number(i);
+        handles << tp_handle_ensure(serviceRepo, contactId.toLatin1().constData(), NULL, NULL);
+    }
+    Features features = Features() << Contact::FeatureAvatarToken << Contact::FeatureAvatarData;
+    QList<ContactPtr> contacts = mConn->contacts(handles, features);
+    QCOMPARE(contacts.size(), handles.size());
+
+    array = g_array_new(FALSE, FALSE, sizeof(gchar));
+    g_array_append_vals(array, avatarData, strlen(avatarData));
+    for (int i = 0; i < contacts.size(); ++i) {
+        QVERIFY(!contacts[i]->isAvatarTokenKnown());
+        QVERIFY(connect(contacts[i].data(),
+                        SIGNAL(avatarDataChanged(const Tp::AvatarData &)),
+                        SLOT(onAvatarDataChanged(const Tp::AvatarData &))));
+
+        QByteArray avatarToken = QString(QLatin1String("visible-avatar-token-%1-%2"))
+            .arg(QDateTime::currentMSecsSinceEpoch()).arg(i).toLatin1();
+        tp_tests_contacts_connection_change_avatar_data(
+                TP_TESTS_CONTACTS_CONNECTION(mConn->service()), handles[i],
+                array, avatarMimeType, avatarToken.constData(), false);
+    }
+    g_array_unref(array);
+
+    // One batch of two contacts at a time, the visible ones at the end of the list go first
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    manager->setAvatarRequestBatchSize(2);
+    manager->setMaxConcurrentAvatarRequests(1);
+    manager->setVisibleContacts(contacts.mid(4));
+
+    manager->requestContactAvatars(contacts);
+
+    while (mAvatarDatasChanged < contacts.size()) {
+        mLoop->processEvents();
+    }
+
+    QCOMPARE(mAvatarsRetrieved.size(), contacts.size());
+    QCOMPARE(mAvatarsRetrieved.mid(0, 2).toSet(), handles.mid(4).toSet());
+    QCOMPARE(mAvatarsRetrieved.toSet(), handles.toSet());
+
+    foreach (const ContactPtr &contact, contacts) {
+        QVERIFY(!contact->avatarData().fileName.isEmpty());
+    }
+
+    processDBusQueue(mConn->client().data());
+    QCOMPARE(manager->pendingAvatarRequests(), 0);
+    manager->setVisibleContacts(QList<ContactPtr>());
+}
+
 void TestContactsAvatar::cleanup()
 {
     cleanupImpl();
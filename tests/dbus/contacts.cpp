@@ -1,4 +1,5 @@
 #include <QDebug>
+#include <QHash>
 #include <QList>
 #include <QTimer>
 
@@ -43,6 +44,9 @@ protected Q_SLOTS:
     void expectConnReady(Tp::ConnectionStatus, Tp::ConnectionStatusReason);
     void expectConnInvalidated();
     void expectPendingContactsFinished(Tp::PendingOperation *);
+    void expectCoalescedContactsFinished(Tp::PendingOperation *);
+    void onAggregatedPresencesChanged(const Tp::Contacts &);
+    void onAggregatedAliasesChanged(const Tp::Contacts &);
 
 private Q_SLOTS:
     void initTestCase();
@@ -51,6 +55,7 @@ private Q_SLOTS:
     void testSupport();
     void testSelfContact();
     void testForHandles();
+    void testForHandlesCoalesced();
     void testForIdentifiers();
     void testFeatures();
     void testFeaturesNotRequested();
@@ -66,6 +71,10 @@ private:
     ConnectionPtr mConn;
     QList<ContactPtr> mContacts;
     Tp::UIntList mInvalidHandles;
+    QHash<PendingOperation *, QList<ContactPtr> > mCoalescedContacts;
+    QHash<PendingOperation *, Tp::UIntList> mCoalescedInvalidHandles;
+    QList<Contacts> mPresencesChanged;
+    QList<Contacts> mAliasesChanged;
 };
 
 void TestContacts::expectConnReady(Tp::ConnectionStatus newStatus,
@@ -96,6 +105,16 @@ void TestContacts::expectConnInvalidated()
     mLoop->exit(0);
 }
 
+void TestContacts::onAggregatedPresencesChanged(const Tp::Contacts &contacts)
+{
+    mPresencesChanged.append(contacts);
+}
+
+void TestContacts::onAggregatedAliasesChanged(const Tp::Contacts &contacts)
+{
+    mAliasesChanged.append(contacts);
+}
+
 void TestContacts::expectPendingContactsFinished(PendingOperation *op)
 {
     TEST_VERIFY_OP(op);
@@ -110,6 +129,19 @@ void TestContacts::expectPendingContactsFinished(PendingOperation *op)
     mLoop->exit(0);
 }
 
+void TestContacts::expectCoalescedContactsFinished(PendingOperation *op)
+{
+    TEST_VERIFY_OP(op);
+
+    PendingContacts *pending = qobject_cast<PendingContacts *>(op);
+    mCoalescedContacts.insert(op, pending->contacts());
+    mCoalescedInvalidHandles.insert(op, pending->invalidHandles());
+
+    if (mCoalescedContacts.size() == 2) {
+        mLoop->exit(0);
+    }
+}
+
 void TestContacts::initTestCase()
 {
     initTestCaseImpl();
@@ -335,6 +367,71 @@ void TestContacts::testForHandles()
     processDBusQueue(mConn.data());
 }
 
+void TestContacts::testForHandlesCoalesced()
+{
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    Tp::UIntList handles;
+    handles << tp_handle_ensure(serviceRepo, "eve", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "frank", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "gina", NULL, NULL);
+    QVERIFY(!handles.contains(0));
+
+    // Two overlapping requests with different features made in the same main loop iteration
+    // share a single GetContactAttributes call, but each gets its own contacts and features
+    Tp::UIntList firstHandles = Tp::UIntList() << handles[0] << handles[1];
+    Tp::UIntList secondHandles = Tp::UIntList() << handles[1] << handles[2] << 31337;
+    Features firstFeatures = Features() << Contact::FeatureAlias;
+    Features secondFeatures = Features() << Contact::FeatureSimplePresence;
+
+    quint64 requestsBefore = mConn->contactManager()->contactAttributesRequests();
+    quint64 callsBefore = mConn->contactManager()->contactAttributesCalls();
+
+    PendingContacts *first = mConn->contactManager()->contactsForHandles(firstHandles,
+            firstFeatures);
+    PendingContacts *second = mConn->contactManager()->contactsForHandles(secondHandles,
+            secondFeatures);
+    mCoalescedContacts.clear();
+    mCoalescedInvalidHandles.clear();
+    QVERIFY(connect(first,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectCoalescedContactsFinished(Tp::PendingOperation*))));
+    QVERIFY(connect(second,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectCoalescedContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mConn->contactManager()->contactAttributesRequests(), requestsBefore + 2);
+    QCOMPARE(mConn->contactManager()->contactAttributesCalls(), callsBefore + 1);
+
+    QList<ContactPtr> firstContacts = mCoalescedContacts.value(first);
+    QCOMPARE(firstContacts.size(), 2);
+    QVERIFY(mCoalescedInvalidHandles.value(first).isEmpty());
+    QCOMPARE(firstContacts[0]->id(), QString(QLatin1String("eve")));
+    QCOMPARE(firstContacts[1]->id(), QString(QLatin1String("frank")));
+    QCOMPARE(firstContacts[0]->requestedFeatures(), firstFeatures);
+
+    QList<ContactPtr> secondContacts = mCoalescedContacts.value(second);
+    QCOMPARE(secondContacts.size(), 2);
+    QCOMPARE(mCoalescedInvalidHandles.value(second), Tp::UIntList() << 31337);
+    QCOMPARE(secondContacts[0]->id(), QString(QLatin1String("frank")));
+    QCOMPARE(secondContacts[1]->id(), QString(QLatin1String("gina")));
+    QCOMPARE(secondContacts[1]->requestedFeatures(), secondFeatures);
+
+    // The contact requested by both ends up with the union of the features
+    QCOMPARE(firstContacts[1], secondContacts[0]);
+    QCOMPARE(firstContacts[1]->requestedFeatures(),
+            Features() << Contact::FeatureAlias << Contact::FeatureSimplePresence);
+
+    firstContacts.clear();
+    secondContacts.clear();
+    mCoalescedContacts.clear();
+    mCoalescedInvalidHandles.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
 void TestContacts::testForIdentifiers()
 {
     QStringList validIDs = QStringList() << QLatin1String("Alice")
@@ -515,7 +612,20 @@ void TestContacts::testFeatures()
     QCOMPARE(mContacts[1]->presence().type(), Tp::ConnectionPresenceTypeBusy);
     QCOMPARE(mContacts[2]->presence().type(), Tp::ConnectionPresenceTypeAway);
 
-    // Change some of the contacts to a new set of attributes
+    // Change some of the contacts to a new set of attributes, each batch of changes should be
+    // aggregated into a single signal
+    ContactManagerPtr manager = mConn->contactManager();
+    manager->setAggregateContactChanges(true);
+    QVERIFY(manager->isAggregatingContactChanges());
+    QVERIFY(connect(manager.data(),
+                SIGNAL(presencesChanged(Tp::Contacts)),
+                SLOT(onAggregatedPresencesChanged(Tp::Contacts))));
+    QVERIFY(connect(manager.data(),
+                SIGNAL(aliasesChanged(Tp::Contacts)),
+                SLOT(onAggregatedAliasesChanged(Tp::Contacts))));
+    mPresencesChanged.clear();
+    mAliasesChanged.clear();
+
     tp_tests_contacts_connection_change_aliases(mConnService, 2, handles.toVector().constData(),
             latterAliases);
     tp_tests_contacts_connection_change_avatar_tokens(mConnService, 2, handles.toVector().constData(),
@@ -525,6 +635,14 @@ void TestContacts::testFeatures()
     mLoop->processEvents();
     processDBusQueue(mConn.data());
 
+    QCOMPARE(mPresencesChanged.size(), 1);
+    QCOMPARE(mPresencesChanged[0], Contacts() << mContacts[0] << mContacts[1]);
+    QCOMPARE(mAliasesChanged.size(), 1);
+    QCOMPARE(mAliasesChanged[0], Contacts() << mContacts[0] << mContacts[1]);
+
+    manager->setAggregateContactChanges(false);
+    disconnect(manager.data(), 0, this, 0);
+
     // Check that the attributes were updated in the Contact objects
     for (int i = 0; i < 3; i++) {
         QCOMPARE(mContacts[i]->handle()[0], handles[i]);
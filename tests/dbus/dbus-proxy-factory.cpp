@@ -45,6 +45,7 @@ private Q_SLOTS:
     void initTestCase();
     void init();
 
+    void testNameOwnerCache();
     void testCaching();
     void testDropRefs();
     void testInvalidate();
@@ -127,6 +128,47 @@ void TestDBusProxyFactory::init()
     mNumFinished = 0;
 }
 
+void TestDBusProxyFactory::testNameOwnerCache()
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QString owner;
+    QVERIFY(!TestBackdoors::lookupNameOwner(bus, mConnName1, owner));
+
+    quint64 synchronousCalls = TestBackdoors::nameOwnerSynchronousCalls(bus);
+
+    QVERIFY(connect(TestBackdoors::resolveNameOwners(bus,
+                    QStringList() << mConnName1 << mConnName1),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QVERIFY(TestBackdoors::lookupNameOwner(bus, mConnName1, owner));
+    QVERIFY(owner.startsWith(QLatin1Char(':')));
+
+    // Once the name is resolved, constructing proxies for it must not block on the bus daemon
+    QList<ConnectionPtr> connections;
+    for (int i = 0; i < 1000; ++i) {
+        ConnectionPtr connection = Connection::create(QDBusConnection::sessionBus(),
+                mConnName1, QString(QLatin1String("%1/%2")).arg(mConnPath1).arg(i),
+                ChannelFactory::create(QDBusConnection::sessionBus()),
+                ContactFactory::create());
+        QVERIFY(connection->isValid());
+        QCOMPARE(connection->busName(), owner);
+        connections.append(connection);
+    }
+
+    PendingReady *cached = mFactory->proxy(mConnName1, mConnPath1,
+            ChannelFactory::create(QDBusConnection::sessionBus()),
+            ContactFactory::create());
+    QCOMPARE(cached->proxy()->busName(), owner);
+
+    QCOMPARE(TestBackdoors::nameOwnerSynchronousCalls(bus), synchronousCalls);
+
+    QVERIFY(connect(cached, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+}
+
 void TestDBusProxyFactory::testCaching()
 {
     PendingReady *first = mFactory->proxy(mConnName1, mConnPath1,
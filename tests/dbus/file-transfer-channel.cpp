@@ -0,0 +1,249 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/file-transfer-chan.h>
+#include <tests/lib/glib/simple-conn.h>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/FileTransferChannel>
+#include <TelepathyQt/OutgoingFileTransferChannel>
+#include <TelepathyQt/PendingReady>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include <QBuffer>
+#include <QTemporaryFile>
+
+using namespace Tp;
+
+class TestFileTransferChannel : public Test
+{
+    Q_OBJECT
+
+public:
+    TestFileTransferChannel(QObject *parent = 0)
+        : Test(parent),
+          mConn(0), mChanService(0)
+    { }
+
+protected Q_SLOTS:
+    void onStateChanged(Tp::FileTransferState state,
+            Tp::FileTransferStateChangeReason reason);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testTransferChunkSize();
+    void testProvideFile_data();
+    void testProvideFile();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void createFileTransferChannel(qulonglong size);
+
+    TestConnHelper *mConn;
+    TpTestsFileTransferChannel *mChanService;
+    OutgoingFileTransferChannelPtr mChan;
+
+    FileTransferState mState;
+};
+
+void TestFileTransferChannel::onStateChanged(Tp::FileTransferState state,
+        Tp::FileTransferStateChangeReason reason)
+{
+    Q_UNUSED(reason);
+
+    qDebug() << "File transfer state changed to" << state;
+    mState = state;
+    mLoop->exit(0);
+}
+
+void TestFileTransferChannel::createFileTransferChannel(qulonglong size)
+{
+    mChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    /* Create service-side file transfer channel object */
+    QString chanPath = QString(QLatin1String("%1/Channel")).arg(mConn->objectPath());
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "bob", NULL, NULL);
+    TpHandle selfHandle = tp_base_connection_get_self_handle(
+            TP_BASE_CONNECTION(mConn->service()));
+
+    mChanService = TP_TESTS_FILE_TRANSFER_CHANNEL(g_object_new(
+            TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL,
+            "connection", mConn->service(),
+            "handle", handle,
+            "requested", TRUE,
+            "object-path", chanPath.toLatin1().constData(),
+            "initiator-handle", selfHandle,
+            "filename", "test.bin",
+            "size", (guint64) size,
+            NULL));
+
+    /* Create client-side file transfer channel object */
+    mChan = OutgoingFileTransferChannel::create(mConn->client(), chanPath, QVariantMap());
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+                SLOT(onStateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason))));
+}
+
+void TestFileTransferChannel::initTestCase()
+{
+    initTestCaseImpl();
+
+    g_type_init();
+    g_set_prgname("file-transfer-channel");
+    tp_debug_set_flags("all");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_SIMPLE_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+}
+
+void TestFileTransferChannel::init()
+{
+    initImpl();
+
+    mState = FileTransferStateNone;
+}
+
+void TestFileTransferChannel::testTransferChunkSize()
+{
+    createFileTransferChannel(0);
+
+    QCOMPARE(mChan->transferChunkSize(), static_cast<qint64>(64 * 1024));
+
+    mChan->setTransferChunkSize(1024);
+    QCOMPARE(mChan->transferChunkSize(), static_cast<qint64>(1024));
+
+    // non-positive chunk sizes are ignored
+    mChan->setTransferChunkSize(0);
+    QCOMPARE(mChan->transferChunkSize(), static_cast<qint64>(1024));
+    mChan->setTransferChunkSize(-1);
+    QCOMPARE(mChan->transferChunkSize(), static_cast<qint64>(1024));
+}
+
+void TestFileTransferChannel::testProvideFile_data()
+{
+    QTest::addColumn<bool>("mapped");
+    QTest::addColumn<qulonglong>("initialOffset");
+    QTest::addColumn<qint64>("chunkSize");
+
+    // QFile inputs are sent from a memory mapping, QBuffer ones through the read buffer
+    QTest::newRow("mapped") << true << qulonglong(0) << qint64(0);
+    QTest::newRow("mapped, initial offset") << true << qulonglong(1000) << qint64(0);
+    QTest::newRow("mapped, small chunks") << true << qulonglong(1000) << qint64(1024);
+    QTest::newRow("mapped, initial offset at the end") << true << qulonglong(200000) << qint64(1024);
+    QTest::newRow("buffered, initial offset") << false << qulonglong(1000) << qint64(0);
+    QTest::newRow("buffered, small chunks") << false << qulonglong(1000) << qint64(1024);
+}
+
+void TestFileTransferChannel::testProvideFile()
+{
+    QFETCH(bool, mapped);
+    QFETCH(qulonglong, initialOffset);
+    QFETCH(qint64, chunkSize);
+
+    // several default-sized chunks, not a multiple of the small chunk size
+    QByteArray data;
+    data.reserve(200000);
+    for (int i = 0; i < 200000; ++i) {
+        data.append(static_cast<char>(i % 251));
+    }
+
+    QTemporaryFile file;
+    QBuffer buffer;
+    QIODevice *input;
+    if (mapped) {
+        QVERIFY(file.open());
+        QCOMPARE(file.write(data), static_cast<qint64>(data.size()));
+        QVERIFY(file.flush());
+        input = &file;
+    } else {
+        buffer.setData(data);
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        input = &buffer;
+    }
+
+    createFileTransferChannel(data.size());
+    QVERIFY(connect(mChan->becomeReady(OutgoingFileTransferChannel::FeatureCore),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->state(), FileTransferStatePending);
+    QCOMPARE(mChan->size(), static_cast<qulonglong>(data.size()));
+
+    if (chunkSize > 0) {
+        mChan->setTransferChunkSize(chunkSize);
+        QCOMPARE(mChan->transferChunkSize(), chunkSize);
+    }
+
+    QVERIFY(connect(mChan->provideFile(input),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    tp_tests_file_transfer_channel_remote_accept(mChanService, initialOffset);
+
+    while (mState != FileTransferStateCompleted) {
+        QCOMPARE(mLoop->exec(), 0);
+        QVERIFY(mState != FileTransferStateCancelled);
+    }
+
+    QCOMPARE(mChan->initialOffset(), initialOffset);
+
+    GByteArray *received = tp_tests_file_transfer_channel_get_received_data(mChanService);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(received->data), received->len),
+            data.mid(int(initialOffset)));
+
+    // the input is closed once the transfer is over
+    QVERIFY(!input->isOpen());
+}
+
+void TestFileTransferChannel::cleanup()
+{
+    cleanupImpl();
+
+    if (mChan && mChan->isValid()) {
+        qDebug() << "waiting for the channel to become invalidated";
+
+        QVERIFY(connect(mChan.data(),
+                SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
+                mLoop,
+                SLOT(quit())));
+        tp_base_channel_close(TP_BASE_CHANNEL(mChanService));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    mChan.reset();
+
+    if (mChanService != 0) {
+        g_object_unref(mChanService);
+        mChanService = 0;
+    }
+
+    mLoop->processEvents();
+}
+
+void TestFileTransferChannel::cleanupTestCase()
+{
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestFileTransferChannel)
+#include "_gen/file-transfer-channel.cpp.moc.hpp"
@@ -32,6 +32,7 @@ private Q_SLOTS:
     void init();
 
     void testRequestAndRelease();
+    void testCopyBenchmark();
 
     void cleanup();
     void cleanupTestCase();
@@ -111,6 +112,33 @@ void TestHandles::testRequestAndRelease()
     processDBusQueue(mConn->client().data());
 }
 
+void TestHandles::testCopyBenchmark()
+{
+    QStringList ids;
+    for (int i = 0; i < 10000; ++i) {
+        ids << QString(QLatin1String("contact%1")).arg(i);
+    }
+
+    PendingHandles *pending = mConn->client()->lowlevel()->requestHandles(Tp::HandleTypeContact, ids);
+    QVERIFY(connect(pending,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingHandlesFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    ReferencedHandles handles = mHandles;
+    mHandles = ReferencedHandles();
+    QCOMPARE(handles.size(), ids.size());
+
+    // mid() creates a new container, referencing (and later unreferencing) every handle
+    QBENCHMARK {
+        ReferencedHandles copy = handles.mid(0);
+        QCOMPARE(copy.size(), handles.size());
+    }
+
+    handles = ReferencedHandles();
+    mLoop->processEvents();
+    processDBusQueue(mConn->client().data());
+}
+
 void TestHandles::cleanup()
 {
     cleanupImpl();
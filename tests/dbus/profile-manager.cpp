@@ -3,6 +3,8 @@
 #include <TelepathyQt/PendingReady>
 #include <TelepathyQt/ProfileManager>
 
+#include <TelepathyQt/test-backdoors.h>
+
 #include <tests/lib/test.h>
 
 using namespace Tp;
@@ -12,9 +14,22 @@ class TestProfileManager : public Test
     Q_OBJECT
 
 private Q_SLOTS:
+    void initTestCase();
+
     void testProfileManager();
+    void testProfileIndex();
+
+    void cleanupTestCase();
 };
 
+void TestProfileManager::initTestCase()
+{
+    initTestCaseImpl();
+
+    // The test environment points XDG_CACHE_HOME to an empty directory, so there is no index yet
+    QVERIFY(!QFile::exists(TestBackdoors::profileIndexFileName()));
+}
+
 void TestProfileManager::testProfileManager()
 {
     ProfileManagerPtr pm = ProfileManager::create(QDBusConnection::sessionBus());
@@ -81,6 +96,46 @@ void TestProfileManager::testProfileManager()
     mLoop->processEvents();
 }
 
+void TestProfileManager::testProfileIndex()
+{
+    // The previous test indexed the profiles, this one answers from the index
+    QVERIFY(QFile::exists(TestBackdoors::profileIndexFileName()));
+
+    ProfileManagerPtr pm = ProfileManager::create(QDBusConnection::sessionBus());
+    QVERIFY(connect(pm->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(pm->isReady(), true);
+
+    QCOMPARE(pm->profilesForCM(QLatin1String("testprofilecm")).count(), 2);
+    QCOMPARE(pm->profilesForProtocol(QLatin1String("testprofileproto")).count(), 2);
+    QCOMPARE(pm->profileForService(QLatin1String("test-profile-non-im-type")).isNull(), true);
+    QCOMPARE(pm->profileForService(QLatin1String("test-profile-malformed")).isNull(), true);
+
+    ProfilePtr profile = pm->profileForService(QLatin1String("test-profile"));
+    QVERIFY(!profile.isNull());
+    QCOMPARE(profile->isValid(), true);
+    QCOMPARE(profile->isFake(), false);
+    QCOMPARE(profile->name(), QLatin1String("TestProfile"));
+    QCOMPARE(profile->cmName(), QLatin1String("testprofilecm"));
+    QCOMPARE(profile->protocolName(), QLatin1String("testprofileproto"));
+    QCOMPARE(profile->parameters().count(), 2);
+
+    // Profiles are loaded once and then shared
+    QCOMPARE(pm->profileForService(QLatin1String("test-profile")).data(), profile.data());
+    QCOMPARE(pm->profiles().count(), 2);
+
+    mLoop->processEvents();
+}
+
+void TestProfileManager::cleanupTestCase()
+{
+    QFile::remove(TestBackdoors::profileIndexFileName());
+
+    cleanupTestCaseImpl();
+}
+
 QTEST_MAIN(TestProfileManager)
 
 #include "_gen/profile-manager.cpp.moc.hpp"
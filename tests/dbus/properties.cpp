@@ -8,6 +8,8 @@
 
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/Debug>
+#include <TelepathyQt/PendingVariant>
+#include <TelepathyQt/PendingVariantMap>
 
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
@@ -32,6 +34,8 @@ private Q_SLOTS:
     void init();
 
     void testPropertiesMonitoring();
+    void testPropertiesCache();
+    void testPropertiesChangedDuringGetAll();
 
     void cleanup();
     void cleanupTestCase();
@@ -126,6 +130,116 @@ void TestProperties::testPropertiesMonitoring()
     g_hash_table_destroy (changed);
 }
 
+void TestProperties::testPropertiesCache()
+{
+    QCOMPARE(mConn->hasCachedProperties(), false);
+    QCOMPARE(mConn->propertiesGeneration(), quint64(0));
+
+    // the cache is only filled while monitoring properties
+    mConn->setMonitorProperties(true);
+    QCOMPARE(mConn->isMonitoringProperties(), true);
+
+    PendingVariantMap *pvm = mConn->requestAllProperties();
+    QVERIFY(connect(pvm, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mConn->hasCachedProperties(), true);
+    QCOMPARE(mConn->cachedProperties(), pvm->result());
+    QVERIFY(mConn->cachedProperty(QLatin1String("Status")).isValid());
+    quint64 generation = mConn->propertiesGeneration();
+    QVERIFY(generation > 0);
+    QVERIFY(mConn->propertiesChangedSince(generation).isEmpty());
+
+    GHashTable *changed = tp_asv_new(
+                "test-prop", G_TYPE_STRING, "Cached",
+                NULL
+                );
+    tp_svc_dbus_properties_emit_properties_changed (mConnService,
+            mConn->interface().toLatin1().data(), changed, NULL);
+    g_hash_table_destroy (changed);
+
+    connect(mConn, SIGNAL(propertiesChanged(QVariantMap,QStringList)),
+            mLoop, SLOT(quit()));
+    mLoop->exec();
+
+    QCOMPARE(mConn->cachedProperty(QLatin1String("test-prop")).toString(),
+            QLatin1String("Cached"));
+    QCOMPARE(mConn->propertiesGeneration(), generation + 1);
+    QCOMPARE(mConn->propertiesChangedSince(generation),
+            QStringList() << QLatin1String("test-prop"));
+
+    // further requests are answered from the cache
+    pvm = mConn->requestAllProperties();
+    QVERIFY(pvm->isFinished());
+    QCOMPARE(pvm->result().value(QLatin1String("test-prop")).toString(),
+            QLatin1String("Cached"));
+
+    PendingVariant *pv = mConn->requestPropertyStatus();
+    QVERIFY(pv->isFinished());
+    QCOMPARE(pv->result(), mConn->cachedProperty(QLatin1String("Status")));
+
+    // invalidated properties make the cache incomplete
+    const gchar *invalidated[] = { "test-prop", NULL };
+    tp_svc_dbus_properties_emit_properties_changed (mConnService,
+            mConn->interface().toLatin1().data(), NULL, invalidated);
+    mLoop->exec();
+
+    QCOMPARE(mConn->hasCachedProperties(), false);
+    QVERIFY(!mConn->cachedProperty(QLatin1String("test-prop")).isValid());
+    QCOMPARE(mConn->propertiesGeneration(), generation + 2);
+}
+
+void TestProperties::testPropertiesChangedDuringGetAll()
+{
+    mConn->setMonitorProperties(true);
+
+    PendingVariantMap *pvm = mConn->requestAllProperties();
+
+    // The service only handles the GetAll call once we get back to the main loop, so its reply
+    // comes after these signals, with the old values
+    GHashTable *changed = tp_asv_new(
+                "Status", G_TYPE_UINT, (guint) TP_CONNECTION_STATUS_CONNECTING,
+                NULL
+                );
+    const gchar *invalidated[] = { "SelfHandle", NULL };
+    tp_svc_dbus_properties_emit_properties_changed (mConnService,
+            mConn->interface().toLatin1().data(), changed, invalidated);
+    g_hash_table_destroy (changed);
+
+    QSignalSpy spy(mConn, SIGNAL(propertiesChanged(QVariantMap,QStringList)));
+    QVERIFY(connect(pvm, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(spy.count(), 1);
+
+    // The reply did not overwrite the value reported by PropertiesChanged...
+    QVERIFY(pvm->result().contains(QLatin1String("Status")));
+    QVERIFY(pvm->result().value(QLatin1String("Status")).toUInt() !=
+            (uint) TP_CONNECTION_STATUS_CONNECTING);
+    QCOMPARE(mConn->cachedProperty(QLatin1String("Status")).toUInt(),
+            (uint) TP_CONNECTION_STATUS_CONNECTING);
+
+    // ...nor put back the invalidated property, so the cache is not complete
+    QVERIFY(pvm->result().contains(QLatin1String("SelfHandle")));
+    QVERIFY(!mConn->cachedProperty(QLatin1String("SelfHandle")).isValid());
+    QCOMPARE(mConn->hasCachedProperties(), false);
+
+    // The other properties were cached from the reply
+    QCOMPARE(mConn->cachedProperty(QLatin1String("Interfaces")),
+            pvm->result().value(QLatin1String("Interfaces")));
+
+    // Requesting all the properties again fetches the invalidated one
+    pvm = mConn->requestAllProperties();
+    QVERIFY(!pvm->isFinished());
+    QVERIFY(connect(pvm, SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mConn->hasCachedProperties(), true);
+    QVERIFY(mConn->cachedProperty(QLatin1String("SelfHandle")).isValid());
+}
+
 void TestProperties::cleanup()
 {
     if (mConn) {
@@ -352,6 +352,8 @@ void TestStreamTubeChan::testCheckRemoteConnectionsCommon()
             mExpectedHandle);
     QCOMPARE(chan->contactsForConnections().value(mRemoteConnectionId)->id(),
             mExpectedId);
+    QCOMPARE(chan->contactForConnection(mRemoteConnectionId),
+            chan->contactsForConnections().value(mRemoteConnectionId));
 
     if (contexts[mCurrentContext].accessControl == TP_SOCKET_ACCESS_CONTROL_PORT) {
         // qDebug() << "+++ conn for source addresses" << chan->connectionsForSourceAddresses();
@@ -360,6 +362,7 @@ void TestStreamTubeChan::testCheckRemoteConnectionsCommon()
         QPair<QHostAddress, quint16> srcAddr(mExpectedAddress, mExpectedPort);
         QCOMPARE(chan->connectionsForSourceAddresses().contains(srcAddr), true);
         QCOMPARE(chan->connectionsForSourceAddresses().value(srcAddr), mRemoteConnectionId);
+        QCOMPARE(chan->sourceAddressForConnection(mRemoteConnectionId), srcAddr);
     } else if (contexts[mCurrentContext].accessControl == TP_SOCKET_ACCESS_CONTROL_CREDENTIALS) {
         // qDebug() << "+++ conn for credentials" << chan->connectionsForCredentials();
         QCOMPARE(chan->connectionsForCredentials().isEmpty(), false);
@@ -784,6 +787,9 @@ void TestStreamTubeChan::testOfferSuccess()
         QCOMPARE(chan->contactsForConnections().isEmpty(), true);
         QCOMPARE(chan->connectionsForSourceAddresses().isEmpty(), true);
         QCOMPARE(chan->connectionsForCredentials().isEmpty(), true);
+        QVERIFY(chan->contactForConnection(mRemoteConnectionId).isNull());
+        QCOMPARE(chan->sourceAddressForConnection(mRemoteConnectionId),
+                qMakePair(QHostAddress(QHostAddress::Null), quint16(0)));
 
         delete localServer;
         delete localSocket;
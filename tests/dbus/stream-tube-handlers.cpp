@@ -296,6 +296,7 @@ private Q_SLOTS:
     void testBasicTcpExport();
     void testFailedExport();
     void testServerConnMonitoring();
+    void testServerRelay();
     void testSSTHErrorPaths();
 
     void testClientBasicTcp();
@@ -333,6 +334,7 @@ private:
     ContactPtr mNewServerConnectionContact, mClosedServerConnectionContact;
     OutgoingStreamTubeChannelPtr mNewServerConnectionTube, mServerConnectionCloseTube;
     QString mServerConnectionCloseError, mServerConnectionCloseMessage;
+    StreamTubeServer::RelayStats mClosedServerConnectionRelayStats;
 
     IncomingStreamTubeChannelPtr mOfferedTube;
 
@@ -586,6 +588,10 @@ void TestStreamTubeHandlers::onServerConnectionClosed(
     mServerConnectionCloseMessage = message;
     mServerConnectionCloseTube = tube;
 
+    // The relay stats should still be around while the signal is being emitted
+    StreamTubeServer *server = qobject_cast<StreamTubeServer *>(sender());
+    mClosedServerConnectionRelayStats = server->relayStats(sourceAddress, sourcePort);
+
     mLoop->exit(0);
 }
 
@@ -1186,6 +1192,165 @@ void TestStreamTubeHandlers::testServerConnMonitoring()
     QCOMPARE(mServerCloseError, QString(TP_QT_ERROR_CANCELLED)); // == local close request
 }
 
+void TestStreamTubeHandlers::testServerRelay()
+{
+    QTcpServer service;
+    QVERIFY(service.listen(QHostAddress::LocalHost));
+
+    StreamTubeServerPtr server =
+        StreamTubeServer::create(QStringList(), QStringList() << QLatin1String("multiftp"),
+                QLatin1String("warezd"), true);
+
+    QVERIFY(!server->isRelaying());
+    server->relayTcpSocket(QHostAddress::LocalHost, service.serverPort());
+
+    QVERIFY(server->isRegistered());
+    QVERIFY(server->isRelaying());
+    QCOMPARE(server->relayedTcpSocketAddress(),
+            qMakePair(QHostAddress(QHostAddress::LocalHost), service.serverPort()));
+
+    // The relay listens on a socket of its own, which is what gets offered
+    QPair<QHostAddress, quint16> relayAddr = server->exportedTcpSocketAddress();
+    QCOMPARE(relayAddr.first, QHostAddress(QHostAddress::LocalHost));
+    QVERIFY(relayAddr.second != 0);
+    QVERIFY(relayAddr.second != service.serverPort());
+
+    QMap<QString, ClientHandlerInterface *> handlers = ourHandlers();
+
+    QVERIFY(!handlers.isEmpty());
+    ClientHandlerInterface *handler = handlers.value(server->clientName());
+    QVERIFY(handler != 0);
+
+    QPair<QString, QVariantMap> chan = createTubeChannel(true, HandleTypeRoom, true);
+
+    QVERIFY(connect(server.data(),
+                SIGNAL(tubeRequested(Tp::AccountPtr,Tp::OutgoingStreamTubeChannelPtr,QDateTime,Tp::ChannelRequestHints)),
+                SLOT(onTubeRequested(Tp::AccountPtr,Tp::OutgoingStreamTubeChannelPtr,QDateTime,Tp::ChannelRequestHints))));
+    QVERIFY(connect(server.data(),
+                SIGNAL(newTcpConnection(QHostAddress,quint16,Tp::AccountPtr,Tp::ContactPtr,Tp::OutgoingStreamTubeChannelPtr)),
+                SLOT(onNewServerConnection(QHostAddress,quint16,Tp::AccountPtr,Tp::ContactPtr,Tp::OutgoingStreamTubeChannelPtr))));
+    QVERIFY(connect(server.data(),
+                SIGNAL(tcpConnectionClosed(QHostAddress,quint16,Tp::AccountPtr,Tp::ContactPtr,QString,QString,Tp::OutgoingStreamTubeChannelPtr)),
+                SLOT(onServerConnectionClosed(QHostAddress,quint16,Tp::AccountPtr,Tp::ContactPtr,QString,QString,Tp::OutgoingStreamTubeChannelPtr))));
+
+    ChannelDetails details = { QDBusObjectPath(chan.first), chan.second };
+    handler->HandleChannels(
+            QDBusObjectPath(mAcc->objectPath()),
+            QDBusObjectPath(mConn->objectPath()),
+            ChannelDetailsList() << details,
+            ObjectPathList(),
+            QDateTime::currentDateTime().toTime_t(),
+            QVariantMap());
+
+    QCOMPARE(mLoop->exec(), 0);
+
+    QVERIFY(!mRequestedTube.isNull());
+    QCOMPARE(mRequestedTube->objectPath(), chan.first);
+
+    while (mRequestedTube->isValid() && mRequestedTube->state() != TubeChannelStateRemotePending) {
+        mLoop->processEvents();
+    }
+    QVERIFY(mRequestedTube->isValid());
+    QCOMPARE(mRequestedTube->ipAddress(), relayAddr);
+
+    // Connect to the offered socket like the CM would, and check the data makes it to the service
+    QTcpSocket cmSocket;
+    cmSocket.connectToHost(relayAddr.first, relayAddr.second);
+    QVERIFY(cmSocket.waitForConnected());
+    QHostAddress cmAddress = cmSocket.localAddress();
+    quint16 cmPort = cmSocket.localPort();
+
+    QByteArray request("USER anonymous\r\n");
+    cmSocket.write(request);
+    QVERIFY(cmSocket.waitForBytesWritten());
+
+    QVERIFY(service.waitForNewConnection(5000));
+    QTcpSocket *serviceSocket = service.nextPendingConnection();
+    QVERIFY(serviceSocket != 0);
+
+    QByteArray received;
+    while (received.size() < request.size() && serviceSocket->waitForReadyRead(5000)) {
+        received += serviceSocket->readAll();
+    }
+    QCOMPARE(received, request);
+
+    // Now tell the tube about the connection, giving the CM side address as the source
+    GValue *connParam = tp_g_value_slice_new_take_boxed(
+            TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4,
+            dbus_g_type_specialized_construct(TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4));
+
+    dbus_g_type_struct_set(connParam,
+            0, cmAddress.toString().toLatin1().constData(),
+            1, cmPort,
+            G_MAXUINT);
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "first", NULL, NULL);
+
+    tp_tests_stream_tube_channel_peer_connected_no_stream(mChanServices.back(), connParam, handle);
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mNewServerConnectionAddress, cmAddress);
+    QCOMPARE(mNewServerConnectionPort, cmPort);
+    QCOMPARE(mNewServerConnectionContact->id(), QLatin1String("first"));
+
+    StreamTubeServer::RelayStats stats =
+        server->relayStats(mNewServerConnectionAddress, mNewServerConnectionPort);
+    QVERIFY(stats.isValid());
+    QVERIFY(stats.isActive());
+    QCOMPARE(stats.bytesReceived(), qint64(request.size()));
+    QCOMPARE(stats.bytesSent(), qint64(0));
+    QCOMPARE(stats.stalls(), 0U);
+
+    // Unknown connections have no stats
+    QVERIFY(!server->relayStats(QHostAddress::LocalHost, 1).isValid());
+
+    // The reply goes back the same way
+    QByteArray reply("331 Any password will work\r\n");
+    serviceSocket->write(reply);
+    QVERIFY(serviceSocket->waitForBytesWritten());
+
+    QByteArray replied;
+    while (replied.size() < reply.size() && cmSocket.waitForReadyRead(5000)) {
+        replied += cmSocket.readAll();
+    }
+    QCOMPARE(replied, reply);
+
+    stats = server->relayStats(mNewServerConnectionAddress, mNewServerConnectionPort);
+    QVERIFY(stats.isValid());
+    QCOMPARE(stats.bytesReceived(), qint64(request.size()));
+    QCOMPARE(stats.bytesSent(), qint64(reply.size()));
+
+    // Closing the CM side closes the service side too
+    cmSocket.disconnectFromHost();
+    QVERIFY(serviceSocket->state() == QAbstractSocket::UnconnectedState ||
+            serviceSocket->waitForDisconnected(5000));
+
+    tp_tests_stream_tube_channel_last_connection_disconnected(mChanServices.back(),
+            TP_ERROR_STR_DISCONNECTED);
+    QCOMPARE(mLoop->exec(), 0);
+
+    QCOMPARE(mClosedServerConnectionAddress, cmAddress);
+    QCOMPARE(mClosedServerConnectionPort, cmPort);
+
+    // The final stats were available when the connection close was signaled, but not after that
+    QVERIFY(mClosedServerConnectionRelayStats.isValid());
+    QVERIFY(!mClosedServerConnectionRelayStats.isActive());
+    QCOMPARE(mClosedServerConnectionRelayStats.bytesReceived(), qint64(request.size()));
+    QCOMPARE(mClosedServerConnectionRelayStats.bytesSent(), qint64(reply.size()));
+    QVERIFY(!server->relayStats(mClosedServerConnectionAddress,
+                mClosedServerConnectionPort).isValid());
+
+    // Exporting a socket directly stops relaying for tubes handled after that
+    server->exportTcpSocket(&service);
+    QVERIFY(!server->isRelaying());
+    QCOMPARE(server->exportedTcpSocketAddress().second, service.serverPort());
+    QCOMPARE(server->relayedTcpSocketAddress().second, quint16(0));
+
+    delete serviceSocket;
+}
+
 void TestStreamTubeHandlers::testSSTHErrorPaths()
 {
     // Create and look up a handler with an incorrectly set up channel factory
@@ -1892,6 +2057,7 @@ void TestStreamTubeHandlers::cleanup()
     mClosedServerConnectionContact.reset();
     mNewServerConnectionTube.reset();
     mServerConnectionCloseTube.reset();
+    mClosedServerConnectionRelayStats = StreamTubeServer::RelayStats();
 
     if (mOfferedTube && mOfferedTube->isValid()) {
         qDebug() << "waiting for the ofrd tube to become invalidated";
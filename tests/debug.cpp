@@ -0,0 +1,339 @@
+#include <QtTest/QtTest>
+#include <QtCore/QThread>
+
+#include <TelepathyQt/Debug>
+
+#include "TelepathyQt/debug-internal.h"
+
+using namespace Tp;
+
+class TestDebug : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+
+    void testSink();
+    void testSinkTypes();
+    void testCallback();
+    void testCopies();
+    void testCompatibility();
+    void testNested();
+    void testFormatReset();
+    void testThreads();
+    void testMessageFlood_data();
+    void testMessageFlood();
+
+    void cleanup();
+};
+
+class CollectingSink : public DebugSink
+{
+public:
+    CollectingSink(QtMsgType minimumType = QtDebugMsg)
+        : DebugSink(minimumType)
+    {
+    }
+
+    ~CollectingSink()
+    {
+        detach();
+    }
+
+    QList<QtMsgType> types;
+    QStringList messages;
+
+protected:
+    void message(QtMsgType type, const QString &msg)
+    {
+        types.append(type);
+        messages.append(msg.trimmed());
+    }
+};
+
+namespace
+{
+
+QStringList callbackMessages;
+
+void collectingCallback(const QString &libraryName, const QString &libraryVersion,
+        QtMsgType type, const QString &msg)
+{
+    Q_UNUSED(libraryName);
+    Q_UNUSED(libraryVersion);
+    Q_UNUSED(type);
+    callbackMessages.append(msg.trimmed());
+}
+
+// Silences the default output for the tests which only care about the sinks
+void nullCallback(const QString &, const QString &, QtMsgType, const QString &)
+{
+}
+
+QString nestedMessage(int depth)
+{
+    if (depth > 0) {
+        Tp::debug() << "nested" << depth << nestedMessage(depth - 1);
+    }
+    return QString::number(depth);
+}
+
+class LoggingThread : public QThread
+{
+public:
+    LoggingThread(int id, int count) : mId(id), mCount(count) { }
+
+protected:
+    void run()
+    {
+        for (int i = 0; i < mCount; ++i) {
+            Tp::debug() << "thread" << mId << "message" << i;
+        }
+    }
+
+private:
+    int mId;
+    int mCount;
+};
+
+}
+
+void TestDebug::init()
+{
+    Tp::enableDebug(false);
+    Tp::enableWarnings(false);
+    Tp::setDebugCallback(nullCallback);
+    callbackMessages.clear();
+}
+
+void TestDebug::testSink()
+{
+    CollectingSink sink;
+    QVERIFY(!sink.isAttached());
+
+    Tp::debug() << "not attached";
+    QVERIFY(sink.messages.isEmpty());
+
+    sink.attach();
+    QVERIFY(sink.isAttached());
+
+    // Sinks get messages even with the debug output to the callback disabled
+    Tp::debug() << "hello" << 42;
+    QCOMPARE(sink.messages, QStringList() << QLatin1String("hello 42"));
+    QCOMPARE(sink.types.last(), QtDebugMsg);
+
+    Tp::warning().nospace() << "a" << "b";
+    QCOMPARE(sink.messages.last(), QLatin1String("ab"));
+    QCOMPARE(sink.types.last(), QtWarningMsg);
+
+    sink.detach();
+    QVERIFY(!sink.isAttached());
+
+    Tp::debug() << "detached";
+    QCOMPARE(sink.messages.size(), 2);
+}
+
+void TestDebug::testSinkTypes()
+{
+    CollectingSink warningSink(QtWarningMsg);
+    CollectingSink debugSink;
+    QCOMPARE(warningSink.minimumType(), QtWarningMsg);
+    QCOMPARE(debugSink.minimumType(), QtDebugMsg);
+
+    warningSink.attach();
+
+    Tp::debug() << "debug";
+    Tp::warning() << "warning";
+
+    QCOMPARE(warningSink.messages, QStringList() << QLatin1String("warning"));
+
+    debugSink.attach();
+
+    Tp::debug() << "debug";
+    Tp::warning() << "warning";
+
+    QCOMPARE(warningSink.messages, QStringList() << QLatin1String("warning") <<
+            QLatin1String("warning"));
+    QCOMPARE(debugSink.messages, QStringList() << QLatin1String("debug") <<
+            QLatin1String("warning"));
+}
+
+void TestDebug::testCallback()
+{
+    Tp::setDebugCallback(collectingCallback);
+
+    Tp::debug() << "disabled";
+    QVERIFY(callbackMessages.isEmpty());
+
+    Tp::enableDebug(true);
+    Tp::debug() << "enabled";
+    QCOMPARE(callbackMessages, QStringList() << QLatin1String("enabled"));
+
+    // The callback and the sinks both get the message
+    CollectingSink sink;
+    sink.attach();
+    Tp::debug() << "both";
+    QCOMPARE(callbackMessages.last(), QLatin1String("both"));
+    QCOMPARE(sink.messages, QStringList() << QLatin1String("both"));
+
+    // Disabling the debug output only affects the callback
+    Tp::enableDebug(false);
+    Tp::debug() << "sink only";
+    QCOMPARE(callbackMessages.size(), 2);
+    QCOMPARE(sink.messages.last(), QLatin1String("sink only"));
+}
+
+void TestDebug::testCopies()
+{
+    CollectingSink sink;
+    sink.attach();
+
+    {
+        DebugStream first = Tp::debug();
+        first << "one";
+
+        DebugStream second = first;
+        second << "two";
+
+        DebugStream third;
+        third = second;
+        third << "three";
+        first << "four";
+
+        QVERIFY(sink.messages.isEmpty());
+    }
+
+    // Copies share the message, which is output once the last of them is gone
+    QCOMPARE(sink.messages, QStringList() << QLatin1String("one two three four"));
+}
+
+void TestDebug::testCompatibility()
+{
+    CollectingSink sink;
+    sink.attach();
+
+    // What binaries built against the old header get, which they format with its inline members
+    {
+        Debug debug = Tp::enabledDebug();
+        debug << "old" << 1;
+
+        Debug copy = debug;
+        copy << "copy";
+    }
+
+    QCOMPARE(sink.messages, QStringList() << QLatin1String("old 1 copy") <<
+            QLatin1String("old 1"));
+    QCOMPARE(sink.types, QList<QtMsgType>() << QtDebugMsg << QtDebugMsg);
+
+    sink.detach();
+    {
+        Debug warning = Tp::enabledWarning();
+        warning << "nobody listens";
+    }
+    QCOMPARE(sink.messages.size(), 2);
+}
+
+void TestDebug::testNested()
+{
+    CollectingSink sink;
+    sink.attach();
+
+    // Go deeper than the records each thread keeps around
+    nestedMessage(8);
+
+    QCOMPARE(sink.messages.size(), 8);
+    for (int i = 0; i < 8; ++i) {
+        QCOMPARE(sink.messages[i], QString(QLatin1String("nested %1 \"%2\""))
+                .arg(i + 1).arg(i));
+    }
+}
+
+void TestDebug::testFormatReset()
+{
+    CollectingSink sink;
+    sink.attach();
+
+    Tp::debug().nospace() << hex << 255 << "x";
+    Tp::debug() << 255 << "x";
+
+    QCOMPARE(sink.messages, QStringList() << QLatin1String("ffx") << QLatin1String("255 x"));
+}
+
+void TestDebug::testThreads()
+{
+    CollectingSink sink;
+    sink.attach();
+
+    QList<LoggingThread *> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.append(new LoggingThread(i, 250));
+    }
+    foreach (LoggingThread *thread, threads) {
+        thread->start();
+    }
+    foreach (LoggingThread *thread, threads) {
+        QVERIFY(thread->wait(30000));
+    }
+    qDeleteAll(threads);
+
+    QCOMPARE(sink.messages.size(), 1000);
+
+    // Messages from different threads don't get mixed up
+    QSet<QString> unique = sink.messages.toSet();
+    QCOMPARE(unique.size(), 1000);
+    for (int i = 0; i < 4; ++i) {
+        QVERIFY(unique.contains(QString(QLatin1String("thread %1 message 249")).arg(i)));
+    }
+}
+
+void TestDebug::testMessageFlood_data()
+{
+    QTest::addColumn<bool>("enabled");
+
+    QTest::newRow("debug off") << false;
+    QTest::newRow("debug on") << true;
+}
+
+void TestDebug::testMessageFlood()
+{
+    QFETCH(bool, enabled);
+
+    // The overhead of debugging is the difference between the two rows. Messages go to the null
+    // callback, so this measures formatting and delivery rather than the cost of printing them.
+    Tp::enableDebug(enabled);
+
+    // Roughly what handling a received text message takes, logged the way the message queue
+    // processing logs each message
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i) {
+            QVariantMap header;
+            header.insert(QLatin1String("message-token"), QString::number(i));
+            header.insert(QLatin1String("message-sender"), uint(i % 50));
+            header.insert(QLatin1String("message-received"), qint64(1000000 + i));
+            QVariantMap body;
+            body.insert(QLatin1String("content-type"), QLatin1String("text/plain"));
+            body.insert(QLatin1String("content"), QString(QLatin1String("message %1")).arg(i));
+            QList<QVariantMap> parts;
+            parts << header << body;
+
+            Tp::debug() << "Received message" << header.value(QLatin1String("message-token"))
+                .toString() << "from" << header.value(QLatin1String("message-sender")).toUInt() <<
+                "with" << parts.size() << "parts";
+
+            QCOMPARE(parts.last().value(QLatin1String("content")).toString(),
+                    QString(QLatin1String("message %1")).arg(i));
+        }
+    }
+}
+
+void TestDebug::cleanup()
+{
+    Tp::setDebugCallback(0);
+    Tp::enableDebug(true);
+    Tp::enableWarnings(true);
+}
+
+QTEST_MAIN(TestDebug)
+
+#include "_gen/debug.cpp.moc.hpp"
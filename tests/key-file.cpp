@@ -10,6 +10,7 @@ class TestKeyFile : public QObject
 
 private Q_SLOTS:
     void testKeyFile();
+    void testParseBenchmark();
 };
 
 void TestKeyFile::testKeyFile()
@@ -106,6 +107,45 @@ void TestKeyFile::testKeyFile()
 
     QCOMPARE(keyFile.value(QLatin1String("param-escaped-semicolon")), QString(QLatin1String("s")));
     QCOMPARE(keyFile.value(QLatin1String("default-escaped-semicolon")), QString(QLatin1String("foo;bar")));
+
+    // values are unescaped once and then cached, copies see the same values
+    KeyFile copy(keyFile);
+    QCOMPARE(copy.value(QLatin1String("default-escaped-semicolon")), QString(QLatin1String("foo;bar")));
+    QCOMPARE(copy.valueAsStringList(QLatin1String("default-list")),
+             QStringList() << QLatin1String("list") << QLatin1String("of") << QLatin1String("misc"));
+    QCOMPARE(copy.rawValue(QLatin1String("default-escaped-semicolon")), QString(QLatin1String("foo\\;bar")));
+}
+
+void TestKeyFile::testParseBenchmark()
+{
+    QString top_srcdir = QString::fromLocal8Bit(::getenv("abs_top_srcdir"));
+    if (!top_srcdir.isEmpty()) {
+        QDir::setCurrent(top_srcdir + QLatin1String("/tests"));
+    }
+
+    QDir managersDir(QLatin1String("telepathy/managers"));
+    QStringList fileNames;
+    foreach (const QString &entry, managersDir.entryList(QStringList() << QLatin1String("*.manager"))) {
+        QString fileName = managersDir.filePath(entry);
+        // the malformed files would only benchmark the warning output
+        if (KeyFile(fileName).status() == KeyFile::NoError) {
+            fileNames << fileName;
+        }
+    }
+    QVERIFY(!fileNames.isEmpty());
+
+    // parse every file and read every value once, as ManagerFile does
+    QBENCHMARK {
+        foreach (const QString &fileName, fileNames) {
+            KeyFile keyFile(fileName);
+            foreach (const QString &group, keyFile.allGroups()) {
+                keyFile.setGroup(group);
+                foreach (const QString &key, keyFile.keys()) {
+                    keyFile.value(key);
+                }
+            }
+        }
+    }
 }
 
 QTEST_MAIN(TestKeyFile)
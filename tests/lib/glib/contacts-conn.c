@@ -98,6 +98,8 @@ struct _TpTestsContactsConnectionPrivate
   GPtrArray *default_contact_info;
   /* TpHandle => gchar ** */
   GHashTable *client_types;
+  /* number of RequestAvatars calls handled */
+  guint n_avatar_requests;
 
   TestContactListManager *list_manager;
 };
@@ -783,6 +785,13 @@ tp_tests_contacts_connection_change_client_types(
         handle, (const gchar **) client_types);
 }
 
+guint
+tp_tests_contacts_connection_get_n_avatar_requests (
+    TpTestsContactsConnection *self)
+{
+  return self->priv->n_avatar_requests;
+}
+
 static void
 my_get_alias_flags (TpSvcConnectionInterfaceAliasing *aliasing,
                     DBusGMethodInvocation *context)
@@ -1009,6 +1018,8 @@ my_request_avatars (TpSvcConnectionInterfaceAvatars *avatars,
       return;
     }
 
+  self->priv->n_avatar_requests++;
+
   for (i = 0; i < contacts->len; i++)
     {
       TpHandle handle = g_array_index (contacts, TpHandle, i);
@@ -117,6 +117,9 @@ void tp_tests_contacts_connection_set_default_contact_info (
 void tp_tests_contacts_connection_change_client_types (
     TpTestsContactsConnection *self, TpHandle handle, gchar **client_types);
 
+guint tp_tests_contacts_connection_get_n_avatar_requests (
+    TpTestsContactsConnection *self);
+
 /* Legacy version (no Contacts interface, and no immortal handles) */
 
 typedef struct _TpTestsLegacyContactsConnection TpTestsLegacyContactsConnection;
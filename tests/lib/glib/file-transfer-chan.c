@@ -0,0 +1,572 @@
+/*
+ * file-transfer-chan.c - Simple file transfer channel
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "file-transfer-chan.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/channel-iface.h>
+#include <telepathy-glib/svc-channel.h>
+
+#include <gio/gio.h>
+
+#define READ_BUFFER_SIZE 4096
+
+enum
+{
+  PROP_STATE = 1,
+  PROP_CONTENT_TYPE,
+  PROP_FILENAME,
+  PROP_SIZE,
+  PROP_CONTENT_HASH_TYPE,
+  PROP_CONTENT_HASH,
+  PROP_DESCRIPTION,
+  PROP_DATE,
+  PROP_AVAILABLE_SOCKET_TYPES,
+  PROP_TRANSFERRED_BYTES,
+  PROP_INITIAL_OFFSET,
+};
+
+struct _TpTestsFileTransferChannelPrivate {
+    TpFileTransferState state;
+    gchar *filename;
+    guint64 size;
+    guint64 transferred_bytes;
+    guint64 initial_offset;
+    GHashTable *available_socket_types;
+
+    GSocketService *service;
+    GSocketConnection *connection;
+    guchar buffer[READ_BUFFER_SIZE];
+    GByteArray *received_data;
+};
+
+static void
+destroy_socket_control_list (gpointer data)
+{
+  GArray *tab = data;
+  g_array_free (tab, TRUE);
+}
+
+static void
+create_available_socket_types (TpTestsFileTransferChannel *self)
+{
+  TpSocketAccessControl access_control;
+  GArray *ipv4_tab;
+
+  g_assert (self->priv->available_socket_types == NULL);
+  self->priv->available_socket_types = g_hash_table_new_full (NULL, NULL,
+      NULL, destroy_socket_control_list);
+
+  /* Socket_Address_Type_IPv4, the only one the Qt client uses */
+  ipv4_tab = g_array_sized_new (FALSE, FALSE, sizeof (TpSocketAccessControl),
+      1);
+  access_control = TP_SOCKET_ACCESS_CONTROL_LOCALHOST;
+  g_array_append_val (ipv4_tab, access_control);
+
+  g_hash_table_insert (self->priv->available_socket_types,
+      GUINT_TO_POINTER (TP_SOCKET_ADDRESS_TYPE_IPV4), ipv4_tab);
+}
+
+static void
+tp_tests_file_transfer_channel_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  switch (property_id)
+    {
+      case PROP_STATE:
+        g_value_set_uint (value, self->priv->state);
+        break;
+
+      case PROP_CONTENT_TYPE:
+        g_value_set_string (value, "application/octet-stream");
+        break;
+
+      case PROP_FILENAME:
+        g_value_set_string (value, self->priv->filename);
+        break;
+
+      case PROP_SIZE:
+        g_value_set_uint64 (value, self->priv->size);
+        break;
+
+      case PROP_CONTENT_HASH_TYPE:
+        g_value_set_uint (value, TP_FILE_HASH_TYPE_NONE);
+        break;
+
+      case PROP_CONTENT_HASH:
+        g_value_set_string (value, "");
+        break;
+
+      case PROP_DESCRIPTION:
+        g_value_set_string (value, "test file");
+        break;
+
+      case PROP_DATE:
+        g_value_set_uint64 (value, 0);
+        break;
+
+      case PROP_AVAILABLE_SOCKET_TYPES:
+        g_value_set_boxed (value, self->priv->available_socket_types);
+        break;
+
+      case PROP_TRANSFERRED_BYTES:
+        g_value_set_uint64 (value, self->priv->transferred_bytes);
+        break;
+
+      case PROP_INITIAL_OFFSET:
+        g_value_set_uint64 (value, self->priv->initial_offset);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_tests_file_transfer_channel_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        g_free (self->priv->filename);
+        self->priv->filename = g_value_dup_string (value);
+        break;
+
+      case PROP_SIZE:
+        self->priv->size = g_value_get_uint64 (value);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void file_transfer_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (TpTestsFileTransferChannel,
+    tp_tests_file_transfer_channel,
+    TP_TYPE_BASE_CHANNEL,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_FILE_TRANSFER,
+      file_transfer_iface_init);
+    )
+
+/* type definition stuff */
+
+static const char * tp_tests_file_transfer_channel_interfaces[] = {
+    NULL
+};
+
+static void
+tp_tests_file_transfer_channel_init (TpTestsFileTransferChannel *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE ((self),
+      TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL, TpTestsFileTransferChannelPrivate);
+}
+
+static GObject *
+constructor (GType type,
+             guint n_props,
+             GObjectConstructParam *props)
+{
+  GObject *object =
+      G_OBJECT_CLASS (tp_tests_file_transfer_channel_parent_class)->constructor (
+          type, n_props, props);
+  TpTestsFileTransferChannel *self = TP_TESTS_FILE_TRANSFER_CHANNEL (object);
+
+  self->priv->state = TP_FILE_TRANSFER_STATE_PENDING;
+  self->priv->received_data = g_byte_array_new ();
+
+  create_available_socket_types (self);
+
+  tp_base_channel_register (TP_BASE_CHANNEL (self));
+
+  return object;
+}
+
+static void
+dispose (GObject *object)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  if (self->priv->service != NULL)
+    {
+      g_socket_service_stop (self->priv->service);
+      tp_clear_object (&self->priv->service);
+    }
+
+  tp_clear_object (&self->priv->connection);
+  tp_clear_pointer (&self->priv->available_socket_types, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->received_data, g_byte_array_unref);
+  tp_clear_pointer (&self->priv->filename, g_free);
+
+  ((GObjectClass *) tp_tests_file_transfer_channel_parent_class)->dispose (
+    object);
+}
+
+static void
+channel_close (TpBaseChannel *channel)
+{
+  tp_base_channel_destroyed (channel);
+}
+
+static void
+fill_immutable_properties (TpBaseChannel *chan,
+    GHashTable *properties)
+{
+  TpBaseChannelClass *klass = TP_BASE_CHANNEL_CLASS (
+      tp_tests_file_transfer_channel_parent_class);
+
+  klass->fill_immutable_properties (chan, properties);
+
+  tp_dbus_properties_mixin_fill_properties_hash (
+      G_OBJECT (chan), properties,
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Filename",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Size",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHashType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHash",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Description",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Date",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "AvailableSocketTypes",
+      NULL);
+}
+
+static void
+tp_tests_file_transfer_channel_class_init (
+    TpTestsFileTransferChannelClass *klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  TpBaseChannelClass *base_class = TP_BASE_CHANNEL_CLASS (klass);
+  GParamSpec *param_spec;
+  static TpDBusPropertiesMixinPropImpl file_transfer_props[] = {
+      { "State", "state", NULL },
+      { "ContentType", "content-type", NULL },
+      { "Filename", "filename", NULL },
+      { "Size", "size", NULL },
+      { "ContentHashType", "content-hash-type", NULL },
+      { "ContentHash", "content-hash", NULL },
+      { "Description", "description", NULL },
+      { "Date", "date", NULL },
+      { "AvailableSocketTypes", "available-socket-types", NULL },
+      { "TransferredBytes", "transferred-bytes", NULL },
+      { "InitialOffset", "initial-offset", NULL },
+      { NULL }
+  };
+
+  object_class->constructor = constructor;
+  object_class->get_property = tp_tests_file_transfer_channel_get_property;
+  object_class->set_property = tp_tests_file_transfer_channel_set_property;
+  object_class->dispose = dispose;
+
+  base_class->channel_type = TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER;
+  base_class->target_handle_type = TP_HANDLE_TYPE_CONTACT;
+  base_class->interfaces = tp_tests_file_transfer_channel_interfaces;
+  base_class->close = channel_close;
+  base_class->fill_immutable_properties = fill_immutable_properties;
+
+  param_spec = g_param_spec_uint ("state", "TpFileTransferState",
+      "state of the transfer",
+      0, NUM_TP_FILE_TRANSFER_STATES - 1, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_STATE, param_spec);
+
+  param_spec = g_param_spec_string ("content-type", "Content type",
+      "the content type of the file",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("filename", "Filename",
+      "the name of the file",
+      "",
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_FILENAME, param_spec);
+
+  param_spec = g_param_spec_uint64 ("size", "Size",
+      "the size of the file in bytes",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SIZE, param_spec);
+
+  param_spec = g_param_spec_uint ("content-hash-type", "Content hash type",
+      "the type of the content hash",
+      0, NUM_TP_FILE_HASH_TYPES - 1, TP_FILE_HASH_TYPE_NONE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("content-hash", "Content hash",
+      "the hash of the file contents",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH,
+      param_spec);
+
+  param_spec = g_param_spec_string ("description", "Description",
+      "the description of the file",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DESCRIPTION,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("date", "Date",
+      "the last modification time of the file",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DATE, param_spec);
+
+  param_spec = g_param_spec_boxed (
+      "available-socket-types", "Available socket types",
+      "GHashTable containing available socket types.",
+      TP_HASH_TYPE_SUPPORTED_SOCKET_MAP,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_AVAILABLE_SOCKET_TYPES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("transferred-bytes", "Transferred bytes",
+      "the number of bytes transferred so far",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TRANSFERRED_BYTES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("initial-offset", "Initial offset",
+      "the offset the transfer starts at",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIAL_OFFSET,
+      param_spec);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      TP_IFACE_QUARK_CHANNEL_TYPE_FILE_TRANSFER,
+      tp_dbus_properties_mixin_getter_gobject_properties, NULL,
+      file_transfer_props);
+
+  g_type_class_add_private (object_class,
+      sizeof (TpTestsFileTransferChannelPrivate));
+}
+
+static void
+change_state (TpTestsFileTransferChannel *self,
+  TpFileTransferState state,
+  TpFileTransferStateChangeReason reason)
+{
+  self->priv->state = state;
+
+  tp_svc_channel_type_file_transfer_emit_file_transfer_state_changed (self,
+      state, reason);
+}
+
+static void read_cb (GObject *source, GAsyncResult *result,
+    gpointer user_data);
+
+static void
+read_next (TpTestsFileTransferChannel *self)
+{
+  g_input_stream_read_async (
+      g_io_stream_get_input_stream (G_IO_STREAM (self->priv->connection)),
+      self->priv->buffer, READ_BUFFER_SIZE, G_PRIORITY_DEFAULT, NULL,
+      read_cb, g_object_ref (self));
+}
+
+static void
+read_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+  GError *error = NULL;
+  gssize len;
+
+  len = g_input_stream_read_finish (G_INPUT_STREAM (source), result, &error);
+  g_assert_no_error (error);
+
+  if (len == 0)
+    {
+      /* EOF, the client closes the socket once it has sent everything */
+      g_io_stream_close (G_IO_STREAM (self->priv->connection), NULL, NULL);
+      change_state (self, TP_FILE_TRANSFER_STATE_COMPLETED,
+          TP_FILE_TRANSFER_STATE_CHANGE_REASON_NONE);
+      g_object_unref (self);
+      return;
+    }
+
+  g_byte_array_append (self->priv->received_data, self->priv->buffer, len);
+  self->priv->transferred_bytes += len;
+  tp_svc_channel_type_file_transfer_emit_transferred_bytes_changed (self,
+      self->priv->transferred_bytes);
+
+  read_next (self);
+  g_object_unref (self);
+}
+
+static void
+service_incoming_cb (GSocketService *service,
+    GSocketConnection *connection,
+    GObject *source_object,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+
+  /* only one connection is expected per transfer */
+  g_assert (self->priv->connection == NULL);
+  self->priv->connection = g_object_ref (connection);
+
+  read_next (self);
+}
+
+static GValue *
+create_local_socket (TpTestsFileTransferChannel *self)
+{
+  gboolean success;
+  GInetAddress *localhost;
+  GSocketAddress *address, *effective_address;
+  GValue *address_gvalue;
+
+  localhost = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  address = g_inet_socket_address_new (localhost, 0);
+  g_object_unref (localhost);
+
+  self->priv->service = g_socket_service_new ();
+
+  success = g_socket_listener_add_address (
+      G_SOCKET_LISTENER (self->priv->service),
+      address, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_DEFAULT,
+      NULL, &effective_address, NULL);
+  g_assert (success);
+
+  tp_g_signal_connect_object (self->priv->service, "incoming",
+      G_CALLBACK (service_incoming_cb), self, 0);
+
+  address_gvalue = tp_g_value_slice_new_take_boxed (
+      TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4,
+      dbus_g_type_specialized_construct (
+        TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4));
+
+  dbus_g_type_struct_set (address_gvalue,
+      0, "127.0.0.1",
+      1, g_inet_socket_address_get_port (
+        G_INET_SOCKET_ADDRESS (effective_address)),
+      G_MAXUINT);
+
+  g_object_unref (address);
+  g_object_unref (effective_address);
+  return address_gvalue;
+}
+
+static void
+file_transfer_provide_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    DBusGMethodInvocation *context)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) iface;
+  GError *error = NULL;
+  GValue *address;
+
+  if (!tp_base_channel_is_requested (TP_BASE_CHANNEL (self)))
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_PERMISSION_DENIED,
+          "Can't provide a file on an incoming transfer");
+      goto fail;
+    }
+
+  if (self->priv->service != NULL)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "ProvideFile has already been called");
+      goto fail;
+    }
+
+  if (address_type != TP_SOCKET_ADDRESS_TYPE_IPV4 ||
+      access_control != TP_SOCKET_ACCESS_CONTROL_LOCALHOST)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+          "Address type not supported with this access control");
+      goto fail;
+    }
+
+  address = create_local_socket (self);
+
+  tp_svc_channel_type_file_transfer_return_from_provide_file (context,
+      address);
+
+  tp_g_value_slice_free (address);
+  return;
+
+fail:
+  dbus_g_method_return_error (context, error);
+  g_error_free (error);
+}
+
+static void
+file_transfer_accept_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    guint64 offset,
+    DBusGMethodInvocation *context)
+{
+  GError error = { TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+      "Only outgoing transfers are implemented" };
+
+  dbus_g_method_return_error (context, &error);
+}
+
+static void
+file_transfer_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelTypeFileTransferClass *klass = iface;
+
+#define IMPLEMENT(x) tp_svc_channel_type_file_transfer_implement_##x (klass, file_transfer_##x)
+  IMPLEMENT(provide_file);
+  IMPLEMENT(accept_file);
+#undef IMPLEMENT
+}
+
+/* Called to emulate the remote contact accepting an outgoing transfer */
+void
+tp_tests_file_transfer_channel_remote_accept (
+    TpTestsFileTransferChannel *self,
+    guint64 initial_offset)
+{
+  g_assert (self->priv->state == TP_FILE_TRANSFER_STATE_PENDING);
+
+  self->priv->initial_offset = initial_offset;
+  tp_svc_channel_type_file_transfer_emit_initial_offset_defined (self,
+      initial_offset);
+
+  change_state (self, TP_FILE_TRANSFER_STATE_ACCEPTED,
+      TP_FILE_TRANSFER_STATE_CHANGE_REASON_REQUESTED);
+  change_state (self, TP_FILE_TRANSFER_STATE_OPEN,
+      TP_FILE_TRANSFER_STATE_CHANGE_REASON_NONE);
+}
+
+GByteArray *
+tp_tests_file_transfer_channel_get_received_data (
+    TpTestsFileTransferChannel *self)
+{
+  return self->priv->received_data;
+}
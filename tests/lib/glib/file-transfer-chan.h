@@ -0,0 +1,65 @@
+/*
+ * file-transfer-chan.h - Simple file transfer channel
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __TP_TESTS_FILE_TRANSFER_CHAN_H__
+#define __TP_TESTS_FILE_TRANSFER_CHAN_H__
+
+#include <glib-object.h>
+#include <telepathy-glib/base-channel.h>
+#include <telepathy-glib/base-connection.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpTestsFileTransferChannel TpTestsFileTransferChannel;
+typedef struct _TpTestsFileTransferChannelClass TpTestsFileTransferChannelClass;
+typedef struct _TpTestsFileTransferChannelPrivate TpTestsFileTransferChannelPrivate;
+
+GType tp_tests_file_transfer_channel_get_type (void);
+
+#define TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL \
+  (tp_tests_file_transfer_channel_get_type ())
+#define TP_TESTS_FILE_TRANSFER_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL, \
+                               TpTestsFileTransferChannel))
+#define TP_TESTS_FILE_TRANSFER_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL, \
+                            TpTestsFileTransferChannelClass))
+#define TP_TESTS_IS_FILE_TRANSFER_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL))
+#define TP_TESTS_IS_FILE_TRANSFER_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL))
+#define TP_TESTS_FILE_TRANSFER_CHANNEL_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL, \
+                              TpTestsFileTransferChannelClass))
+
+struct _TpTestsFileTransferChannelClass {
+    TpBaseChannelClass parent_class;
+    TpDBusPropertiesMixinClass dbus_properties_class;
+};
+
+struct _TpTestsFileTransferChannel {
+    TpBaseChannel parent;
+
+    TpTestsFileTransferChannelPrivate *priv;
+};
+
+/* Emulates the remote contact accepting an outgoing transfer, asking for the
+ * data from initial_offset on */
+void tp_tests_file_transfer_channel_remote_accept (
+    TpTestsFileTransferChannel *self,
+    guint64 initial_offset);
+
+/* The data received from the client, once the state is Completed */
+GByteArray *tp_tests_file_transfer_channel_get_received_data (
+    TpTestsFileTransferChannel *self);
+
+G_END_DECLS
+
+#endif /* #ifndef __TP_TESTS_FILE_TRANSFER_CHAN_H__ */
@@ -0,0 +1,181 @@
+#include <QtTest/QtTest>
+
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/Feature>
+#include <TelepathyQt/PendingReady>
+#include <TelepathyQt/ReadinessHelper>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/SharedPtr>
+
+using namespace Tp;
+
+namespace {
+
+class Object : public RefCounted
+{
+};
+
+struct Introspection
+{
+    Feature feature;
+    QList<Feature> *started;
+};
+
+void introspect(void *data)
+{
+    Introspection *introspection = static_cast<Introspection *>(data);
+    introspection->started->append(introspection->feature);
+}
+
+}
+
+class TestReadinessHelper : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestReadinessHelper(QObject *parent = 0);
+
+protected Q_SLOTS:
+    void onFinished(Tp::PendingOperation *op);
+
+private Q_SLOTS:
+    void init();
+
+    void testParallel();
+    void testMaxInFlight();
+
+    void cleanup();
+
+private:
+    void processEvents();
+
+    SharedPtr<Object> mObject;
+    ReadinessHelper *mHelper;
+    Feature mFeatureA, mFeatureB, mFeatureC;
+    Introspection mIntrospectionA, mIntrospectionB, mIntrospectionC;
+    QList<Feature> mStarted;
+    int mNumFinished;
+    bool mFinishedValid;
+};
+
+TestReadinessHelper::TestReadinessHelper(QObject *parent)
+    : QObject(parent),
+      mHelper(0),
+      mFeatureA(QLatin1String("TestReadinessHelper"), 0),
+      mFeatureB(QLatin1String("TestReadinessHelper"), 1),
+      mFeatureC(QLatin1String("TestReadinessHelper"), 2),
+      mNumFinished(0),
+      mFinishedValid(false)
+{
+    Tp::enableDebug(true);
+    Tp::enableWarnings(true);
+}
+
+void TestReadinessHelper::processEvents()
+{
+    for (int i = 0; i < 10; ++i) {
+        QCoreApplication::processEvents();
+    }
+}
+
+void TestReadinessHelper::onFinished(Tp::PendingOperation *op)
+{
+    ++mNumFinished;
+    mFinishedValid = op->isValid();
+}
+
+void TestReadinessHelper::init()
+{
+    mStarted.clear();
+    mNumFinished = 0;
+    mFinishedValid = false;
+
+    mIntrospectionA.feature = mFeatureA;
+    mIntrospectionA.started = &mStarted;
+    mIntrospectionB.feature = mFeatureB;
+    mIntrospectionB.started = &mStarted;
+    mIntrospectionC.feature = mFeatureC;
+    mIntrospectionC.started = &mStarted;
+
+    // A and B are independent, C depends on both
+    ReadinessHelper::Introspectables introspectables;
+    introspectables[mFeatureA] = ReadinessHelper::Introspectable(QSet<uint>() << 0,
+            Features(), QStringList(), &introspect, &mIntrospectionA);
+    introspectables[mFeatureB] = ReadinessHelper::Introspectable(QSet<uint>() << 0,
+            Features(), QStringList(), &introspect, &mIntrospectionB);
+    introspectables[mFeatureC] = ReadinessHelper::Introspectable(QSet<uint>() << 0,
+            Features() << mFeatureA << mFeatureB, QStringList(), &introspect, &mIntrospectionC);
+
+    mObject = SharedPtr<Object>(new Object);
+    mHelper = new ReadinessHelper(mObject.data(), 0, introspectables);
+}
+
+void TestReadinessHelper::testParallel()
+{
+    QVERIFY(connect(mHelper->becomeReady(Features() << mFeatureC),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onFinished(Tp::PendingOperation*))));
+    processEvents();
+
+    // Both dependencies of C are introspected at the same time
+    QCOMPARE(mStarted.size(), 2);
+    QVERIFY(mStarted.contains(mFeatureA));
+    QVERIFY(mStarted.contains(mFeatureB));
+    QCOMPARE(mHelper->introspectionTime(mFeatureA), -1);
+
+    mHelper->setIntrospectCompleted(mFeatureA, true);
+    processEvents();
+    QCOMPARE(mStarted.size(), 2);
+
+    mHelper->setIntrospectCompleted(mFeatureB, true);
+    processEvents();
+    QCOMPARE(mStarted.size(), 3);
+    QCOMPARE(mStarted.last(), mFeatureC);
+    QCOMPARE(mNumFinished, 0);
+
+    mHelper->setIntrospectCompleted(mFeatureC, true);
+    processEvents();
+    QCOMPARE(mNumFinished, 1);
+    QVERIFY(mFinishedValid);
+    QVERIFY(mHelper->isReady(Features() << mFeatureA << mFeatureB << mFeatureC));
+
+    QVERIFY(mHelper->introspectionTime(mFeatureA) >= 0);
+    QVERIFY(mHelper->introspectionTime(mFeatureB) >= 0);
+    QVERIFY(mHelper->introspectionTime(mFeatureC) >= 0);
+}
+
+void TestReadinessHelper::testMaxInFlight()
+{
+    mHelper->setMaxInFlightIntrospections(1);
+    QCOMPARE(mHelper->maxInFlightIntrospections(), 1);
+
+    QVERIFY(connect(mHelper->becomeReady(Features() << mFeatureA << mFeatureB),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onFinished(Tp::PendingOperation*))));
+    processEvents();
+    QCOMPARE(mStarted.size(), 1);
+
+    mHelper->setIntrospectCompleted(mStarted.first(), true);
+    processEvents();
+    QCOMPARE(mStarted.size(), 2);
+    QVERIFY(mStarted.first() != mStarted.last());
+
+    mHelper->setIntrospectCompleted(mStarted.last(), false,
+            QLatin1String("org.freedesktop.Telepathy.Error.NotAvailable"), QLatin1String("Test"));
+    processEvents();
+    QCOMPARE(mNumFinished, 1);
+    QVERIFY(mHelper->isReady(mStarted.first()));
+    QCOMPARE(mHelper->missingFeatures(), Features() << mStarted.last());
+}
+
+void TestReadinessHelper::cleanup()
+{
+    delete mHelper;
+    mHelper = 0;
+    mObject.reset();
+}
+
+QTEST_MAIN(TestReadinessHelper)
+
+#include "_gen/readiness-helper.cpp.moc.hpp"